@@ -0,0 +1,84 @@
+/*
+ *  Copyright (c) 2005, Daniel C. Newman <dan.newman@mtbaldy.us>
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  
+ *   + Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  
+ *   + Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *  
+ *   + Neither the name of mtbaldy.us nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ *  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ *  OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+#if !defined(__AC_H__)
+
+#define __AC_H__
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ *  Maximum number of states in an automaton.  The state numbers are
+ *  stored in unsigned chars.
+ */
+#define AC_MAX_STATES 256
+
+/*
+ *  ac_t
+ *
+ *    An Aho-Corasick automaton for simultaneously searching text for
+ *    any of a fixed set of strings.  The automaton is built ahead of
+ *    time by make_includes.c from the strings listed in the
+ *    [boyer-moore] section of make_includes.conf and written to
+ *    bm_const.h as ac_info.
+ *
+ *    The failure links have been folded into the transition table:
+ *    starting from state 0, every byte of the text moves the automaton
+ *    to exactly one next state,
+ *
+ *        state = info->next[state][c];
+ *
+ *    and there is never any backtracking.  When info->match[state] is
+ *    non-zero, then the bytes just consumed end an occurrence of the
+ *    string whose AC_MATCH_x value is info->match[state].  Should two
+ *    strings end at the same byte, then the longer of the two is the
+ *    one reported.
+ */
+typedef struct {
+     int                   nstates;     /* Number of states                */
+     const unsigned char (*next)[256];  /* State transition table          */
+     const unsigned char  *match;       /* AC_MATCH_x ending at each state */
+} ac_t;
+
+/*
+ *  Advance the automaton info from state by the byte c
+ */
+#define AC_NEXT(info, state, c) ((info)->next[(state)][(unsigned char)(c)])
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
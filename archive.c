@@ -0,0 +1,1318 @@
+/*
+ *  Copyright (c) 2005, Daniel C. Newman <dan.newman@mtbaldy.us>
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  
+ *   + Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  
+ *   + Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *  
+ *   + Neither the name of mtbaldy.us nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ *  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ *  OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "err.h"
+#include "debug.h"
+#include "os.h"
+#include "bdat.h"
+#include "archive.h"
+
+static debug_proc_t  our_debug_ap;
+static debug_proc_t *debug_proc = our_debug_ap;
+static void         *debug_ctx  = NULL;
+static int do_debug = 0;
+
+static void debug(const char *fmt, ...);
+static void info(const char *fmt, ...);
+
+static void
+our_debug_ap(void *ctx, int reason, const char *fmt, va_list ap)
+{
+     (void)ctx;
+     (void)reason;
+
+     vfprintf(stderr, fmt, ap);
+     fputc('\n', stderr);
+     fflush(stderr);
+}
+
+
+void
+arch_debug_set(debug_proc_t *proc, void *ctx, int flags)
+{
+     debug_proc = proc ? proc : our_debug_ap;
+     debug_ctx  = proc ? ctx : NULL;
+     do_debug   = ((flags & DEBUG_ERRS) && debug_proc) ? 1 : 0;
+}
+
+
+/*
+ *  Log an error to the event log when the debug bits indicate DEBUG_ERRS
+ */
+
+static void
+debug(const char *fmt, ...)
+{
+     if (do_debug && debug_proc)
+     {
+	  va_list ap;
+
+	  va_start(ap, fmt);
+	  (*debug_proc)(debug_ctx, ERR_LOG_ERR, fmt, ap);
+	  va_end(ap);
+     }
+}
+
+
+/*
+ *  Record non-error/non-warning events
+ */
+
+static void
+info(const char *fmt, ...)
+{
+     if (do_debug && debug_proc)
+     {
+	  va_list ap;
+
+	  va_start(ap, fmt);
+	  (*debug_proc)(debug_ctx, ERR_LOG_DEBUG, fmt, ap);
+	  va_end(ap);
+     }
+}
+
+#if defined(DEBUG_CHECK)
+#define info   printf
+#define debug  printf
+#endif
+
+
+#define ARCH_MASK(n)  (((n) < 32) ? ((1U << (n)) - 1) : 0xffffffffU)
+
+/*
+ *  Bit stream writer.  Bits are written most significant first into a
+ *  buffer which grows as needed; err is set should it fail to grow.
+ */
+typedef struct {
+     unsigned char      *buf;   /* Buffer                                */
+     size_t              len;   /* Bytes used                            */
+     size_t              max;   /* Bytes allocated                       */
+     unsigned long long  acc;   /* Bits not yet moved to buf             */
+     unsigned int        nacc;  /* Number of bits in acc                 */
+     int                 err;   /* Unable to grow buf                    */
+} arch_wbits_t;
+
+/*
+ *  Bit stream reader; reading past the end of the stream sets err
+ */
+typedef struct {
+     const unsigned char *ptr;  /* Next byte                             */
+     const unsigned char *end;  /* End of the stream                     */
+     unsigned long long   acc;  /* Bits read from the stream             */
+     unsigned int         nacc; /* Number of unconsumed bits in acc      */
+     int                  err;  /* Read past the end of the stream       */
+} arch_rbits_t;
+
+
+static int
+arch_grow(arch_wbits_t *w, size_t need)
+{
+     size_t max;
+     unsigned char *tmp;
+
+     if (w->len + need <= w->max)
+	  return(0);
+     max = w->max ? w->max : 8192;
+     while (max < w->len + need)
+	  max *= 2;
+     tmp = (unsigned char *)realloc(w->buf, max);
+     if (!tmp)
+     {
+	  w->err = 1;
+	  return(-1);
+     }
+     w->buf = tmp;
+     w->max = max;
+
+     return(0);
+}
+
+
+/*
+ *  Write the low n bits of bits, 1 <= n <= 32
+ */
+static void
+arch_put(arch_wbits_t *w, unsigned int bits, unsigned int n)
+{
+     w->acc   = (w->acc << n) | (bits & ARCH_MASK(n));
+     w->nacc += n;
+     if (w->nacc < 8)
+	  return;
+     if (arch_grow(w, 5))
+     {
+	  w->nacc &= 7;
+	  return;
+     }
+     while (w->nacc >= 8)
+     {
+	  w->nacc -= 8;
+	  w->buf[w->len++] = (unsigned char)(w->acc >> w->nacc);
+     }
+}
+
+
+/*
+ *  Pad the stream with zero bits to a byte boundary
+ */
+static void
+arch_flush(arch_wbits_t *w)
+{
+     if (w->nacc)
+	  arch_put(w, 0, 8 - w->nacc);
+}
+
+
+/*
+ *  Append bytes to a stream which is at a byte boundary
+ */
+static void
+arch_put_bytes(arch_wbits_t *w, const void *ptr, size_t len)
+{
+     if (arch_grow(w, len))
+	  return;
+     if (ptr)
+	  memcpy(w->buf + w->len, ptr, len);
+     else
+	  memset(w->buf + w->len, 0, len);
+     w->len += len;
+}
+
+
+/*
+ *  Read n bits, 1 <= n <= 32
+ */
+static unsigned int
+arch_get(arch_rbits_t *r, unsigned int n)
+{
+     while (r->nacc < n)
+     {
+	  r->acc <<= 8;
+	  if (r->ptr < r->end)
+	       r->acc |= *r->ptr++;
+	  else
+	       r->err = 1;
+	  r->nacc += 8;
+     }
+     r->nacc -= n;
+
+     return((unsigned int)(r->acc >> r->nacc) & ARCH_MASK(n));
+}
+
+
+static unsigned int
+arch_clz(unsigned int x)
+{
+     unsigned int n;
+
+     for (n = 0; n < 32 && !(x & 0x80000000U); n++)
+	  x <<= 1;
+     return(n);
+}
+
+
+static unsigned int
+arch_ctz(unsigned int x)
+{
+     unsigned int n;
+
+     for (n = 0; n < 32 && !(x & 1); n++)
+	  x >>= 1;
+     return(n);
+}
+
+
+static unsigned int
+arch_fbits(float f)
+{
+     unsigned int u;
+
+     memcpy(&u, &f, 4);
+     return(u);
+}
+
+
+/*
+ *  Compress the segment's time stamps as deltas of deltas
+ */
+static void
+arch_put_times(arch_wbits_t *w, const bdat_seg_t *seg)
+{
+     long long delta, dod, pdelta, prev, t;
+     unsigned long long u;
+     size_t i;
+
+     prev   = 0;
+     pdelta = 0;
+     for (i = 0; i < seg->nrecs; i++)
+     {
+	  t = (long long)BDAT_REC_TIME(BDAT_REC(seg, i));
+	  if (i == 0)
+	  {
+	       u = (unsigned long long)t;
+	       arch_put(w, (unsigned int)(u >> 32), 32);
+	       arch_put(w, (unsigned int)u, 32);
+	  }
+	  else
+	  {
+	       delta = t - prev;
+	       dod   = delta - pdelta;
+	       if (dod == 0)
+		    arch_put(w, 0, 1);
+	       else if (-63 <= dod && dod <= 64)
+	       {
+		    arch_put(w, 0x2, 2);
+		    arch_put(w, (unsigned int)(dod + 63), 7);
+	       }
+	       else if (-255 <= dod && dod <= 256)
+	       {
+		    arch_put(w, 0x6, 3);
+		    arch_put(w, (unsigned int)(dod + 255), 9);
+	       }
+	       else if (-2047 <= dod && dod <= 2048)
+	       {
+		    arch_put(w, 0xe, 4);
+		    arch_put(w, (unsigned int)(dod + 2047), 12);
+	       }
+	       else
+	       {
+		    u = (unsigned long long)dod;
+		    arch_put(w, 0xf, 4);
+		    arch_put(w, (unsigned int)(u >> 32), 32);
+		    arch_put(w, (unsigned int)u, 32);
+	       }
+	       pdelta = delta;
+	  }
+	  prev = t;
+     }
+}
+
+
+/*
+ *  Compress a column's values as exclusive ORs of successive values
+ */
+static void
+arch_put_vals(arch_wbits_t *w, const bdat_seg_t *seg, size_t col)
+{
+     unsigned int lead, plead, prev, ptrail, sig, trail, v, x;
+     size_t i;
+
+     prev   = 0;
+     plead  = 32;
+     ptrail = 0;
+     for (i = 0; i < seg->nrecs; i++)
+     {
+	  v = arch_fbits(BDAT_REC_VAL(BDAT_REC(seg, i), col));
+	  if (i == 0)
+	       arch_put(w, v, 32);
+	  else if (!(x = v ^ prev))
+	       arch_put(w, 0, 1);
+	  else
+	  {
+	       lead  = arch_clz(x);
+	       trail = arch_ctz(x);
+	       if (plead < 32 && lead >= plead && trail >= ptrail)
+	       {
+		    /*
+		     *  Fits within the previous window of meaningful bits
+		     */
+		    arch_put(w, 0x2, 2);
+		    arch_put(w, x >> ptrail, 32 - plead - ptrail);
+	       }
+	       else
+	       {
+		    sig = 32 - lead - trail;
+		    arch_put(w, 0x3, 2);
+		    arch_put(w, lead, 5);
+		    arch_put(w, sig - 1, 5);
+		    arch_put(w, x >> trail, sig);
+		    plead  = lead;
+		    ptrail = trail;
+	       }
+	  }
+	  prev = v;
+     }
+}
+
+
+/*
+ *  Length of a NUL padded field
+ */
+static size_t
+arch_fldlen(const char *fld, size_t max)
+{
+     const char *ptr = (const char *)memchr(fld, '\0', max);
+     return(ptr ? (size_t)(ptr - fld) : max);
+}
+
+
+/*
+ *  Compress a segment of a binary day file into a block in w, which
+ *  is emptied first.  The block's index entry, less its offset and
+ *  day, is returned in ent.
+ */
+static int
+arch_blk_encode(arch_wbits_t *w, const bdat_seg_t *seg, arch_ent_t *ent)
+{
+     arch_blk_t blk;
+     const bdat_col_t *col;
+     unsigned int *offs;
+     size_t c, i, ncols, olen;
+     long long t;
+
+     w->len  = 0;
+     w->nacc = 0;
+     w->err  = 0;
+
+     ncols = seg->hdr->ncols;
+     olen  = (ncols + 1) * sizeof(unsigned int);
+     offs  = (unsigned int *)malloc(olen);
+     if (!offs)
+	  return(ERR_NOMEM);
+
+     /*
+      *  Room for the header and stream offsets, and then the column
+      *  descriptions
+      */
+     arch_put_bytes(w, NULL, sizeof(arch_blk_t) + olen);
+     for (c = 0; c < ncols; c++)
+     {
+	  col = &seg->cols[c];
+	  arch_put_bytes(w, col->romid, arch_fldlen(col->romid,
+						   sizeof(col->romid)));
+	  arch_put_bytes(w, "", 1);
+	  arch_put_bytes(w, col->format, arch_fldlen(col->format,
+						    sizeof(col->format)));
+	  arch_put_bytes(w, "", 1);
+	  arch_put_bytes(w, col->units, arch_fldlen(col->units,
+						   sizeof(col->units)));
+	  arch_put_bytes(w, "", 1);
+	  arch_put_bytes(w, col->dtype, arch_fldlen(col->dtype,
+						   sizeof(col->dtype)));
+	  arch_put_bytes(w, "", 1);
+	  arch_put_bytes(w, col->desc, arch_fldlen(col->desc,
+						  sizeof(col->desc)));
+	  arch_put_bytes(w, "", 1);
+     }
+
+     /*
+      *  The bit streams, each starting on a byte boundary
+      */
+     offs[0] = (unsigned int)w->len;
+     arch_put_times(w, seg);
+     arch_flush(w);
+     for (c = 0; c < ncols; c++)
+     {
+	  offs[c + 1] = (unsigned int)w->len;
+	  arch_put_vals(w, seg, c);
+	  arch_flush(w);
+     }
+
+     /*
+      *  Pad the block to a multiple of 8 bytes so that each block is
+      *  aligned within the archive
+      */
+     arch_put_bytes(w, NULL, (8 - (w->len & 7)) & 7);
+     if (w->err)
+     {
+	  free(offs);
+	  return(ERR_NOMEM);
+     }
+
+     memset(&blk, 0, sizeof(arch_blk_t));
+     memcpy(blk.magic, ARCH_BLK_MAGIC, ARCH_MAGIC_LEN);
+     blk.blk_len = (unsigned int)w->len;
+     blk.ncols   = (unsigned int)ncols;
+     blk.nrecs   = (unsigned int)seg->nrecs;
+     blk.gmtoff  = seg->hdr->gmtoff;
+     blk.vmajor  = seg->hdr->vmajor;
+     blk.vminor  = seg->hdr->vminor;
+     memcpy(blk.zone, seg->hdr->zone, sizeof(blk.zone));
+     memcpy(w->buf, &blk, sizeof(arch_blk_t));
+     memcpy(w->buf + sizeof(arch_blk_t), offs, olen);
+     free(offs);
+
+     memset(ent, 0, sizeof(arch_ent_t));
+     ent->blk_len = blk.blk_len;
+     for (i = 0; i < seg->nrecs; i++)
+     {
+	  t = (long long)BDAT_REC_TIME(BDAT_REC(seg, i));
+	  if (i == 0 || t < ent->tfirst)
+	       ent->tfirst = t;
+	  if (i == 0 || t > ent->tlast)
+	       ent->tlast = t;
+     }
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Ensure that *buf, currently of *max bytes, has room for need bytes
+ */
+static int
+arch_buf_grow(char **buf, size_t *max, size_t need)
+{
+     size_t newmax;
+     char *tmp;
+
+     if (need <= *max)
+	  return(ERR_OK);
+     newmax = *max ? *max : 8192;
+     while (newmax < need)
+	  newmax *= 2;
+     tmp = (char *)realloc(*buf, newmax);
+     if (!tmp)
+	  return(ERR_NOMEM);
+     *buf = tmp;
+     *max = newmax;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Decode the records of the block of avail bytes at ptr with time
+ *  stamps from start to end, appending them as a segment of a binary
+ *  day file to *buf which holds *n bytes out of *max
+ */
+static int
+arch_blk_decode(const char *ptr, size_t avail, time_t start, time_t end,
+		char **buf, size_t *max, size_t *n)
+{
+     arch_blk_t blk;
+     arch_rbits_t r;
+     bdat_col_t *col;
+     const char *fld[5], *sptr, *send;
+     unsigned char *sel;
+     unsigned int *offs;
+     long long *times, delta, dod, t;
+     unsigned long long u;
+     size_t c, i, k, nsel, olen, rec_len;
+     unsigned int bits, lead, plead, prev, ptrail, sig, trail, x;
+     char *rec, *recs;
+     float f;
+     int istat;
+
+     offs  = NULL;
+     times = NULL;
+     sel   = NULL;
+     istat = ERR_NO;
+
+     if (avail < sizeof(arch_blk_t))
+	  goto done;
+     memcpy(&blk, ptr, sizeof(arch_blk_t));
+     if (memcmp(blk.magic, ARCH_BLK_MAGIC, ARCH_MAGIC_LEN) ||
+	 blk.blk_len > avail || blk.ncols > 0xffffU ||
+	 (size_t)blk.nrecs > 8 * (size_t)blk.blk_len + 1)
+	  goto done;
+     olen = (blk.ncols + 1) * sizeof(unsigned int);
+     if (sizeof(arch_blk_t) + olen > blk.blk_len)
+	  goto done;
+     if (!(offs = (unsigned int *)malloc(olen)))
+	  goto nomem;
+     memcpy(offs, ptr + sizeof(arch_blk_t), olen);
+     if (offs[0] < sizeof(arch_blk_t) + olen)
+	  goto done;
+     for (c = 0; c < blk.ncols; c++)
+	  if (offs[c + 1] < offs[c] || offs[c + 1] > blk.blk_len)
+	       goto done;
+     if (offs[blk.ncols] > blk.blk_len)
+	  goto done;
+
+     /*
+      *  Decode the time stamps and select those within the range
+      */
+     if (!(times = (long long *)malloc((blk.nrecs + 1) * sizeof(long long))) ||
+	 !(sel = (unsigned char *)malloc(blk.nrecs + 1)))
+	  goto nomem;
+     memset(&r, 0, sizeof(arch_rbits_t));
+     r.ptr = (const unsigned char *)ptr + offs[0];
+     r.end = (const unsigned char *)ptr +
+	  ((blk.ncols > 0) ? offs[1] : blk.blk_len);
+     t     = 0;
+     delta = 0;
+     nsel  = 0;
+     for (i = 0; i < blk.nrecs; i++)
+     {
+	  if (i == 0)
+	  {
+	       u = (unsigned long long)arch_get(&r, 32) << 32;
+	       u |= arch_get(&r, 32);
+	       t = (long long)u;
+	  }
+	  else
+	  {
+	       if (!arch_get(&r, 1))
+		    dod = 0;
+	       else if (!arch_get(&r, 1))
+		    dod = (long long)arch_get(&r, 7) - 63;
+	       else if (!arch_get(&r, 1))
+		    dod = (long long)arch_get(&r, 9) - 255;
+	       else if (!arch_get(&r, 1))
+		    dod = (long long)arch_get(&r, 12) - 2047;
+	       else
+	       {
+		    u = (unsigned long long)arch_get(&r, 32) << 32;
+		    u |= arch_get(&r, 32);
+		    dod = (long long)u;
+	       }
+	       delta += dod;
+	       t     += delta;
+	  }
+	  times[i] = t;
+	  sel[i] = ((long long)start <= t && t <= (long long)end) ? 1 : 0;
+	  nsel += sel[i];
+     }
+     if (r.err)
+	  goto done;
+     if (!nsel)
+     {
+	  istat = ERR_OK;
+	  goto done;
+     }
+
+     /*
+      *  Segment header and column descriptions
+      */
+     rec_len = BDAT_REC_LEN(blk.ncols);
+     if (arch_buf_grow(buf, max, *n + BDAT_HDR_LEN(blk.ncols) +
+		       nsel * rec_len))
+	  goto nomem;
+     bdat_hdr_init((bdat_hdr_t *)(*buf + *n), blk.ncols, blk.gmtoff,
+		   blk.zone[sizeof(blk.zone) - 1] ? "" : blk.zone,
+		   blk.vmajor, blk.vminor);
+     col  = (bdat_col_t *)(*buf + *n + sizeof(bdat_hdr_t));
+     sptr = ptr + sizeof(arch_blk_t) + olen;
+     send = ptr + offs[0];
+     for (c = 0; c < blk.ncols; c++, col++)
+     {
+	  for (k = 0; k < 5; k++)
+	  {
+	       fld[k] = sptr;
+	       sptr = (const char *)memchr(sptr, '\0', (size_t)(send - sptr));
+	       if (!sptr)
+		    goto done;
+	       sptr++;
+	  }
+	  bdat_col_init(col, fld[0], fld[1], fld[2], fld[3], fld[4]);
+     }
+
+     /*
+      *  Records, their values missing until decoded
+      */
+     recs = *buf + *n + BDAT_HDR_LEN(blk.ncols);
+     for (i = 0, rec = recs; i < blk.nrecs; i++)
+	  if (sel[i])
+	  {
+	       bdat_rec_init(rec, blk.ncols, (time_t)times[i], NULL);
+	       rec += rec_len;
+	  }
+
+     for (c = 0; c < blk.ncols; c++)
+     {
+	  memset(&r, 0, sizeof(arch_rbits_t));
+	  r.ptr  = (const unsigned char *)ptr + offs[c + 1];
+	  r.end  = (const unsigned char *)ptr +
+	       ((c + 1 < blk.ncols) ? offs[c + 2] : blk.blk_len);
+	  prev   = 0;
+	  plead  = 32;
+	  ptrail = 0;
+	  for (i = 0, rec = recs; i < blk.nrecs; i++)
+	  {
+	       if (i == 0)
+		    bits = arch_get(&r, 32);
+	       else if (!arch_get(&r, 1))
+		    bits = prev;
+	       else if (!arch_get(&r, 1))
+	       {
+		    if (plead >= 32)
+			 goto done;
+		    x = arch_get(&r, 32 - plead - ptrail) << ptrail;
+		    bits = prev ^ x;
+	       }
+	       else
+	       {
+		    lead  = arch_get(&r, 5);
+		    sig   = arch_get(&r, 5) + 1;
+		    if (lead + sig > 32)
+			 goto done;
+		    trail = 32 - lead - sig;
+		    x     = (trail < 32) ? arch_get(&r, sig) << trail : 0;
+		    bits  = prev ^ x;
+		    plead  = lead;
+		    ptrail = trail;
+	       }
+	       prev = bits;
+	       if (sel[i])
+	       {
+		    memcpy(&f, &bits, 4);
+		    bdat_rec_set(rec, c, f);
+		    rec += rec_len;
+	       }
+	  }
+	  if (r.err)
+	       goto done;
+     }
+
+     *n += BDAT_HDR_LEN(blk.ncols) + nsel * rec_len;
+     istat = ERR_OK;
+     goto done;
+
+nomem:
+     istat = ERR_NOMEM;
+
+done:
+     if (offs)
+	  free(offs);
+     if (times)
+	  free(times);
+     if (sel)
+	  free(sel);
+
+     return(istat);
+}
+
+
+/*
+ *  Returns in *fname the malloc()ed string prefix followed by suffix
+ */
+static int
+arch_fname(char **fname, const char *prefix, const char *suffix)
+{
+     size_t len1, len2;
+
+     len1 = strlen(prefix);
+     len2 = strlen(suffix);
+     *fname = (char *)malloc(len1 + len2 + 1);
+     if (!(*fname))
+     {
+	  debug("arch_fname(%d): Insufficient virtual memory", __LINE__);
+	  return(ERR_NOMEM);
+     }
+     memcpy(*fname, prefix, len1);
+     memcpy(*fname + len1, suffix, len2 + 1);
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Returns 1 when the len bytes at ptr begin with a file header of the
+ *  given magic, written by a host of this byte order
+ */
+static int
+arch_file_ok(const char *ptr, size_t len, const char *magic)
+{
+     arch_file_t hdr;
+
+     if (len < sizeof(arch_file_t))
+	  return(0);
+     memcpy(&hdr, ptr, sizeof(arch_file_t));
+     return(!memcmp(hdr.magic, magic, ARCH_MAGIC_LEN) &&
+	    hdr.version == ARCH_VERSION && hdr.order == ARCH_ORDER);
+}
+
+
+int
+arch_read(const char *prefix, time_t start, time_t end, char **buf,
+	  size_t *buflen)
+{
+     const char *abase, *ibase;
+     const arch_ent_t *ents;
+     arch_ent_t ent;
+     char *aname, *iname;
+     size_t alen, hi, ilen, lo, max, mid, n, nents;
+     int istat;
+
+     if (!prefix || !buf || !buflen)
+     {
+	  debug("arch_read(%d): Invalid call arguments; prefix=%p, buf=%p, "
+		"buflen=%p", __LINE__, prefix, buf, buflen);
+	  return(ERR_BADARGS);
+     }
+     *buf    = NULL;
+     *buflen = 0;
+
+     aname = NULL;
+     iname = NULL;
+     abase = NULL;
+     ibase = NULL;
+     alen  = 0;
+     ilen  = 0;
+     max   = 0;
+     n     = 0;
+
+     if (ERR_OK != (istat = arch_fname(&aname, prefix, ".gar")) ||
+	 ERR_OK != (istat = arch_fname(&iname, prefix, ".gax")))
+	  goto done;
+
+     if (os_mmap(iname, &ibase, &ilen) || os_mmap(aname, &abase, &alen))
+     {
+	  istat = (errno == ENOENT) ? ERR_EOM : ERR_NO;
+	  debug("arch_read(%d): Unable to read the archive \"%s\"; errno=%d; "
+		"%s", __LINE__, abase ? iname : aname, errno, strerror(errno));
+	  goto done;
+     }
+     if (!arch_file_ok(ibase, ilen, ARCH_IDX_MAGIC) ||
+	 !arch_file_ok(abase, alen, ARCH_MAGIC))
+     {
+	  debug("arch_read(%d): The archive \"%s\" or its index is not an "
+		"archive written by a host of this byte order",
+		__LINE__, aname);
+	  istat = ERR_NO;
+	  goto done;
+     }
+
+     /*
+      *  The blocks are in chronological order: find the first whose
+      *  latest record is at or after the start of the range
+      */
+     ents  = (const arch_ent_t *)(ibase + sizeof(arch_file_t));
+     nents = (ilen - sizeof(arch_file_t)) / sizeof(arch_ent_t);
+     lo = 0;
+     hi = nents;
+     while (lo < hi)
+     {
+	  mid = lo + (hi - lo) / 2;
+	  if (ents[mid].tlast < (long long)start)
+	       lo = mid + 1;
+	  else
+	       hi = mid;
+     }
+
+     for (; lo < nents; lo++)
+     {
+	  memcpy(&ent, &ents[lo], sizeof(arch_ent_t));
+	  if (ent.tfirst > (long long)end)
+	       break;
+	  if (ent.tlast < (long long)start)
+	       continue;
+	  if (ent.offset < (long long)sizeof(arch_file_t) ||
+	      (unsigned long long)ent.offset + ent.blk_len > alen)
+	  {
+	       debug("arch_read(%d): Index entry %u of the archive \"%s\" "
+		     "lies outside of the archive; ignoring it",
+		     __LINE__, (unsigned int)lo, aname);
+	       continue;
+	  }
+	  istat = arch_blk_decode(abase + ent.offset, ent.blk_len, start, end,
+				  buf, &max, &n);
+	  if (istat == ERR_NOMEM)
+	       goto done;
+	  else if (istat != ERR_OK)
+	       debug("arch_read(%d): Block %u of the archive \"%s\" is "
+		     "corrupt; ignoring it", __LINE__, (unsigned int)lo,
+		     aname);
+     }
+     istat = ERR_OK;
+
+done:
+     os_munmap(abase, alen);
+     os_munmap(ibase, ilen);
+     if (aname)
+	  free(aname);
+     if (iname)
+	  free(iname);
+     if (istat == ERR_OK)
+	  *buflen = n;
+     else if (*buf)
+     {
+	  free(*buf);
+	  *buf = NULL;
+     }
+
+     return(istat);
+}
+
+
+static int
+arch_write(int fd, const void *buf, size_t len)
+{
+     const char *ptr = (const char *)buf;
+     ssize_t nwritten;
+
+     while (len)
+     {
+	  nwritten = write(fd, ptr, len);
+	  if (nwritten < 0)
+	  {
+	       if (errno == EINTR)
+		    continue;
+	       return(-1);
+	  }
+	  ptr += nwritten;
+	  len -= (size_t)nwritten;
+     }
+
+     return(0);
+}
+
+
+/*
+ *  Open, and if need be create, the archive or its index.  An existing
+ *  file must begin with a file header bearing the given magic.
+ */
+static int
+arch_open(const char *fname, const char *magic, off_t *size)
+{
+     arch_file_t hdr;
+     struct stat sbuf;
+     int fd;
+     ssize_t nread;
+
+     fd = open(fname, O_RDWR | O_CREAT | O_BINARY, 0644);
+     if (fd < 0)
+     {
+	  debug("arch_open(%d): Unable to open the file \"%s\"; open() call "
+		"failed; errno=%d; %s", __LINE__, fname, errno,
+		strerror(errno));
+	  return(-1);
+     }
+     if (fstat(fd, &sbuf))
+	  goto error;
+     if (sbuf.st_size == 0)
+     {
+	  memset(&hdr, 0, sizeof(arch_file_t));
+	  memcpy(hdr.magic, magic, ARCH_MAGIC_LEN);
+	  hdr.version = ARCH_VERSION;
+	  hdr.order   = ARCH_ORDER;
+	  if (arch_write(fd, &hdr, sizeof(arch_file_t)))
+	       goto error;
+	  *size = (off_t)sizeof(arch_file_t);
+	  return(fd);
+     }
+
+     nread = read(fd, &hdr, sizeof(arch_file_t));
+     if (nread != (ssize_t)sizeof(arch_file_t) ||
+	 !arch_file_ok((const char *)&hdr, sizeof(arch_file_t), magic))
+     {
+	  debug("arch_open(%d): The file \"%s\" is not an archive written "
+		"by a host of this byte order; not appending to it",
+		__LINE__, fname);
+	  close(fd);
+	  return(-1);
+     }
+     *size = sbuf.st_size;
+     return(fd);
+
+error:
+     debug("arch_open(%d): Unable to initialize the file \"%s\"; "
+	   "errno=%d; %s", __LINE__, fname, errno, strerror(errno));
+     close(fd);
+     return(-1);
+}
+
+
+/*
+ *  Returns the date days_ago days before today as yyyymmdd
+ */
+static unsigned int
+arch_day(time_t now, unsigned int days_ago)
+{
+     struct tm tm;
+
+     localtime_r(&now, &tm);
+     tm.tm_mday -= (int)days_ago;
+     tm.tm_hour  = 12;
+     now = mktime(&tm);
+     localtime_r(&now, &tm);
+
+     return((unsigned int)(10000 * (tm.tm_year + 1900) +
+			   100 * (tm.tm_mon + 1) + tm.tm_mday));
+}
+
+
+/*
+ *  The dates of the day files found in the archive's directory
+ */
+typedef struct {
+     const char   *base;        /* File name part of the prefix          */
+     size_t        blen;        /* Length of base                        */
+     unsigned int *days;        /* Dates as yyyymmdd                     */
+     size_t        ndays;       /* Dates in days[]                       */
+     size_t        maxdays;     /* Room in days[]                        */
+     int           nomem;       /* Ran out of memory                     */
+} arch_scan_t;
+
+
+static int
+arch_scan_proc(void *ctx, const char *name)
+{
+     arch_scan_t *scan = (arch_scan_t *)ctx;
+     unsigned int day;
+     size_t i;
+
+     if (strncmp(name, scan->base, scan->blen) || name[scan->blen] != '-')
+	  return(0);
+     name += scan->blen + 1;
+     day = 0;
+     for (i = 0; i < 8; i++)
+     {
+	  if (name[i] < '0' || name[i] > '9')
+	       return(0);
+	  day = 10 * day + (unsigned int)(name[i] - '0');
+     }
+     if (strcmp(name + 8, ".dat") && strcmp(name + 8, ".bdat"))
+	  return(0);
+
+     if (scan->ndays >= scan->maxdays)
+     {
+	  unsigned int *tmp = (unsigned int *)realloc(scan->days,
+			  (scan->maxdays + 64) * sizeof(unsigned int));
+	  if (!tmp)
+	  {
+	       scan->nomem = 1;
+	       return(1);
+	  }
+	  scan->days = tmp;
+	  scan->maxdays += 64;
+     }
+     scan->days[scan->ndays++] = day;
+
+     return(0);
+}
+
+
+static int
+arch_day_cmp(const void *a, const void *b)
+{
+     unsigned int da = *(const unsigned int *)a;
+     unsigned int db = *(const unsigned int *)b;
+
+     return((da < db) ? -1 : ((da > db) ? 1 : 0));
+}
+
+
+int
+arch_days(const char *prefix, unsigned int keep)
+{
+     const char *base;
+     char *aname, *bname, *dname, *iname, *bdat;
+     arch_wbits_t w;
+     arch_ent_t ent, *ents;
+     arch_scan_t scan;
+     bdat_seg_t seg;
+     size_t blen, i, len, lineno, nents, maxents, plen;
+     off_t aday, aend, asize, isize, iend;
+     int afd, ifd, istat;
+     unsigned int day, last_day, newest;
+     char *dir;
+
+     if (!prefix)
+     {
+	  debug("arch_days(%d): Invalid call arguments; prefix=%p",
+		__LINE__, prefix);
+	  return(ERR_BADARGS);
+     }
+     if (keep < ARCH_KEEP_MIN)
+	  keep = ARCH_KEEP_MIN;
+
+     aname   = NULL;
+     iname   = NULL;
+     dname   = NULL;
+     bname   = NULL;
+     bdat    = NULL;
+     ents    = NULL;
+     dir     = NULL;
+     maxents = 0;
+     afd     = -1;
+     ifd     = -1;
+     aend    = 0;
+     aday    = (off_t)-1;
+     memset(&w, 0, sizeof(arch_wbits_t));
+     memset(&scan, 0, sizeof(arch_scan_t));
+
+     plen = strlen(prefix);
+     if (ERR_OK != (istat = arch_fname(&aname, prefix, ".gar")) ||
+	 ERR_OK != (istat = arch_fname(&iname, prefix, ".gax")) ||
+	 ERR_OK != (istat = arch_fname(&dname, prefix, "-yyyymmdd.dat")) ||
+	 ERR_OK != (istat = arch_fname(&bname, prefix, "-yyyymmdd.bdat")))
+	  goto done;
+
+     istat = ERR_NO;
+     if (0 > (afd = arch_open(aname, ARCH_MAGIC, &asize)) ||
+	 0 > (ifd = arch_open(iname, ARCH_IDX_MAGIC, &isize)))
+	  goto done;
+
+     /*
+      *  Find the last index entry which describes a whole block of the
+      *  archive.  Anything after it in either file is what remains of
+      *  an interrupted run and is truncated away.
+      */
+     aend = (off_t)sizeof(arch_file_t);
+     iend = (off_t)sizeof(arch_file_t) +
+	  (off_t)(((size_t)isize - sizeof(arch_file_t)) / sizeof(arch_ent_t) *
+		  sizeof(arch_ent_t));
+     last_day = 0;
+     while (iend > (off_t)sizeof(arch_file_t))
+     {
+	  if (lseek(ifd, iend - (off_t)sizeof(arch_ent_t), SEEK_SET) < 0 ||
+	      read(ifd, &ent, sizeof(arch_ent_t)) !=
+	        (ssize_t)sizeof(arch_ent_t))
+	       goto io_error;
+	  if (ent.offset >= (long long)sizeof(arch_file_t) &&
+	      ent.offset + (long long)ent.blk_len <= (long long)asize)
+	  {
+	       aend     = (off_t)(ent.offset + ent.blk_len);
+	       last_day = ent.day;
+	       break;
+	  }
+	  iend -= (off_t)sizeof(arch_ent_t);
+     }
+     if ((iend != isize && ftruncate(ifd, iend)) ||
+	 (aend != asize && ftruncate(afd, aend)))
+	  goto io_error;
+
+     /*
+      *  List the day files in the prefix's directory
+      */
+     scan.base = prefix;
+     for (i = plen; i > 0; i--)
+	  if (prefix[i - 1] == '/' || prefix[i - 1] == '\\')
+	       break;
+     if (i)
+     {
+	  scan.base = prefix + i;
+	  if (!(dir = (char *)malloc(i + 1)))
+	  {
+	       istat = ERR_NOMEM;
+	       goto done;
+	  }
+	  memcpy(dir, prefix, i);
+	  dir[i] = '\0';
+     }
+     scan.blen = strlen(scan.base);
+     if (os_dir_scan(dir ? dir : ".", arch_scan_proc, &scan))
+     {
+	  debug("arch_days(%d): Unable to list the directory \"%s\"; "
+		"errno=%d; %s", __LINE__, dir ? dir : ".", errno,
+		strerror(errno));
+	  goto done;
+     }
+     else if (scan.nomem)
+     {
+	  istat = ERR_NOMEM;
+	  goto done;
+     }
+     if (scan.ndays > 1)
+	  qsort(scan.days, scan.ndays, sizeof(unsigned int), arch_day_cmp);
+
+     /*
+      *  Archive, oldest first, each day file old enough and newer than
+      *  the last day archived.  The archive is only ever appended to, so
+      *  a day file older than that is left alone.
+      */
+     newest = arch_day(time(NULL), keep);
+     for (i = 0; i < scan.ndays; i++)
+     {
+	  day = scan.days[i];
+	  if ((i && day == scan.days[i - 1]) || day > newest)
+	       continue;
+	  else if (day <= last_day)
+	  {
+	       info("arch_days(%d): Not archiving the day file for %08u as "
+		    "the archive \"%s\" already extends to %08u",
+		    __LINE__, day, aname, last_day);
+	       continue;
+	  }
+	  sprintf(dname + plen, "-%08u.dat", day);
+	  sprintf(bname + plen, "-%08u.bdat", day);
+
+	  /*
+	   *  The text file is the complete record of the day; the binary
+	   *  file only holds data from when binary files were enabled
+	   */
+	  blen = 0;
+	  if (!os_mmap(dname, &base, &len))
+	  {
+	       istat = bdat_from_text(base, len, &bdat, &blen, &lineno);
+	       os_munmap(base, len);
+	       if (istat == ERR_NOMEM)
+		    goto done;
+	       else if (istat == ERR_NO)
+	       {
+		    debug("arch_days(%d): The data file \"%s\" is not a data "
+			  "file; see line %u; not archiving it",
+			  __LINE__, dname, (unsigned int)lineno);
+		    continue;
+	       }
+	  }
+	  else if (errno != ENOENT)
+	  {
+	       debug("arch_days(%d): Unable to read the data file \"%s\"; "
+		     "errno=%d; %s", __LINE__, dname, errno,
+		     strerror(errno));
+	       continue;
+	  }
+	  else if (!os_mmap(bname, &base, &len))
+	  {
+	       if (len)
+	       {
+		    if (!(bdat = (char *)malloc(len)))
+		    {
+			 os_munmap(base, len);
+			 istat = ERR_NOMEM;
+			 goto done;
+		    }
+		    memcpy(bdat, base, len);
+	       }
+	       blen = len;
+	       os_munmap(base, len);
+	       if (bdat_len(bdat, blen) == (size_t)-1)
+	       {
+		    debug("arch_days(%d): The file \"%s\" is not a binary "
+			  "data file; not archiving it", __LINE__, bname);
+		    free(bdat);
+		    bdat = NULL;
+		    continue;
+	       }
+	  }
+	  else
+	       /*
+		*  No data for this day
+		*/
+	       continue;
+
+	  /*
+	   *  A block for each segment with records
+	   */
+	  aday  = aend;
+	  nents = 0;
+	  memset(&seg, 0, sizeof(bdat_seg_t));
+	  while ((istat = bdat_seg_next(bdat, blen, &seg)) == ERR_OK)
+	  {
+	       if (!seg.nrecs)
+		    continue;
+	       if (ERR_OK != (istat = arch_blk_encode(&w, &seg, &ent)))
+		    goto done;
+	       ent.offset = (long long)aend;
+	       ent.day    = day;
+	       if (nents >= maxents)
+	       {
+		    arch_ent_t *tmp = (arch_ent_t *)realloc(ents,
+				    (maxents + 8) * sizeof(arch_ent_t));
+		    if (!tmp)
+		    {
+			 istat = ERR_NOMEM;
+			 goto done;
+		    }
+		    ents = tmp;
+		    maxents += 8;
+	       }
+	       if (lseek(afd, aend, SEEK_SET) < 0 ||
+		   arch_write(afd, w.buf, w.len))
+		    goto io_error;
+	       aend += (off_t)w.len;
+	       ents[nents++] = ent;
+	  }
+	  if (bdat)
+	       free(bdat);
+	  bdat = NULL;
+
+	  /*
+	   *  The blocks must reach the disk before their index entries,
+	   *  and those before the day files are removed
+	   */
+	  if (nents)
+	  {
+	       if (fsync(afd) ||
+		   lseek(ifd, iend, SEEK_SET) < 0 ||
+		   arch_write(ifd, ents, nents * sizeof(arch_ent_t)) ||
+		   fsync(ifd))
+		    goto io_error;
+	       iend += (off_t)(nents * sizeof(arch_ent_t));
+	  }
+	  last_day = day;
+	  if ((remove(dname) && errno != ENOENT) ||
+	      (remove(bname) && errno != ENOENT))
+	       debug("arch_days(%d): Unable to remove the data file for "
+		     "%08u after archiving it; errno=%d; %s",
+		     __LINE__, day, errno, strerror(errno));
+	  info("arch_days(%d): Archived %u blocks for %08u to \"%s\"",
+	       __LINE__, (unsigned int)nents, day, aname);
+     }
+     istat = ERR_OK;
+     goto done;
+
+io_error:
+     debug("arch_days(%d): Error updating the archive \"%s\"; errno=%d; %s",
+	   __LINE__, aname, errno, strerror(errno));
+     istat = ERR_NO;
+
+     /*
+      *  Leave behind no blocks lacking index entries
+      */
+     if (afd >= 0 && aday >= 0 && ftruncate(afd, aday))
+	  debug("arch_days(%d): Unable to truncate the archive \"%s\"; "
+		"errno=%d; %s", __LINE__, aname, errno, strerror(errno));
+
+done:
+     if (afd >= 0)
+	  close(afd);
+     if (ifd >= 0)
+	  close(ifd);
+     if (aname)
+	  free(aname);
+     if (iname)
+	  free(iname);
+     if (dname)
+	  free(dname);
+     if (bname)
+	  free(bname);
+     if (bdat)
+	  free(bdat);
+     if (ents)
+	  free(ents);
+     if (w.buf)
+	  free(w.buf);
+     if (dir)
+	  free(dir);
+     if (scan.days)
+	  free(scan.days);
+
+     return(istat);
+}
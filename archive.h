@@ -0,0 +1,174 @@
+/*
+ *  Copyright (c) 2005, Daniel C. Newman <dan.newman@mtbaldy.us>
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  
+ *   + Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  
+ *   + Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *  
+ *   + Neither the name of mtbaldy.us nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ *  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ *  OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+/*
+ *  archive.h
+ *
+ *  Compressed archive of past days' data.  Once a day file,
+ *  <prefix>-yyyymmdd.dat, is old enough, the nightly thread compresses
+ *  it into the archive <prefix>.gar, indexes it in <prefix>.gax, and
+ *  then removes it and any binary day file for the same day.
+ *
+ *  Each segment of a day file becomes a block of the archive, its
+ *  time stamps and each of its columns compressed as a separate bit
+ *  stream after Pelkonen et al., "Gorilla: A Fast, Scalable, In-Memory
+ *  Time Series Database":
+ *
+ *    time stamps -- the first in 64 bits and then the delta of the
+ *      deltas, which for a steady sampling period is usually 0 and
+ *      thus stored in a single bit
+ *
+ *      '0'                       delta of delta == 0
+ *      '10'   + 7 bits           -63 <= delta of delta <= 64
+ *      '110'  + 9 bits           -255 <= delta of delta <= 256
+ *      '1110' + 12 bits          -2047 <= delta of delta <= 2048
+ *      '1111' + 64 bits          otherwise
+ *
+ *    values -- the first in 32 bits and then the exclusive OR of each
+ *      value with its predecessor, which for a slowly changing value
+ *      has long runs of leading and trailing zero bits
+ *
+ *      '0'                       same value as the predecessor
+ *      '10'   + meaningful bits  the non-zero bits fall within those
+ *                                of the previous exclusive OR
+ *      '11'   + 5 bits of leading zeros + 5 bits of length less one
+ *             + meaningful bits
+ *
+ *  A missing value is a NaN and is compressed like any other value.
+ *  The archive is a file header followed by the blocks:
+ *
+ *    arch_file_t
+ *    block: arch_blk_t, unsigned int offs[ncols+1], column descriptions,
+ *           time stamp bit stream, column 0 bit stream, ...
+ *    block: ...
+ *
+ *  offs[] gives the offset of each bit stream from the start of the
+ *  block so that a reader may decode only the columns it needs.  Each
+ *  column description is its ROM id, format, units, type, and
+ *  description as five NUL terminated strings.  The index is a file
+ *  header followed by an arch_ent_t for each block, in the order of
+ *  the blocks.  A block is appended to the archive and synced to disk
+ *  before its index entry is; a block lacking an index entry, as left
+ *  by an interrupted write, is truncated away by the next archiving
+ *  run.  As with binary day files, both files are in the byte order of
+ *  the host which wrote them.
+ */
+
+#if !defined(__ARCHIVE_H__)
+
+#define __ARCHIVE_H__
+
+#include <time.h>
+#include "debug.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define ARCH_MAGIC      "HA7GARC\n"
+#define ARCH_IDX_MAGIC  "HA7GIDX\n"
+#define ARCH_BLK_MAGIC  "HA7GBLK\n"
+#define ARCH_MAGIC_LEN  8
+#define ARCH_VERSION    1
+#define ARCH_ORDER      0x01020304U
+
+/*
+ *  Day files younger than this many days are never archived: yesterday's
+ *  file is needed at startup to recover yesterday's extrema
+ */
+#define ARCH_KEEP_MIN   2
+
+/*
+ *  Header of both the archive and its index
+ */
+typedef struct {
+     char          magic[ARCH_MAGIC_LEN]; /* ARCH_MAGIC or ARCH_IDX_MAGIC */
+     unsigned int  version;     /* ARCH_VERSION                          */
+     unsigned int  order;       /* ARCH_ORDER in the writer's byte order */
+} arch_file_t;
+
+/*
+ *  Block header
+ */
+typedef struct {
+     char          magic[ARCH_MAGIC_LEN]; /* ARCH_BLK_MAGIC              */
+     unsigned int  blk_len;     /* Bytes in the block including header   */
+     unsigned int  ncols;       /* Columns                               */
+     unsigned int  nrecs;       /* Records                               */
+     int           gmtoff;      /* Writer's offset from UTC in seconds   */
+     unsigned int  vmajor;      /* Writer's major version number         */
+     unsigned int  vminor;      /* Writer's minor version number         */
+     char          zone[24];    /* Writer's time zone name               */
+} arch_blk_t;
+
+/*
+ *  Index entry
+ */
+typedef struct {
+     long long     tfirst;      /* Earliest time stamp in the block      */
+     long long     tlast;       /* Latest time stamp in the block        */
+     long long     offset;      /* Offset of the block in the archive    */
+     unsigned int  blk_len;     /* Bytes in the block                    */
+     unsigned int  day;         /* Day file's date as yyyymmdd           */
+} arch_ent_t;
+
+/*
+ *  Compress the day files <prefix>-yyyymmdd.dat which are at least keep
+ *  days old, but newer than the last day already archived, into the
+ *  archive <prefix>.gar and then remove them along with any binary day
+ *  files <prefix>-yyyymmdd.bdat for the same days.  A keep of less than
+ *  ARCH_KEEP_MIN is taken as ARCH_KEEP_MIN.  A day for which there is
+ *  only a binary day file is archived from that file.  Day files no newer
+ *  than the last day archived are logged and left in place.
+ */
+int arch_days(const char *prefix, unsigned int keep);
+
+/*
+ *  Decode the records from the archive <prefix>.gar with time stamps
+ *  from start to end, inclusive, returning them as a binary day file
+ *  (see bdat.h) in *buf, a malloc()ed buffer of *buflen bytes which the
+ *  caller must free().  Only the blocks whose index entries overlap
+ *  the range are read.  Returns ERR_OK, with *buflen of zero when no
+ *  records fall within the range, or an error.
+ */
+int arch_read(const char *prefix, time_t start, time_t end, char **buf,
+  size_t *buflen);
+
+void arch_debug_set(debug_proc_t *proc, void *ctx, int flags);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
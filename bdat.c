@@ -0,0 +1,504 @@
+/*
+ *  Copyright (c) 2005, Daniel C. Newman <dan.newman@mtbaldy.us>
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  
+ *   + Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  
+ *   + Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *  
+ *   + Neither the name of mtbaldy.us nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ *  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ *  OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "err.h"
+#include "device.h"
+#include "bdat.h"
+
+/*
+ *  A quiet NaN marks a missing value
+ */
+static const union {
+     unsigned int  u;
+     float         f;
+} bdat_nan = { 0x7fc00000U };
+
+
+/*
+ *  Copy a string into a fixed size, NUL padded field, truncating it
+ *  as needed
+ */
+static void
+bdat_strcpy(char *dst, size_t dstlen, const char *src)
+{
+     size_t len;
+
+     len = src ? strlen(src) : 0;
+     if (len >= dstlen)
+	  len = dstlen - 1;
+     if (len)
+	  memcpy(dst, src, len);
+     memset(dst + len, 0, dstlen - len);
+}
+
+
+void
+bdat_hdr_init(bdat_hdr_t *hdr, size_t ncols, long gmtoff, const char *zone,
+	      unsigned int vmajor, unsigned int vminor)
+{
+     memset(hdr, 0, sizeof(bdat_hdr_t));
+     memcpy(hdr->magic, BDAT_MAGIC, BDAT_MAGIC_LEN);
+     hdr->version = BDAT_VERSION;
+     hdr->order   = BDAT_ORDER;
+     hdr->hdr_len = (unsigned int)BDAT_HDR_LEN(ncols);
+     hdr->rec_len = (unsigned int)BDAT_REC_LEN(ncols);
+     hdr->ncols   = (unsigned int)ncols;
+     hdr->gmtoff  = (int)gmtoff;
+     hdr->vmajor  = vmajor;
+     hdr->vminor  = vminor;
+     bdat_strcpy(hdr->zone, sizeof(hdr->zone), zone);
+}
+
+
+void
+bdat_col_init(bdat_col_t *col, const char *romid, const char *format,
+	      const char *units, const char *dtype, const char *desc)
+{
+     bdat_strcpy(col->romid,  sizeof(col->romid),  romid);
+     bdat_strcpy(col->format, sizeof(col->format), format);
+     bdat_strcpy(col->units,  sizeof(col->units),  units);
+     bdat_strcpy(col->dtype,  sizeof(col->dtype),  dtype);
+     bdat_strcpy(col->desc,   sizeof(col->desc),   desc);
+}
+
+
+void
+bdat_rec_init(char *rec, size_t ncols, time_t t, const float *vals)
+{
+     long long tval;
+     float *fptr;
+     size_t i;
+
+     tval = (long long)t;
+     memcpy(rec, &tval, 8);
+     fptr = (float *)(rec + 8);
+     if (vals)
+	  memcpy(fptr, vals, ncols * sizeof(float));
+     else
+	  for (i = 0; i < ncols; i++)
+	       fptr[i] = bdat_nan.f;
+
+     /*
+      *  Zero any padding so that the file's contents are reproducible
+      */
+     memset(rec + 8 + 4 * ncols, 0, BDAT_REC_LEN(ncols) - 8 - 4 * ncols);
+}
+
+
+void
+bdat_rec_set(char *rec, size_t col, float val)
+{
+     ((float *)(rec + 8))[col] = val;
+}
+
+
+int
+bdat_seg_next(const char *base, size_t len, bdat_seg_t *seg)
+{
+     const bdat_hdr_t *hdr;
+     const char *end, *ptr;
+     size_t avail;
+
+     if (!seg || (!base && len))
+	  return(ERR_BADARGS);
+
+     ptr = seg->hdr ? seg->end : base;
+     end = base + len;
+     avail = (size_t)(end - ptr);
+     if (!avail)
+	  return(ERR_EOM);
+     else if (seg->hdr)
+     {
+	  /*
+	   *  Whatever follows the last whole record of a segment is either
+	   *  the next header or what remains of an interrupted write
+	   */
+	  if (avail < BDAT_MAGIC_LEN || memcmp(ptr, BDAT_MAGIC, BDAT_MAGIC_LEN))
+	       return(ERR_EOM);
+     }
+     else if (memcmp(ptr, BDAT_MAGIC,
+		     (avail < BDAT_MAGIC_LEN) ? avail : BDAT_MAGIC_LEN))
+	  return(ERR_NO);
+     if (avail < sizeof(bdat_hdr_t))
+	  return(ERR_EOM);
+
+     hdr = (const bdat_hdr_t *)ptr;
+     if (hdr->order != BDAT_ORDER || hdr->version != BDAT_VERSION ||
+	 hdr->hdr_len != BDAT_HDR_LEN(hdr->ncols) ||
+	 hdr->rec_len != BDAT_REC_LEN(hdr->ncols))
+	  return(ERR_NO);
+     if (avail < hdr->hdr_len)
+	  return(ERR_EOM);
+
+     seg->hdr   = hdr;
+     seg->cols  = (const bdat_col_t *)(ptr + sizeof(bdat_hdr_t));
+     seg->recs  = ptr + hdr->hdr_len;
+     seg->nrecs = 0;
+
+     /*
+      *  The segment runs until the next header or the last whole record
+      */
+     for (ptr = seg->recs; (size_t)(end - ptr) >= hdr->rec_len;
+	  ptr += hdr->rec_len)
+     {
+	  if (!memcmp(ptr, BDAT_MAGIC, BDAT_MAGIC_LEN))
+	       break;
+	  seg->nrecs++;
+     }
+     seg->end = ptr;
+
+     return(ERR_OK);
+}
+
+
+size_t
+bdat_len(const char *base, size_t len)
+{
+     bdat_seg_t seg;
+     int istat;
+
+     memset(&seg, 0, sizeof(bdat_seg_t));
+     while ((istat = bdat_seg_next(base, len, &seg)) == ERR_OK)
+	  ;
+     if (istat != ERR_EOM)
+	  return((size_t)-1);
+
+     return(seg.hdr ? (size_t)(seg.end - base) : 0);
+}
+
+
+/*
+ *  Ensure that *buf, currently of *max bytes, has room for need bytes
+ */
+static int
+bdat_grow(char **buf, size_t *max, size_t need)
+{
+     size_t newmax;
+     char *tmp;
+
+     if (need <= *max)
+	  return(ERR_OK);
+     newmax = *max ? *max : 4096;
+     while (newmax < need)
+	  newmax *= 2;
+     tmp = (char *)realloc(*buf, newmax);
+     if (!tmp)
+	  return(ERR_NOMEM);
+     *buf = tmp;
+     *max = newmax;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Parse a column description,
+ *
+ *    #<colnum>:<ROM id>:<fmt>:<units>:<type>:<description>
+ *
+ *  into cols[colnum-2], growing cols as needed.  Other comments, along
+ *  with the description of column 1, the time stamp, are ignored.
+ */
+static int
+bdat_text_column(bdat_col_t **cols, size_t *ncols, size_t *colmax,
+		 const char *line, const char *eol)
+{
+     const char *fld[5];
+     size_t colnum, i, len, max;
+     char buf[5][256];
+     bdat_col_t *tmp;
+
+     colnum = 0;
+     for (line++; line < eol && '0' <= *line && *line <= '9'; line++)
+	  colnum = colnum * 10 + (size_t)(*line - '0');
+     if (line >= eol || *line != ':' || colnum < 2)
+	  return(ERR_OK);
+
+     /*
+      *  Split off the first four fields; the description is the rest
+      */
+     fld[0] = line + 1;
+     for (i = 1; i < 5; i++)
+     {
+	  fld[i] = (const char *)memchr(fld[i-1], ':',
+					(size_t)(eol - fld[i-1]));
+	  if (!fld[i])
+	       return(ERR_OK);
+	  fld[i]++;
+     }
+     for (i = 0; i < 5; i++)
+     {
+	  len = (size_t)(((i < 4) ? fld[i+1] - 1 : eol) - fld[i]);
+	  if (len >= sizeof(buf[i]))
+	       len = sizeof(buf[i]) - 1;
+	  memcpy(buf[i], fld[i], len);
+	  buf[i][len] = '\0';
+     }
+     if (!buf[0][0])
+	  return(ERR_OK);
+
+     if (colnum - 1 > *colmax)
+     {
+	  max = 32 * ((colnum + 31) / 32);
+	  tmp = (bdat_col_t *)realloc(*cols, max * sizeof(bdat_col_t));
+	  if (!tmp)
+	       return(ERR_NOMEM);
+	  memset(tmp + *colmax, 0, (max - *colmax) * sizeof(bdat_col_t));
+	  *cols   = tmp;
+	  *colmax = max;
+     }
+     bdat_col_init(&(*cols)[colnum-2], buf[0], buf[1], buf[2], buf[3],
+		   buf[4]);
+     if (colnum - 1 > *ncols)
+	  *ncols = colnum - 1;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Parse the record from ptr to eol and append it to *buf.  The
+ *  character at eol, if any, must not continue a number.
+ */
+static int
+bdat_text_record(char **buf, size_t *max, size_t *n, size_t ncols,
+		 const char *ptr, const char *eol)
+{
+     char *rec, *vend;
+     size_t c;
+     long tval;
+     double dval;
+
+     tval = strtol(ptr, &vend, 10);
+     if (vend == ptr || tval == 0)
+	  return(ERR_OK);
+
+     if (bdat_grow(buf, max, *n + BDAT_REC_LEN(ncols)))
+	  return(ERR_NOMEM);
+     rec = *buf + *n;
+     bdat_rec_init(rec, ncols, (time_t)tval, NULL);
+     for (c = 0; c < ncols; c++)
+     {
+	  ptr = vend;
+	  while (ptr < eol && (*ptr == ' ' || *ptr == '\t'))
+	       ptr++;
+	  if (ptr >= eol)
+	       break;
+	  if (*ptr == DEV_MISSING_VALUE)
+	  {
+	       vend = (char *)ptr + 1;
+	       continue;
+	  }
+
+	  /*
+	   *  Junk ends the record; the remaining values are missing
+	   */
+	  dval = strtod(ptr, &vend);
+	  if (vend == ptr || vend > eol)
+	       break;
+	  bdat_rec_set(rec, c, (float)dval);
+     }
+     *n += BDAT_REC_LEN(ncols);
+
+     return(ERR_OK);
+}
+
+
+int
+bdat_from_text(const char *text, size_t len, char **buf, size_t *buflen,
+	       size_t *lineno)
+{
+     const char *end, *eol, *ptr;
+     char *bdat, *last, line[128], zbuf[64];
+     size_t colmax, llen, max, n, ncols, nline;
+     int comments, hours, istat, mins;
+     long gmtoff;
+     unsigned int vmajor, vminor;
+     bdat_col_t *cols;
+     char sign;
+
+     if (lineno)
+	  *lineno = 0;
+     if (!buf || !buflen || (!text && len))
+	  return(ERR_BADARGS);
+     *buf    = NULL;
+     *buflen = 0;
+
+     bdat     = NULL;
+     last     = NULL;
+     max      = 0;
+     n        = 0;
+     cols     = NULL;
+     colmax   = 0;
+     ncols    = 0;
+     comments = 0;
+     gmtoff   = 0;
+     vmajor   = 0;
+     vminor   = 0;
+     zbuf[0]  = '\0';
+     nline    = 0;
+     istat    = ERR_OK;
+
+     end = text + len;
+     for (ptr = text; ptr < end; ptr = eol + 1)
+     {
+	  if (!(eol = (const char *)memchr(ptr, '\n', (size_t)(end - ptr))))
+	       eol = end;
+	  nline++;
+	  while (ptr < eol && (*ptr == ' ' || *ptr == '\t'))
+	       ptr++;
+	  if (ptr >= eol)
+	       continue;
+
+	  if (*ptr == '#')
+	  {
+	       if (!comments)
+	       {
+		    /*
+		     *  Start of a new set of column descriptions
+		     */
+		    if (cols)
+			 memset(cols, 0, colmax * sizeof(bdat_col_t));
+		    ncols    = 0;
+		    comments = 1;
+	       }
+
+	       /*
+		*  The version and time zone lines are short: copy them so
+		*  as to NUL terminate them for sscanf()
+		*/
+	       llen = (size_t)(eol - ptr);
+	       if (llen && ptr[llen-1] == '\r')
+		    llen--;
+	       if (llen < sizeof(line))
+	       {
+		    memcpy(line, ptr, llen);
+		    line[llen] = '\0';
+		    if (2 == sscanf(line, "#ha7netd v%u.%u", &vmajor, &vminor))
+			 continue;
+		    if (4 == sscanf(line, "#All time units are seconds since "
+				    "00:00 1 Jan 1970 %c%2d%2d (%63[^)])",
+				    &sign, &hours, &mins, zbuf))
+		    {
+			 gmtoff = 3600L * hours + 60L * mins;
+			 if (sign == '-')
+			      gmtoff = -gmtoff;
+			 continue;
+		    }
+	       }
+	       istat = bdat_text_column(&cols, &ncols, &colmax, ptr,
+					ptr + llen);
+	       if (istat != ERR_OK)
+		    goto done;
+	       continue;
+	  }
+
+	  if (comments)
+	  {
+	       /*
+		*  The first record following a run of column descriptions
+		*  starts a new segment
+		*/
+	       comments = 0;
+	       if (!ncols)
+	       {
+		    istat = ERR_NO;
+		    goto done;
+	       }
+	       if (bdat_grow(&bdat, &max, n + BDAT_HDR_LEN(ncols)))
+		    goto nomem;
+	       bdat_hdr_init((bdat_hdr_t *)(bdat + n), ncols, gmtoff, zbuf,
+			     vmajor, vminor);
+	       memcpy(bdat + n + sizeof(bdat_hdr_t), cols,
+		      ncols * sizeof(bdat_col_t));
+	       n += BDAT_HDR_LEN(ncols);
+	  }
+	  else if (!n)
+	  {
+	       istat = ERR_NO;
+	       goto done;
+	  }
+
+	  /*
+	   *  A final line lacking a new line is copied so that strtod()
+	   *  cannot read past the end of the text
+	   */
+	  if (eol < end)
+	       istat = bdat_text_record(&bdat, &max, &n, ncols, ptr, eol);
+	  else
+	  {
+	       llen = (size_t)(eol - ptr);
+	       if (!(last = (char *)malloc(llen + 1)))
+		    goto nomem;
+	       memcpy(last, ptr, llen);
+	       last[llen] = '\0';
+	       istat = bdat_text_record(&bdat, &max, &n, ncols, last,
+					last + llen);
+	  }
+	  if (istat != ERR_OK)
+	       goto done;
+     }
+
+     if (!n)
+	  istat = ERR_EOM;
+     goto done;
+
+nomem:
+     istat = ERR_NOMEM;
+
+done:
+     if (cols)
+	  free(cols);
+     if (last)
+	  free(last);
+     if (istat == ERR_OK)
+     {
+	  *buf    = bdat;
+	  *buflen = n;
+     }
+     else
+     {
+	  if (bdat)
+	       free(bdat);
+	  if (lineno)
+	       *lineno = nline;
+     }
+
+     return(istat);
+}
@@ -0,0 +1,175 @@
+/*
+ *  Copyright (c) 2005, Daniel C. Newman <dan.newman@mtbaldy.us>
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  
+ *   + Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  
+ *   + Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *  
+ *   + Neither the name of mtbaldy.us nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ *  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ *  OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+/*
+ *  bdat.h
+ *
+ *  Binary day files.  A binary day file holds the same records as a
+ *  text data file, <prefix>-yyyymmdd.dat, but as fixed width records
+ *  which may be appended to and mapped into memory and then addressed
+ *  directly.  The file is a sequence of segments, each describing its
+ *  columns in a header followed by its records:
+ *
+ *     bdat_hdr_t                       ncols bdat_col_t
+ *     record 0: time, val[0], ..., val[ncols-1], padding
+ *     record 1: ...
+ *     ...
+ *
+ *  A record is a 64 bit time_t followed by a float for each column,
+ *  padded to a multiple of 8 bytes.  A missing value is stored as a
+ *  NaN.  A new segment is started each time the data logger starts
+ *  anew, just as a new run of comments in a text data file: a segment
+ *  ends where a header begins at a record boundary.  Values are in the
+ *  byte order of the host which wrote them; files from a host of the
+ *  other byte order are rejected.
+ */
+
+#if !defined(__BDAT_H__)
+
+#define __BDAT_H__
+
+#include <time.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define BDAT_MAGIC     "HA7BDAT\n"
+#define BDAT_MAGIC_LEN 8
+#define BDAT_VERSION   1
+#define BDAT_ORDER     0x01020304U
+
+typedef struct {
+     char          magic[BDAT_MAGIC_LEN]; /* BDAT_MAGIC                  */
+     unsigned int  version;     /* BDAT_VERSION                          */
+     unsigned int  order;       /* BDAT_ORDER in the writer's byte order */
+     unsigned int  hdr_len;     /* Bytes of header including the columns */
+     unsigned int  rec_len;     /* Bytes per record                      */
+     unsigned int  ncols;       /* Values per record                     */
+     int           gmtoff;      /* Writer's offset from UTC in seconds   */
+     unsigned int  vmajor;      /* Writer's major version number         */
+     unsigned int  vminor;      /* Writer's minor version number         */
+     char          zone[24];    /* Writer's time zone name               */
+} bdat_hdr_t;
+
+/*
+ *  Column description; the same fields as a column comment in a text
+ *  data file.  Each string is NUL terminated.
+ */
+typedef struct {
+     char  romid[24];           /* Device's ROM id                       */
+     char  format[24];          /* printf() format for the values        */
+     char  units[16];           /* Units of measure                      */
+     char  dtype[16];           /* Type of measurement                   */
+     char  desc[176];           /* Description of the measurement        */
+} bdat_col_t;
+
+#define BDAT_HDR_LEN(ncols) \
+     (sizeof(bdat_hdr_t) + (size_t)(ncols) * sizeof(bdat_col_t))
+#define BDAT_REC_LEN(ncols) \
+     ((8 + 4 * (size_t)(ncols) + 7) & ~(size_t)7)
+
+/*
+ *  Initialize a segment header for ncols columns.  The column
+ *  descriptions, which immediately follow the header, are filled in
+ *  with bdat_col_init().
+ */
+void bdat_hdr_init(bdat_hdr_t *hdr, size_t ncols, long gmtoff,
+  const char *zone, unsigned int vmajor, unsigned int vminor);
+void bdat_col_init(bdat_col_t *col, const char *romid, const char *format,
+  const char *units, const char *dtype, const char *desc);
+
+/*
+ *  Store a record's time and values into rec, a buffer of at least
+ *  BDAT_REC_LEN(ncols) bytes.  A NULL vals stores ncols missing values
+ *  for the caller to then fill in with bdat_rec_set().
+ */
+void bdat_rec_init(char *rec, size_t ncols, time_t t, const float *vals);
+void bdat_rec_set(char *rec, size_t col, float val);
+
+#define BDAT_REC_TIME(rec)      ((time_t)*(const long long *)(rec))
+#define BDAT_REC_VAL(rec, col)  (((const float *)((rec) + 8))[col])
+#define BDAT_MISSING(val)       ((val) != (val))
+
+/*
+ *  A segment of a binary day file mapped into memory.  Record i is at
+ *  BDAT_REC(seg, i).
+ */
+typedef struct {
+     const bdat_hdr_t *hdr;     /* Segment header; NULL before the first */
+     const bdat_col_t *cols;    /* hdr->ncols column descriptions        */
+     const char       *recs;    /* First record                          */
+     size_t            nrecs;   /* Number of whole records               */
+     const char       *end;     /* End of the last whole record          */
+} bdat_seg_t;
+
+#define BDAT_REC(seg, i)  ((seg)->recs + (size_t)(i) * (seg)->hdr->rec_len)
+
+/*
+ *  Step through the segments of the binary day file of len bytes at
+ *  base, which must be aligned to 8 bytes as is any memory mapping.
+ *  Zero seg and then call bdat_seg_next() for each segment in turn.
+ *  Returns ERR_OK with seg describing the next segment, ERR_EOM when
+ *  there are no more segments, or ERR_NO when the file is not a binary
+ *  day file written by a host of this byte order.  A partial record or
+ *  header at the end of the file, as left by an interrupted write, is
+ *  ignored.
+ */
+int bdat_seg_next(const char *base, size_t len, bdat_seg_t *seg);
+
+/*
+ *  Returns the length of the binary day file of len bytes at base less
+ *  any partial record or header at its end, or (size_t)-1 when it is
+ *  not a binary day file written by a host of this byte order.
+ */
+size_t bdat_len(const char *base, size_t len);
+
+/*
+ *  Convert the text data file of len bytes at text into a binary day
+ *  file returned in *buf, a malloc()ed buffer of *buflen bytes which
+ *  the caller must free().  Returns ERR_OK on success, ERR_EOM when the
+ *  text holds no column descriptions, ERR_NOMEM, or ERR_NO when a
+ *  record precedes the first column descriptions or a run of comments
+ *  describes no columns; *lineno is then set to the offending line.
+ *  Junk within a record ends that record, its remaining values being
+ *  missing.
+ */
+int bdat_from_text(const char *text, size_t len, char **buf,
+  size_t *buflen, size_t *lineno);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -35,6 +35,8 @@
 
 #define __CRC_H__
 
+#include <sys/types.h>
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -136,6 +138,21 @@ int crc16(int crc, int ch);
 
 unsigned char crc8(unsigned char crc, unsigned char ch);
 
+/*
+ *  int crc16_buf(int crc, const unsigned char *data, size_t len)
+ *  unsigned char crc8_buf(unsigned char crc, const unsigned char *data,
+ *                         size_t len)
+ *
+ *    Compute the CRC-16 [DOW CRC] of the len bytes pointed at by data
+ *    using crc as the seed.  The result is identical to that of calling
+ *    crc16() [crc8()] once for each byte, but is computed 8 bytes at a
+ *    time.  The same properties described above apply.
+ */
+
+int crc16_buf(int crc, const unsigned char *data, size_t len);
+unsigned char crc8_buf(unsigned char crc, const unsigned char *data,
+  size_t len);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -46,11 +46,17 @@
  *  will produce the same result as
  *
  *     # crc 8 0AED9c
+ *
+ *  With -b, the program instead measures the throughput of the hex
+ *  decoding and CRC computations used on data read from the 1-Wire
+ *  bus master.  And with -f, that of fmt_float() against snprintf()
+ *  when formatting measurements for the data and XML files.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "crc.h"
 #include "utils.h"
 #include "weather.h"
@@ -80,12 +86,201 @@ usage(FILE *fp, const char *prog)
 
      fprintf(fp,
 "Usage: %s [-v] [-h] [-?] 16|8 data [data [...]]\n"
+"       %s -b [bytes]\n"
+"       %s -f [values]\n"
 "     16 - Perform a CRC-16 computation\n"
 "      8 - Perform a DOW CRC computation (e.g, CRC-8)\n"
 "   data - Hex encoded data to compute the CRC of\n"
+"     -b - Benchmark hex decoding and CRCs of blocks of the given size\n"
+"          (default \"-b 4096\")\n"
+"     -f - Benchmark formatting of the given number of measurements\n"
+"          with fmt_float() and snprintf() (default \"-f 1000000\")\n"
 " -h, -? - This usage message\n"
 "     -v - Write version information and then exit\n",
-	     bn ? bn : prog);
+	     bn ? bn : prog, bn ? bn : prog, bn ? bn : prog);
+}
+
+
+/*
+ *  Report the throughput achieved over blocks of nbytes bytes by
+ *
+ *    1. each Hex2Byte() implementation which the CPU supports, and
+ *    2. the byte at a time and buffer CRC routines.
+ */
+static int
+benchmark(size_t nbytes)
+{
+     char *hex;
+     unsigned char *data;
+     clock_t t0, t1;
+     double secs;
+     int impl;
+     size_t i, iters, n;
+
+     if (!nbytes)
+	  nbytes = 4096;
+     hex  = (char *)malloc(2 * nbytes);
+     data = (unsigned char *)malloc(nbytes);
+     if (!hex || !data)
+     {
+	  fprintf(stderr, "Insufficient virtual memory\n");
+	  if (hex)
+	       free(hex);
+	  if (data)
+	       free(data);
+	  return(1);
+     }
+     for (i = 0; i < 2 * nbytes; i++)
+	  hex[i] = "0123456789abcdefABCDEF"[rand() % 22];
+
+     /*
+      *  Decode about 256 Mb of output per implementation
+      */
+     iters = (256 * 1024 * 1024) / nbytes;
+     if (!iters)
+	  iters = 1;
+
+     fprintf(stdout, "Hex decode, %lu byte blocks\n", (unsigned long)nbytes);
+     for (impl = HEX2BYTE_SCALAR; impl <= HEX2BYTE_AVX2; impl++)
+     {
+	  if (Hex2ByteSelect(impl) != impl)
+	  {
+	       fprintf(stdout, "  %-8s not supported\n", Hex2ByteName(impl));
+	       continue;
+	  }
+	  t0 = clock();
+	  for (n = 0; n < iters; n++)
+	  {
+	       Hex2Byte(data, hex, 2 * nbytes);
+	       hex[n % (2 * nbytes)] = "0123456789abcdef"[data[0] & 0x0f];
+	  }
+	  t1 = clock();
+	  secs = (double)(t1 - t0) / (double)CLOCKS_PER_SEC;
+	  fprintf(stdout, "  %-8s %10.1f Mb/s\n", Hex2ByteName(impl),
+		  secs > 0.0 ?
+		  ((double)iters * (double)nbytes) / (secs * 1024.0 * 1024.0) :
+		  0.0);
+     }
+     Hex2ByteSelect(HEX2BYTE_AUTO);
+
+     fprintf(stdout, "CRC, %lu byte blocks\n", (unsigned long)nbytes);
+     for (impl = 0; impl < 4; impl++)
+     {
+	  int crc = 0;
+
+	  t0 = clock();
+	  for (n = 0; n < iters; n++)
+	  {
+	       switch (impl)
+	       {
+	       case 0 :
+		    for (i = 0; i < nbytes; i++)
+			 crc = crc8((unsigned char)crc, data[i]);
+		    break;
+
+	       case 1 :
+		    crc = crc8_buf((unsigned char)crc, data, nbytes);
+		    break;
+
+	       case 2 :
+		    for (i = 0; i < nbytes; i++)
+			 crc = crc16(crc, data[i]);
+		    break;
+
+	       case 3 :
+		    crc = crc16_buf(crc, data, nbytes);
+		    break;
+	       }
+	  }
+	  t1 = clock();
+	  secs = (double)(t1 - t0) / (double)CLOCKS_PER_SEC;
+	  fprintf(stdout, "  %-10s %8.1f Mb/s (%04x)\n",
+		  (impl == 0) ? "crc8" : (impl == 1) ? "crc8_buf" :
+		  (impl == 2) ? "crc16" : "crc16_buf",
+		  secs > 0.0 ?
+		  ((double)iters * (double)nbytes) / (secs * 1024.0 * 1024.0) :
+		  0.0, crc & 0xffff);
+     }
+
+     free(hex);
+     free(data);
+     return(0);
+}
+
+
+/*
+ *  Report the rate at which nvals measurements are formatted with each
+ *  of the device drivers' formats by
+ *
+ *    1. snprintf() with the format, as the data and XML files once were,
+ *       and
+ *    2. fmt_float() with the compiled format.
+ *
+ *  Any difference in their output is also reported.
+ */
+static int
+benchmark_fmt(size_t nvals)
+{
+     static const char *fmts[] = {"%0.1f", "%0.2f", "%0.f", "%f"};
+     char buf1[FMT_FLOAT_LEN], buf2[FMT_FLOAT_LEN];
+     float *vals;
+     fmt_float_t ff;
+     clock_t t0, t1;
+     double rate[2], secs;
+     int impl;
+     size_t bad, i, k;
+
+     if (!nvals)
+	  nvals = 1000000;
+     vals = (float *)malloc(nvals * sizeof(float));
+     if (!vals)
+     {
+	  fprintf(stderr, "Insufficient virtual memory\n");
+	  return(1);
+     }
+
+     /*
+      *  Plausible readings: temperatures, humidities, and pressures
+      */
+     for (i = 0; i < nvals; i++)
+	  vals[i] = (float)(rand() % 115000 - 5000) / 100.0f;
+
+     fprintf(stdout, "Formatting, %lu values\n", (unsigned long)nvals);
+     for (k = 0; k < sizeof(fmts) / sizeof(fmts[0]); k++)
+     {
+	  fmt_float_compile(&ff, fmts[k]);
+	  for (impl = 0; impl < 2; impl++)
+	  {
+	       t0 = clock();
+	       if (impl)
+		    for (i = 0; i < nvals; i++)
+			 fmt_float(buf1, sizeof(buf1), &ff, vals[i]);
+	       else
+		    for (i = 0; i < nvals; i++)
+			 snprintf(buf1, sizeof(buf1), fmts[k], vals[i]);
+	       t1 = clock();
+	       secs = (double)(t1 - t0) / (double)CLOCKS_PER_SEC;
+	       rate[impl] = (secs > 0.0) ?
+		    (double)nvals / (secs * 1000000.0) : 0.0;
+	  }
+
+	  bad = 0;
+	  for (i = 0; i < nvals; i++)
+	  {
+	       fmt_float(buf1, sizeof(buf1), &ff, vals[i]);
+	       snprintf(buf2, sizeof(buf2), fmts[k], vals[i]);
+	       if (strcmp(buf1, buf2))
+		    bad++;
+	  }
+
+	  fprintf(stdout, "  %-6s snprintf %7.2f M/s  fmt_float %7.2f M/s  "
+		  "%5.1fx  %lu differ\n", fmts[k], rate[0], rate[1],
+		  (rate[0] > 0.0) ? rate[1] / rate[0] : 0.0,
+		  (unsigned long)bad);
+     }
+
+     free(vals);
+     return(0);
 }
 
 
@@ -125,6 +320,16 @@ int main(int argc, const char *argv[])
 	       case 'v' :
 		    version(stdout, argv[0]);
 		    return(0);
+
+	       case 'b' :
+		    return(benchmark(((i + 1) < argc) ?
+				     (size_t)strtoul(argv[i + 1], NULL, 0) :
+				     0));
+
+	       case 'f' :
+		    return(benchmark_fmt(((i + 1) < argc) ?
+					 (size_t)strtoul(argv[i + 1], NULL, 0) :
+					 0));
 	       }
 	  }
 	  else if (algorithm == 0)
@@ -199,14 +404,12 @@ int main(int argc, const char *argv[])
 
      if (algorithm == 16)
      {
-	  for (i = 0; i < totlen; i++)
-	       crc = crc16(crc, data[i]);
+	  crc = crc16_buf(crc, data, totlen);
 	  fprintf(stdout, "%04x\n", (0xffff & crc));
      }
      else
      {
-	  for (i = 0; i < totlen; i++)
-	       crc = crc8(crc, data[i]);
+	  crc = crc8_buf((unsigned char)crc, data, totlen);
 	  fprintf(stdout, "%02x\n", (0xff & crc));
      }
 
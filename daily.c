@@ -42,6 +42,7 @@
 #include "debug.h"
 #include "os.h"
 #include "device.h"
+#include "archive.h"
 #include "daily.h"
 
 static time_t midnight(time_t now);
@@ -57,10 +58,17 @@ typedef struct daily_list_s {
      device_t            *devices;
 } daily_list_t;
 
+typedef struct daily_arch_s {
+     struct daily_arch_s *next;
+     unsigned int         keep;       /* Days of day files to keep        */
+     char                 prefix[1];  /* Data file prefix; NUL terminated */
+} daily_arch_t;
+
 static os_shutdown_t      *shutdown_info = NULL;
 static os_pthread_mutex_t  mutex;
 static int                 initialized = 0;
 static daily_list_t       *daily_list = NULL;
+static daily_arch_t       *arch_list = NULL;
 
 static debug_proc_t  our_debug_ap;
 static debug_proc_t *debug_proc = our_debug_ap;
@@ -159,6 +167,7 @@ void
 daily_lib_done(void)
 {
      daily_list_t *tmp;
+     daily_arch_t *atmp;
 
      if (!initialized)
 	  return;
@@ -170,6 +179,12 @@ daily_lib_done(void)
 	  daily_list = daily_list->next;
 	  free(tmp);
      }
+     while (arch_list)
+     {
+	  atmp = arch_list;
+	  arch_list = arch_list->next;
+	  free(atmp);
+     }
      initialized = 0;
      os_pthread_mutex_unlock(&mutex);
      os_pthread_mutex_destroy(&mutex);
@@ -222,6 +237,34 @@ daily_add_devices(device_t *devices)
 }
 
 
+int
+daily_add_archive(const char *prefix, unsigned int keep)
+{
+     daily_arch_t *tmp;
+     size_t len;
+
+     if (!prefix)
+	  return(ERR_BADARGS);
+
+     /*
+      *  The caller's prefix may not outlive us, so keep a copy
+      */
+     len = strlen(prefix);
+     tmp = (daily_arch_t *)malloc(sizeof(daily_arch_t) + len);
+     if (!tmp)
+	  return(ERR_NOMEM);
+     tmp->keep = keep;
+     memcpy(tmp->prefix, prefix, len + 1);
+
+     os_pthread_mutex_lock(&mutex);
+     tmp->next = arch_list;
+     arch_list = tmp;
+     os_pthread_mutex_unlock(&mutex);
+
+     return(ERR_OK);
+}
+
+
 static time_t
 midnight(time_t now)
 {
@@ -256,9 +299,11 @@ sleep_until_midnight(os_shutdown_t *sinfo)
 static void
 daily_grind(void *ctx)
 {
-     int istat;
+     int ires, istat;
      os_shutdown_t *sinfo = (os_shutdown_t *)ctx;
      daily_list_t *tmp;
+     daily_arch_t *alist, *atmp, *acopy;
+     size_t len;
 
      if (!sinfo)
 	  sinfo = shutdown_info;
@@ -289,6 +334,45 @@ daily_grind(void *ctx)
 	  }
 	  os_pthread_mutex_unlock(&mutex);
 
+	  /*
+	   *  Now that yesterday is done, compress the day files which
+	   *  have become old enough into their archives.  That can take
+	   *  a while, so work from a copy of the list rather than hold
+	   *  the mutex throughout.
+	   */
+	  alist = NULL;
+	  os_pthread_mutex_lock(&mutex);
+	  for (atmp = arch_list; atmp; atmp = atmp->next)
+	  {
+	       len = strlen(atmp->prefix);
+	       acopy = (daily_arch_t *)malloc(sizeof(daily_arch_t) + len);
+	       if (!acopy)
+	       {
+		    debug("midnight_thread(%d): Insufficient virtual memory; "
+			  "not archiving the data files \"%s-yyyymmdd.dat\"",
+			  __LINE__, atmp->prefix);
+		    continue;
+	       }
+	       acopy->keep = atmp->keep;
+	       memcpy(acopy->prefix, atmp->prefix, len + 1);
+	       acopy->next = alist;
+	       alist = acopy;
+	  }
+	  os_pthread_mutex_unlock(&mutex);
+
+	  while (alist)
+	  {
+	       atmp  = alist;
+	       alist = alist->next;
+	       ires = arch_days(atmp->prefix, atmp->keep);
+	       if (ires != ERR_OK)
+		    debug("midnight_thread(%d): Unable to archive the data "
+			  "files \"%s-yyyymmdd.dat\"; arch_days() returned "
+			  "%d; %s", __LINE__, atmp->prefix, ires,
+			  err_strerror(ires));
+	       free(atmp);
+	  }
+
 	  /*
 	   *  Sleep for a few secnds: by 21 March 2010, systems had become
 	   *  fast enough that the above easily finishes in well under a
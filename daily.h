@@ -79,6 +79,14 @@ int daily_start(void);
 int daily_add_devices(device_t *devices);
 
 
+/*
+ *  Have the nightly thread compress the day files <prefix>-yyyymmdd.dat
+ *  which are at least keep days old into the archive <prefix>.gar.  See
+ *  arch_days() in archive.h.
+ */
+int daily_add_archive(const char *prefix, unsigned int keep);
+
+
 /*
  *  Asynchronously begin a graceful shutdown of the nightly thread, and
  *  then subsequently call daily_shutdown_finish() to wait for the thread
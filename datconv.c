@@ -0,0 +1,501 @@
+/*
+ *  Copyright (c) 2005, Daniel C. Newman <dan.newman@mtbaldy.us>
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  
+ *   + Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  
+ *   + Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *  
+ *   + Neither the name of mtbaldy.us nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ *  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ *  OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+/*
+ *  This program converts a day's data file between the text format,
+ *  <host>-yyyymmdd.dat, and the binary format, <host>-yyyymmdd.bdat,
+ *  described in bdat.h.  For example,
+ *
+ *     # datconv 192.168.0.250-20100930.dat
+ *
+ *  writes 192.168.0.250-20100930.bdat while
+ *
+ *     # datconv 192.168.0.250-20100930.bdat
+ *
+ *  writes the text file back out.  Each run of column descriptions in
+ *  a text file becomes a segment of the binary file, and vice versa.
+ *
+ *  Data may also be extracted from the compressed archive of past days
+ *  described in archive.h,
+ *
+ *     # datconv -r 20100901-20100930 192.168.0.250.gar sept.dat
+ *
+ *  writes the records for September 2010 to sept.dat.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "err.h"
+#include "os.h"
+#include "bdat.h"
+#include "archive.h"
+#include "weather.h"
+
+static const char *prog = "datconv";
+
+static void version(FILE *fp);
+static void usage(FILE *fp);
+
+
+static void
+version(FILE *fp)
+{
+     fprintf(fp,
+"%s version %d.%d.%d, built " __DATE__ " " __TIME__ "\n"
+"%s\n",
+	     prog, WEATHER_VERSION_MAJOR, WEATHER_VERSION_MINOR,
+	     WEATHER_VERSION_REVISION, WEATHER_COPYRIGHT);
+}
+
+
+static void
+usage(FILE *fp)
+{
+     fprintf(fp,
+"Usage: %s [-b | -t] [-r from[-to]] [-h] [-v] input-file [output-file]\n"
+" input-file   - Data file to convert or archive, <host>.gar, to extract\n"
+"                data from\n"
+" output-file  - File to write (default is input-file with its suffix\n"
+"                changed from \".dat\" to \".bdat\" or vice versa; data\n"
+"                extracted from an archive defaults to standard output)\n"
+" -b           - Write a binary data file (default unless input-file ends\n"
+"                with \".bdat\" or \".gar\")\n"
+" -t           - Write a text data file (default when input-file ends\n"
+"                with \".bdat\" or \".gar\")\n"
+" -r from-to   - Extract the days from through to, each given as yyyymmdd,\n"
+"                from the archive (default is all days; to defaults to\n"
+"                from)\n"
+" -h, -?       - This usage message\n"
+" -v           - Write version information and then exit\n",
+	     prog);
+}
+
+
+/*
+ *  Write a binary day file as a text data file
+ */
+static int
+write_text(FILE *fp, const char *base, size_t len, const char *from)
+{
+     const char *fmt, *rec;
+     size_t c, r;
+     int istat;
+     fmt_float_t *ff;
+     bdat_seg_t seg;
+     const bdat_hdr_t *hdr;
+     char buf[FMT_FLOAT_LEN];
+     float fval;
+
+     ff = NULL;
+     memset(&seg, 0, sizeof(bdat_seg_t));
+     while ((istat = bdat_seg_next(base, len, &seg)) == ERR_OK)
+     {
+	  hdr = seg.hdr;
+	  free(ff);
+	  ff = (fmt_float_t *)malloc((hdr->ncols + 1) * sizeof(fmt_float_t));
+	  if (!ff)
+	       return(ERR_NOMEM);
+
+	  /*
+	   *  Column descriptions, as per weather_data_write()
+	   */
+	  fprintf(fp,
+"#ha7netd v%u.%u (converted from %s)\n"
+"#All time units are seconds since 00:00 1 Jan 1970 %c%02d%02d (%.*s)\n"
+"#<column>:<ROM id>:<format>:<units>:<type>:<description>\n"
+"#1::%%u:s:time_t:Seconds since 1 Jan 1970 00:00\n",
+		  hdr->vmajor, hdr->vminor, from,
+		  (hdr->gmtoff >= 0) ? '+' : '-',
+		  abs(hdr->gmtoff / 3600), abs(hdr->gmtoff / 60) % 60,
+		  (int)sizeof(hdr->zone) - 1, hdr->zone);
+	  for (c = 0; c < hdr->ncols; c++)
+	  {
+	       const bdat_col_t *col = &seg.cols[c];
+
+	       fmt = memchr(col->format, '\0', sizeof(col->format)) ?
+		    col->format : "%f";
+	       fmt_float_compile(&ff[c], fmt);
+	       fprintf(fp, "#%u:%.*s:%s:%.*s:%.*s:%.*s\n",
+		       (unsigned int)c + 2,
+		       (int)sizeof(col->romid) - 1, col->romid, fmt,
+		       (int)sizeof(col->units) - 1, col->units,
+		       (int)sizeof(col->dtype) - 1, col->dtype,
+		       (int)sizeof(col->desc) - 1, col->desc);
+	  }
+
+	  /*
+	   *  And the records
+	   */
+	  for (r = 0; r < seg.nrecs; r++)
+	  {
+	       rec = BDAT_REC(&seg, r);
+	       fprintf(fp, "%ld", (long)BDAT_REC_TIME(rec));
+	       for (c = 0; c < hdr->ncols; c++)
+	       {
+		    fval = BDAT_REC_VAL(rec, c);
+		    if (BDAT_MISSING(fval))
+			 fprintf(fp, " %c", DEV_MISSING_VALUE);
+		    else if (fmt_float(buf, sizeof(buf), &ff[c], fval) >= 0)
+			 fprintf(fp, " %s", buf);
+	       }
+	       fputc('\n', fp);
+	  }
+     }
+     if (ff)
+	  free(ff);
+
+     return((istat == ERR_EOM) ? ERR_OK : istat);
+}
+
+
+/*
+ *  Write the len bytes at base, a binary day file, to outfile as either
+ *  a binary or a text data file.  An outfile of "-" is standard output.
+ */
+static int
+write_file(const char *outfile, const char *base, size_t len, int to_text,
+	   const char *from)
+{
+     FILE *fp;
+     int istat, to_stdout, werr;
+
+     to_stdout = !strcmp(outfile, "-");
+     fp = to_stdout ? stdout : fopen(outfile, to_text ? "w" : "wb");
+     if (!fp)
+     {
+	  fprintf(stderr, "%s: Unable to open the file \"%s\"; errno=%d; "
+		  "%s\n", prog, outfile, errno, strerror(errno));
+	  return(1);
+     }
+
+     /*
+      *  A failed fwrite() is caught by ferror()
+      */
+     istat = ERR_OK;
+     if (to_text)
+	  istat = write_text(fp, base, len, from);
+     else if (len)
+	  fwrite(base, len, 1, fp);
+     werr = ferror(fp);
+     werr |= to_stdout ? fflush(fp) : fclose(fp);
+
+     if (istat == ERR_NOMEM)
+	  fprintf(stderr, "%s: Insufficient virtual memory\n", prog);
+     else if (istat != ERR_OK)
+	  fprintf(stderr, "%s: The input is not a binary data file for "
+		  "this host\n", prog);
+     else if (werr)
+	  fprintf(stderr, "%s: Error writing the file \"%s\"; errno=%d; %s\n",
+		  prog, outfile, errno, strerror(errno));
+     else
+	  return(0);
+
+     if (!to_stdout)
+	  remove(outfile);
+     return(1);
+}
+
+
+static int
+convert(const char *infile, const char *outfile, int to_text)
+{
+     const char *base;
+     char *bdat;
+     size_t blen, len, lineno;
+     int istat;
+
+     if (os_mmap(infile, &base, &len))
+     {
+	  fprintf(stderr, "%s: Unable to read the file \"%s\"; errno=%d; %s\n",
+		  prog, infile, errno, strerror(errno));
+	  return(1);
+     }
+
+     if (to_text)
+     {
+	  istat = write_file(outfile, base, len, 1, "a binary data file");
+	  os_munmap(base, len);
+	  return(istat);
+     }
+
+     istat = bdat_from_text(base, len, &bdat, &blen, &lineno);
+     os_munmap(base, len);
+     if (istat == ERR_EOM)
+     {
+	  bdat = NULL;
+	  blen = 0;
+     }
+     else if (istat == ERR_NOMEM)
+     {
+	  fprintf(stderr, "%s: Insufficient virtual memory\n", prog);
+	  return(1);
+     }
+     else if (istat != ERR_OK)
+     {
+	  fprintf(stderr, "%s: The file \"%s\" has no column descriptions "
+		  "preceding line %u\n", prog, infile, (unsigned int)lineno);
+	  return(1);
+     }
+
+     istat = write_file(outfile, bdat, blen, 0, NULL);
+     if (bdat)
+	  free(bdat);
+
+     return(istat);
+}
+
+
+/*
+ *  Parse yyyymmdd into the time_t of 00:00 local time that day, plus
+ *  ndays days
+ */
+static int
+parse_day(const char *str, size_t len, int ndays, time_t *t)
+{
+     struct tm tm;
+     unsigned long day;
+     char *end;
+
+     if (len != 8)
+	  return(-1);
+     day = strtoul(str, &end, 10);
+     if (end != str + len)
+	  return(-1);
+
+     memset(&tm, 0, sizeof(struct tm));
+     tm.tm_year  = (int)(day / 10000) - 1900;
+     tm.tm_mon   = (int)(day / 100 % 100) - 1;
+     tm.tm_mday  = (int)(day % 100) + ndays;
+     tm.tm_isdst = -1;
+     *t = mktime(&tm);
+
+     return((*t == (time_t)-1) ? -1 : 0);
+}
+
+
+static int
+extract(const char *infile, const char *outfile, int to_text,
+	const char *range)
+{
+     char *bdat, *prefix;
+     const char *dash;
+     size_t blen, len;
+     time_t end, start;
+     int istat;
+
+     start = (time_t)0;
+     end   = (time_t)0x7fffffff;
+     if (range)
+     {
+	  dash = strchr(range, '-');
+	  len  = dash ? (size_t)(dash - range) : strlen(range);
+	  if (parse_day(range, len, 0, &start) ||
+	      parse_day(dash ? dash + 1 : range,
+			dash ? strlen(dash + 1) : len, 1, &end))
+	  {
+	       fprintf(stderr, "%s: Unable to parse the range of days \"%s\"; "
+		       "specify from-to with each as yyyymmdd\n", prog, range);
+	       return(1);
+	  }
+	  end--;
+     }
+
+     /*
+      *  The archive is named by its prefix, <host>
+      */
+     len = strlen(infile) - 4;
+     if (!(prefix = (char *)malloc(len + 1)))
+     {
+	  fprintf(stderr, "%s: Insufficient virtual memory\n", prog);
+	  return(1);
+     }
+     memcpy(prefix, infile, len);
+     prefix[len] = '\0';
+
+     istat = arch_read(prefix, start, end, &bdat, &blen);
+     free(prefix);
+     if (istat != ERR_OK)
+     {
+	  fprintf(stderr, "%s: Unable to read the archive \"%s\"; %s\n",
+		  prog, infile, err_strerror(istat));
+	  return(1);
+     }
+
+     istat = write_file(outfile, bdat, blen, to_text, "an archive");
+     if (bdat)
+	  free(bdat);
+
+     return(istat);
+}
+
+
+/*
+ *  Returns 1 when str ends with suffix
+ */
+static int
+has_suffix(const char *str, const char *suffix)
+{
+     size_t len, slen;
+
+     len  = strlen(str);
+     slen = strlen(suffix);
+     return(len >= slen && !strcmp(str + len - slen, suffix));
+}
+
+
+int
+main(int argc, const char *argv[])
+{
+     int archive, i, istat, to_text;
+     const char *infile, *outfile, *range;
+     char *fname;
+     size_t len;
+
+     if (argc > 0 && argv[0])
+     {
+	  prog = os_basename((char *)argv[0]);
+	  if (!prog || !(*prog))
+	       prog = argv[0];
+     }
+
+     fname   = NULL;
+     infile  = NULL;
+     outfile = NULL;
+     range   = NULL;
+     to_text = -1;
+     for (i = 1; i < argc; i++)
+     {
+	  if (argv[i][0] == '-' && argv[i][1])
+	  {
+	       switch(argv[i][1])
+	       {
+	       case 'b' :
+		    to_text = 0;
+		    break;
+
+	       case 't' :
+		    to_text = 1;
+		    break;
+
+	       case 'r' :
+		    if (argv[i][2])
+			 range = argv[i] + 2;
+		    else if (++i < argc)
+			 range = argv[i];
+		    else
+		    {
+			 usage(stderr);
+			 return(1);
+		    }
+		    break;
+
+	       case 'h' :
+	       case '?' :
+		    usage(stdout);
+		    return(0);
+
+	       case 'v' :
+		    version(stdout);
+		    return(0);
+
+	       default :
+		    usage(stderr);
+		    return(1);
+	       }
+	  }
+	  else if (!infile)
+	       infile = argv[i];
+	  else if (!outfile)
+	       outfile = argv[i];
+	  else
+	  {
+	       usage(stderr);
+	       return(1);
+	  }
+     }
+     if (!infile)
+     {
+	  usage(stderr);
+	  return(1);
+     }
+     archive = has_suffix(infile, ".gar");
+     if (range && !archive)
+     {
+	  fprintf(stderr, "%s: A range of days, -r, may only be given when "
+		  "extracting data from an archive\n", prog);
+	  return(1);
+     }
+     if (to_text < 0)
+	  to_text = archive || has_suffix(infile, ".bdat");
+
+     if (archive)
+	  return(extract(infile, outfile ? outfile : "-", to_text, range));
+
+     if (!outfile)
+     {
+	  /*
+	   *  Swap the suffix or else append one
+	   */
+	  len = strlen(infile);
+	  if (to_text && has_suffix(infile, ".bdat"))
+	       len -= 5;
+	  else if (!to_text && has_suffix(infile, ".dat"))
+	       len -= 4;
+	  fname = (char *)malloc(len + 6);
+	  if (!fname)
+	  {
+	       fprintf(stderr, "%s: Insufficient virtual memory\n", prog);
+	       return(1);
+	  }
+	  memcpy(fname, infile, len);
+	  strcpy(fname + len, to_text ? ".dat" : ".bdat");
+	  outfile = fname;
+     }
+     if (!strcmp(infile, outfile))
+     {
+	  fprintf(stderr, "%s: The input and output files are the same "
+		  "file, \"%s\"\n", prog, infile);
+	  free(fname);
+	  return(1);
+     }
+
+     istat = convert(infile, outfile, to_text);
+     if (fname)
+	  free(fname);
+
+     return(istat);
+}
@@ -37,6 +37,7 @@
 #include <ctype.h>
 #include "err.h"
 #include "atmos.h"
+#include "math.h"
 #include "convert.h"
 #include "vapor.h"
 #include "glob.h"
@@ -70,7 +71,7 @@ static device_dispatch_t *device_drivers[256];
 #undef DECLARE
 #endif
 
-#define DRIVER(a1,a2,a3,a4,a5,a6,a7,a8)
+#define DRIVER(a1,a2,a3,a4,a5,a6,a7,a8,a9,a10)
 #define DECLARE(a1,a2) \
      extern a1 a2;
 #include "devices.h"
@@ -78,20 +79,21 @@ static device_dispatch_t *device_drivers[256];
 #undef DRIVER
 
 #define DECLARE(t,p)
-#define DRIVER(name,fcode,drvinit,drvdone,devinit,devdone,devread,devshow)  \
+#define DRIVER(name,fcode,drvinit,drvdone,devinit,devdone,devread,devstart, \
+	       devcollect,devshow)					    \
      { NULL, fcode, name, sizeof(name)-1, drvinit, drvdone, devinit, \
-       devdone, devread, devshow },
+       devdone, devread, devstart, devcollect, devshow },
 
 static device_dispatch_t driver_block[] = {
 #include "devices.h"
-     {0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+     {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
 };
 
 static device_proc_read_t dev_default_read;
 
 static device_dispatch_t default_driver = {
      NULL, 0x00, "Default driver", 14, 0, 0, dev_default_init, 0,
-     dev_default_read, NULL
+     dev_default_read, NULL, NULL, NULL
 };
 
 #undef DRIVER
@@ -106,6 +108,9 @@ static hi_lo_t hi_lo_init = {
      { EMPTY_TIMESTR, EMPTY_TIMESTR, EMPTY_TIMESTR}
 };
 
+const int dev_roll_periods[NROLL] = { 24 * 60 * 60, 3 * 60 * 60, 60 * 60 };
+const int dev_tier_widths[NTIERS]  = { 15 * 60, 60 * 60 };
+
 static const char *dtype_names[1 + DEV_DTYPE_LAST - DEV_DTYPE_UNKNOWN];
 static const char *dtype_descs[1 + DEV_DTYPE_LAST - DEV_DTYPE_UNKNOWN];
 static const char *unit_names[1 + DEV_UNIT_LAST - DEV_UNIT_UNKNOWN];
@@ -121,6 +126,15 @@ int        dev_doverbose = 0;
 static os_pthread_mutex_t mutex;
 static int initialized = 0;
 
+/*
+ *  Bracket changes to the fields copied by dev_snapshot().  The device's
+ *  mutex must be held.
+ */
+#define DEV_WRITE_BEGIN(dev) \
+     (os_store_release(&(dev)->seq, (dev)->seq + 1), os_fence_release())
+#define DEV_WRITE_END(dev) \
+     os_store_release(&(dev)->seq, (dev)->seq + 1)
+
 /*
  *  Default routine to write error information to stderr when (1) debug
  *  output is requested via the debug flags, and (2) no output procedure
@@ -472,6 +486,8 @@ again:
 	       dev->data.fld_dtype[i] = DEV_DTYPE_UNKNOWN;
 
 nearly_done:
+     for (i = 0; i < NVALS; i++)
+	  fmt_float_compile(&dev->data.fld_fmt[i], dev->data.fld_format[i]);
      dev_flag_set(dev, DEV_FLAGS_INITIALIZED);
      return(ERR_OK);
 }
@@ -515,14 +531,179 @@ dev_done(ha7net_t *ctx, device_t *dev, device_t *devs)
 }
 
 
+/*
+ *  Ring buffer slots following and preceding slot n of device dev
+ */
+#define DEV_NEXT_BIN(dev,n) (((n) < (dev)->data.npast - 1) ? (n) + 1 : 0)
+#define DEV_PREV_BIN(dev,n) (((n) > 0) ? (n) - 1 : (dev)->data.npast - 1)
+
+
+/*
+ *  Add x to the compensated sum *sum + *comp using Neumaier's variant
+ *  of Kahan summation.  Unlike Kahan's, it remains accurate when x is
+ *  larger in magnitude than the running sum -- as happens when we
+ *  subtract segments back out of a running average.
+ */
+static void
+dev_sum_add(double *sum, double *comp, double x)
+{
+     double t = *sum + x;
+
+     if (fabs(*sum) >= fabs(x))
+	  *comp += (*sum - t) + x;
+     else
+	  *comp += (x - t) + *sum;
+     *sum = t;
+}
+
+
+/*
+ *  Integrate field fld of the device's data over the segment of the
+ *  ring buffer running from slot n-1 to slot n.  Returns 0 if either
+ *  end point is missing or beyond recorded history, 1 otherwise.
+ *
+ *  We compute an integrated average:
+ *
+ *      v(i-1)
+ *         *---
+ *         |   ---  v(i)
+ *         |      ---*
+ *         |         |
+ *         *---------*
+ *      t(i-1)      t(i)
+ *
+ *  Area = area of rectangle + area of triangle
+ *       = [t(i) - t(i-1)] * v(i-1)
+ *           + 1/2 [t(i) - t(i-1)] * [v(i) - v(i-1)]
+ *       = [t(i) - t(i-1)] * [v(i-1) + 1/2v(i) - 1/2v(i-1)]
+ *       = [t(i) - t(i-1)] * [v(i) + v(i-1)] / 2
+ */
+static int
+dev_segment(const device_t *dev, int fld, size_t n, double *area, long *dt)
+{
+     size_t n1 = DEV_PREV_BIN(dev, n);
+     time_t t1, t2;
+
+     t1 = dev->data.time[n1];
+     t2 = dev->data.time[n];
+     if (t1 == (time_t)0 || t2 == (time_t)0 ||
+	 t1 == DEV_MISSING_TVALUE || t2 == DEV_MISSING_TVALUE)
+	  return(0);
+
+     *dt   = (long)difftime(t2, t1);
+     *area = 0.5 * ((double)dev->data.val[fld][n] +
+		    (double)dev->data.val[fld][n1]) * (double)*dt;
+
+     return(1);
+}
+
+
+/*
+ *  Push the sample val[fld][n] onto the back of the monotonic deque dq,
+ *  first discarding those samples which it supersedes, and then drop
+ *  from the front of each period the samples which are now too old.
+ *  When is_max is non-zero the deque tracks maxima; otherwise, minima.
+ */
+static void
+dev_roll_push(device_t *dev, dev_deque_t *dq, int fld, size_t n, int is_max)
+{
+     unsigned long p;
+     float v = dev->data.val[fld][n];
+     time_t t0 = dev->data.time[n];
+     int k;
+
+     while (dq->back != dq->front[0])
+     {
+	  float v1 =
+	       dev->data.val[fld][dq->slot[(dq->back - 1) % dev->data.npast]];
+
+	  if (is_max ? (v1 > v) : (v1 < v))
+	       break;
+	  dq->back--;
+     }
+     p = dq->back++;
+     dq->slot[p % dev->data.npast] = (unsigned int)n;
+
+     for (k = 0; k < NROLL; k++)
+     {
+	  if (dq->front[k] > p)
+	       dq->front[k] = p;
+	  while ((int)difftime(t0,
+		   dev->data.time[dq->slot[dq->front[k] % dev->data.npast]]) >
+		 dev_roll_periods[k])
+	       dq->front[k]++;
+     }
+}
+
+
+/*
+ *  Slot n of the ring buffer is about to be reused: if it is still
+ *  referenced by the deque, it is the oldest entry.  Discard it.
+ */
+static void
+dev_roll_drop(device_t *dev, dev_deque_t *dq, size_t n)
+{
+     unsigned long p = dq->front[0];
+     int k;
+
+     if (p == dq->back || dq->slot[p % dev->data.npast] != n)
+	  return;
+     for (k = 0; k < NROLL; k++)
+	  if (dq->front[k] == p)
+	       dq->front[k] = p + 1;
+}
+
+
+/*
+ *  Add a sample of field i to each of its rollup tiers.  The caller must
+ *  hold the device's lock.
+ */
+static void
+dev_rollup_put(device_t *dev, int i, time_t t, float val)
+{
+     dev_rollup_t *b;
+     unsigned int seq;
+     int k;
+
+     if (t <= dev->data.tier_after)
+	  return;
+     for (k = 0; k < NTIERS; k++)
+     {
+	  if (!dev->data.tier[k][i])
+	       continue;
+	  seq = (unsigned int)(t / dev_tier_widths[k]);
+	  b = &dev->data.tier[k][i][seq % dev->data.tier_nbins[k]];
+	  if (b->seq != seq)
+	  {
+	       /*
+		*  First sample for this bin: evict the stale data
+		*/
+	       b->seq   = seq;
+	       b->count = 1;
+	       b->min   = val;
+	       b->max   = val;
+	       b->sum   = val;
+	       continue;
+	  }
+	  b->count++;
+	  b->sum += val;
+	  if (val < b->min)
+	       b->min = val;
+	  if (val > b->max)
+	       b->max = val;
+     }
+}
+
+
 int
 dev_stats(device_t *dev, int fld_start, int fld_end, size_t fld_ignore1,
 	  size_t fld_ignore2)
 {
-     int dt, i, i0, i1, i2, j, k;
-     float dt2, dt_sum[NVALS][NPERS];
+     double area;
+     long dt;
+     int i, j, k;
      size_t n0;
-     time_t t0, t1, t2;
+     time_t t0, t1;
 
      /*
       *  Sanity test
@@ -539,6 +720,7 @@ dev_stats(device_t *dev, int fld_start, int fld_end, size_t fld_ignore1,
 	  fld_end = NVALS - 1;
 
      dev_lock(dev);
+     DEV_WRITE_BEGIN(dev);
 
      n0 = dev->data.n_current;
 
@@ -550,6 +732,9 @@ dev_stats(device_t *dev, int fld_start, int fld_end, size_t fld_ignore1,
 	  if (!dev->data.fld_used[i] || i == fld_ignore1 || i == fld_ignore2)
 	       continue;
 
+	  dev->data.last_time[i] = dev->data.time[n0];
+	  dev->data.last_val[i]  = dev->data.val[i][n0];
+
 	  /*
 	   *  Minima
 	   */
@@ -572,14 +757,51 @@ dev_stats(device_t *dev, int fld_start, int fld_end, size_t fld_ignore1,
 	       dev->data.today.tmax[i] = dev->data.time[n0];
 	       dev->data.today.tmax_str[i][0] = 0;
 	  }
+
+	  /*
+	   *  Rolling extrema
+	   */
+	  dev_roll_push(dev, &dev->data.roll.lo[i], i, n0, 0);
+	  dev_roll_push(dev, &dev->data.roll.hi[i], i, n0, 1);
+	  for (k = 0; k < NROLL; k++)
+	  {
+	       hi_lo_t *r = &dev->data.rolling[k];
+	       size_t n;
+
+	       n = dev->data.roll.lo[i].slot[dev->data.roll.lo[i].front[k] %
+					     dev->data.npast];
+	       if (r->min[i] != dev->data.val[i][n] ||
+		   r->tmin[i] != dev->data.time[n])
+	       {
+		    r->min[i]         = dev->data.val[i][n];
+		    r->tmin[i]        = dev->data.time[n];
+		    r->tmin_str[i][0] = 0;
+	       }
+	       n = dev->data.roll.hi[i].slot[dev->data.roll.hi[i].front[k] %
+					     dev->data.npast];
+	       if (r->max[i] != dev->data.val[i][n] ||
+		   r->tmax[i] != dev->data.time[n])
+	       {
+		    r->max[i]         = dev->data.val[i][n];
+		    r->tmax[i]        = dev->data.time[n];
+		    r->tmax_str[i][0] = 0;
+	       }
+	  }
+
+	  /*
+	   *  Rollup tiers
+	   */
+	  dev_rollup_put(dev, i, dev->data.time[n0], dev->data.val[i][n0]);
      }
 
      /*
       *  Running averages
       *
-      *  We compute these in a tedious fashion.  We could just add in
-      *  the new data and subtract out the trailing data; however, that
-      *  might lead to excessive cumulative roundoff errors.
+      *  See the description of averages_t in device.h.  Rather than
+      *  re-integrate the entire window with each new sample, we add in
+      *  the segments which have arrived since we were last called and
+      *  then subtract out those which have since aged out of each window.
+      *  The cost per call is then independent of the averaging periods.
       */
 
      /*
@@ -588,72 +810,47 @@ dev_stats(device_t *dev, int fld_start, int fld_end, size_t fld_ignore1,
      if (dev->data.avgs.period[0] <= 0)
 	  goto skip_averages;
 
-     /*
-      *  Zero the fields
-      */
-     for (j = fld_start; j <= fld_end; j++)
-     {
-	  if (!dev->data.fld_used[j] || j == fld_ignore1 || j == fld_ignore2)
-	       break;
-	  for (k = 0; k < NPERS; k++)
-	  {
-	       dev->data.avgs.avg[j][k] = 0.0;
-	       dt_sum[j][k] = 0.0;
-	  }
-     }
      memset(dev->data.avgs.range_exists, 0, sizeof(device_period_array_t));
 
      /*
       *  t0 = current time
       */
-     i0 = (int)n0;
-     t0 = dev->data.time[i0];
+     t0 = dev->data.time[n0];
 
-     /*
-      *  Now compute the running averages
-      *
-      *  Note that since there can be missing samples; we cannot readily
-      *  compute how many samples to look back.  That is, even if we know
-      *  that we want a 30 minute average and that the sampling periond is
-      *  2 minutes, we do not know if looking back 15 samples is correct or
-      *  not: if we missed a sampling cycle, then we would only want to
-      *  look back 14 samples....  The easiest way to deal with this is
-      *  to just start moving backwards in time until we hit samples outside
-      *  of our largest sampling window, dev->data.avgs.period[0].
-      */
-     for (i = 1; i < NPAST; i++)
-     {
-	  i1 = i0 - i;
-	  i2 = i1 + 1;
-	  if (i1 < 0)
-	  {
-	       i1 = NPAST + i1;
-	       if (i2 < 0)
-		    i2 = NPAST + i2;
-	  }
-	  t1 = dev->data.time[i1];
-	  t2 = dev->data.time[i2];
-	  if (t1 == (time_t)0 || t2 == (time_t)0)
-	       /*
-		*  We've gone beyond recorded history
-		*/
-	       break;
-	  else if (t1 == DEV_MISSING_TVALUE || t2 == DEV_MISSING_TVALUE)
-	       /*
-		*  Missing value
-		*/
+     for (j = fld_start; j <= fld_end; j++)
+     {
+	  if (!dev->data.fld_used[j] || j == fld_ignore1 || j == fld_ignore2)
 	       continue;
-	  dt = (int)difftime(t0, t1);
-	  if (dt > dev->data.avgs.period[0])
+
+	  if (!dev->data.avgs.primed[j])
+	  {
 	       /*
-		*  We're now looking too far back in time
+		*  Start with empty windows just ahead of the oldest
+		*  sample.  Catching up will then integrate over all
+		*  the history presently in the ring buffer.
 		*/
-	       break;
-	  dt2 = (float)difftime(t2, t1);
-	  for (j = fld_start; j <= fld_end; j++)
+	       dev->data.avgs.head[j] = DEV_NEXT_BIN(dev, n0);
+	       for (k = 0; k < NPERS; k++)
+	       {
+		    dev->data.avgs.tail[j][k] =
+			 DEV_NEXT_BIN(dev, dev->data.avgs.head[j]);
+		    dev->data.avgs.sum[j][k]    = 0.0;
+		    dev->data.avgs.comp[j][k]   = 0.0;
+		    dev->data.avgs.dt_sum[j][k] = 0;
+	       }
+	       dev->data.avgs.primed[j] = 1;
+	  }
+
+	  /*
+	   *  Add in the segments ending at head+1, head+2, ..., n0.
+	   *  Usually that is just the one segment ending at n0.
+	   */
+	  while (dev->data.avgs.head[j] != n0)
 	  {
-	       if (!dev->data.fld_used[j] || j == fld_ignore1 ||
-		   j == fld_ignore2)
+	       size_t s = DEV_NEXT_BIN(dev, dev->data.avgs.head[j]);
+
+	       dev->data.avgs.head[j] = s;
+	       if (!dev_segment(dev, j, s, &area, &dt))
 		    continue;
 	       for (k = 0; k < NPERS; k++)
 	       {
@@ -662,62 +859,189 @@ dev_stats(device_t *dev, int fld_start, int fld_end, size_t fld_ignore1,
 			  *  No more averaging periods
 			  */
 			 break;
-		    if (dt > dev->data.avgs.period[k])
+		    dev_sum_add(&dev->data.avgs.sum[j][k],
+				&dev->data.avgs.comp[j][k], area);
+		    dev->data.avgs.dt_sum[j][k] += dt;
+	       }
+	  }
+
+	  /*
+	   *  Now subtract out the segments which have aged out of each
+	   *  window.  Since there can be missing samples, we cannot readily
+	   *  compute how many segments that is: we simply drop segments from
+	   *  the tail until we reach one which starts within the window.
+	   */
+	  for (k = 0; k < NPERS; k++)
+	  {
+	       size_t s;
+
+	       if (dev->data.avgs.period[k] <= 0)
+		    break;
+
+	       while ((s = dev->data.avgs.tail[j][k]) !=
+		      DEV_NEXT_BIN(dev, dev->data.avgs.head[j]))
+	       {
+		    if (dev_segment(dev, j, s, &area, &dt))
 		    {
-			 /*
-			  *  We're looking too far back in time for this
-			  *  averaging period.
-			  */
-			 dev->data.avgs.range_exists[k] = 1;
-			 break;
+			 t1 = dev->data.time[DEV_PREV_BIN(dev, s)];
+			 if ((int)difftime(t0, t1) <= dev->data.avgs.period[k])
+			      break;
+			 dev_sum_add(&dev->data.avgs.sum[j][k],
+				     &dev->data.avgs.comp[j][k], -area);
+			 dev->data.avgs.dt_sum[j][k] -= dt;
 		    }
-		    else if (dt >= dev->data.avgs.period_approx[k])
-			 dev->data.avgs.range_exists[k] = 1;
+		    dev->data.avgs.tail[j][k] = DEV_NEXT_BIN(dev, s);
+	       }
 
+	       if (s == DEV_NEXT_BIN(dev, dev->data.avgs.head[j]))
+	       {
 		    /*
-		     *  We compute an integrated average:
-		     *
-		     *      v(i-1)
-		     *         *---
-		     *         |   ---  v(i)
-		     *         |      ---*
-		     *         |         |
-		     *         *---------*
-		     *      t(i-1)      t(i)
-		     *
-		     *  Area = area of rectangle + area of triangle
-		     *       = [t(i) - t(i-1)] * v(i-1)
-		     *           + 1/2 [t(i) - t(i-1)] * [v(i) - v(i-1)]
-		     *       = [t(i) - t(i-1)] * [v(i-1) + 1/2v(i) - 1/2v(i-1)]
-		     *       = [t(i) - t(i-1)] * [v(i) + v(i-1)] / 2
-		     */   
-		    dev->data.avgs.avg[j][k] +=
-			 0.5 * (dev->data.val[j][i2] + dev->data.val[j][i1])
-			                                                 * dt2;
-		    dt_sum[j][k] += dt2;
+		     *  Empty window: discard any residual roundoff
+		     */
+		    dev->data.avgs.sum[j][k]    = 0.0;
+		    dev->data.avgs.comp[j][k]   = 0.0;
+		    dev->data.avgs.dt_sum[j][k] = 0;
+	       }
+
+	       if (dev->data.avgs.dt_sum[j][k] > 0)
+		    dev->data.avgs.avg[j][k] = (float)
+			 ((dev->data.avgs.sum[j][k] +
+			   dev->data.avgs.comp[j][k]) /
+			  (double)dev->data.avgs.dt_sum[j][k]);
+	       else
+		    dev->data.avgs.avg[j][k] = 0.0;
+	  }
+
+	  /*
+	   *  The tail of the longest window is the oldest sample in use.
+	   *  If it reaches back far enough for a given period, then that
+	   *  period's average covers its entire range.
+	   */
+	  if (dev->data.avgs.tail[j][0] !=
+	      DEV_NEXT_BIN(dev, dev->data.avgs.head[j]))
+	  {
+	       t1 = dev->data.time[DEV_PREV_BIN(dev,
+						dev->data.avgs.tail[j][0])];
+	       dt = (long)difftime(t0, t1);
+	       for (k = 0; k < NPERS; k++)
+	       {
+		    if (dev->data.avgs.period[k] <= 0)
+			 break;
+		    if (dt >= dev->data.avgs.period_approx[k])
+			 dev->data.avgs.range_exists[k] = 1;
 	       }
 	  }
      }
+
+skip_averages:
+     DEV_WRITE_END(dev);
+     dev_unlock(dev);
+
      /*
-      *  And, compute the averages
+      *  All done
       */
-     for (j = fld_start; j <= fld_end; j++)
+     return(ERR_OK);
+}
+
+
+/*
+ *  Advance to the next data bin, returning its index
+ */
+static size_t
+dev_next_bin(device_t *dev)
+{
+     int j, k;
+     size_t n0, n1, n2;
+
+     dev_lock(dev);
+     n1 = dev->data.n_current;
+     dev->data.n_current  = n0 = DEV_NEXT_BIN(dev, n1);
+     dev->data.n_previous = n1;
+
+     /*
+      *  Slot n0 is about to be reused.  Drop it from the rolling extrema
+      *  deques and drop the segment starting at it, n0 to n0+1, from any
+      *  running average window still holding it.  A field whose averages
+      *  lag a full trip around the ring buffer behind is simply started
+      *  afresh by dev_stats().
+      */
+     n2 = DEV_NEXT_BIN(dev, n0);
+     for (j = 0; j < NVALS; j++)
      {
-	  if (!dev->data.fld_used[j] || j == fld_ignore1 || j == fld_ignore2)
-	       break;
+	  dev_roll_drop(dev, &dev->data.roll.lo[j], n0);
+	  dev_roll_drop(dev, &dev->data.roll.hi[j], n0);
+	  if (!dev->data.avgs.primed[j])
+	       continue;
+	  if (dev->data.avgs.head[j] == n0)
+	  {
+	       dev->data.avgs.primed[j] = 0;
+	       continue;
+	  }
 	  for (k = 0; k < NPERS; k++)
-	       if (dt_sum[j][k] > 0.0)
-		    dev->data.avgs.avg[j][k] = dev->data.avgs.avg[j][k] /
-			 dt_sum[j][k];
-	       else
-		    dev->data.avgs.avg[j][k] = 0.0;
-     }
+	  {
+	       double area;
+	       long dt;
 
-skip_averages:
+	       if (dev->data.avgs.period[k] <= 0)
+		    break;
+	       if (dev->data.avgs.tail[j][k] != n2 ||
+		   n2 == DEV_NEXT_BIN(dev, dev->data.avgs.head[j]))
+		    continue;
+	       if (dev_segment(dev, j, n2, &area, &dt))
+	       {
+		    dev_sum_add(&dev->data.avgs.sum[j][k],
+				&dev->data.avgs.comp[j][k], -area);
+		    dev->data.avgs.dt_sum[j][k] -= dt;
+	       }
+	       dev->data.avgs.tail[j][k] = DEV_NEXT_BIN(dev, n2);
+	  }
+     }
      dev_unlock(dev);
 
+     return(n0);
+}
+
+
+/*
+ *  Finish up after a device's read or collect procedure has been called
+ */
+static int
+dev_read_finish(device_t *dev, size_t n0, int istat)
+{
+     if (istat != ERR_OK)
+     {
+	  int i;
+
+	  /*
+	   *  Indicate a missing value
+	   */
+	  dev_lock(dev);
+	  DEV_WRITE_BEGIN(dev);
+	  dev->data.time[n0] = DEV_MISSING_TVALUE;
+	  for (i = 0; i < NVALS; i++)
+	       dev->data.last_time[i] = DEV_MISSING_TVALUE;
+	  DEV_WRITE_END(dev);
+	  dev_unlock(dev);
+
+	  /*
+	   *  And return the error
+	   */
+	  return(istat);
+     }
+
      /*
-      *  All done
+      *  Update running stats: minima, maxima, and averages
+      *
+      *  If the device has pressure correction enabled, then ignore
+      *  that slot for now as we cannot compute it until all the devices
+      *  it depends upon have been read.
+      */
+     dev_stats(dev, 0, NVALS - 1, 
+	       dev->data.pcor ? dev->data.pcor->fld_spare : NVALS,
+	       dev->data.pcor ? dev->data.pcor->fld_spare2 : NVALS);
+
+     /*
+      *  And return
       */
      return(ERR_OK);
 }
@@ -726,8 +1050,7 @@ skip_averages:
 int
 dev_read(ha7net_t *ctx, device_t *dev, unsigned int flags)
 {
-     int istat;
-     size_t n0, n1;
+     size_t n0;
 
      if (do_trace)
 	  trace("dev_read(%d): Called for device %s (dev=%p) with "
@@ -755,46 +1078,149 @@ dev_read(ha7net_t *ctx, device_t *dev, unsigned int flags)
      /*
       *  Select the next data bin
       */
+     n0 = dev_next_bin(dev);
+
+     /*
+      *  Call the read procedure
+      */
+     return(dev_read_finish(dev, n0, (*dev->driver->read)(ctx, dev, flags)));
+}
+
+
+int
+dev_replay(device_t *dev, time_t t, const float *vals, int missing)
+{
+     int i;
+     size_t n0;
+
+     if (!dev || !vals || !dev->data.time)
+     {
+	  debug("dev_replay(%d): Invalid call arguments supplied; dev=%p, "
+		"vals=%p", __LINE__, dev, vals);
+	  return(ERR_BADARGS);
+     }
+
+     n0 = dev_next_bin(dev);
+     if (missing)
+	  return(dev_read_finish(dev, n0, ERR_NO));
+
      dev_lock(dev);
-     n1 = dev->data.n_current;
-     dev->data.n_current  = n0 = (n1 < (NPAST-1)) ? n1 + 1 : 0;
-     dev->data.n_previous = n1;
+     DEV_WRITE_BEGIN(dev);
+     dev->data.time[n0] = t;
+     for (i = 0; i < NVALS; i++)
+	  if (dev->data.val[i])
+	       dev->data.val[i][n0] = vals[i];
+     DEV_WRITE_END(dev);
      dev_unlock(dev);
 
      /*
-      *  Call the read procedure
+      *  The data file holds any pressure corrections already made, so
+      *  every field's statistics are updated at once
       */
-     istat = (*dev->driver->read)(ctx, dev, flags);
-     if (istat != ERR_OK)
+     return(dev_stats(dev, 0, NVALS - 1, NVALS, NVALS));
+}
+
+
+int
+dev_start(ha7net_t *ctx, device_t *dev, unsigned int flags)
+{
+     int istat;
+     size_t n0;
+
+     if (do_trace)
+	  trace("dev_start(%d): Called for device %s (dev=%p) with "
+		"ha7net ctx=%p and flags=0x%x (%u)",
+		__LINE__, dev ? dev_romid(dev) : "(null)", dev, ctx, flags,
+	       flags);
+
+     if (!dev)
      {
-	  /*
-	   *  Indicate a missing value
-	   */
-	  dev_lock(dev);
-	  dev->data.time[n0] = DEV_MISSING_TVALUE;
-	  dev_unlock(dev);
+	  debug("dev_start(%d): Invalid call arguments supplied; ctx=%p, "
+		"dev=%p", __LINE__, ctx, dev);
+	  return(ERR_BADARGS);
+     }
+
+     /*
+      *  Caller should have used dev_read() instead
+      */
+     if (!dev_can_start(dev))
+	  return(ERR_NO);
+
+     /*
+      *  Select the next data bin
+      */
+     n0 = dev_next_bin(dev);
+
+     /*
+      *  Call the start procedure
+      */
+     dev_flag_clear(dev, DEV_FLAGS_STARTED);
+     istat = (*dev->driver->start)(ctx, dev, flags);
+     if (istat != ERR_OK)
+	  return(dev_read_finish(dev, n0, istat));
+
+     /*
+      *  Note when the conversion began
+      */
+     gettimeofday(&dev->started, NULL);
+     dev_flag_set(dev, DEV_FLAGS_STARTED);
+
+     return(ERR_OK);
+}
+
+
+int
+dev_collect(ha7net_t *ctx, device_t *dev, unsigned int flags)
+{
+     if (do_trace)
+	  trace("dev_collect(%d): Called for device %s (dev=%p) with "
+		"ha7net ctx=%p and flags=0x%x (%u)",
+		__LINE__, dev ? dev_romid(dev) : "(null)", dev, ctx, flags,
+	       flags);
 
-	  /*
-	   *  And return the error
-	   */
-	  return(istat);
+     if (!dev)
+     {
+	  debug("dev_collect(%d): Invalid call arguments supplied; ctx=%p, "
+		"dev=%p", __LINE__, ctx, dev);
+	  return(ERR_BADARGS);
+     }
+     else if (!dev_can_start(dev) || !dev_flag_test(dev, DEV_FLAGS_STARTED))
+     {
+	  debug("dev_collect(%d): No conversion has been started for the "
+		"device %s", __LINE__, dev_romid(dev));
+	  return(ERR_NO);
      }
 
      /*
-      *  Update running stats: minima, maxima, and averages
-      *
-      *  If the device has pressure correction enabled, then ignore
-      *  that slot for now as we cannot compute it until all the devices
-      *  it depends upon have been read.
+      *  Call the collect procedure: dev_start() has already selected
+      *  the data bin
       */
-     dev_stats(dev, 0, NVALS - 1, 
-	       dev->data.pcor ? dev->data.pcor->fld_spare : NVALS,
-	       dev->data.pcor ? dev->data.pcor->fld_spare2 : NVALS);
+     dev_flag_clear(dev, DEV_FLAGS_STARTED);
+     return(dev_read_finish(dev, dev->data.n_current,
+			    (*dev->driver->collect)(ctx, dev, flags)));
+}
 
-     /*
-      *  And return
-      */
-     return(ERR_OK);
+
+void
+dev_dwell(device_t *dev, unsigned int ms)
+{
+     long dt;
+     struct timeval tv;
+
+     if (!dev)
+	  return;
+
+     gettimeofday(&tv, NULL);
+
+     /* Delta in milliseconds */
+     dt = (long)(tv.tv_sec - dev->started.tv_sec) * 1000 +
+	  (long)(tv.tv_usec - dev->started.tv_usec) / 1000;
+
+     if (dt < 0)
+	  /* Clock went backwards: play it safe */
+	  dt = 0;
+     if (dt < (long)ms)
+	  os_sleep(ms - (unsigned int)dt);
 }
 
 
@@ -950,22 +1376,25 @@ dev_list_init(ha7net_t *ctx, device_t *devices)
 
 
 int
-dev_info_hints(device_t *devices, size_t ndevices, const device_loc_t *linfo)
+dev_info_hints(device_t *devices, size_t ndevices, const device_loc_t *linfo,
+	       const dev_index_t *index)
 {
+     device_t *dev;
      size_t l;
 
      if (do_trace)
 	  trace("dev_info_hints(%d): Called with devices=%p, ndevices=%u, "
-		"linfo=%p", __LINE__, devices, ndevices, linfo);
+		"linfo=%p, index=%p", __LINE__, devices, ndevices, linfo,
+		index);
 
      /*
       *  Sanity checks
       */
-     if (!devices && ndevices)
+     if ((!devices || !index) && ndevices)
      {
 	  debug("dev_info_hints(%d): Bad call arguments supplied; no "
-		"device list supplied; devices=%p, ndevices=%u",
-		__LINE__, devices, ndevices);	  
+		"device list or index supplied; devices=%p, ndevices=%u, "
+		"index=%p", __LINE__, devices, ndevices, index);
 	  return(ERR_BADARGS);
      }
 
@@ -985,26 +1414,21 @@ dev_info_hints(device_t *devices, size_t ndevices, const device_loc_t *linfo)
 	   *  here as other threads may also be using the linfo
 	   *  list.
 	   */
-	  for (l = 0; l < ndevices; l++)
+	  dev = dev_index_find(index, linfo->romid, strlen(linfo->romid));
+	  if (dev)
 	  {
-	       if (memcmp(linfo->romid, devices[l].romid, sizeof(linfo->romid)))
-		    /*
-		     *  ROM id's do not match
-		     */
-		    continue;
-	       
 	       /*
 		*  If a driver hint was supplied, then update our notion
 		*  of which driver to use for this device.
 		*/
 	       if (linfo->hint && linfo->hint[0])
-		    devices[l].driver = dev_driver_get(devices[l].fcode,
-						       linfo->hint, linfo->hlen);
+		    dev->driver = dev_driver_get(dev->fcode, linfo->hint,
+						 linfo->hlen);
 	       if (linfo->group1.ref)
 	       {
-		    devices[l].group1 = linfo->group1;
-		    devices[l].group1.next = NULL;
-		    devices[l].group1.prev = NULL;
+		    dev->group1 = linfo->group1;
+		    dev->group1.next = NULL;
+		    dev->group1.prev = NULL;
 	       }
 	  }
 	  linfo = linfo->next;
@@ -1020,8 +1444,9 @@ dev_info_hints(device_t *devices, size_t ndevices, const device_loc_t *linfo)
 int
 dev_info_merge(device_t *devices, size_t ndevices, int apply_hints,
 	       device_period_array_t periods, const device_loc_t *linfo,
-	       const device_ignore_t *ilist)
+	       const device_ignore_t *ilist, const dev_index_t *index)
 {
+     device_t *dev;
      int groups_seen;
      size_t l;
      device_period_array_t period_approx;
@@ -1029,17 +1454,18 @@ dev_info_merge(device_t *devices, size_t ndevices, int apply_hints,
 
      if (do_trace)
 	  trace("dev_info_merge(%d): Called with devices=%p, ndevices=%u, "
-		"apply_hints=%d, periods=%p, linfo=%p, ilist=%p",
-		__LINE__, devices, ndevices, apply_hints, periods, linfo, ilist);
+		"apply_hints=%d, periods=%p, linfo=%p, ilist=%p, index=%p",
+		__LINE__, devices, ndevices, apply_hints, periods, linfo, ilist,
+		index);
 
      /*
       *  Sanity checks
       */
-     if (!devices && ndevices)
+     if ((!devices || !index) && ndevices)
      {
 	  debug("dev_info_merge(%d): Bad call arguments supplied; no "
-		"device list supplied; devices=%p, ndevices=%u",
-		__LINE__, devices, ndevices);	  
+		"device list or index supplied; devices=%p, ndevices=%u, "
+		"index=%p", __LINE__, devices, ndevices, index);
 	  return(ERR_BADARGS);
      }
 
@@ -1080,28 +1506,22 @@ dev_info_merge(device_t *devices, size_t ndevices, int apply_hints,
 	   *  here as other threads may also be using the linfo
 	   *  list.
 	   */
-	  for (l = 0; l < ndevices; l++)
+	  dev = dev_index_find(index, linfo->romid, strlen(linfo->romid));
+	  if (dev)
 	  {
-	       if (memcmp(linfo->romid, devices[l].romid,
-			  sizeof(linfo->romid)))
-		    /*
-		     *  ROM id's do not match
-		     */
-		    continue;
-	       
 	       /*
 		*  If a driver hint was supplied, then update our notion
 		*  of which driver to use for this device.
 		*/
 	       if (apply_hints && linfo->hint && linfo->hint[0])
-		    devices[l].driver = dev_driver_get(devices[l].fcode,
-						       linfo->hint, linfo->hlen);
+		    dev->driver = dev_driver_get(dev->fcode, linfo->hint,
+						 linfo->hlen);
 
 	       /*
 		*  Copy over any device flags
 		*/
 	       if (linfo->flags)
-		    dev_flag_set(&devices[l], linfo->flags);
+		    dev_flag_set(dev, linfo->flags);
 
 	       /*
 		*  Device specific averaging periods
@@ -1110,11 +1530,11 @@ dev_info_merge(device_t *devices, size_t ndevices, int apply_hints,
 	       {
 		    size_t m;
 
-		    memmove(&devices[l].data.avgs.period, linfo->periods,
+		    memmove(&dev->data.avgs.period, linfo->periods,
 			    sizeof(device_period_array_t));
 		    for (m = 0; m < NPERS; m++)
-			 devices[l].data.avgs.period_approx[m] =
-			   (int)(0.95 * (float)devices[l].data.avgs.period[m]);
+			 dev->data.avgs.period_approx[m] =
+			   (int)(0.95 * (float)dev->data.avgs.period[m]);
 	       }
 
 	       /*
@@ -1135,27 +1555,27 @@ dev_info_merge(device_t *devices, size_t ndevices, int apply_hints,
 	       if (linfo->dlen)
 		    memmove(tmpl, linfo->desc, linfo->dlen);
 	       tmpl[linfo->dlen] = '\0';
-	       devices[l].desc   = tmpl;
-	       devices[l].dlen   = linfo->dlen;
+	       dev->desc   = tmpl;
+	       dev->dlen   = linfo->dlen;
 
 	       /*
 		*  Device specific information
 		*/
-	       devices[l].gain   = linfo->gain;
-	       devices[l].offset = linfo->offset;
-	       devices[l].spec = tmpl + linfo->dlen + 1;
-	       devices[l].slen = linfo->slen;
+	       dev->gain   = linfo->gain;
+	       dev->offset = linfo->offset;
+	       dev->spec = tmpl + linfo->dlen + 1;
+	       dev->slen = linfo->slen;
 	       if (linfo->slen && linfo->spec)
-		    memmove(devices[l].spec, linfo->spec, linfo->slen);
-	       devices[l].spec[linfo->slen] = '\0';
+		    memmove(dev->spec, linfo->spec, linfo->slen);
+	       dev->spec[linfo->slen] = '\0';
 
-	       if (!linfo->group1.ref)
-		    break;
-	       groups_seen++;
-	       devices[l].group1 = linfo->group1;
-	       devices[l].group1.next = NULL;
-	       devices[l].group1.prev = NULL;
- 	       break;
+	       if (linfo->group1.ref)
+	       {
+		    groups_seen++;
+		    dev->group1 = linfo->group1;
+		    dev->group1.next = NULL;
+		    dev->group1.prev = NULL;
+	       }
 	  }
 	  linfo = linfo->next;
      }
@@ -1228,16 +1648,9 @@ dev_info_merge(device_t *devices, size_t ndevices, int apply_hints,
 	       }
 	       else
 	       {
-		    for (l = 0; l < ndevices; l++)
-		    {
-			 if (devices[l].flags & DEV_FLAGS_IGNORE)
-			      continue;
-			 if (ilist->plen != OWIRE_ID_LEN ||
-			     memcmp(ilist->pat, devices[l].romid,
-				    OWIRE_ID_LEN))
-			      continue;
-			 devices[l].flags |= DEV_FLAGS_IGNORE;
-		    }
+		    dev = dev_index_find(index, ilist->pat, ilist->plen);
+		    if (dev)
+			 dev->flags |= DEV_FLAGS_IGNORE;
 	       }
 	  }
 	  ilist = ilist->next;
@@ -1339,6 +1752,10 @@ dev_array_free(device_t *devs)
      {
 	  if (tmpd->data.pcor)
 	       free(tmpd->data.pcor);
+	  if (tmpd->data.ring)
+	       free(tmpd->data.ring);
+	  if (tmpd->data.tiers)
+	       free(tmpd->data.tiers);
 	  os_pthread_mutex_destroy(&tmpd->mutex);
 	  if (dev_desc(tmpd))
 	       free(dev_desc(tmpd));
@@ -1348,10 +1765,269 @@ dev_array_free(device_t *devs)
 }
 
 
+/*
+ *  Convert a ROM id to its dev_index_t key.  Returns 0 when the ROM id
+ *  is not 16 hex digits.
+ */
+static int
+dev_index_key(const char *romid, size_t len, unsigned long long *key)
+{
+     int c;
+     size_t i;
+     unsigned long long k;
+
+     if (!romid || len != OWIRE_ID_LEN)
+	  return(0);
+
+     k = 0;
+     for (i = 0; i < OWIRE_ID_LEN; i++)
+     {
+	  c = (unsigned char)romid[i];
+	  if ('0' <= c && c <= '9')
+	       c -= '0';
+	  else if ('A' <= c && c <= 'F')
+	       c -= 'A' - 10;
+	  else if ('a' <= c && c <= 'f')
+	       c -= 'a' - 10;
+	  else
+	       return(0);
+	  k = (k << 4) | (unsigned long long)c;
+     }
+     *key = k;
+
+     return(1);
+}
+
+
+/*
+ *  Fibonacci hashing: slot numbers are taken from the upper half of
+ *  key * 2^64 / phi, which mixes all of the ROM id's serial number bits
+ *  into the slot number.
+ */
+#define DEV_INDEX_SLOT(index, key) \
+     ((size_t)(((key) * 0x9E3779B97F4A7C15ULL) >> 32) & (index)->mask)
+
+
+int
+dev_index_build(dev_index_t *index, device_t *devices, size_t ndevices)
+{
+     size_t i, l, nslots;
+     unsigned long long key;
+
+     if (!index || (!devices && ndevices))
+     {
+	  debug("dev_index_build(%d): Invalid call arguments supplied; "
+		"index=%p, devices=%p, ndevices=%u",
+		__LINE__, index, devices, ndevices);
+	  return(ERR_BADARGS);
+     }
+
+     nslots = 2;
+     while (nslots < 2 * ndevices)
+	  nslots <<= 1;
+     index->keys = (unsigned long long *)calloc(nslots,
+			 sizeof(unsigned long long) + sizeof(device_t *));
+     if (!index->keys)
+     {
+	  debug("dev_index_build(%d): Insufficient virtual memory",
+		__LINE__);
+	  index->devs = NULL;
+	  index->mask = 0;
+	  return(ERR_NOMEM);
+     }
+     index->devs = (device_t **)(index->keys + nslots);
+     index->mask = nslots - 1;
+
+     for (l = 0; l < ndevices; l++)
+     {
+	  if (!dev_index_key(devices[l].romid, OWIRE_ID_LEN, &key))
+	       continue;
+	  for (i = DEV_INDEX_SLOT(index, key); index->devs[i];
+	       i = (i + 1) & index->mask)
+	       if (index->keys[i] == key)
+		    break;
+	  if (index->devs[i])
+	       /*
+		*  Duplicate ROM id
+		*/
+	       continue;
+	  index->keys[i] = key;
+	  index->devs[i] = &devices[l];
+     }
+
+     return(ERR_OK);
+}
+
+
+device_t *
+dev_index_find(const dev_index_t *index, const char *romid, size_t len)
+{
+     size_t i;
+     unsigned long long key;
+
+     if (!index || !index->devs || !dev_index_key(romid, len, &key))
+	  return(NULL);
+
+     for (i = DEV_INDEX_SLOT(index, key); index->devs[i];
+	  i = (i + 1) & index->mask)
+	  if (index->keys[i] == key)
+	       return(index->devs[i]);
+
+     return(NULL);
+}
+
+
+void
+dev_index_free(dev_index_t *index)
+{
+     if (!index)
+	  return;
+     if (index->keys)
+	  free(index->keys);
+     index->keys = NULL;
+     index->devs = NULL;
+     index->mask = 0;
+}
+
+#undef DEV_INDEX_SLOT
+
+
+/*
+ *  Alignment for the columns of the ring buffer block
+ */
+#define DEV_CACHE_LINE 64
+#define DEV_CACHE_ROUND(n) \
+     (((n) + DEV_CACHE_LINE - 1) & ~(size_t)(DEV_CACHE_LINE - 1))
+
+/*
+ *  Allocate a device's time[] and val[][] ring buffers along with the
+ *  rolling extrema deques which index them, all in a single block: time[],
+ *  then the val[i][] columns, and then the deques.  Columns are allocated
+ *  only for the fields in use or, if the driver has yet to say which
+ *  those are, for all of them.  Any previous ring buffers are released
+ *  and the statistics which refer to them are reset.  The caller must
+ *  either hold the device's lock or be its only user.
+ */
+static int
+dev_ring_alloc(device_t *dev, size_t npast)
+{
+     int all;
+     char *base, *ptr;
+     size_t i, ncols, tsize, vsize, ssize;
+
+     all = 1;
+     for (i = 0; i < NVALS; i++)
+	  if (dev->data.fld_used[i])
+	       all = 0;
+     ncols = 0;
+     for (i = 0; i < NVALS; i++)
+	  if (all || dev->data.fld_used[i])
+	       ncols++;
+
+     tsize = DEV_CACHE_ROUND(npast * sizeof(time_t));
+     vsize = DEV_CACHE_ROUND(npast * sizeof(float));
+     ssize = DEV_CACHE_ROUND(npast * sizeof(unsigned int));
+     base = (char *)calloc(1, DEV_CACHE_LINE - 1 + tsize +
+			   ncols * (vsize + 2 * ssize));
+     if (!base)
+	  return(ERR_NOMEM);
+
+     if (dev->data.ring)
+	  free(dev->data.ring);
+     dev->data.ring = base;
+
+     ptr = (char *)DEV_CACHE_ROUND((size_t)base);
+     dev->data.time = (time_t *)ptr;
+     ptr += tsize;
+     for (i = 0; i < NVALS; i++)
+     {
+	  if (all || dev->data.fld_used[i])
+	  {
+	       dev->data.val[i] = (float *)ptr;
+	       ptr += vsize;
+	  }
+	  else
+	       dev->data.val[i] = NULL;
+     }
+     memset(&dev->data.roll, 0, sizeof(rolling_t));
+     for (i = 0; i < NVALS; i++)
+     {
+	  if (!dev->data.val[i])
+	       continue;
+	  dev->data.roll.lo[i].slot = (unsigned int *)ptr;
+	  ptr += ssize;
+	  dev->data.roll.hi[i].slot = (unsigned int *)ptr;
+	  ptr += ssize;
+     }
+     memset(dev->data.avgs.primed, 0, sizeof(dev->data.avgs.primed));
+     dev->data.npast      = npast;
+     dev->data.n_current  = 0;
+     dev->data.n_previous = 0;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Allocate empty rollup tiers of nbins[k] bins for each of the device's
+ *  fields in use, releasing any previous tiers.  Devices with no fields
+ *  in use, such as those being ignored, get none; nor do tiers of no
+ *  bins.  The caller must either hold the device's lock or be its only
+ *  user.
+ */
+static int
+dev_tiers_alloc(device_t *dev, const size_t *nbins)
+{
+     dev_rollup_t *ptr;
+     int k;
+     size_t i, nfld, ntotal;
+
+     ntotal = 0;
+     for (k = 0; k < NTIERS; k++)
+	  ntotal += nbins[k];
+     nfld = 0;
+     for (i = 0; i < NVALS; i++)
+	  if (dev->data.fld_used[i])
+	       nfld++;
+
+     if (dev->data.tiers)
+	  free(dev->data.tiers);
+     dev->data.tiers = NULL;
+     memset(dev->data.tier, 0, sizeof(dev->data.tier));
+     memset(dev->data.tier_nbins, 0, sizeof(dev->data.tier_nbins));
+     dev->data.tier_after = (time_t)0;
+     if (!nfld || !ntotal)
+	  return(ERR_OK);
+
+     ptr = (dev_rollup_t *)calloc(nfld * ntotal, sizeof(dev_rollup_t));
+     if (!ptr)
+	  return(ERR_NOMEM);
+     dev->data.tiers = ptr;
+
+     for (k = 0; k < NTIERS; k++)
+	  dev->data.tier_nbins[k] = nbins[k];
+     for (i = 0; i < NVALS; i++)
+     {
+	  if (!dev->data.fld_used[i])
+	       continue;
+	  for (k = 0; k < NTIERS; k++)
+	  {
+	       if (!nbins[k])
+		    continue;
+	       dev->data.tier[k][i] = ptr;
+	       ptr += nbins[k];
+	  }
+     }
+
+     return(ERR_OK);
+}
+
+
 device_t *
 dev_array(size_t ndevices)
 {
      device_t *devs;
+     int k;
      size_t n;
 
      devs = (device_t *)calloc(ndevices + 1, sizeof(device_t));
@@ -1360,15 +2036,206 @@ dev_array(size_t ndevices)
 
      for (n = 0; n < ndevices; n++)
      {
+	  if (ERR_OK != dev_ring_alloc(&devs[n], NPAST))
+	  {
+	       while (n-- > 0)
+	       {
+		    free(devs[n].data.ring);
+		    os_pthread_mutex_destroy(&devs[n].mutex);
+	       }
+	       free(devs);
+	       return(NULL);
+	  }
 	  os_pthread_mutex_init(&devs[n].mutex, NULL);
 	  devs[n].data.today     = hi_lo_init;
 	  devs[n].data.yesterday = hi_lo_init;
+	  for (k = 0; k < NROLL; k++)
+	       devs[n].data.rolling[k] = hi_lo_init;
+	  for (k = 0; k < NVALS; k++)
+	       devs[n].data.last_time[k] = DEV_MISSING_TVALUE;
      }
      devs[ndevices].flags = DEV_FLAGS_END;
      return(devs);
 }
 
 
+int
+dev_history_size(device_t *devs, int period, int history,
+		 const int *tier_keep)
+{
+     device_t *dev;
+     int istat, k;
+     size_t nbins[NTIERS], npast;
+
+     if (!devs || period <= 0)
+     {
+	  debug("dev_history_size(%d): Invalid call arguments supplied; "
+		"devs=%p, period=%d", __LINE__, devs, period);
+	  return(ERR_BADARGS);
+     }
+
+     /*
+      *  Determine how far back in time we need to reach: the longest
+      *  rolling extrema period at the least
+      */
+     if (history < dev_roll_periods[0])
+	  history = dev_roll_periods[0];
+     for (dev = devs; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+     {
+	  if (dev->data.avgs.period[0] > history)
+	       history = dev->data.avgs.period[0];
+	  if (dev->data.pcor && history < 12 * 60 * 60)
+	       history = 12 * 60 * 60;
+     }
+
+     /*
+      *  One slot for the current sample plus one for each period
+      *  within the history.  And a bit of slack for missed samples
+      *  and jitter in the sampling times.
+      */
+     npast = 1 + (size_t)((history + period - 1) / period);
+     npast += npast / 16 + 1;
+
+     /*
+      *  Bins retained by each rollup tier
+      */
+     for (k = 0; k < NTIERS; k++)
+	  nbins[k] = (tier_keep && tier_keep[k] > 0) ?
+	       (size_t)((tier_keep[k] + dev_tier_widths[k] - 1) /
+			dev_tier_widths[k]) : 0;
+
+     for (dev = devs; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+     {
+	  dev_lock(dev);
+	  istat = dev_ring_alloc(dev, npast);
+	  if (istat == ERR_OK)
+	       istat = dev_tiers_alloc(dev, nbins);
+	  dev_unlock(dev);
+	  if (istat != ERR_OK)
+	  {
+	       debug("dev_history_size(%d): Insufficient virtual memory "
+		     "for %u samples", __LINE__, npast);
+	       return(istat);
+	  }
+     }
+
+     return(ERR_OK);
+}
+
+
+size_t
+dev_rollup_get(device_t *dev, int fld, int k, time_t from, time_t to,
+	       dev_rollup_t *out, size_t max)
+{
+     const dev_rollup_t *b;
+     size_t n, nbins;
+     unsigned int seq, seq_end;
+
+     if (!dev || fld < 0 || fld >= NVALS || k < 0 || k >= NTIERS ||
+	 !out || !max || to <= from)
+	  return(0);
+
+     /*
+      *  Bins within [from, to) but no more than the tier can hold
+      */
+     seq     = (unsigned int)((from + dev_tier_widths[k] - 1) /
+				  dev_tier_widths[k]);
+     seq_end = (unsigned int)((to - 1) / dev_tier_widths[k]) + 1;
+
+     n = 0;
+     dev_lock(dev);
+     if (dev->data.tier[k][fld])
+     {
+	  nbins = dev->data.tier_nbins[k];
+	  if (seq_end - seq > nbins)
+	       seq = seq_end - nbins;
+	  for (; seq != seq_end && n < max; seq++)
+	  {
+	       b = &dev->data.tier[k][fld][seq % nbins];
+	       if (b->seq == seq && b->count)
+		    out[n++] = *b;
+	  }
+     }
+     dev_unlock(dev);
+
+     return(n);
+}
+
+
+void
+dev_rollup_add(device_t *dev, int fld, time_t t, float val)
+{
+     if (!dev || fld < 0 || fld >= NVALS)
+	  return;
+
+     dev_lock(dev);
+     dev_rollup_put(dev, fld, t, val);
+     dev_unlock(dev);
+}
+
+
+/*
+ *  Copy the fields of a dev_snapshot_t; seq is left to the caller
+ */
+static void
+dev_snapshot_copy(const device_t *dev, dev_snapshot_t *snap)
+{
+     memcpy(snap->time, dev->data.last_time, sizeof(snap->time));
+     memcpy(snap->val, dev->data.last_val, sizeof(snap->val));
+     memcpy(snap->period, dev->data.avgs.period, sizeof(snap->period));
+     memcpy(snap->range_exists, dev->data.avgs.range_exists,
+	    sizeof(snap->range_exists));
+     memcpy(snap->avg, dev->data.avgs.avg, sizeof(snap->avg));
+     snap->today     = dev->data.today;
+     snap->yesterday = dev->data.yesterday;
+     memcpy(snap->rolling, dev->data.rolling, sizeof(snap->rolling));
+}
+
+
+int
+dev_snapshot(const device_t *dev, dev_snapshot_t *snap)
+{
+     int tries;
+     unsigned int seq;
+
+     if (!dev || !snap)
+     {
+	  debug("dev_snapshot(%d): Invalid call arguments supplied; "
+		"dev=%p, snap=%p", __LINE__, dev, snap);
+	  return(ERR_BADARGS);
+     }
+
+     /*
+      *  The sequence count is odd while a writer is changing the fields
+      *  and has moved on once it is done.  Either way, our copy may be
+      *  torn and must be made again.
+      */
+     for (tries = 0; tries < DEV_SNAPSHOT_TRIES; tries++)
+     {
+	  seq = os_load_acquire(&dev->seq);
+	  if (seq & 1)
+	       continue;
+	  dev_snapshot_copy(dev, snap);
+	  os_fence_acquire();
+	  if (seq == os_load_acquire(&dev->seq))
+	  {
+	       snap->seq = seq;
+	       return(ERR_OK);
+	  }
+     }
+
+     /*
+      *  A writer keeps getting in our way; wait our turn
+      */
+     dev_lock((device_t *)dev);
+     dev_snapshot_copy(dev, snap);
+     snap->seq = dev->seq;
+     dev_unlock((device_t *)dev);
+
+     return(ERR_OK);
+}
+
+
 void
 dev_hi_lo_reset(device_t *devs)
 {
@@ -1380,8 +2247,10 @@ dev_hi_lo_reset(device_t *devs)
 		   !dev_flag_test(devs, DEV_FLAGS_INITIALIZED))
 		    goto skip_me;
 	       dev_lock(devs);
+	       DEV_WRITE_BEGIN(devs);
 	       devs->data.yesterday = devs->data.today;
 	       devs->data.today     = hi_lo_init;
+	       DEV_WRITE_END(devs);
 	       dev_unlock(devs);
 	  skip_me:
 	       devs++;
@@ -1431,6 +2300,7 @@ dev_pcor_adjust(device_t *dev, int period)
      device_t *dev2;
      size_t fld, fld_press, fld_spare, fld_spare2, n, n2;
      device_press_adj_t *pcor;
+     dev_snapshot_t snap;
      time_t t, t2;
 
      if (!dev)
@@ -1483,11 +2353,11 @@ try_again:
 	   *  Only need to look back n2 slots
 	   */
 	  npast12 = n - n2;
-     else if (n2 < NPAST)
+     else if (n2 < dev->data.npast)
 	  /*
 	   *  Deal with wrapping
 	   */
-	  npast12 = (NPAST + n) - n2;
+	  npast12 = (dev->data.npast + n) - n2;
      else
 	  /*
 	   *  We're not storing enough data to look back 12 hours
@@ -1498,9 +2368,13 @@ try_again:
       *  See if we have data this far in the past.  If we don't, then
       *  shave 15 minutes off of the 12 hours and try again.
       */
-     dev_lock(dev);
-     t2 = dev->data.time[npast12];
-     dev_unlock(dev);
+     t2 = 0;
+     if (npast12 >= 0)
+     {
+	  dev_lock(dev);
+	  t2 = dev->data.time[npast12];
+	  dev_unlock(dev);
+     }
      if (npast12 == -1 || t2 == 0)
      {
 	  if (--past > 0)
@@ -1529,18 +2403,18 @@ try_again:
 		*/
 	       continue;
 
-	  dev_lock(dev2);
-	  n2 = dev2->data.n_current;
-	  if (dev2->data.time[n2] != DEV_MISSING_TVALUE)
+	  if (ERR_OK == dev_snapshot(dev2, &snap) &&
+	      snap.time[fld] != DEV_MISSING_TVALUE)
 	  {
-	       float t = convert_temp(dev2->data.val[fld][n2],
+	       float t = convert_temp(snap.val[fld],
 				      dev2->data.fld_units[fld], DEV_UNIT_C);
 	       avg_temp  += t;
 	       avg_temp2 += t;
 	       count_temp++;
 	       count_temp2++;
 	  }
-	  if (npast12 >= 0)
+	  dev_lock(dev2);
+	  if (npast12 >= 0 && dev2->data.npast == dev->data.npast)
 	  {
 	       /*
 		*  Also average in the temperature 12 hours previously
@@ -1556,7 +2430,7 @@ try_again:
 		*  Hmmmm... we were unable to read that device 12 hours
 		*  ago.  Try for 12 hours ago + 1 period
 		*/
-	       else if (npast12 < (NPAST-1) &&
+	       else if ((size_t)npast12 < (dev2->data.npast - 1) &&
 			dev2->data.time[npast12+1] != DEV_MISSING_TVALUE)
 	       {
 		    avg_temp += convert_temp(dev2->data.val[fld][npast12+1],
@@ -1600,11 +2474,10 @@ try_again:
 		*/
 	       continue;
 
-	  dev_lock(dev2);
-	  n2 = dev2->data.n_current;
-	  if (dev2->data.time[n2] != DEV_MISSING_TVALUE)
+	  if (ERR_OK == dev_snapshot(dev2, &snap) &&
+	      snap.time[fld] != DEV_MISSING_TVALUE)
 	  {
-	       float rh = convert_humidity(dev2->data.val[fld][n2],
+	       float rh = convert_humidity(snap.val[fld],
 					   dev2->data.fld_units[fld],
 					   DEV_UNIT_RH);
 	       avg_rh  += rh;
@@ -1612,7 +2485,6 @@ try_again:
 	       count_rh++;
 	       count_rh2++;
 	  }
-	  dev_unlock(dev2);
      }
 
      if (count_rh) /* count_rh > 0 implies count_rh2 > 0 */
@@ -1638,7 +2510,6 @@ try_again:
 	  dev->data.val[fld_spare][n]  = r  * dev->data.val[fld_press][n];
 	  dev->data.val[fld_spare2][n] = r2 * dev->data.val[fld_press][n];
 	  dev_unlock(dev);
-	  dev_stats(dev, fld_spare, fld_spare2, NVALS, NVALS);
      }
      else
      {
@@ -1688,9 +2559,12 @@ try_again:
      }
 
      /*
-      *  All done
+      *  Update the running stats for the corrected pressures now that
+      *  they are known.  dev_read() skipped them.
       */
 done:
+     dev_stats(dev, fld_spare, fld_spare2, NVALS, NVALS);
+
      return(ERR_OK);
 }
 
@@ -1937,11 +2811,13 @@ dev_pcor_add(device_t *device, device_t *devices, int altitude)
      device->data.fld_dtype[pcor->fld_spare]  = DEV_DTYPE_PRSL;
      device->data.fld_units[pcor->fld_spare]  = device->data.fld_units[ipress]; 
      device->data.fld_format[pcor->fld_spare] = device->data.fld_format[ipress];
+     device->data.fld_fmt[pcor->fld_spare]    = device->data.fld_fmt[ipress];
 
      device->data.fld_used[pcor->fld_spare2]   = DEV_FLD_USED;
      device->data.fld_dtype[pcor->fld_spare2]  = DEV_DTYPE_PRSL0;
      device->data.fld_units[pcor->fld_spare2]  = device->data.fld_units[ipress]; 
      device->data.fld_format[pcor->fld_spare2] = device->data.fld_format[ipress];
+     device->data.fld_fmt[pcor->fld_spare2]    = device->data.fld_fmt[ipress];
 
      /*
       *  Now add a reference to the field to the device structure
@@ -41,7 +41,7 @@
 #include "debug.h"
 #include "os.h"
 #include "owire_devices.h"
-#include "utils.h"  /* for timestr */
+#include "utils.h"  /* for timestr, fmt_float_t */
 #include "xml_const.h"
 
 #if defined(__cplusplus)
@@ -134,8 +134,10 @@ typedef struct dev_group_s {
 
 
 /*
- *  Maximum number of measurements to store in memory.  Value chosen to
+ *  Default number of measurements to store in memory.  Value chosen to
  *  represent an entire 24 hour day's worth of samples taken every minute.
+ *  dev_array() gives each device this many slots; dev_history_size() may
+ *  then be used to size them from the actual sampling period.
  */
 
 #define NPAST (60 * 24)
@@ -161,6 +163,23 @@ typedef struct dev_group_s {
 
 #define NPERS 4
 
+/*
+ *  Number of rolling extrema periods per device.  The periods themselves,
+ *  in seconds, are stored in dev_roll_periods[] and are sorted such that
+ *  dev_roll_periods[k] >= dev_roll_periods[k+1].
+ */
+
+#define NROLL 3
+
+/*
+ *  Number of rollup tiers of longer term history kept per device.  The
+ *  width of each tier's bins, in seconds, is stored in dev_tier_widths[].
+ *  The number of bins retained is configured and stored with each device
+ *  in tier_nbins[].
+ */
+
+#define NTIERS 2
+
 /*
  *  device_period_array_t
  *
@@ -180,6 +199,7 @@ typedef int device_period_array_t[NPERS];
 #define DEV_FLAGS_INITIALIZED 0x00000002 /* Device is initialized            */
 #define DEV_FLAGS_ISSUB       0x00000004 /* Device is a subdevice of another */
 #define DEV_FLAGS_OUTSIDE     0x00000008 /* Device reports outdoors measure  */
+#define DEV_FLAGS_STARTED     0x00000010 /* Conversion started; not collected*/
 #define DEV_FLAGS_END         0x80000000 /* End of device list/array         */
 
 
@@ -267,6 +287,21 @@ typedef struct device_loc_s {
  *
  *  float avg[NVALS][NPERS]
  *    Running averages.  See the description above.
+ *
+ *  The remaining fields are private to dev_stats() and dev_next_bin().
+ *  Rather than re-integrate each window on every sample, dev_stats()
+ *  keeps for each value i and period j the integral and the summed
+ *  duration of the ring buffer segments [time[k-1], time[k]] presently
+ *  within the window.  New segments are added as samples arrive and
+ *  the oldest are subtracted back out once they age past period[j] or
+ *  their ring buffer slot is about to be reused.  The integral is kept
+ *  as a compensated (Neumaier) sum, sum[i][j] + comp[i][j], so that the
+ *  adding and subtracting does not accumulate roundoff error.  Segments
+ *  with an end point of DEV_MISSING_TVALUE or 0 are never included.
+ *
+ *  The segments in window [i][j] are those ending at the ring buffer
+ *  slots tail[i][j], tail[i][j] + 1, ..., head[i] (mod npast).  The
+ *  window is empty when tail[i][j] == head[i] + 1 (mod npast).
  */
 
 typedef struct {
@@ -274,6 +309,12 @@ typedef struct {
      device_period_array_t period_approx;
      device_period_array_t range_exists;
      float                 avg[NVALS][NPERS];
+     double                sum[NVALS][NPERS];    /* Integral of val[i]       */
+     double                comp[NVALS][NPERS];   /* Compensation for sum     */
+     long                  dt_sum[NVALS][NPERS]; /* Duration of the window   */
+     size_t                tail[NVALS][NPERS];   /* Oldest segment in window */
+     size_t                head[NVALS];          /* Newest segment added     */
+     int                   primed[NVALS];        /* head & tail are valid    */
 } averages_t;
 
 
@@ -287,8 +328,8 @@ typedef struct {
  */
 
 typedef struct {
-     float   min[NVALS];    /* min(dev->data[i][j], 0 <= j < NPAST) = min[i] */
-     float   max[NVALS];    /* max(dev->data[i][j], 0 <= j < NPAST) = max[i] */
+     float   min[NVALS];    /* min(dev->data[i][j], 0 <= j < npast) = min[i] */
+     float   max[NVALS];    /* max(dev->data[i][j], 0 <= j < npast) = max[i] */
      time_t  tmin[NVALS];   /* tmin[i] is the time stamp for min[i]          */
      time_t  tmax[NVALS];   /* tmax[i] is the time stamp for max[i]          */
      timestr tmin_str[NVALS]; /* Storage for a HH:MM representations of tmin */
@@ -296,6 +337,60 @@ typedef struct {
 } hi_lo_t;
 
 
+/*
+ *  rolling_t
+ *
+ *  Rolling extrema -- the minimum and maximum of val[i][] over the trailing
+ *  dev_roll_periods[k] seconds -- are found with a pair of monotonic deques
+ *  for each value i.  lo[i] holds the ring buffer slots of those samples
+ *  which are smaller than every later sample within the longest period;
+ *  hi[i], those which are larger.  Each new sample pushes out from the
+ *  back of the deque all the samples it supersedes, so the oldest entry
+ *  within period k is that period's extremum.  Since every sample is
+ *  pushed and popped at most once, updates take amortized constant time.
+ *
+ *  Deque positions are free running counters; the entry at position p is
+ *  slot[p % npast].  front[k] is the position of the oldest entry still
+ *  within period k and back is the position following the newest entry.
+ *  Entries before front[0] have been discarded.  slot[] has npast entries
+ *  and is allocated along with the ring buffer.
+ */
+
+typedef struct {
+     unsigned int  *slot;          /* Ring buffer slots, oldest first      */
+     unsigned long  front[NROLL];  /* Oldest entry within each period      */
+     unsigned long  back;          /* Position after the newest entry      */
+} dev_deque_t;
+
+typedef struct {
+     dev_deque_t    lo[NVALS];     /* Candidate minima for val[i][]        */
+     dev_deque_t    hi[NVALS];     /* Candidate maxima for val[i][]        */
+} rolling_t;
+
+
+/*
+ *  dev_rollup_t
+ *
+ *  A rollup bin summarizes the samples of one value taken over a fixed
+ *  interval of time: dev_tier_widths[k] seconds for the bins of tier k.
+ *  Bin b of tier k holds the interval starting at time seq * width, where
+ *  seq % tier_nbins[k] == b.  A bin whose seq does not match the
+ *  interval in question holds stale data, or none at all, and should be
+ *  treated as missing.  dev_stats() adds each sample to its bins as it
+ *  lands, replacing whatever stale data they held.
+ */
+
+typedef struct {
+     unsigned int  seq;            /* Bin start time / bin width           */
+     unsigned int  count;          /* Number of samples in the bin         */
+     float         min;            /* Smallest sample                      */
+     float         max;            /* Largest sample                       */
+     float         sum;            /* Sum of the samples; mean = sum/count */
+} dev_rollup_t;
+
+#define DEV_ROLLUP_START(k,r) ((time_t)(r)->seq * (time_t)dev_tier_widths[k])
+
+
 /*
  *  device_data_t
  *
@@ -303,27 +398,41 @@ typedef struct {
  *  The primary field in this structure is the val[][] field:
  *
  *     val[i][j] is the j'th measurement for the devices ith component
- *               where 0 <= j < NPAST and 0 <= i < NVALS.
+ *               where 0 <= j < npast and 0 <= i < NVALS.
  *  and
  *
  *     time[j] is the timestamp for the measurement val[][j]
  *
  *  Each time dev_read() is called, dev_read() will increment n_current.
- *  n_current is the "j" index running from 0 to NPAST-1 which should
+ *  n_current is the "j" index running from 0 to npast-1 which should
  *  be used to determine where in time[] and val[][] to store the next
  *  set of measurements.  When the incremented value of n_current attains
- *  (or exceeds) NPAST, dev_read() "wraps" the index setting n_current = 0.
+ *  (or exceeds) npast, dev_read() "wraps" the index setting n_current = 0.
  *  As such, it is possible for n_previous > n_current.  Specifically, when
- *  n_previous = NPAST - 1 and n_current = 0.
+ *  n_previous = npast - 1 and n_current = 0.
+ *
+ *  The time[] and val[][] ring buffers are allocated on the heap, npast
+ *  slots apiece, by dev_array() and may be resized with dev_history_size().
+ *  They are stored column by column in a single block, each column starting
+ *  on a cache line boundary.  Once a device's driver has set fld_used[],
+ *  dev_history_size() allocates columns only for the fields in use: val[i]
+ *  is NULL when fld_used[i] == 0.
+ *
+ *  dev_history_size() also allocates, for each field in use, the rollup
+ *  tiers tier[k][i][0 .. tier_nbins[k]-1] in a second block.  The tiers
+ *  are NULL for devices in arrays never passed to dev_history_size() and
+ *  for tiers configured to retain nothing.
  *
  *  The fld_used[] field indicates for which values of i, 0 <= i < NVAL,
  *  the val[i][] values are meaningful.  If fld_used[i] is non-zero, then
  *  val[i][] is used; otherwise, it is ignored.
  *
- *  The running averages and extrema are stored in the avgs, today, and
- *  yesterday fields.  They are automatically generated by dev_read()
- *  after a successful measurement.  Individual device drivers do not
- *  and should not attempt to compute those values.
+ *  The running averages and extrema are stored in the avgs, today,
+ *  yesterday, and rolling fields.  They are automatically generated by
+ *  dev_read() after a successful measurement.  Individual device drivers
+ *  do not and should not attempt to compute those values.  The value
+ *  last added to them is recorded in last_val[i] and last_time[i]; see
+ *  dev_snapshot().
  *
  *  NOTE: if a dev_read() call fails on a device, time[n_current] will be
  *  set to DEV_MISSING_TVALUE so as to indicate a "missing value".
@@ -343,24 +452,40 @@ typedef struct {
  *     fld_format[1] = "%0.f"
  *
  *     fld_used[2,...] = 0
+ *
+ *  dev_init() compiles each fld_format[i] into fld_fmt[i] once the
+ *  driver has set it; the data and XML writers format val[i][] with
+ *  fmt_float(&fld_fmt[i], ...).  A NULL fld_format[i] means "%f".
  */
 
 #define DEV_FLD_USED           1
 #define DEV_FLD_USED_NORECORD -1
 
 typedef struct device_data_s {
-     float        val[NVALS][NPAST+1];  /* Device measurements/conversions   */
-     time_t       time[NPAST+1];        /* Timestamps for each measurement   */
+     /* Fields used with every sample are kept together at the start */
+     time_t      *time;                 /* Timestamps for each measurement   */
+     float       *val[NVALS];           /* Device measurements/conversions   */
+     size_t       npast;                /* Slots in time[] and val[i][]      */
      size_t       n_current;            /* Index of current measurement      */
      size_t       n_previous;           /* Index of previous measurement     */
-     hi_lo_t      today;                /* Today's extrema                   */
-     hi_lo_t      yesterday;            /* Yesterday's extrema               */
-     averages_t   avgs;                 /* Running averages                  */
-     int          fld_dtype[NVALS];     /* DEV_DTYPE_ of val[i][]            */
      int          fld_used[NVALS];      /* val[i][] used if fld_used[i] != 0 */
+     int          fld_dtype[NVALS];     /* DEV_DTYPE_ of val[i][]            */
      int          fld_units[NVALS];     /* DEV_UNIT_ of val[i][]             */
      const char  *fld_format[NVALS];    /* printf() format for val[i][]      */
+     fmt_float_t  fld_fmt[NVALS];       /* fld_format[] compiled by dev_init */
      struct device_press_adj_s *pcor;   /* Pressure correction to sea level  */
+     void        *ring;                 /* Block holding time[] and val[][]  */
+     time_t       last_time[NVALS];     /* Time of the latest val[i] stats'd */
+     float        last_val[NVALS];      /* Latest val[i] added to the stats  */
+     hi_lo_t      today;                /* Today's extrema                   */
+     hi_lo_t      yesterday;            /* Yesterday's extrema               */
+     hi_lo_t      rolling[NROLL];       /* Extrema over each rolling period  */
+     rolling_t    roll;                 /* Deques used to compute rolling[]  */
+     averages_t   avgs;                 /* Running averages                  */
+     dev_rollup_t *tier[NTIERS][NVALS]; /* Rollup tiers of each value        */
+     size_t       tier_nbins[NTIERS];   /* Bins in each tier[k][i]           */
+     void        *tiers;                /* Block holding tier[][]            */
+     time_t       tier_after;           /* Samples up to this are in tier[]  */
 } device_data_t;
 
 /*
@@ -382,7 +507,9 @@ typedef struct device_s {
      float                      gain;          /* Correction gain            */
      float                      offset;        /* Correction offset          */
      struct timeval             lastcmd;       /* Time of last command       */
+     struct timeval             started;       /* Time conversion started    */
      os_pthread_mutex_t         mutex;         /* To serialize access        */
+     unsigned int               seq;           /* Odd while stats change     */
      device_data_t              data;          /* Device measurements        */
      struct device_dispatch_s  *driver;        /* Driver table               */
      void                      *private;       /* Device specific data       */
@@ -395,6 +522,28 @@ typedef struct device_s {
 } device_t;
 
 
+/*
+ *  dev_snapshot_t
+ *
+ *  A consistent copy of a device's latest values along with the running
+ *  averages and extrema computed from them, as filled in by dev_snapshot().
+ *  val[i] is missing when time[i] == DEV_MISSING_TVALUE.  period[],
+ *  range_exists[], and avg[][] are as per averages_t.
+ */
+
+typedef struct {
+     unsigned int  seq;                  /* Device's sequence count        */
+     time_t        time[NVALS];          /* Time stamp of val[i]           */
+     float         val[NVALS];           /* Latest value of each field     */
+     device_period_array_t period;       /* Running average periods        */
+     device_period_array_t range_exists; /* Full period of data exists     */
+     float         avg[NVALS][NPERS];    /* Running averages               */
+     hi_lo_t       today;                /* Today's extrema                */
+     hi_lo_t       yesterday;            /* Yesterday's extrema            */
+     hi_lo_t       rolling[NROLL];       /* Rolling extrema                */
+} dev_snapshot_t;
+
+
 /*
  *  device_press_adj_t
  *
@@ -431,6 +580,10 @@ typedef int device_proc_done_t(struct ha7net_s *ctx, device_t *device,
   device_t *devices);
 typedef int device_proc_read_t(struct ha7net_s *ctx, device_t *device,
   unsigned int flags);
+typedef int device_proc_start_t(struct ha7net_s *ctx, device_t *device,
+  unsigned int flags);
+typedef int device_proc_collect_t(struct ha7net_s *ctx, device_t *device,
+  unsigned int flags);
 typedef void device_proc_out_t(void *out_ctx, const char *fmt, ...);
 typedef int device_proc_show_t(struct ha7net_s *ctx, device_t *device,
   unsigned int flags, device_proc_out_t *out, void *out_ctx);
@@ -460,6 +613,13 @@ typedef int device_proc_show_t(struct ha7net_s *ctx, device_t *device,
  *    Some other error is returned in which case dev_init() stops the list
  *       walk and gives up looking for a driver for that specific device.
  *       A warning is issued and the device is flagged DEV_FLAGS_IGNORE.
+ *
+ *  The start and collect routines are optional and must be supplied as
+ *  a pair.  They split read into two phases: start initiates a conversion
+ *  and returns without waiting for it to complete while collect waits out
+ *  whatever remains of the conversion time and then reads the result.
+ *  This allows the conversions of several devices to proceed at once.
+ *  A driver supplying start and collect must still supply read.
  */
 
 typedef struct device_dispatch_s {
@@ -472,6 +632,8 @@ typedef struct device_dispatch_s {
      device_proc_init_t       *init;     /* Per-device init routine          */
      device_proc_done_t       *done;     /* Per-device de-init routine       */
      device_proc_read_t       *read;     /* Perform a measurement/conversion */
+     device_proc_start_t      *start;    /* Initiate a conversion            */
+     device_proc_collect_t    *collect;  /* Complete a started conversion    */
      device_proc_show_t       *show;     /* Show device specific information */
 } device_dispatch_t;
 
@@ -511,19 +673,63 @@ device_dispatch_t *dev_driver_get(unsigned char fc, const char *hint,
 /*
  *  Return a pointer to a dynamically allocated and initialized array of
  *  devices_t structures.  The array will have ndevices + 1 entries with
- *  the final entry satisfying dev_flag_test(, DEV_FLAGS_END).  The array
- *  must be released with dev_array_free() so as to ensure that all allocated
- *  memory is properly released.
+ *  the final entry satisfying dev_flag_test(, DEV_FLAGS_END).  Each device
+ *  is given NPAST slots of measurement history.  The array must be released
+ *  with dev_array_free() so as to ensure that all allocated memory is
+ *  properly released.
  */
 
 device_t *dev_array(size_t ndevices);
 
+/*
+ *  Size the measurement history of each device in the array so as to hold
+ *  history seconds worth of samples taken every period seconds.  The
+ *  history is extended as needed to cover the longest rolling extrema
+ *  period, each device's longest averaging period and, for barometers
+ *  adjusted to sea level, the 12 hours of outdoor temperatures that
+ *  adjustment uses.  All devices in the array receive the same number of
+ *  slots so that their n_current indices remain in step.  Call this
+ *  before any measurements are stored as resizing a device's history
+ *  discards its measurements.  The rollup tiers of each field in use are
+ *  allocated, empty, as well: tier k retains tier_keep[k] seconds of
+ *  bins, none when tier_keep[k] <= 0.
+ */
+
+int dev_history_size(device_t *devices, int period, int history,
+  const int *tier_keep);
+
 /*
  *  Free a device_t array allocated by dev_array().
  */
 
 void dev_array_free(device_t *devices);
 
+/*
+ *  dev_index_t
+ *
+ *  Hash index from ROM id to device over a device array.  The 16 hex
+ *  digits of a ROM id are taken as a 64 bit integer, which serves as
+ *  the key: lookups compare keys, never strings, and are indifferent to
+ *  the case of the digits.  The table is open addressed with linear
+ *  probing and has at least twice as many slots as there are devices.
+ *  Should two devices share a ROM id, only the first is indexed.
+ *
+ *  Build the index with dev_index_build() once the array has been
+ *  populated, look up devices with dev_index_find(), and release the
+ *  index with dev_index_free() before releasing the array.
+ */
+
+typedef struct {
+     size_t               mask;  /* Number of slots less one             */
+     unsigned long long  *keys;  /* keys[i] is the ROM id of devs[i]     */
+     device_t           **devs;  /* devs[i] == NULL for an empty slot    */
+} dev_index_t;
+
+int dev_index_build(dev_index_t *index, device_t *devices, size_t ndevices);
+device_t *dev_index_find(const dev_index_t *index, const char *romid,
+  size_t len);
+void dev_index_free(dev_index_t *index);
+
 /*
  *  Walk an array of device_t structures, initializing each device not
  *  marked DEV_FLAGS_IGNORE or DEV_FLAGS_INITIALIZED.  Devices merely
@@ -584,12 +790,68 @@ device_proc_done_t dev_done;
  */
 device_proc_read_t dev_read;
 
+/*
+ *  Initiate a measurement / conversion without waiting for it to complete.
+ *  Returns ERR_NO when the device's driver does not support split-phase
+ *  reads.  On success, the device is flagged DEV_FLAGS_STARTED and
+ *  dev_collect() must then be called.
+ */
+device_proc_start_t dev_start;
+
+/*
+ *  Complete a measurement / conversion begun with dev_start()
+ */
+device_proc_collect_t dev_collect;
+
+/*
+ *  Non-zero when the device's driver supports dev_start() and dev_collect()
+ *  *** This macro assumes that dev != NULL ***
+ */
+#define dev_can_start(dev) \
+     ((dev)->driver && (dev)->driver->start && (dev)->driver->collect)
+
+/*
+ *  For use by drivers' collect routines: sleep until at least "ms"
+ *  milliseconds have elapsed since dev_start() initiated the conversion
+ */
+void dev_dwell(device_t *dev, unsigned int ms);
+
 /*
  *  Compute belated statistics: normally done by dev_read()
  */
 int dev_stats(device_t *dev, int fld_start, int fld_end, size_t fld_ignore1,
   size_t fld_ignore2);
 
+/*
+ *  Add a measurement taken at time t, as recorded in a data file, just as
+ *  dev_read() would have: vals[i] is the value of each field in use, or,
+ *  should missing be non-zero, the measurement is recorded as missing.
+ */
+int dev_replay(device_t *dev, time_t t, const float *vals, int missing);
+
+/*
+ *  Have every DS18S20 on the bus perform a temperature conversion with a
+ *  single Skip ROM + Convert T and wait once for them to complete.  The
+ *  subsequent ds18s20_read() calls will then merely read each scratchpad.
+ *  The conversion remains in effect until the next ds18s20_convert_all()
+ *  call or until ctx->convert_t is zeroed.
+ */
+int ds18s20_convert_all(struct ha7net_s *ctx, device_t *devices);
+
+/*
+ *  Copy into snap the device's latest values together with their running
+ *  averages and extrema.  The copy is consistent -- it is never torn by
+ *  a concurrent dev_read() -- yet is normally made without taking the
+ *  device's mutex.  Writers, which still serialize on the mutex, make
+ *  dev->seq odd while they update those fields and even again once they
+ *  are done.  The copy is retried should dev->seq change while it is being
+ *  made; after DEV_SNAPSHOT_TRIES attempts the mutex is taken instead.
+ */
+
+#define DEV_SNAPSHOT_TRIES 64
+
+int dev_snapshot(const device_t *dev, dev_snapshot_t *snap);
+
 /*
  *  Macros to set device flags, clear device flags, and test device flags
  *  *** These macros assume that dev != NULL ***
@@ -636,6 +898,45 @@ int dev_stats(device_t *dev, int fld_start, int fld_end, size_t fld_ignore1,
 
 void dev_hi_lo_reset(device_t *devs);
 
+/*
+ *  Rolling extrema periods in seconds: the last 24 hours, 3 hours, and
+ *  hour.  dev_history_size() always sizes the ring buffer to reach back
+ *  the full 24 hours.  Until it is called, when samples are taken more
+ *  often than once a minute, the longest period is limited to the npast
+ *  most recent samples.
+ */
+
+extern const int dev_roll_periods[NROLL];
+
+/*
+ *  Rollup tiers: 15 minute bins and hourly bins, each retained for as
+ *  long as configured.  Together with the ring buffer of recent samples,
+ *  these provide long range history without re-reading the data files.
+ */
+
+extern const int dev_tier_widths[NTIERS];
+
+/*
+ *  Copy into out[] the rollup bins from tier k of value fld which start
+ *  within the interval [from, to), oldest first.  Missing bins are
+ *  skipped; use DEV_ROLLUP_START() to obtain the start time of each bin
+ *  copied.  At most max bins are copied and the number copied is
+ *  returned.
+ */
+
+size_t dev_rollup_get(device_t *dev, int fld, int k, time_t from, time_t to,
+  dev_rollup_t *out, size_t max);
+
+/*
+ *  Add the value val of field fld sampled at time t to the device's rollup
+ *  tiers without otherwise touching its statistics.  Used to bring the
+ *  tiers up to date from the data files; samples no later than
+ *  dev->data.tier_after are already in the tiers and are ignored, here
+ *  as in dev_stats().
+ */
+
+void dev_rollup_add(device_t *dev, int fld, time_t t, float val);
+
 /*
  *  Utility routine to apply driver hints to the device list in an attempt
  *  to locate the most apt driver for a specific ROM ID.  This is useful
@@ -649,17 +950,18 @@ void dev_hi_lo_reset(device_t *devs);
  */
 
 int dev_info_hints(device_t *devices, size_t ndevices,
-  const device_loc_t *linfo);
+  const device_loc_t *linfo, const dev_index_t *index);
 
 
 /*
  *  Utility routine to merge disparate pieces of information into
- *  an array of device_t structures.
+ *  an array of device_t structures.  Both it and dev_info_hints() locate
+ *  the devices named in linfo through index, an index of the array.
  */
 
 int dev_info_merge(device_t *devices, size_t ndevices, int apply_hints,
   device_period_array_t periods, const device_loc_t *linfo,
-  const device_ignore_t *ilist);
+  const device_ignore_t *ilist, const dev_index_t *index);
 
 
 /*
@@ -758,7 +1060,7 @@ extern void dev_detail(const char *fmt, ...);
 #undef DECLARE
 #endif
 
-#define DRIVER(a1,a2,a3,a4,a5,a6,a7,a8)
+#define DRIVER(a1,a2,a3,a4,a5,a6,a7,a8,a9,a10)
 #define DECLARE(a1,a2) \
      a1 a2;
 
@@ -33,5 +33,8 @@
  */
 DECLARE(device_proc_init_t,ds18s20_init)
 DECLARE(device_proc_read_t,ds18s20_read)
+DECLARE(device_proc_start_t,ds18s20_start)
+DECLARE(device_proc_collect_t,ds18s20_collect)
 
-DRIVER("ds18s20", OWIRE_DEV_18S20, 0, 0, ds18s20_init, 0, ds18s20_read, 0)
+DRIVER("ds18s20", OWIRE_DEV_18S20, 0, 0, ds18s20_init, 0, ds18s20_read,
+       ds18s20_start, ds18s20_collect, 0)
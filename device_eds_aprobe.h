@@ -34,8 +34,11 @@
 DECLARE(device_proc_init_t, eds_aprobe_init)
 DECLARE(device_proc_done_t, eds_aprobe_done)
 DECLARE(device_proc_read_t, eds_aprobe_read)
+DECLARE(device_proc_start_t, eds_aprobe_start)
+DECLARE(device_proc_collect_t, eds_aprobe_collect)
 DECLARE(device_proc_show_t, eds_aprobe_show)
 
 DRIVER("EDS Analog Probe", OWIRE_DEV_2406, 0, 0, eds_aprobe_init,
-       eds_aprobe_done, eds_aprobe_read, eds_aprobe_show)
+       eds_aprobe_done, eds_aprobe_read, eds_aprobe_start,
+       eds_aprobe_collect, eds_aprobe_show)
 
@@ -36,4 +36,4 @@ DECLARE(device_proc_done_t,h3r1_done)
 DECLARE(device_proc_read_t,h3r1_read)
 
 DRIVER("HBI Humidity Sensor", OWIRE_DEV_2438, 0, 0, h3r1_init,
-       h3r1_done, h3r1_read, 0)
+       h3r1_done, h3r1_read, 0, 0, 0)
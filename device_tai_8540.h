@@ -36,4 +36,4 @@ DECLARE(device_proc_done_t,tai_8540_done)
 DECLARE(device_proc_read_t,tai_8540_read)
 
 DRIVER("AAG Humidity Sensor", OWIRE_DEV_2438, 0, 0, tai_8540_init,
-       tai_8540_done, tai_8540_read, 0)
+       tai_8540_done, tai_8540_read, 0, 0, 0)
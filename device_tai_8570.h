@@ -37,5 +37,5 @@ DECLARE(device_proc_read_t, tai_8570_read)
 DECLARE(device_proc_show_t, tai_8570_show)
 
 DRIVER("AAG Pressure Sensor", OWIRE_DEV_2406, 0, 0, tai_8570_init,
-       tai_8570_done, tai_8570_read, tai_8570_show)
+       tai_8570_done, tai_8570_read, 0, 0, tai_8570_show)
 
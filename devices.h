@@ -43,13 +43,16 @@
  *
  *          DRIVER(procedure-type, procedure-name)
  *
- *       where "procedure-type" is one of the five types
+ *       where "procedure-type" is one of the eight types
  *
  *          device_proc_drv_init_t
  *          device_proc_drv_done_t
  *          device_proc_init_t
  *          device_proc_done_t
  *          device_proc_read_t
+ *          device_proc_start_t
+ *          device_proc_collect_t
+ *          device_proc_show_t
  *
  *       declared in device.h, and "procedure-name" is the name of a
  *       global C procedure provided by the device driver code and of
@@ -59,7 +62,8 @@
  *
  *    2. Provides device driver information via the DRIVER() macro:
  *
- *         DRIVER(name,fcode,drvinit,drvdone,devint,devdon,devread)
+ *         DRIVER(name,fcode,drvinit,drvdone,devint,devdon,devread,
+ *                devstart,devcollect,devshow)
  *
  *       where
  *
@@ -77,9 +81,13 @@
  *         device_proc_init_t devinit
  *         device_proc_done_t devdone
  *         device_proc_read_t devread
+ *         device_proc_start_t devstart
+ *         device_proc_collect_t devcollect
+ *         device_proc_show_t devshow
  *           The global device driver procedures provided by the driver.
  *           Only devread must be provided.  All other procedures may be
- *           omitted by supplying the value NULL.
+ *           omitted by supplying the value NULL.  However, devstart and
+ *           devcollect must either both be provided or both be omitted.
  *
  */
 
@@ -32,6 +32,7 @@
  *  SUCH DAMAGE.
  */
 #include <time.h>
+#include <string.h>
 #include "os.h"
 #include "device.h"
 #include "ha7net.h"
@@ -68,41 +69,149 @@ ds18s20_init(ha7net_t *ctx, device_t *dev, device_t *devices)
 }
 
 
+/*
+ *  Count the devices which are driven by ds18s20_read(), including
+ *  those which are read as part of another device (e.g., EDS Analog Probe)
+ */
+static size_t
+ds18s20_count(device_t *devices)
+{
+     device_t *dev;
+     size_t n;
+
+     n   = 0;
+     dev = devices;
+     while (!dev_flag_test(dev, DEV_FLAGS_END))
+     {
+	  if (!dev_flag_test(dev, DEV_FLAGS_IGNORE) &&
+	      dev_flag_test(dev, DEV_FLAGS_INITIALIZED) &&
+	      dev_driver(dev) && dev_driver(dev)->read == ds18s20_read)
+	       n++;
+	  dev++;
+     }
+     return(n);
+}
+
+
 int
-ds18s20_read(ha7net_t *ctx, device_t *dev, unsigned int flags)
+ds18s20_convert_all(ha7net_t *ctx, device_t *devices)
+{
+     int istat;
+
+     if (!ctx || !devices)
+     {
+	  dev_debug("ds18s20_convert_all(%d): Invalid call arguments; "
+		    "ctx=%p, devices=%p; neither may be zero",
+		    __LINE__, ctx, devices);
+	  return(ERR_BADARGS);
+     }
+
+     /*
+      *  Any previous bus-wide conversion is now stale
+      */
+     memset(&ctx->convert_t, 0, sizeof(struct timeval));
+
+     /*
+      *  Nothing to be gained unless there are at least two thermometers
+      */
+     if (ds18s20_count(devices) < 2)
+	  return(ERR_OK);
+
+     /*
+      *  Reset the bus and then issue a Skip ROM (0xCC) followed by a
+      *  Convert T (0x44).  Every DS18S20 on the bus will then begin a
+      *  temperature conversion.  Note that we must not pass a device to
+      *  ha7net_writeblock(): that would address a single device.
+      */
+     istat = ha7net_resetbus(ctx, 0);
+     if (istat == ERR_OK)
+	  istat = ha7net_writeblock(ctx, NULL, NULL, NULL, "CC44", 0);
+     if (istat != ERR_OK)
+     {
+	  dev_debug("ds18s20_convert_all(%d): Unable to initiate a bus-wide "
+		    "temperature conversion; each device will be converted "
+		    "individually; ha7net_writeblock() returned %d; %s",
+		    __LINE__, istat, err_strerror(istat));
+	  return(istat);
+     }
+     gettimeofday(&ctx->convert_t, NULL);
+
+     /*
+      *  Wait once for all of the conversions.  The bus must be left alone
+      *  while the conversions are in progress: parasitically powered
+      *  devices draw their conversion current from the bus.
+      */
+     os_sleep(1250);
+
+     return(ERR_OK);
+}
+
+
+static int
+ds18s20_check(const char *func, ha7net_t *ctx, device_t *dev)
 {
-     int attempts, count_per_c, count_remain, i, istat;
-     unsigned char data[10];
-     unsigned int delay;
-     time_t t0, t1;
-     float tempc;
-     short temp_read;
-     static ha7net_crc_t crc = HA7NET_CRC8(1, 8, 0);
-  
      if (!ctx || !dev)
      {
-	  dev_debug("ds18s20_read(%d): Invalid call arguments; ctx=%p, "
-		    "dev=%p; neither may be non-zero", __LINE__, ctx, dev);
+	  dev_debug("%s(%d): Invalid call arguments; ctx=%p, dev=%p; neither "
+		    "may be non-zero", func, __LINE__, ctx, dev);
 	  return(ERR_BADARGS);
      }
      else if (dev_fcode(dev) != OWIRE_DEV_18S20)
      {
-	  dev_debug("ds18s20_read(%d): The device dev=%p with family code "
-		    "0x%02x does not appear to be a thermometer (0x%02x); "
-		    "the device appears to be a %s",
-		    __LINE__, dev, dev_fcode(dev), OWIRE_DEV_18S20,
+	  dev_debug("%s(%d): The device dev=%p with family code 0x%02x does "
+		    "not appear to be a thermometer (0x%02x); the device "
+		    "appears to be a %s",
+		    func, __LINE__, dev, dev_fcode(dev), OWIRE_DEV_18S20,
 		    dev_strfcode(dev_fcode(dev)));
 	  return(ERR_NO);
      }
+     return(ERR_OK);
+}
+
+
+/*
+ *  How ds18s20_measure() should obtain a temperature conversion
+ */
+#define DS18S20_CONVERT 0  /* Convert now and wait for it                  */
+#define DS18S20_BUS     1  /* ds18s20_convert_all() did a bus-wide convert */
+#define DS18S20_STARTED 2  /* ds18s20_start() initiated a convert          */
+
+static int
+ds18s20_measure(ha7net_t *ctx, device_t *dev, int how)
+{
+     int attempts, count_per_c, count_remain, istat;
+     unsigned char data[10];
+     time_t t0, t1;
+     float tempc;
+     short temp_read;
+     static ha7net_crc_t crc = HA7NET_CRC8(1, 8, 0);
+
+     /*
+      *  If a conversion is already underway, then we need only wait
+      *  for it to complete and then read the scratchpad
+      */
+     attempts = 1;
+     if (how == DS18S20_BUS)
+     {
+	  t0 = (time_t)ctx->convert_t.tv_sec;
+	  goto loop;
+     }
+     else if (how == DS18S20_STARTED)
+     {
+	  dev_dwell(dev, 1250);
+	  t0 = (time_t)dev->started.tv_sec;
+	  goto loop;
+     }
 
      /*
       *  Tell the DS18S20 to begin a temperature measurement
       */
+convert:
      t0 = time(NULL);
      istat = ha7net_writeblock(ctx, dev, NULL, NULL, "44", 0);
      if (istat != ERR_OK)
      {
-	  dev_debug("ds18s20_read(%d): Unable to initiate a temperature "
+	  dev_debug("ds18s20_measure(%d): Unable to initiate a temperature "
 		    "conversion; ha7net_writeblock() returned %d; %s",
 		    __LINE__, istat, err_strerror(istat));
 	  return(istat);
@@ -148,7 +257,6 @@ ds18s20_read(ha7net_t *ctx, device_t *dev, unsigned int flags)
       *                                       COUNT_PER_DEGREE_C
       *                                
       */
-     attempts = 1;
 loop:
      istat = ha7net_writeblock_ex(ctx, dev, data, 10, "BEFFFFFFFFFFFFFFFFFF",
 				  &crc, 0);
@@ -156,7 +264,7 @@ loop:
 	  t1 = time(NULL);
      if (istat != ERR_OK)
      {
-	  dev_debug("ds18s20_read(%d): Unable to read the device's scratch "
+	  dev_debug("ds18s20_measure(%d): Unable to read the device's scratch "
 		    "pad; ha7net_writeblock_ex() returned %d; %s",
 		    __LINE__, istat, err_strerror(istat));
 	  return(istat);
@@ -168,14 +276,14 @@ loop:
      if (data[2] == 0x00 || data[2] == 0xff)
 	  goto data_okay;
 
-     dev_detail("ds18s20_read(%d): Read of DS18S20 device with ROM id "
+     dev_detail("ds18s20_measure(%d): Read of DS18S20 device with ROM id "
 		"\"%s\" failed with bad MSB=0x%02x; will attempt "
 		"another read", __LINE__, dev->romid, data[2]);
  
     if (++attempts <= 2)
 	  goto loop;
 
-     dev_detail("ds18s20_read(%d): Read of DS18S20 device with ROM id "
+     dev_detail("ds18s20_measure(%d): Read of DS18S20 device with ROM id "
 		"\"%s\" has failed", __LINE__, dev->romid);
 
      return(ERR_CRC);
@@ -192,16 +300,28 @@ data_okay:
 	  /*
 	   *  Problem reading the thermometer -- we got the max value
 	   *  This means either we didn't wait long enough or we have
-	   *  a problem with the parasitic power.
+	   *  a problem with the parasitic power.  The latter is more
+	   *  likely when other bus traffic occurred during the conversion
+	   *  so fall back to having this device perform its own conversion.
 	   */
+	  if (how != DS18S20_CONVERT)
+	  {
+	       dev_detail("ds18s20_measure(%d): Received 85C temp from DS18S20 "
+			  "with ROM id \"%s\" after an overlapped conversion; "
+			  "will attempt an individual conversion",
+			  __LINE__, dev->romid);
+	       how      = DS18S20_CONVERT;
+	       attempts = 1;
+	       goto convert;
+	  }
 	  if (++attempts <= 2)
 	  {
-	       dev_detail("ds18s20_read(%d): Received 85C temp from DS18S20 "
+	       dev_detail("ds18s20_measure(%d): Received 85C temp from DS18S20 "
 			  "with ROM id \"%s\"; will attempt another read",
 			  __LINE__, dev->romid);
 	       goto loop;
 	  }
-	  dev_detail("ds18s20_read(%d): Received 85C temp from DS18S20 "
+	  dev_detail("ds18s20_measure(%d): Received 85C temp from DS18S20 "
 		     "with ROM id \"%s\"; giving up for now",
 		     __LINE__, dev->romid);
 	  return(ERR_CRC);
@@ -219,3 +339,55 @@ data_okay:
 
      return(ERR_OK);
 }
+
+
+int
+ds18s20_read(ha7net_t *ctx, device_t *dev, unsigned int flags)
+{
+     int istat;
+
+     if (ERR_OK != (istat = ds18s20_check("ds18s20_read", ctx, dev)))
+	  return(istat);
+
+     return(ds18s20_measure(ctx, dev, (ctx->convert_t.tv_sec != 0) ?
+			    DS18S20_BUS : DS18S20_CONVERT));
+}
+
+
+int
+ds18s20_start(ha7net_t *ctx, device_t *dev, unsigned int flags)
+{
+     int istat;
+
+     if (ERR_OK != (istat = ds18s20_check("ds18s20_start", ctx, dev)))
+	  return(istat);
+
+     /*
+      *  Nothing to do if a bus-wide conversion has been done
+      */
+     if (ctx->convert_t.tv_sec != 0)
+	  return(ERR_OK);
+
+     /*
+      *  Tell the DS18S20 to begin a temperature measurement
+      */
+     istat = ha7net_writeblock(ctx, dev, NULL, NULL, "44", 0);
+     if (istat != ERR_OK)
+	  dev_debug("ds18s20_start(%d): Unable to initiate a temperature "
+		    "conversion; ha7net_writeblock() returned %d; %s",
+		    __LINE__, istat, err_strerror(istat));
+     return(istat);
+}
+
+
+int
+ds18s20_collect(ha7net_t *ctx, device_t *dev, unsigned int flags)
+{
+     int istat;
+
+     if (ERR_OK != (istat = ds18s20_check("ds18s20_collect", ctx, dev)))
+	  return(istat);
+
+     return(ds18s20_measure(ctx, dev, (ctx->convert_t.tv_sec != 0) ?
+			    DS18S20_BUS : DS18S20_STARTED));
+}
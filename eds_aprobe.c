@@ -450,46 +450,115 @@ done:
 }
 
 
-int
-eds_aprobe_read(ha7net_t *ctx, device_t *dev, unsigned int flags)
+static int
+eds_aprobe_check(const char *func, ha7net_t *ctx, device_t *dev,
+		 eds_aprobe_t **devx)
 {
-     int analog_value, istat;
-     float analog_value_temp_compensated, eng_val, last_temp, offset, scale;
-     unsigned char data[14];
-     eds_aprobe_t *devx;
-     time_t t0, t1;
-     static ha7net_crc_t crc = HA7NET_CRC16(0, 12, 0);
-
      /*
       *  Bozo check
       */
      if (!ctx || !dev)
      {
-	  dev_debug("eds_aprobe_read(%d): Invalid call arguments; ctx=%p, "
-		    "dev=%p; neither may be non-zero", __LINE__, ctx, dev);
+	  dev_debug("%s(%d): Invalid call arguments; ctx=%p, dev=%p; neither "
+		    "may be non-zero", func, __LINE__, ctx, dev);
 	  return(ERR_BADARGS);
      }
 
-     devx = (eds_aprobe_t *)dev_private(dev);
-     if (!devx || !devx->ds18s20 || dev_fcode(dev) != OWIRE_DEV_2406)
+     *devx = (eds_aprobe_t *)dev_private(dev);
+     if (!(*devx) || !(*devx)->ds18s20 || dev_fcode(dev) != OWIRE_DEV_2406)
      {
-	  dev_debug("eds_aprobe_read(%d): The device dev=%p with family "
-		    "code 0x%02x does not appear to be an EDS Analog Probe "
-		    "or eds_aprobe_init() has not yet been called for this "
-		    "device", __LINE__, dev, dev_fcode(dev));
+	  dev_debug("%s(%d): The device dev=%p with family code 0x%02x does "
+		    "not appear to be an EDS Analog Probe or eds_aprobe_init() "
+		    "has not yet been called for this device",
+		    func, __LINE__, dev, dev_fcode(dev));
 	  return(ERR_NO);
      }
 
+     return(ERR_OK);
+}
+
+
+/*
+ *  Issue the F5A6... channel access sequence which on the first go
+ *  warms up the DS2406 and on the second go returns the analog value.
+ */
+static int
+eds_aprobe_access(const char *func, ha7net_t *ctx, device_t *dev,
+		  unsigned char *data, const char *what)
+{
+     int istat;
+     static ha7net_crc_t crc = HA7NET_CRC16(0, 12, 0);
+
+     istat = ha7net_writeblock_ex(ctx, dev, data, 14,
+				  "F5A6FFFFFEFFFFFFFFFFFFFFFFFF", &crc, 0);
+     if (istat != ERR_OK)
+     {
+	  dev_debug("%s(%d): Unable to %s; ha7net_writeblock_ex() returned "
+		    "%d; %s", func, __LINE__, what, istat, err_strerror(istat));
+	  if (istat == ERR_CRC)
+	       dev_debug("%s(%d): Read data was 0x"
+			 "%02x%02x%02x%02x%02x%02x%02x"
+			 "%02x%02x%02x%02x%02x%02x%02x",
+			 func, __LINE__,
+			 data[0], data[1], data[2], data[3], data[4],
+			 data[5], data[6], data[7], data[8], data[9],
+			 data[10], data[11], data[12], data[13]);
+     }
+     return(istat);
+}
+
+
+/*
+ *  Take the temperature just measured by the probe's associated DS18S20
+ *  as the probe's temperature
+ */
+static int
+eds_aprobe_temp(device_t *dev, eds_aprobe_t *devx)
+{
+     float last_temp;
+     size_t n;
+
+     /*
+      *  Lock down the structure while we alter field values
+      */
+     dev_lock(devx->ds18s20);
+     n = devx->ds18s20->data.n_current;
+     last_temp = devx->ds18s20->data.val[0][n];
+     if (devx->ds18s20->data.time[n] == DEV_MISSING_TVALUE)
+     {
+	  dev_unlock(devx->ds18s20);
+	  dev_debug("eds_aprobe_temp(%d): No temperature measurement is "
+		    "available from the EDS Analog Probe's associated DS18S20 "
+		    "(ROM id \"%s\")", __LINE__, dev_romid(devx->ds18s20));
+	  return(ERR_NO);
+     }
+     dev_unlock(devx->ds18s20);
+
+     dev_lock(dev);
+     dev->data.val[0][dev->data.n_current] = last_temp;
+     dev_unlock(dev);
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Read the probe's associated DS18S20
+ */
+static int
+eds_aprobe_ds18s20(ha7net_t *ctx, device_t *dev, eds_aprobe_t *devx)
+{
+     int istat;
+
      /*
       *  Get a current temperature read for the probe's associated DS18S20
       *  Use flags of zero so that we don't release the bus lock which
       *  ha7net_gettemp() will obtain
       */
-again:
      istat = dev_read(ctx, devx->ds18s20, 0);
      if (istat != ERR_OK)
      {
-	  dev_debug("eds_aprobe_read(%d): Unable to perform a temperature "
+	  dev_debug("eds_aprobe_ds18s20(%d): Unable to perform a temperature "
 		    "measurement with the EDS Analog Probe's associated "
 		    "DS18S20 (ROM id \"%s\"); ha7net_gettemp() returned "
 		    "the error %d; %s",
@@ -498,38 +567,85 @@ again:
 	  return(istat);
      }
 
+     return(eds_aprobe_temp(dev, devx));
+}
+
+
+/*
+ *  Compute and store the probe's value from the data returned by the
+ *  second channel access
+ */
+static int
+eds_aprobe_compute(device_t *dev, eds_aprobe_t *devx,
+		   const unsigned char *data, time_t t0, time_t t1)
+{
+     int analog_value;
+     float analog_value_temp_compensated, eng_val, last_temp;
+
      /*
-      *  Lock down the structure while we alter field values
+      *  Now, extract the data which is in two bytes & 1's complement
       */
+     analog_value = parseAnalogData(data[9], data[11]);
 
-     last_temp = devx->ds18s20->data.val[0][devx->ds18s20->data.n_current];
+     /*
+      *  Temperature compensated value
+      */
      dev_lock(dev);
-     dev->data.val[0][dev->data.n_current] = last_temp;
+     last_temp = dev->data.val[0][dev->data.n_current];
+     dev_unlock(dev);
+     analog_value_temp_compensated = 
+	  (((float)analog_value *
+	    (1.0 + (last_temp - devx->temp_calib) * 
+	     ((float)devx->temp_coeff / 1000000.0))));
+
+     eng_val = (analog_value_temp_compensated * devx->scale) + devx->offset;
+
+#if 0
+     eng_val = ((float)analog_value * devx->scale) + devx->offset;
+     eng_val = eng_val *
+	  (1.0 + (last_temp - devx->temp_calib) * 
+	   ((float)devx->temp_coeff / 1000000.0));
+#endif
+
+     dev_lock(dev);
+     dev->data.val[1][dev->data.n_current] = eng_val;
+     dev->data.time[dev->data.n_current] = t0 + (int)(difftime(t1, t0)/2.0);
      dev_unlock(dev);
 
+     /*
+      *  Yeah
+      */
+     return(ERR_OK);
+}
+
+
+int
+eds_aprobe_read(ha7net_t *ctx, device_t *dev, unsigned int flags)
+{
+     int istat;
+     unsigned char data[14];
+     eds_aprobe_t *devx;
+     time_t t0, t1;
+
+     if (ERR_OK != (istat = eds_aprobe_check("eds_aprobe_read", ctx, dev,
+					     &devx)))
+	  return(istat);
+
+again:
+     istat = eds_aprobe_ds18s20(ctx, dev, devx);
+     if (istat != ERR_OK)
+	  return(istat);
+
      /*
       *  Now, warm up the DS2406.  Note that the writeblock will reset
       *  the 1-Wire bus and then select the DS2406.  We'll use the bus
       *  lock from the prior gettemp call.
       */
      t0 = time(NULL);
-     istat = ha7net_writeblock_ex(ctx, dev, data, 14,
-				  "F5A6FFFFFEFFFFFFFFFFFFFFFFFF", &crc, 0);
+     istat = eds_aprobe_access("eds_aprobe_read", ctx, dev, data,
+			       "initiate a conversion");
      if (istat != ERR_OK)
-     {
-	  dev_debug("eds_aprobe_read(%d): Unable to initiate a conversion; "
-		    "ha7net_writeblock_ex() returned %d; %s",
-		    __LINE__, istat, err_strerror(istat));
-	  if (istat == ERR_CRC)
-	       dev_debug("eds_aprobe_read(%d): Read data was 0x"
-			 "%02x%02x%02x%02x%02x%02x%02x"
-			 "%02x%02x%02x%02x%02x%02x%02x",
-			 __LINE__,
-			 data[0], data[1], data[2], data[3], data[4],
-			 data[5], data[6], data[7], data[8], data[9],
-			 data[10], data[11], data[12], data[13]);
 	  return(istat);
-     }
 
      /*
       *  Need to wait for devx->dwell milliseconds
@@ -550,24 +666,11 @@ again:
       *   e - CRC16 high byte
       *   f - CRC16 low byte
       */
-     istat = ha7net_writeblock_ex(ctx, dev, data, 14,
-				  "F5A6FFFFFEFFFFFFFFFFFFFFFFFF", &crc, 0);
+     istat = eds_aprobe_access("eds_aprobe_read", ctx, dev, data,
+			       "read the device's scratch pad");
      t1 = time(NULL);
      if (istat != ERR_OK)
-     {
-	  dev_debug("eds_aprobe_read(%d): Unable to read the device's "
-		    "scratch pad; ha7net_writeblock_ex() returned %d; %s",
-		    __LINE__, istat, err_strerror(istat));
-	  if (istat == ERR_CRC)
-	       dev_debug("eds_aprobe_read(%d): Read data was 0x"
-			 "%02x%02x%02x%02x%02x%02x%02x"
-			 "%02x%02x%02x%02x%02x%02x%02x",
-			 __LINE__,
-			 data[0], data[1], data[2], data[3], data[4],
-			 data[5], data[6], data[7], data[8], data[9],
-			 data[10], data[11], data[12], data[13]);
 	  return(istat);
-     }
 
      /*
       *  If this is the first read of this probe, then go back and do it
@@ -588,37 +691,104 @@ again:
 	  goto again;
      }
 
+     return(eds_aprobe_compute(dev, devx, data, t0, t1));
+}
+
+
+int
+eds_aprobe_start(ha7net_t *ctx, device_t *dev, unsigned int flags)
+{
+     int istat;
+     unsigned char data[14];
+     eds_aprobe_t *devx;
+
+     if (ERR_OK != (istat = eds_aprobe_check("eds_aprobe_start", ctx, dev,
+					     &devx)))
+	  return(istat);
+
      /*
-      *  Now, extract the data which is in two bytes & 1's complement
+      *  Start a temperature conversion on the associated DS18S20 unless
+      *  the cycle has already done so; it is collected along with the
+      *  probe
       */
-     analog_value = parseAnalogData(data[9], data[11]);
+     if (!dev_flag_test(devx->ds18s20, DEV_FLAGS_STARTED))
+     {
+	  istat = dev_start(ctx, devx->ds18s20, 0);
+	  if (istat != ERR_OK)
+	  {
+	       dev_debug("eds_aprobe_start(%d): Unable to start a temperature "
+			 "conversion on the EDS Analog Probe's associated "
+			 "DS18S20 (ROM id \"%s\"); dev_start() returned %d; "
+			 "%s", __LINE__, dev_romid(devx->ds18s20), istat,
+			 err_strerror(istat));
+	       return(istat);
+	  }
+     }
 
      /*
-      *  Temperature compensated value
+      *  And warm up the DS2406
       */
-     analog_value_temp_compensated = 
-	  (((float)analog_value *
-	    (1.0 + (last_temp - devx->temp_calib) * 
-	     ((float)devx->temp_coeff / 1000000.0))));
+     return(eds_aprobe_access("eds_aprobe_start", ctx, dev, data,
+			      "initiate a conversion"));
+}
 
-     eng_val = (analog_value_temp_compensated * devx->scale) + devx->offset;
 
-#if 0
-     eng_val = ((float)analog_value * devx->scale) + devx->offset;
-     eng_val = eng_val *
-	  (1.0 + (last_temp - devx->temp_calib) * 
-	   ((float)devx->temp_coeff / 1000000.0));
-#endif
+int
+eds_aprobe_collect(ha7net_t *ctx, device_t *dev, unsigned int flags)
+{
+     int istat;
+     unsigned char data[14];
+     eds_aprobe_t *devx;
+     time_t t1;
 
-     dev_lock(dev);
-     dev->data.val[1][dev->data.n_current] = eng_val;
-     dev->data.time[dev->data.n_current] = t0 + (int)(difftime(t1, t0)/2.0);
-     dev_unlock(dev);
+     if (ERR_OK != (istat = eds_aprobe_check("eds_aprobe_collect", ctx, dev,
+					     &devx)))
+	  return(istat);
 
      /*
-      *  Yeah
+      *  Wait out whatever remains of the dwell time
       */
-     return(ERR_OK);
+     dev_dwell(dev, devx->dwell);
+
+     istat = eds_aprobe_access("eds_aprobe_collect", ctx, dev, data,
+			       "read the device's scratch pad");
+     t1 = time(NULL);
+     if (istat != ERR_OK)
+	  return(istat);
+
+     /*
+      *  Read out the DS18S20's conversion if no one else has yet
+      */
+     if (dev_flag_test(devx->ds18s20, DEV_FLAGS_STARTED))
+     {
+	  istat = dev_collect(ctx, devx->ds18s20, 0);
+	  if (istat != ERR_OK)
+	  {
+	       dev_debug("eds_aprobe_collect(%d): Unable to read the "
+			 "temperature from the EDS Analog Probe's associated "
+			 "DS18S20 (ROM id \"%s\"); dev_collect() returned "
+			 "%d; %s", __LINE__, dev_romid(devx->ds18s20), istat,
+			 err_strerror(istat));
+	       return(istat);
+	  }
+     }
+
+     /*
+      *  The first read of a probe needs to be repeated: do so the
+      *  slow way
+      */
+     if (devx->device_state < EDS_READONCE)
+     {
+	  devx->device_state = EDS_READONCE;
+	  return(eds_aprobe_read(ctx, dev, flags));
+     }
+
+     istat = eds_aprobe_temp(dev, devx);
+     if (istat != ERR_OK)
+	  return(istat);
+
+     return(eds_aprobe_compute(dev, devx, data, (time_t)dev->started.tv_sec,
+			       t1));
 }
 
 
@@ -0,0 +1,1536 @@
+/*
+ *  Copyright (c) 2005, Daniel C. Newman <dan.newman@mtbaldy.us>
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  
+ *   + Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  
+ *   + Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *  
+ *   + Neither the name of mtbaldy.us nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ *  OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ *  AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ *  OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ *  OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+/*
+ *  This program emulates an Embedded Data Systems HA7Net 1-Wire bus master
+ *  so that ha7netd and search may be exercised without any hardware.  It
+ *  serves the /1Wire/<name>.html pages used by ha7net.c from a simulated
+ *  1-Wire bus populated with
+ *
+ *     ds18s20[:temp]            DS18S20 thermometer
+ *     ds2438[:temp[,rh]]        DS2438 with an HIH-3610 humidity sensor
+ *                               as found in an AAG TAI-8540
+ *     h3r1[:temp[,rh]]          DS2438 with an HIH-4000 humidity sensor
+ *                               as found in an HBI H3-R1
+ *     tai8570[:temp[,mbar]]     Pair of DS2406s bit-banging an Intersema
+ *                               MS5534 barometer as found in an AAG TAI-8570
+ *
+ *  Each device specification may be prefixed with "<count>*" to add
+ *  several identical devices (e.g., 20*ds18s20:21.5).  Temperatures are in
+ *  degrees Celsius, relative humidity in percent, and pressure in millibar.
+ *
+ *  The two humidity sensors share the DS2438's family code and ha7netd
+ *  cannot tell them apart: give each a [device] section in its
+ *  configuration with hint=AAG or hint=HBI to match, otherwise its
+ *  humidity will not read correctly.
+ *
+ *  The devices are modelled at the level of their 1-Wire function commands
+ *  so the HTTP responses, CRCs, conversion delays (including the power-on
+ *  85C scratchpad of the DS18S20), and TAI-8570 bit sequences are what a
+ *  real bus would produce.  Per-request latency and jitter may be added and
+ *  faults injected at a chosen rate: dropped connections, HTTP 500 errors,
+ *  and corrupted result data.  Connections are persistent unless -c is
+ *  given, and are closed by the emulator after -i seconds of idleness.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+
+#include "err.h"
+#include "os.h"
+#include "os_socket.h"
+#include "debug.h"
+#include "http.h"
+#include "crc.h"
+#include "utils.h"
+#include "owire_devices.h"
+#include "weather.h"
+
+static int             debug     = 0;
+static unsigned short  port      = 8080;
+static const char     *address   = NULL;
+static unsigned int    latency   = 0;     /* Per request latency, ms        */
+static unsigned int    jitter    = 0;     /* Random additional latency, ms  */
+static unsigned int    faults    = 0;     /* Fault rate, percent            */
+static unsigned int    idle      = 60;    /* Idle connection timeout, s     */
+static int             close_all = 0;     /* Close after every response     */
+
+#define EMU_MAX_DEVICES 256
+#define EMU_MAX_DATA    1024              /* Max. WriteBlock bytes          */
+
+#define FAULT_NONE     0
+#define FAULT_DROP     1                  /* Close without responding       */
+#define FAULT_ERROR    2                  /* HTTP 500 response              */
+#define FAULT_CORRUPT  3                  /* Flip a digit of result data    */
+
+/*
+ *  MS5534 barometer state.  Bits are clocked in by the writer DS2406 and
+ *  the resulting word clocked out by the reader DS2406.
+ */
+typedef struct {
+     char          bits[32];  /* Bits received since the last sequence    */
+     size_t        nbits;     /* Number of bits in bits[]                 */
+     unsigned int  word;      /* Word being clocked out, MSB first        */
+     unsigned int  w[4];      /* Calibration words W1 - W4                */
+     int           c1, c2, c3, c4, c5, c6, ut1;
+} ms5534_t;
+
+typedef struct emu_dev_s emu_dev_t;
+typedef unsigned char emu_xfer_t(emu_dev_t *dev, unsigned char in);
+
+struct emu_dev_s {
+     unsigned char   rom[8];       /* ROM id, family code first            */
+     char            romid[17];    /* ROM id as the HA7Net presents it     */
+     emu_xfer_t     *xfer;         /* Function command handler             */
+     unsigned char   cmd;          /* Function command in progress         */
+     size_t          pos;          /* Bytes transferred since the command  */
+     unsigned int    addr;         /* Address or page for the command      */
+     int             crc;          /* Running CRC16                        */
+     int             crcpos;       /* Next CRC16 byte to send, 0 = none    */
+     size_t          dcount;       /* Channel data bytes since last CRC    */
+     size_t          dindex;       /* Channel data bytes since the command */
+     int             converting;   /* Conversion in progress               */
+     struct timeval  convert_t;    /* When the conversion was started      */
+     unsigned char   scratch[9];   /* Scratchpad                           */
+     unsigned char   page[8][8];   /* DS2438 memory pages                  */
+     unsigned char   mem[4*32];    /* DS2406 EPROM                         */
+     unsigned char   status[8];    /* DS2406 status memory                 */
+     int             vcc;          /* DS2406 Vcc powered                   */
+     ms5534_t       *ms5534;       /* TAI-8570 barometer, if any           */
+     float           temp;         /* Simulated temperature, C             */
+     float           rh;           /* Simulated relative humidity, %       */
+     int             h3r1;         /* DS2438 is an HBI H3-R1, not TAI-8540 */
+     float           pres;         /* Simulated pressure, mbar             */
+};
+
+#define ROM_CMD    0   /* Awaiting a ROM command after a bus reset         */
+#define ROM_MATCH  1   /* Receiving the ROM id of a Match ROM command      */
+#define ROM_FUNC   2   /* Device(s) selected; passing function commands    */
+#define ROM_IDLE   3   /* Nothing selected; bus floats high                */
+
+static struct {
+     emu_dev_t       devs[EMU_MAX_DEVICES];
+     size_t          ndevs;
+     emu_dev_t      *selected;     /* Selected device; NULL with skip      */
+     int             skip;         /* Skip ROM: all devices selected       */
+     int             state;        /* ROM_ state                           */
+     unsigned char   match[8];     /* Match ROM id being received          */
+     size_t          nmatch;
+     char            lockid[11];   /* Current lock, "" when none           */
+     unsigned int    nlocks;
+     unsigned long   nrequests;
+     os_pthread_mutex_t mutex;
+} bus;
+
+typedef struct {
+     char   *data;
+     size_t  len;
+     size_t  max;
+} emu_buf_t;
+
+static const char *hex = "0123456789ABCDEF";
+
+static void version(FILE *fp, const char *prog);
+static void usage(FILE *fp, const char *prog);
+
+
+static void
+emu_log(const char *fmt, ...)
+{
+     va_list ap;
+
+     if (!debug)
+	  return;
+
+     va_start(ap, fmt);
+     vfprintf(stderr, fmt, ap);
+     va_end(ap);
+     fputc('\n', stderr);
+     fflush(stderr);
+}
+
+
+static long
+emu_elapsed(const struct timeval *t0)
+{
+     struct timeval t1;
+
+     gettimeofday(&t1, NULL);
+     return((t1.tv_sec - t0->tv_sec) * 1000 +
+	    (t1.tv_usec - t0->tv_usec) / 1000);
+}
+
+
+static int
+emu_printf(emu_buf_t *buf, const char *fmt, ...)
+{
+     va_list ap;
+     int len;
+
+     for (;;)
+     {
+	  if (buf->data)
+	  {
+	       va_start(ap, fmt);
+	       len = vsnprintf(buf->data + buf->len, buf->max - buf->len,
+			       fmt, ap);
+	       va_end(ap);
+	       if (len < 0)
+		    return(ERR_NO);
+	       if ((buf->len + len) < buf->max)
+	       {
+		    buf->len += len;
+		    return(ERR_OK);
+	       }
+	  }
+	  else
+	       len = 0;
+
+	  /*
+	   *  Grow the buffer and try again
+	   */
+	  {
+	       size_t newmax = 4096 * ((buf->len + len + 4096) / 4096);
+	       char *tmp = (char *)realloc(buf->data, newmax);
+	       if (!tmp)
+	       {
+		    fprintf(stderr, "Insufficient virtual memory\n");
+		    return(ERR_NOMEM);
+	       }
+	       buf->data = tmp;
+	       buf->max  = newmax;
+	  }
+     }
+}
+
+
+/*
+ *  MS5534 calculations.  These are the inverses of the calculations in
+ *  tai_8570.c and are used to produce the D1 and D2 words which yield the
+ *  simulated temperature and pressure.
+ */
+
+static float
+ms5534_temp(const ms5534_t *ms, int d2, float *dt_)
+{
+     float dt, t;
+
+     dt = (float)(d2 - ms->ut1);
+     if (d2 >= ms->ut1)
+	  t = 20.0 + dt * (float)(ms->c6 + 50) / 10240.0;
+     else
+     {
+	  dt = dt - dt*dt/65536.0;
+	  t = 20.0 + dt * (float)(ms->c6 + 50) / 10240.0 + dt / 2560.0;
+     }
+     if (dt_)
+	  *dt_ = dt;
+     return(t);
+}
+
+
+static void
+ms5534_words(const ms5534_t *ms, float temp, float pres, unsigned int *d1,
+	     unsigned int *d2)
+{
+     float dt, off, sens, x;
+     int hi, lo, mid;
+
+     /*
+      *  The temperature is monotonic in D2: bisect for it
+      */
+     lo = 0;
+     hi = 0xffff;
+     while (lo < hi)
+     {
+	  mid = (lo + hi) / 2;
+	  if (ms5534_temp(ms, mid, NULL) < temp)
+	       lo = mid + 1;
+	  else
+	       hi = mid;
+     }
+     *d2 = (unsigned int)lo;
+     (void)ms5534_temp(ms, lo, &dt);
+
+     off  = (float)(ms->c2 * 4) + (float)(ms->c4 - 512) * dt / 4096.0;
+     sens = (float)ms->c1 + (float)ms->c3 * dt / 1024.0 + 24576.0;
+     x    = (pres - 250.0) * 32.0;
+     lo   = (int)((x + off) * 16384.0 / sens + 7168.5);
+     *d1  = (lo < 0) ? 0 : ((lo > 0xffff) ? 0xffff : (unsigned int)lo);
+}
+
+
+static void
+ms5534_init(ms5534_t *ms)
+{
+     unsigned char d[8];
+     size_t i;
+
+     memset(ms, 0, sizeof(ms5534_t));
+
+     /*
+      *  Calibration words from the example in tai_8570.c
+      */
+     ms->w[0] = 0xBE66;
+     ms->w[1] = 0x675B;
+     ms->w[2] = 0xB9AF;
+     ms->w[3] = 0xC199;
+     for (i = 0; i < 4; i++)
+     {
+	  d[2*i]     = (unsigned char)(ms->w[i] >> 8);
+	  d[2*i + 1] = (unsigned char)(ms->w[i] & 0xff);
+     }
+     ms->c1  = ((int)d[0] << 7) | ((int)d[1] >> 1);
+     ms->c5  = ((int)(d[1] & 0x01) << 10) | ((int)d[2] << 2) |
+	  ((int)(d[3] & 0xC0) >> 6);
+     ms->c6  = (int)(0x3F & d[3]);
+     ms->c4  = ((int)d[4] << 2) | ((int)(d[5] & 0xC0) >> 6);
+     ms->c2  = ((int)(0x3f & d[5]) << 6) | (int)(d[7] & 0x3F);
+     ms->c3  = ((int)d[6] << 2) | ((int)(d[7] & 0xC0) >> 6);
+     ms->ut1 = 8 * ms->c5 + 20224;
+}
+
+
+/*
+ *  Clock a byte written to the writer DS2406's PIO into the MS5534.
+ *  0x0E is a 1 bit and 0x04 a 0 bit; see tai_8570.c.
+ */
+
+static void
+ms5534_clock(ms5534_t *ms, const emu_dev_t *dev, unsigned char in)
+{
+     unsigned int d1, d2;
+     int i;
+     static const struct {
+	  const char *bits;
+	  int         which;
+     } seqs[] = {
+	  { "101010101010101000000", -1 },  /* Reset    */
+	  { "111010101000",           0 },  /* Read W1  */
+	  { "111010110000",           1 },  /* Read W2  */
+	  { "111011001000",           2 },  /* Read W3  */
+	  { "111011010000",           3 },  /* Read W4  */
+	  { "1111010000",             4 },  /* Read D1  */
+	  { "1111001000",             5 },  /* Read D2  */
+	  { NULL,                     0 }
+     };
+
+     if (in != 0x0E && in != 0x04)
+	  return;
+
+     /*
+      *  Every sequence starts with a 1; drop the extra clocks which follow
+      */
+     if (!ms->nbits && in == 0x04)
+	  return;
+
+     ms->bits[ms->nbits++] = (in == 0x0E) ? '1' : '0';
+     ms->bits[ms->nbits]   = '\0';
+
+     for (i = 0; seqs[i].bits; i++)
+     {
+	  if (strcmp(ms->bits, seqs[i].bits))
+	       continue;
+	  if (seqs[i].which < 0)
+	       ms->word = 0;
+	  else if (seqs[i].which < 4)
+	       ms->word = ms->w[seqs[i].which];
+	  else
+	  {
+	       ms5534_words(ms, dev->temp, dev->pres, &d1, &d2);
+	       ms->word = (seqs[i].which == 4) ? d1 : d2;
+	  }
+	  ms->nbits = 0;
+	  return;
+     }
+
+     if (ms->nbits >= (sizeof(ms->bits) - 1))
+	  ms->nbits = 0;
+}
+
+
+static int
+ms5534_bit(ms5534_t *ms)
+{
+     int bit;
+
+     bit = (ms->word & 0x8000) ? 1 : 0;
+     ms->word = (ms->word << 1) & 0xffff;
+     return(bit);
+}
+
+
+/*
+ *  DS18S20 thermometer
+ */
+
+static void
+ds18s20_settle(emu_dev_t *dev)
+{
+     int i, tr, cr;
+
+     if (dev->converting && emu_elapsed(&dev->convert_t) >= 750)
+     {
+	  /*
+	   *  Temp = TEMP_READ - 0.25 + (COUNT_PER_C - COUNT_REMAIN) / COUNT_PER_C
+	   */
+	  tr = (int)(dev->temp + 0.25 + 1000.0) - 1000;
+	  cr = (int)(16.0 - 16.0 * (dev->temp - (float)tr + 0.25) + 0.5);
+	  if (cr < 1)
+	       cr = 1;
+	  else if (cr > 16)
+	       cr = 16;
+	  dev->scratch[0] = (unsigned char)((tr * 2) & 0xff);
+	  dev->scratch[1] = (unsigned char)(((tr * 2) >> 8) & 0xff);
+	  dev->scratch[6] = (unsigned char)cr;
+	  dev->scratch[7] = 0x10;
+	  dev->converting = 0;
+     }
+
+     dev->scratch[8] = 0;
+     for (i = 0; i < 8; i++)
+	  dev->scratch[8] = crc8(dev->scratch[8], dev->scratch[i]);
+}
+
+
+static unsigned char
+ds18s20_xfer(emu_dev_t *dev, unsigned char in)
+{
+     size_t pos = dev->pos++;
+
+     if (pos == 0)
+     {
+	  dev->cmd = in;
+	  if (in == 0x44)
+	  {
+	       /*
+		*  Convert T: the scratchpad is updated 750 ms from now
+		*/
+	       ds18s20_settle(dev);
+	       dev->converting = 1;
+	       gettimeofday(&dev->convert_t, NULL);
+	  }
+	  return(in);
+     }
+
+     switch(dev->cmd)
+     {
+     case 0xBE :  /* Read Scratchpad */
+	  ds18s20_settle(dev);
+	  return((pos <= 9) ? dev->scratch[pos - 1] : 0xFF);
+
+     case 0x4E :  /* Write Scratchpad: TH, TL */
+	  if (pos <= 2)
+	       dev->scratch[pos + 1] = in;
+	  return(in);
+
+     case 0x44 :  /* Convert T: read slots return 1 when done */
+	  return((emu_elapsed(&dev->convert_t) >= 750) ? 0xFF : 0x00);
+
+     case 0xB4 :  /* Read Power Supply: externally powered */
+     default :
+	  return(0xFF);
+     }
+}
+
+
+/*
+ *  DS2438 battery monitor with an HIH-3610 or, for an HBI H3-R1, an
+ *  HIH-4000 on its VAD input
+ */
+
+#define DS2438_VDD 5.0
+
+static void
+ds2438_volt(emu_dev_t *dev)
+{
+     float v;
+     int raw;
+
+     if (dev->page[0][0] & 0x08)
+	  v = DS2438_VDD;
+     else if (dev->h3r1)
+	  /*
+	   *  Inverse of the H3-R1 humidity calculation in hbi_h3r1.c with
+	   *  its default gain of 1 and offset of 0
+	   */
+	  v = DS2438_VDD * dev->rh * 0.0062 *
+	       (1.0305 + dev->temp * (0.000044 - 0.0000011 * dev->temp)) + 0.8;
+     else
+	  /*
+	   *  Inverse of the TAI-8540 humidity calculation in tai_8540.c
+	   */
+	  v = DS2438_VDD * dev->rh * 0.0062 * (1.0546 - 0.00216 * dev->temp) +
+	       0.8;
+     raw = (int)(v * 100.0 + 0.5);
+     if (raw < 0)
+	  raw = 0;
+     else if (raw > 0x3ff)
+	  raw = 0x3ff;
+     dev->page[0][3] = (unsigned char)(raw & 0xff);
+     dev->page[0][4] = (unsigned char)((raw >> 8) & 0x03);
+}
+
+
+static void
+ds2438_temp(emu_dev_t *dev)
+{
+     int raw;
+
+     raw = (int)(dev->temp / 0.03125 + ((dev->temp < 0) ? -0.5 : 0.5)) << 3;
+     dev->page[0][1] = (unsigned char)(raw & 0xf8);
+     dev->page[0][2] = (unsigned char)((raw >> 8) & 0xff);
+}
+
+
+static unsigned char
+ds2438_xfer(emu_dev_t *dev, unsigned char in)
+{
+     size_t pos = dev->pos++;
+     unsigned char crc;
+     int i;
+
+     if (pos == 0)
+     {
+	  dev->cmd = in;
+	  if (in == 0x44)
+	       ds2438_temp(dev);
+	  else if (in == 0xB4)
+	       ds2438_volt(dev);
+	  return(in);
+     }
+     else if (pos == 1)
+     {
+	  dev->addr = in & 0x07;
+	  if (dev->cmd == 0xB8)
+	       /* Recall Memory */
+	       memcpy(dev->scratch, dev->page[dev->addr], 8);
+	  else if (dev->cmd == 0x48)
+	  {
+	       /* Copy Scratchpad: only the config and threshold bytes of
+		  page 0 are writable */
+	       if (dev->addr)
+		    memcpy(dev->page[dev->addr], dev->scratch, 8);
+	       else
+	       {
+		    dev->page[0][0] = dev->scratch[0] & 0x0f;
+		    dev->page[0][7] = dev->scratch[7];
+	       }
+	  }
+	  return(in);
+     }
+
+     switch(dev->cmd)
+     {
+     case 0xBE :  /* Read Scratchpad */
+	  if (pos < 10)
+	       return(dev->scratch[pos - 2]);
+	  else if (pos == 10)
+	  {
+	       crc = 0;
+	       for (i = 0; i < 8; i++)
+		    crc = crc8(crc, dev->scratch[i]);
+	       return(crc);
+	  }
+	  return(0xFF);
+
+     case 0x4E :  /* Write Scratchpad */
+	  if (pos < 10)
+	       dev->scratch[pos - 2] = in;
+	  return(in);
+
+     default :
+	  return(0xFF);
+     }
+}
+
+
+/*
+ *  DS2406 dual addressable switch.  When part of a TAI-8570, channel
+ *  access data written to the writer (Vcc powered) DS2406 is clocked into
+ *  the MS5534 and each "FF FA" pair read from the reader DS2406 returns the
+ *  next bit as 0xFF (1) or 0x55 (0).
+ */
+
+static unsigned char
+ds2406_crcbyte(emu_dev_t *dev)
+{
+     unsigned char out;
+
+     if (dev->crcpos == 1)
+     {
+	  out = (unsigned char)(~dev->crc & 0xff);
+	  dev->crcpos = 2;
+     }
+     else
+     {
+	  out = (unsigned char)((~dev->crc >> 8) & 0xff);
+	  dev->crcpos = 0;
+	  dev->crc    = 0;
+	  dev->dcount = 0;
+     }
+     return(out);
+}
+
+
+static unsigned char
+ds2406_xfer(emu_dev_t *dev, unsigned char in)
+{
+     size_t pos = dev->pos++;
+     unsigned char out;
+     int every;
+
+     if (pos == 0)
+     {
+	  dev->cmd    = in;
+	  dev->crc    = crc16(0, in);
+	  dev->crcpos = 0;
+	  dev->dcount = 0;
+	  dev->dindex = 0;
+	  return(in);
+     }
+
+     switch(dev->cmd)
+     {
+     case 0xAA :  /* Read Status */
+     case 0x55 :  /* Write Status */
+	  if (pos <= 2)
+	  {
+	       if (pos == 1)
+		    dev->addr = in;
+	       else
+		    dev->addr |= (unsigned int)in << 8;
+	       dev->crc = crc16(dev->crc, in);
+	       return(in);
+	  }
+	  else if (dev->crcpos)
+	       return(ds2406_crcbyte(dev));
+	  else if (dev->addr >= 8)
+	       return(0xFF);
+	  if (dev->cmd == 0x55)
+	  {
+	       dev->status[dev->addr] = in;
+	       dev->crc    = crc16(dev->crc, in);
+	       dev->addr   = 8;
+	       dev->crcpos = 1;
+	       return(in);
+	  }
+	  out = dev->status[dev->addr++];
+	  dev->crc = crc16(dev->crc, out);
+	  if (dev->addr >= 8)
+	       dev->crcpos = 1;
+	  return(out);
+
+     case 0xF5 :  /* Channel Access */
+	  if (pos <= 2)
+	  {
+	       if (pos == 1)
+		    dev->addr = in;
+	       dev->crc = crc16(dev->crc, in);
+	       return(in);
+	  }
+	  else if (pos == 3)
+	  {
+	       /* Channel info byte: Vcc, two channels, PIO flip-flops */
+	       out = (dev->vcc ? 0x80 : 0x00) | 0x40 |
+		    ((dev->status[7] >> 5) & 0x03);
+	       dev->crc = crc16(dev->crc, out);
+	       return(out);
+	  }
+	  else if (dev->crcpos)
+	       return(ds2406_crcbyte(dev));
+
+	  out = in;
+	  if (dev->ms5534)
+	  {
+	       if (dev->vcc)
+		    ms5534_clock(dev->ms5534, dev, in);
+	       else if (!(dev->dindex & 1))
+		    out = ms5534_bit(dev->ms5534) ? 0xFF : 0x55;
+	  }
+	  dev->dindex++;
+	  dev->crc = crc16(dev->crc, out);
+
+	  switch(dev->addr & 0x03)
+	  {
+	  case 1  : every = 1;  break;
+	  case 2  : every = 8;  break;
+	  case 3  : every = 32; break;
+	  default : every = 0;  break;
+	  }
+	  if (every && ++dev->dcount >= (size_t)every)
+	       dev->crcpos = 1;
+	  return(out);
+
+     default :
+	  return(0xFF);
+     }
+}
+
+
+/*
+ *  1-Wire bus
+ */
+
+static void
+bus_reset(void)
+{
+     bus.selected = NULL;
+     bus.skip     = 0;
+     bus.state    = ROM_CMD;
+     bus.nmatch   = 0;
+}
+
+
+static emu_dev_t *
+bus_find(const char *romid)
+{
+     size_t i;
+
+     for (i = 0; i < bus.ndevs; i++)
+	  if (!strcasecmp(bus.devs[i].romid, romid))
+	       return(&bus.devs[i]);
+     return(NULL);
+}
+
+
+static void
+bus_select(emu_dev_t *dev)
+{
+     bus_reset();
+     bus.selected = dev;
+     bus.state    = ROM_FUNC;
+     dev->pos     = 0;
+}
+
+
+static unsigned char
+bus_byte(unsigned char in)
+{
+     unsigned char out;
+     size_t i;
+
+     switch(bus.state)
+     {
+     case ROM_CMD :
+	  if (in == 0xCC)
+	  {
+	       /*
+		*  Skip ROM
+		*/
+	       bus.skip  = 1;
+	       bus.state = ROM_FUNC;
+	       for (i = 0; i < bus.ndevs; i++)
+		    bus.devs[i].pos = 0;
+	  }
+	  else if (in == 0x55)
+	  {
+	       bus.state  = ROM_MATCH;
+	       bus.nmatch = 0;
+	  }
+	  else
+	       bus.state = ROM_IDLE;
+	  return(in);
+
+     case ROM_MATCH :
+	  bus.match[bus.nmatch++] = in;
+	  if (bus.nmatch == 8)
+	  {
+	       bus.state = ROM_IDLE;
+	       for (i = 0; i < bus.ndevs; i++)
+	       {
+		    if (!memcmp(bus.devs[i].rom, bus.match, 8))
+		    {
+			 bus_select(&bus.devs[i]);
+			 break;
+		    }
+	       }
+	  }
+	  return(in);
+
+     case ROM_FUNC :
+	  if (!bus.skip)
+	       return((*bus.selected->xfer)(bus.selected, in));
+
+	  /*
+	   *  Every device answers: the bus is a wired-AND
+	   */
+	  out = 0xFF;
+	  for (i = 0; i < bus.ndevs; i++)
+	       out &= (*bus.devs[i].xfer)(&bus.devs[i], in);
+	  return(out);
+
+     default :
+	  return(0xFF);
+     }
+}
+
+
+static emu_dev_t *
+bus_add(unsigned char fcode, emu_xfer_t *xfer)
+{
+     emu_dev_t *dev;
+     unsigned int serial;
+     int i;
+
+     if (bus.ndevs >= EMU_MAX_DEVICES)
+     {
+	  fprintf(stderr, "Too many devices; at most %d may be emulated\n",
+		  EMU_MAX_DEVICES);
+	  return(NULL);
+     }
+
+     dev = &bus.devs[bus.ndevs++];
+     memset(dev, 0, sizeof(emu_dev_t));
+     dev->xfer = xfer;
+
+     /*
+      *  Family code, 48 bit serial number, CRC8.  The HA7Net presents
+      *  the ROM id most significant byte (the CRC) first.
+      */
+     serial = 0x00E00000 + (unsigned int)bus.ndevs;
+     dev->rom[0] = fcode;
+     dev->rom[1] = (unsigned char)(serial & 0xff);
+     dev->rom[2] = (unsigned char)((serial >> 8) & 0xff);
+     dev->rom[3] = (unsigned char)((serial >> 16) & 0xff);
+     dev->rom[4] = 0x0A;
+     dev->rom[5] = 0x00;
+     dev->rom[6] = 0x00;
+     dev->rom[7] = 0;
+     for (i = 0; i < 7; i++)
+	  dev->rom[7] = crc8(dev->rom[7], dev->rom[i]);
+     for (i = 0; i < 8; i++)
+     {
+	  dev->romid[14 - 2*i] = hex[dev->rom[i] >> 4];
+	  dev->romid[15 - 2*i] = hex[dev->rom[i] & 0x0f];
+     }
+     dev->romid[16] = '\0';
+
+     return(dev);
+}
+
+
+static int
+bus_add_spec(const char *spec)
+{
+     emu_dev_t *dev, *rdev;
+     float v1, v2;
+     int count, n;
+     const char *ptr;
+     char *end;
+     static const unsigned char tai_8570_signature[13] = {
+	  0x0F, 0xAA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+	  0x38, 0x35, 0x37, 0x30, 0x00};
+
+     /*
+      *  [<count>*]<type>[:<value>[,<value>]]
+      */
+     count = 1;
+     ptr   = strchr(spec, '*');
+     if (ptr)
+     {
+	  count = (int)strtol(spec, &end, 10);
+	  if (end != ptr || count < 1)
+	       return(ERR_SYNTAX);
+	  spec = ptr + 1;
+     }
+
+     n = 0;
+     v1 = v2 = 0.0;
+     ptr = strchr(spec, ':');
+     if (ptr)
+     {
+	  n = sscanf(ptr + 1, "%f,%f", &v1, &v2);
+	  if (n < 1)
+	       return(ERR_SYNTAX);
+     }
+     else
+	  ptr = spec + strlen(spec);
+
+     while (count-- > 0)
+     {
+	  if ((ptr - spec) == 7 && !strncasecmp(spec, "ds18s20", 7))
+	  {
+	       if (!(dev = bus_add(OWIRE_DEV_18S20, ds18s20_xfer)))
+		    return(ERR_NO);
+	       dev->temp = (n >= 1) ? v1 : 20.0;
+
+	       /*
+		*  Power-on scratchpad reads 85C
+		*/
+	       memcpy(dev->scratch, "\xAA\x00\x4B\x46\xFF\xFF\x0C\x10", 8);
+	       ds18s20_settle(dev);
+	  }
+	  else if (((ptr - spec) == 6 && !strncasecmp(spec, "ds2438", 6)) ||
+		   ((ptr - spec) == 4 && !strncasecmp(spec, "h3r1", 4)))
+	  {
+	       if (!(dev = bus_add(OWIRE_DEV_2438, ds2438_xfer)))
+		    return(ERR_NO);
+	       dev->temp = (n >= 1) ? v1 : 20.0;
+	       dev->rh   = (n >= 2) ? v2 : 50.0;
+	       dev->h3r1 = ((ptr - spec) == 4);
+	       dev->page[0][0] = 0x0F;
+	  }
+	  else if ((ptr - spec) == 7 && !strncasecmp(spec, "tai8570", 7))
+	  {
+	       ms5534_t *ms = (ms5534_t *)malloc(sizeof(ms5534_t));
+	       if (!ms)
+	       {
+		    fprintf(stderr, "Insufficient virtual memory\n");
+		    return(ERR_NOMEM);
+	       }
+	       ms5534_init(ms);
+
+	       if (!(dev = bus_add(OWIRE_DEV_2406, ds2406_xfer)) ||
+		   !(rdev = bus_add(OWIRE_DEV_2406, ds2406_xfer)))
+		    return(ERR_NO);
+	       dev->vcc     = 1;
+	       dev->ms5534  = ms;
+	       rdev->ms5534 = ms;
+	       dev->temp    = rdev->temp = (n >= 1) ? v1 : 20.0;
+	       dev->pres    = rdev->pres = (n >= 2) ? v2 : 1013.25;
+	       memset(dev->mem, 0xFF, sizeof(dev->mem));
+	       memset(rdev->mem, 0xFF, sizeof(rdev->mem));
+
+	       /*
+		*  TMEX directory in page 0 of the writer naming the file
+		*  8570.0 which occupies page 1 and holds the reader's ROM id
+		*/
+	       memcpy(dev->mem, tai_8570_signature, 13);
+	       dev->mem[13] = 1;
+	       dev->mem[14] = 1;
+	       dev->mem[32] = 9;
+	       memcpy(dev->mem + 33, rdev->rom, 8);
+	       dev->mem[41] = 0x00;
+	  }
+	  else
+	       return(ERR_SYNTAX);
+     }
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  HTTP server
+ */
+
+static int
+emu_param(const char *query, const char *name, char *buf, size_t buflen)
+{
+     size_t len, nlen;
+     const char *amp;
+
+     if (!query)
+	  return(0);
+
+     nlen = strlen(name);
+     while (*query)
+     {
+	  amp = strchr(query, '&');
+	  if (!amp)
+	       amp = query + strlen(query);
+	  if ((size_t)(amp - query) > nlen && query[nlen] == '=' &&
+	      !strncasecmp(query, name, nlen))
+	  {
+	       len = amp - (query + nlen + 1);
+	       if (len >= buflen)
+		    len = buflen - 1;
+	       memcpy(buf, query + nlen + 1, len);
+	       buf[len] = '\0';
+	       return(1);
+	  }
+	  query = *amp ? amp + 1 : amp;
+     }
+     return(0);
+}
+
+
+static void
+emu_corrupt(emu_buf_t *body)
+{
+     char *ptr;
+
+     /*
+      *  Flip one digit of the first result value
+      */
+     ptr = body->data ? strstr(body->data, "VALUE=\"") : NULL;
+     if (!ptr || !ptr[7] || ptr[7] == '"')
+	  return;
+     ptr += 7 + (rand() % 2);
+     *ptr = (*ptr == '0') ? '1' : '0';
+}
+
+
+static int
+emu_send(SOCKET sd, int code, const char *title, emu_buf_t *body,
+	 int keep_alive)
+{
+     emu_buf_t resp;
+     const char *reason;
+     int istat;
+
+     switch(code)
+     {
+     case 200 : reason = "OK"; break;
+     case 403 : reason = "Forbidden"; break;
+     case 404 : reason = "Not Found"; break;
+     default  : reason = "Internal Server Error"; break;
+     }
+
+     memset(&resp, 0, sizeof(resp));
+     istat = emu_printf(&resp,
+			"<HTML><HEAD><TITLE>%s</TITLE></HEAD>\r\n<BODY>\r\n"
+			"%.*s</BODY></HTML>\r\n",
+			title, body ? (int)body->len : 0,
+			(body && body->data) ? body->data : "");
+     if (istat == ERR_OK)
+     {
+	  char hdr[256];
+	  int hlen;
+
+	  hlen = snprintf(hdr, sizeof(hdr),
+			  "HTTP/1.1 %d %s\r\n"
+			  "Content-Type: text/html\r\n"
+			  "Content-Length: %u\r\n"
+			  "%s\r\n",
+			  code, reason, (unsigned int)resp.len,
+			  keep_alive ? "" : "Connection: close\r\n");
+	  if (os_send(sd, hdr, (size_t)hlen) != hlen ||
+	      os_send(sd, resp.data, resp.len) != (ssize_t)resp.len)
+	       istat = ERR_WRITE;
+     }
+
+     if (resp.data)
+	  free(resp.data);
+     return(istat);
+}
+
+
+static int
+emu_request(SOCKET sd, http_msg_t *req, int keep_alive)
+{
+     emu_buf_t body;
+     emu_dev_t *dev;
+     int code, fault, istat;
+     size_t i, len, n, npages, start;
+     unsigned char data[EMU_MAX_DATA];
+     char page[64], path[64], uri[2048], val[2*EMU_MAX_DATA + 1];
+     const char *query, *title;
+
+     memset(&body, 0, sizeof(body));
+     code  = 200;
+     title = "HA7Net";
+
+     len = (req->req_uri_len < sizeof(uri)) ? req->req_uri_len :
+	  sizeof(uri) - 1;
+     memcpy(uri, req->req_uri, len);
+     uri[len] = '\0';
+     query = strchr(uri, '?');
+     len = query ? (size_t)(query - uri) : strlen(uri);
+     if (len >= sizeof(path))
+	  len = sizeof(path) - 1;
+     memcpy(path, uri, len);
+     path[len] = '\0';
+     if (query)
+	  query++;
+
+     os_pthread_mutex_lock(&bus.mutex);
+
+     bus.nrequests++;
+     emu_log("%lu: GET %s", bus.nrequests, uri);
+
+     /*
+      *  Simulated bus master latency
+      */
+     if (latency || jitter)
+	  os_sleep(latency + (jitter ? (unsigned int)(rand() % (jitter + 1)) :
+			      0));
+
+     /*
+      *  Fault injection
+      */
+     fault = FAULT_NONE;
+     if (faults && (unsigned int)(rand() % 100) < faults)
+     {
+	  fault = 1 + (rand() % 3);
+	  emu_log("%lu: injecting a %s", bus.nrequests,
+		  (fault == FAULT_DROP) ? "dropped connection" :
+		  ((fault == FAULT_ERROR) ? "server error" :
+		   "corrupted response"));
+	  if (fault == FAULT_DROP)
+	  {
+	       os_pthread_mutex_unlock(&bus.mutex);
+	       return(ERR_NO);
+	  }
+	  else if (fault == FAULT_ERROR)
+	  {
+	       code = 500;
+	       emu_printf(&body, "Simulated failure\r\n");
+	       goto send;
+	  }
+     }
+
+     /*
+      *  Requests must carry the current lock, if any
+      */
+     if (bus.lockid[0] && emu_param(query, "LockID", val, sizeof(val)) &&
+	 strcmp(val, bus.lockid) && strcasecmp(path, "/1Wire/GetLock.html"))
+     {
+	  code = 403;
+	  emu_printf(&body, "Exception: the bus is locked\r\n");
+	  goto send;
+     }
+
+     if (!strcasecmp(path, "/1Wire/GetLock.html"))
+     {
+	  title = "Get Lock";
+	  snprintf(bus.lockid, sizeof(bus.lockid), "%010u", ++bus.nlocks);
+	  emu_printf(&body, "<INPUT TYPE=\"TEXT\" NAME=\"LockID_0\" "
+		     "VALUE=\"%s\">\r\n", bus.lockid);
+     }
+     else if (!strcasecmp(path, "/1Wire/ReleaseLock.html"))
+     {
+	  title = "Release Lock";
+	  bus.lockid[0] = '\0';
+     }
+     else if (!strcasecmp(path, "/1Wire/Reset.html") ||
+	      !strcasecmp(path, "/1Wire/PowerDownBus.html"))
+     {
+	  title = "Reset";
+	  bus_reset();
+     }
+     else if (!strcasecmp(path, "/1Wire/Search.html"))
+     {
+	  unsigned long fc = 0;
+
+	  title = "Search";
+	  if (emu_param(query, "FamilyCode", val, sizeof(val)))
+	       fc = strtoul(val, NULL, 16);
+	  n = 0;
+	  if (!emu_param(query, "Conditional", val, sizeof(val)) ||
+	      val[0] != '1')
+	  {
+	       for (i = 0; i < bus.ndevs; i++)
+		    if (!fc || fc == bus.devs[i].rom[0])
+			 emu_printf(&body, "<INPUT TYPE=\"TEXT\" "
+				    "NAME=\"Address_%u\" VALUE=\"%s\">\r\n",
+				    (unsigned int)n++, bus.devs[i].romid);
+	  }
+	  bus_reset();
+     }
+     else if (!strcasecmp(path, "/1Wire/AddressDevice.html"))
+     {
+	  title = "Address Device";
+	  dev = emu_param(query, "Address", val, sizeof(val)) ?
+	       bus_find(val) : NULL;
+	  if (!dev)
+	       emu_printf(&body, "Exception: no such device\r\n");
+	  else
+	  {
+	       bus_select(dev);
+	       emu_printf(&body, "<INPUT TYPE=\"TEXT\" NAME=\"Address_0\" "
+			  "VALUE=\"%s\">\r\n", dev->romid);
+	  }
+     }
+     else if (!strcasecmp(path, "/1Wire/WriteBlock.html"))
+     {
+	  title = "Write Block";
+	  if (emu_param(query, "Address", val, sizeof(val)))
+	  {
+	       if (!(dev = bus_find(val)))
+	       {
+		    emu_printf(&body, "Exception: no such device\r\n");
+		    goto send;
+	       }
+	       bus_select(dev);
+	  }
+	  if (!emu_param(query, "Data", val, sizeof(val)))
+	       val[0] = '\0';
+	  len = strlen(val) & ~(size_t)1;
+	  Hex2Byte(data, val, len);
+	  len >>= 1;
+	  for (i = 0; i < len; i++)
+	  {
+	       data[i] = bus_byte(data[i]);
+	       val[2*i]     = hex[data[i] >> 4];
+	       val[2*i + 1] = hex[data[i] & 0x0f];
+	  }
+	  val[2*len] = '\0';
+	  emu_printf(&body, "<INPUT TYPE=\"TEXT\" NAME=\"ResultData_0\" "
+		     "VALUE=\"%s\">\r\n", val);
+     }
+     else if (!strcasecmp(path, "/1Wire/ReadPages.html"))
+     {
+	  title = "Read Pages";
+	  dev = emu_param(query, "Address", val, sizeof(val)) ?
+	       bus_find(val) : bus.selected;
+	  start = emu_param(query, "StartPage", val, sizeof(val)) ?
+	       (size_t)strtoul(val, NULL, 10) : 0;
+	  npages = emu_param(query, "PagesToRead", val, sizeof(val)) ?
+	       (size_t)strtoul(val, NULL, 10) : 1;
+	  if (!dev)
+	  {
+	       emu_printf(&body, "Exception: no such device\r\n");
+	       goto send;
+	  }
+	  bus_select(dev);
+	  for (n = 0; n < npages; n++)
+	  {
+	       for (i = 0; i < 32; i++)
+	       {
+		    unsigned char c = ((start + n) < 4) ?
+			 dev->mem[32 * (start + n) + i] : 0xFF;
+		    page[2*i]     = hex[c >> 4];
+		    page[2*i + 1] = hex[c & 0x0f];
+	       }
+	       emu_printf(&body, "<INPUT TYPE=\"TEXT\" NAME=\"Page_%u\" "
+			  "VALUE=\"%.64s\">\r\n", (unsigned int)n, page);
+	  }
+     }
+     else
+     {
+	  code = 404;
+	  emu_printf(&body, "Not found\r\n");
+     }
+
+     if (fault == FAULT_CORRUPT)
+	  emu_corrupt(&body);
+
+send:
+     emu_log("%lu: %d %.*s", bus.nrequests, code,
+	     (int)(body.len > 2 ? body.len - 2 : body.len),
+	     body.data ? body.data : "");
+     os_pthread_mutex_unlock(&bus.mutex);
+
+     istat = emu_send(sd, code, title, &body, keep_alive);
+     if (body.data)
+	  free(body.data);
+     return(istat);
+}
+
+
+static void *
+emu_conn(void *arg)
+{
+     http_conn_t hconn;
+     http_msg_t req;
+     int istat, keep_alive;
+
+     http_init(&hconn);
+     hconn.sd       = (SOCKET)(long)arg;
+     hconn.recv_tmo = idle * 1000;
+     os_sock_timeout(hconn.sd, idle * 1000);
+
+     for (;;)
+     {
+	  memset(&req, 0, sizeof(req));
+	  istat = http_read_request(&hconn, &req);
+	  if (istat != ERR_OK)
+	       break;
+	  keep_alive = (req.keep_alive && !close_all) ? 1 : 0;
+	  istat = emu_request(hconn.sd, &req, keep_alive);
+	  http_dispose(&req);
+	  if (istat != ERR_OK || !keep_alive)
+	       break;
+     }
+
+     http_close(&hconn);
+     return(NULL);
+}
+
+
+static void
+version(FILE *fp, const char *prog)
+{
+     const char *bn;
+
+     if (!prog)
+	  prog = "ha7emu";
+     bn = os_basename((char *)prog);
+     if (!bn || !(*bn))
+	  bn = prog;
+     fprintf(fp,
+"%s version %d.%d.%d, built " __DATE__ " " __TIME__ "\n"
+"%s\n",
+	     bn, WEATHER_VERSION_MAJOR, WEATHER_VERSION_MINOR,
+	     WEATHER_VERSION_REVISION, WEATHER_COPYRIGHT);
+}
+
+
+static void
+usage(FILE *fp, const char *prog)
+{
+     size_t l;
+     const char *bn;
+     static const char *pad = "                                    ";
+
+     bn = prog ? os_basename((char *)prog) : NULL;
+     if (!bn || !(*bn))
+	  bn = prog ? prog : "ha7emu";
+     l = strlen(bn);
+
+     fprintf(fp,
+"Usage: %s [-a address] [-c] [-d] [-f pct] [-h] [-i s] [-j ms] [-l ms]\n"
+"       %.*s [-p port] [-s seed] [-v] [device [device [...]]]\n"
+" device     - [count*]ds18s20[:temp], [count*]ds2438[:temp[,rh]] (an AAG\n"
+"              TAI-8540), [count*]h3r1[:temp[,rh]] (an HBI H3-R1), or\n"
+"              [count*]tai8570[:temp[,mbar]] (default\n"
+"              \"2*ds18s20 ds2438 tai8570\").  Give ha7netd hint=AAG or\n"
+"              hint=HBI for each humidity sensor as it cannot tell them apart\n"
+" -a address - IPv4 address to listen on (default all)\n"
+" -c         - Close the connection after each response\n"
+" -d         - Write each request and response to stderr\n"
+" -f pct     - Inject faults into pct percent of requests (default \"-f %u\")\n"
+" -h, -?     - This usage message\n"
+" -i seconds - Close connections idle this long (default \"-i %u\")\n"
+" -j ms      - Add up to ms milliseconds of random latency (default \"-j %u\")\n"
+" -l ms      - Add ms milliseconds of latency per request (default \"-l %u\")\n"
+" -p port    - TCP port to listen on (default \"-p %u\")\n"
+" -s seed    - Seed for the latency and fault generator\n"
+" -v         - Write version information and then exit\n",
+	     bn, (l <= 20) ? (int)l : 20, pad, faults, idle, jitter, latency,
+	     port);
+}
+
+
+static int
+numarg(int argc, const char *argv[], int *i, unsigned long *val)
+{
+     char *ptr;
+
+     if (++(*i) >= argc)
+     {
+	  usage(stderr, argv[0]);
+	  return(ERR_BADARGS);
+     }
+     ptr = NULL;
+     *val = strtoul(argv[*i], &ptr, 0);
+     if (!ptr || ptr == argv[*i] || *ptr)
+     {
+	  fprintf(stderr, "Unable to convert \"%s\" to a numeric value\n",
+		  argv[*i]);
+	  return(ERR_BADARGS);
+     }
+     return(ERR_OK);
+}
+
+
+int
+main(int argc, const char *argv[])
+{
+     struct sockaddr_in sin;
+     pthread_attr_t t_stack;
+     pthread_t t_dummy;
+     SOCKET sd, sd2;
+     int i, istat, ndevspecs, on;
+     unsigned long ulong;
+     static const char *default_devs[] = {
+	  "2*ds18s20", "ds2438", "tai8570", NULL };
+
+     ndevspecs = 0;
+     srand((unsigned int)time(NULL));
+     os_pthread_mutex_init(&bus.mutex, NULL);
+     bus_reset();
+
+     for (i = 1; i < argc; i++)
+     {
+	  if (argv[i][0] != '-')
+	  {
+	       if (argv[i][0] == '?')
+	       {
+		    usage(stdout, argv[0]);
+		    return(0);
+	       }
+	       if (ERR_OK != (istat = bus_add_spec(argv[i])))
+	       {
+		    if (istat == ERR_SYNTAX)
+			 fprintf(stderr, "Unrecognized device specification "
+				 "\"%s\"\n", argv[i]);
+		    return(1);
+	       }
+	       ndevspecs++;
+	       continue;
+	  }
+
+	  switch(argv[i][1])
+	  {
+	  case 'a' :
+	       if (++i >= argc)
+	       {
+		    usage(stderr, argv[0]);
+		    return(1);
+	       }
+	       address = argv[i];
+	       break;
+
+	  case 'c' :
+	       close_all = 1;
+	       break;
+
+	  case 'd' :
+	       debug = 1;
+	       break;
+
+	  case 'f' :
+	       if (numarg(argc, argv, &i, &ulong) != ERR_OK)
+		    return(1);
+	       faults = (ulong > 100) ? 100 : (unsigned int)ulong;
+	       break;
+
+	  case 'h' :
+	  case '?' :
+	       usage(stdout, argv[0]);
+	       return(0);
+
+	  case 'i' :
+	       if (numarg(argc, argv, &i, &ulong) != ERR_OK)
+		    return(1);
+	       idle = ulong ? (unsigned int)ulong : 1;
+	       break;
+
+	  case 'j' :
+	       if (numarg(argc, argv, &i, &ulong) != ERR_OK)
+		    return(1);
+	       jitter = (unsigned int)ulong;
+	       break;
+
+	  case 'l' :
+	       if (numarg(argc, argv, &i, &ulong) != ERR_OK)
+		    return(1);
+	       latency = (unsigned int)ulong;
+	       break;
+
+	  case 'p' :
+	       if (numarg(argc, argv, &i, &ulong) != ERR_OK)
+		    return(1);
+	       if (!ulong || ulong != (0xffff & ulong))
+	       {
+		    fprintf(stderr, "TCP port number must be in the range "
+			    "[1,%u]\n", 0xffff);
+		    return(1);
+	       }
+	       port = (unsigned short)ulong;
+	       break;
+
+	  case 's' :
+	       if (numarg(argc, argv, &i, &ulong) != ERR_OK)
+		    return(1);
+	       srand((unsigned int)ulong);
+	       break;
+
+	  case 'v' :
+	       version(stdout, argv[0]);
+	       return(0);
+
+	  default :
+	       usage(stderr, argv[0]);
+	       return(1);
+	  }
+     }
+
+     if (!ndevspecs)
+	  for (i = 0; default_devs[i]; i++)
+	       bus_add_spec(default_devs[i]);
+
+     for (i = 0; i < (int)bus.ndevs; i++)
+	  fprintf(stdout, "%d. %s (0x%02x)\n",
+		  i + 1, bus.devs[i].romid, bus.devs[i].rom[0]);
+     fflush(stdout);
+
+     /*
+      *  Listen for connections
+      */
+     os_sock_init();
+     http_lib_init();
+     if (debug)
+	  http_debug_set(NULL, NULL, DEBUG_ERRS);
+
+     sd = socket(AF_INET, SOCK_STREAM, 0);
+     if (sd == INVALID_SOCKET)
+     {
+	  perror("socket");
+	  return(1);
+     }
+     on = 1;
+     setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, (char *)&on, sizeof(on));
+
+     memset(&sin, 0, sizeof(sin));
+     sin.sin_family      = AF_INET;
+     sin.sin_port        = htons(port);
+     sin.sin_addr.s_addr = address ? inet_addr(address) : htonl(INADDR_ANY);
+     if (bind(sd, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+	 listen(sd, 8) < 0)
+     {
+	  perror("bind");
+	  os_sock_close(sd);
+	  return(1);
+     }
+     fprintf(stdout, "Listening on %s:%u\n", address ? address : "*", port);
+     fflush(stdout);
+
+     pthread_attr_init(&t_stack);
+     pthread_attr_setstacksize(&t_stack, 1024 * 128);
+     pthread_attr_setdetachstate(&t_stack, PTHREAD_CREATE_DETACHED);
+
+     for (;;)
+     {
+	  sd2 = accept(sd, NULL, NULL);
+	  if (sd2 == INVALID_SOCKET)
+	       continue;
+	  on = 1;
+	  setsockopt(sd2, IPPROTO_TCP, TCP_NODELAY, (char *)&on, sizeof(on));
+	  istat = pthread_create(&t_dummy, &t_stack, emu_conn,
+				 (void *)(long)sd2);
+	  if (istat)
+	  {
+	       fprintf(stderr, "Unable to start a connection thread; "
+		       "pthread_create() returned %d\n", istat);
+	       os_sock_close(sd2);
+	  }
+     }
+
+     /* NOTREACHED */
+     return(0);
+}
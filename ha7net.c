@@ -43,14 +43,40 @@
 
 #include "utils.h"
 #include "ha7net.h"
-#include "bm.h"
 #include "bm_const.h"
 #include "crc.h"
 
-static void ha7net_freestuff(char **results);
-static int ha7net_getstuff(ha7net_t *ctx, char **results, size_t *reslens,
-  size_t *nresults, size_t maxresults, const char *url, const bm_t *look_for,
-  struct timeval *hrt);
+/*
+ *  ha7net_vals_t
+ *  Where ha7net_scan() puts the VALUE="..." strings it extracts from an
+ *  HA7Net response.  The values are copied back to back, with no
+ *  separators, into the caller-supplied buffer buf: buf receives the
+ *  first bufsize - 1 bytes of the concatenation of all the values
+ *  followed by a NUL.  off[] and len[] locate each value within that
+ *  concatenation.  When buf is NULL and alloc is set, a buffer large
+ *  enough for all the values is malloc()ed and must be free()d by the
+ *  caller; when buf is NULL and alloc is clear, the values are only
+ *  counted and measured.  Either of off[] and len[] may be NULL.
+ */
+typedef struct {
+     char   *buf;      /* Receives the values                              */
+     size_t  bufsize;  /* Size of buf, bytes                               */
+     int     alloc;    /* malloc() buf when NULL                           */
+     size_t  max;      /* Maximum number of values to extract              */
+     size_t *off;      /* Offset of each value in the concatenation        */
+     size_t *len;      /* Length of each value, bytes                      */
+     size_t  n;        /* Number of values extracted                       */
+     size_t  total;    /* Length of the concatenated values, bytes         */
+} ha7net_vals_t;
+
+static void ha7net_vals_init(ha7net_vals_t *vals, char *buf, size_t bufsize,
+  size_t *off, size_t *len, size_t max);
+static int ha7net_scan(const http_msg_t *hresp, ha7net_vals_t *vals,
+  int look_for);
+static int ha7net_getstuff(ha7net_t *ctx, ha7net_vals_t *vals,
+  const char *url, int look_for, int resend, struct timeval *hrt);
+static void ha7net_hdispose(ha7net_t *ctx);
+static void ha7net_hclose(ha7net_t *ctx);
 
 static debug_proc_t  our_debug_ap;
 static debug_proc_t *debug_proc = our_debug_ap;
@@ -196,6 +222,58 @@ ha7net_lib_done(void)
 }
 
 
+/*
+ *  Release the last HTTP response along with any copy of its body
+ */
+static void
+ha7net_hdispose(ha7net_t *ctx)
+{
+     if (ctx->hresp_dispose)
+     {
+	  http_dispose(&ctx->hresp);
+	  ctx->hresp_dispose = 0;
+     }
+     ctx->last_len = 0;
+}
+
+
+/*
+ *  Close the HTTP connection.  The last response was parsed in place in
+ *  the connection's receive buffer, which the close frees, so its body is
+ *  first copied for ha7net_last_response() and the response released.
+ */
+static void
+ha7net_hclose(ha7net_t *ctx)
+{
+     char *tmp;
+
+     if (ctx->hresp_dispose && ctx->hresp.bdy)
+     {
+	  ctx->last_len = 0;
+	  if (ctx->hresp.bdy_len >= ctx->last_max)
+	  {
+	       tmp = (char *)realloc(ctx->last, ctx->hresp.bdy_len + 1);
+	       if (tmp)
+	       {
+		    ctx->last     = tmp;
+		    ctx->last_max = ctx->hresp.bdy_len + 1;
+	       }
+	  }
+	  if (ctx->hresp.bdy_len < ctx->last_max)
+	  {
+	       memcpy(ctx->last, ctx->hresp.bdy, ctx->hresp.bdy_len);
+	       ctx->last[ctx->hresp.bdy_len] = '\0';
+	       ctx->last_len = ctx->hresp.bdy_len;
+	  }
+	  http_dispose(&ctx->hresp);
+	  ctx->hresp_dispose = 0;
+     }
+     else
+	  ha7net_hdispose(ctx);
+     http_close(&ctx->hconn);
+}
+
+
 int
 ha7net_lib_init(void)
 {
@@ -216,11 +294,7 @@ ha7net_done(ha7net_t *ctx, int flags)
 	      (http_isopen(&ctx->hconn) || ctx->host_len))
 	       ha7net_powerdownbus(ctx, 0);
 
-	  if (ctx->hresp_dispose)
-	  {
-	       http_dispose(&ctx->hresp);
-	       ctx->hresp_dispose = 0;
-	  }
+	  ha7net_hdispose(ctx);
 
 	  if (http_isopen(&ctx->hconn))
 	  {
@@ -233,7 +307,7 @@ ha7net_done(ha7net_t *ctx, int flags)
 	       /*
 		*  And shut down the connection
 		*/
-	       http_close(&ctx->hconn);
+	       ha7net_hclose(ctx);
 	  }
 
 	  ctx->host[0]    = '\0';
@@ -241,6 +315,12 @@ ha7net_done(ha7net_t *ctx, int flags)
 	  ctx->port       = 0;
 	  ctx->lockid_len = 0;
 	  ctx->lockid[0]  = '\0';
+
+	  ha7net_hdispose(ctx);
+	  if (ctx->last)
+	       free(ctx->last);
+	  ctx->last     = NULL;
+	  ctx->last_max = 0;
      }
 }
 
@@ -265,9 +345,11 @@ ha7net_close(ha7net_t *ctx, int flags)
 		    ha7net_releaselock(ctx);
 
 	       /*
-		*  And shut down the connection
+		*  And shut down the connection unless asked to keep
+		*  it open for re-use by the next request
 		*/
-	       http_close(&ctx->hconn);
+	       if (!(flags & HA7NET_FLAGS_KEEPALIVE))
+		    ha7net_hclose(ctx);
 	  }
      }
 }
@@ -361,37 +443,199 @@ ha7net_open(ha7net_t *ctx, const char *host, unsigned short port,
 
 
 static void
-ha7net_freestuff(char **results)
+ha7net_vals_init(ha7net_vals_t *vals, char *buf, size_t bufsize,
+		 size_t *off, size_t *len, size_t max)
 {
-     if (do_trace)
-	  trace("ha7net_freestuff(%d): Called with results=%p",
-		__LINE__, results);
+     vals->buf     = buf;
+     vals->bufsize = buf ? bufsize : 0;
+     vals->alloc   = 0;
+     vals->max     = max;
+     vals->off     = off;
+     vals->len     = len;
+     vals->n       = 0;
+     vals->total   = 0;
+     if (buf && bufsize)
+	  buf[0] = '\0';
+}
+
+
+static int
+ha7net_scan(const http_msg_t *hresp, ha7net_vals_t *vals, int look_for)
+{
+     int in_tag, istat, match;
+     size_t room;
+     char *dst;
+     unsigned char state;
+     const unsigned char *uend, *uptr, *vptr;
+
+     if (vals)
+     {
+	  vals->n     = 0;
+	  vals->total = 0;
+     }
+
+     /*
+      *  Check the HTTP Status-Code
+      */
+     if (hresp->sta_code < 200 || hresp->sta_code > 299)
+     {
+	  debug("ha7net_scan(%d): Non-success (2yz) HTTP status code "
+		"received; HTTP Status-Line is \"%.*s\"",
+		__LINE__, hresp->sta ? hresp->sta_len : 6,
+		hresp->sta ? hresp->sta : "(none)");
+	  return(ERR_NO);
+     }
+
+     /*
+      *  Skip now if there's nothing to extract
+      */
+     if (!vals || !vals->max || !look_for)
+	  return(ERR_OK);
+
+     /*
+      *  The values cannot total more than the length of the body
+      */
+     if (!vals->buf && vals->alloc)
+     {
+	  vals->buf = (char *)malloc(hresp->bdy_len + 1);
+	  if (!vals->buf)
+	  {
+	       debug("ha7net_scan(%d): Insufficient virtual memory", __LINE__);
+	       return(ERR_NOMEM);
+	  }
+	  vals->bufsize = hresp->bdy_len + 1;
+     }
+     dst  = vals->buf;
+     room = (dst && vals->bufsize) ? vals->bufsize - 1 : 0;
+
+     /*
+      *  Make a single pass over the message body looking for occurrences
+      *  of the search string and then the following VALUE="xxx" within
+      *  the same tag.  It's this string "xxx" which we are attempting to
+      *  pluck out and pass back.  The search string and VALUE=" are
+      *  both recognized by the Aho-Corasick automaton built from
+      *  make_includes.conf, so each byte of the body is looked at once.
+      */
+     in_tag = 0;
+     state  = 0;
+     uptr   = (const unsigned char *)hresp->bdy;
+     uend   = uptr + hresp->bdy_len;
+     for (; uptr < uend && vals->n < vals->max; uptr++)
+     {
+	  if (*uptr == '>' && in_tag)
+	  {
+	       debug("ha7net_scan(%d): Unable to locate an occurrence of "
+		     "'VALUE=\"...\">' after the search string (AC_MATCH %d) "
+		     "in the HTTP response", __LINE__, look_for);
+	       istat = ERR_NO;
+	       goto done;
+	  }
+	  state = AC_NEXT(&ac_info, state, *uptr);
+	  if (!(match = ac_info.match[state]))
+	       continue;
+	  else if (match == look_for)
+	  {
+	       in_tag = 1;
+	       continue;
+	  }
+	  else if (match != AC_MATCH_VALUE || !in_tag)
+	       continue;
+
+	  /*
+	   *  Copy the value out while looking for the closing double quote
+	   */
+	  vptr = ++uptr;
+	  if (vals->off)
+	       vals->off[vals->n] = vals->total;
+	  for (; uptr < uend && *uptr != '"' && *uptr != '>'; uptr++)
+	  {
+	       if (vals->total < room)
+		    dst[vals->total] = (char)*uptr;
+	       vals->total++;
+	  }
+	  if (uptr >= uend || *uptr != '"')
+	  {
+	       debug("ha7net_scan(%d): Unable to locate a closing '\"' "
+		     "after a 'VALUE=\"' in the HTTP response", __LINE__);
+	       istat = ERR_NO;
+	       goto done;
+	  }
+	  if (vals->len)
+	       vals->len[vals->n] = uptr - vptr;
+	  vals->n++;
+
+	  if (dbglvl & DEBUG_HA7NET_RECV)
+	       detail2("ha7net_scan(%d): Received \"%.*s\"",
+		       __LINE__, (int)(uptr - vptr), (const char *)vptr);
+
+	  /*
+	   *  Start afresh with the byte following the closing quote
+	   */
+	  in_tag = 0;
+	  state  = 0;
+     }
+
+     if (in_tag)
+     {
+	  debug("ha7net_scan(%d): Unable to locate an occurrence of "
+		"'VALUE=\"...\">' after the search string (AC_MATCH %d) "
+		"in the HTTP response", __LINE__, look_for);
+	  istat = ERR_NO;
+	  goto done;
+     }
+     else if (!vals->n)
+     {
+	  /*
+	   *  We've found NO occurrences of the search string
+	   */
+	  debug("ha7net_scan(%d): Unable to locate the search string "
+		"(AC_MATCH %d) in the HTTP response", __LINE__, look_for);
+	  istat = ERR_NO;
+	  goto done;
+     }
+
+     istat = ERR_OK;
 
-     while (results[0])
+done:
+     if (istat == ERR_OK)
+     {
+	  if (dst && vals->bufsize)
+	       dst[(vals->total < room) ? vals->total : room] = '\0';
+     }
+     else
      {
-	  free(results[0]);
-	  results++;
+	  vals->n     = 0;
+	  vals->total = 0;
+	  if (vals->alloc && vals->buf)
+	  {
+	       free(vals->buf);
+	       vals->buf     = NULL;
+	       vals->bufsize = 0;
+	  }
      }
+
+     return(istat);
 }
 
 
+/*
+ *  Send a GET request and scan its response.  resend is non-zero for
+ *  requests which merely read -- Search and ReadPages -- and so may be
+ *  sent a second time should a re-used connection close before the
+ *  response begins.  GetLock, ReleaseLock, Reset, AddressDevice, and
+ *  WriteBlock all change the state of the bus master or the bus.
+ */
 static int
-ha7net_getstuff(ha7net_t *ctx, char **results, size_t *reslens,
-		size_t *nresults, size_t maxresults, const char *url,
-		const bm_t *look_for, struct timeval *hrt)
+ha7net_getstuff(ha7net_t *ctx, ha7net_vals_t *vals, const char *url,
+		int look_for, int resend, struct timeval *hrt)
 {
      struct timeval hrt_start, hrt_end;
-     size_t i, nres, ulen;
-     int istat;
-     const unsigned char *uend, *uptr;
+     int istat, reused;
 
      if (do_trace)
-	  trace("ha7net_getstuff(%d): Called with ctx=%p, results=%p, "
-		"reslens=%p, nresults=%p, maxresults=%u, url=\"%s\" (%p), "
-		"look_for->substr=\"%s\"",
-		__LINE__, ctx, results, reslens, nresults, maxresults,
-		url ? url : "(null)", url,
-		look_for ? (const char *)look_for->substr : "(null)");
+	  trace("ha7net_getstuff(%d): Called with ctx=%p, vals=%p, "
+		"url=\"%s\" (%p), look_for=%d, resend=%d", __LINE__, ctx,
+		vals, url ? url : "(null)", url, look_for, resend);
      if (!ctx || !url)
      {
 	  debug("ha7net_getstuff(%d): Invalid call arguments supplied; "
@@ -407,23 +651,26 @@ ha7net_getstuff(ha7net_t *ctx, char **results, size_t *reslens,
 	  return(ERR_BADARGS);
      }
 
-     /*
-      *  Count of results found
-      */
-     nres = 0;
+     if (vals)
+     {
+	  vals->n     = 0;
+	  vals->total = 0;
+     }
 
      /*
       *  Release any previous HTTP response? 
       */
-     if (ctx->hresp_dispose)
-     {
-	  http_dispose(&ctx->hresp);
-	  ctx->hresp_dispose = 0;
-     }
+     ha7net_hdispose(ctx);
 
      /*
-      *  Open an HTTP connection if we don't have one already
+      *  Open an HTTP connection if we don't have one already.  When we
+      *  are re-using a connection, it may have been closed by the bus
+      *  master while idle.  In that case we will re-open it and then
+      *  re-send the request, provided that the bus master cannot have
+      *  acted upon it.
       */
+     reused = http_isopen(&ctx->hconn) ? 1 : 0;
+reconnect:
      if (!http_isopen(&ctx->hconn))
      {
 	  istat = http_open(&ctx->hconn, ctx->host, ctx->port, ctx->tmo);
@@ -452,6 +699,8 @@ ha7net_getstuff(ha7net_t *ctx, char **results, size_t *reslens,
      istat = http_send_request(&ctx->hconn, "GET", url);
      if (istat != ERR_OK)
      {
+	  if (reused)
+	       goto stale;
 	  detail("ha7net_getstuff(%d): Error sending the request \"GET %s "
 		 "HTTP/1.1\"; http_send_request() returned %d; %s",
 		 __LINE__, url, istat, err_strerror(istat));
@@ -470,231 +719,64 @@ ha7net_getstuff(ha7net_t *ctx, char **results, size_t *reslens,
      }
      if (istat != ERR_OK)
      {
+	  /*
+	   *  The request was delivered.  Only when the bus master closed
+	   *  the connection without starting a response may we send it
+	   *  again, and then only a request which merely reads as the bus
+	   *  master may already have acted upon it.
+	   */
+	  if (istat == ERR_EOM)
+	  {
+	       if (reused && resend)
+		    goto stale;
+	       istat = ERR_READ;
+	  }
 	  detail("ha7net_getstuff(%d): Error reading the HTTP response; "
 		 "http_read_response() returned %d; %s",
 		 __LINE__, istat, err_strerror(istat));
-	  goto done;
-     }
-     ctx->hresp_dispose = 1;
 
-     /*
-      *  Check the HTTP Status-Code
-      */
-     if (ctx->hresp.sta_code < 200 || ctx->hresp.sta_code > 299)
-     {
-	  debug("ha7net_getstuff(%d): Non-success (2yz) HTTP status code "
-		"received; HTTP Status-Line is \"%.*s\"",
-		__LINE__, ctx->hresp.sta ? ctx->hresp.sta_len : 6,
-		ctx->hresp.sta ? ctx->hresp.sta : "(none)");
-	  istat = ERR_NO;
+	  /*
+	   *  Unread response data may remain on the connection: do not
+	   *  let a subsequent request re-use it
+	   */
+	  ha7net_hclose(ctx);
 	  goto done;
      }
+     ctx->hresp_dispose = 1;
 
      /*
-      *  Skip now if !results || !maxresults
-      *  Presently we don't expect anyone to call us and just want a tally
-      *  reported via nresults.
+      *  Extract the results from the response.  This must be done before
+      *  any close of the connection as the response lives in the
+      *  connection's receive buffer.
       */
-     if (!results || !maxresults || !look_for)
-     {
-	  istat = ERR_OK;
-	  goto done;
-     }
+     istat = ha7net_scan(&ctx->hresp, vals, look_for);
 
      /*
-      *  Loop over the message body searching for occurrences of
-      *  the search string and then the following VALUE="xxx".  It's
-      *  this string "xxx" which we are attempting to pluck out and
-      *  pass back via results[].
+      *  And close the connection now if the bus master will not accept
+      *  another request on it
       */
-     uptr = (const unsigned char *)ctx->hresp.bdy;
-     ulen = ctx->hresp.bdy_len;
-     uend = uptr + ulen;
-     do
-     {
-	  ssize_t len, pos;
-	  char *tmp;
-	  const unsigned char *uptr2, *uptr3;
-
-	  /*
-	   *  Look for the search string
-	   */
-	  pos = bm_search(uptr, ulen, look_for);
-	  if (pos < 0)
-	       goto bm_error;
-	  else if (pos >= ulen)
-	  {
-	       if (nres)
-		    /*
-		     *  We've found at least one occurrence of the search
-		     *  string.  That's good enough for me and I'm a computer!
-		     */
-		    break;
-
-	       /*
-		*  We've found NO occurrences of the search string
-		*/
-	       debug("ha7net_getstuff(%d): Unable to locate the search "
-		     "string, '%s', in the HTTP response",
-		     __LINE__,
-		     look_for ? (const char *)look_for->substr : "(null)");
-	       istat = ERR_NO;
-	       goto done;
-	  }
-
-	  /*
-	   *  uptr + pos is the start of the look_for string
-	   *  uptr + pos + look_len is the start of the text immediately
-	   *     following.
-	   */
-	  uptr += pos + look_for->sublen;
-	  ulen -= pos + look_for->sublen;
-
-	  /*
-	   *  Now look for the following 'VALUE="'.  It must appear before
-	   *  a following '>'.
-	   */
-	  pos = bm_search(uptr, ulen, &bm_info_value);
-	  if (pos < 0)
-	       goto bm_error;
-	  else if (pos >= ulen)
-	  {
-	       if (nres)
-		    /*
-		     *  We've found at least one occurrence of the search
-		     *  string.  That's good enough for me and I'm a computer!
-		     */
-		    break;
-
-	       /*
-		*  We've found NO occurrences of the search string
-		*/
-	       debug("ha7net_getstuff(%d): Unable to locate the search "
-		     "string, '%s', in the HTTP response",
-		     __LINE__,
-		     look_for ? (const char *)look_for->substr : "(null)");
-	       istat = ERR_NO;
-	       goto done;
-	  }
-
-	  uptr3 = uptr;
-	  while (*uptr3 && *uptr3 != '>')
-	       uptr3++;
-	  if (!*uptr3 || (uptr + pos) >= uptr3)
-	  {
-	       /*
-		*  Something isn't right....
-		*/
-	       debug("ha7net_getstuff(%d): Unable to locate an occurrence of "
-		     "'VALUE=\"...\">' after the search string '%s' in the "
-		     "HTTP response",
-		     __LINE__,
-		     look_for ? (const char *)look_for->substr : "(null)");
-	       istat = ERR_NO;
-	       goto done;
-	  }
-
-	  /*
-	   *  Last time I checked, the string 'VALUE="' has 7 octets
-	   */
-	  uptr += pos + bm_info_value.sublen;
-	  ulen -= pos + bm_info_value.sublen;
-
-	  /*
-	   *  Look for the trailing double quote
-	   */
-	  uptr2 = uptr;
-	  while(*uptr2 && *uptr2 != '"')
-	       uptr2++;
-	  if (*uptr2 != '"' || uptr2 > uptr3)
-	  {
-	       debug("ha7net_getstuff(%d): Unable to locate a closing '\"' "
-		     "after a 'VALUE=\"' in the HTTP response", __LINE__);
-	       istat = ERR_NO;
-	       goto done;
-	  }
-
-	  len = uptr2 - uptr;
-	  tmp = (char *)malloc(len + 1);
-	  if (!tmp)
-	  {
-	       debug("ha7net_getstuff(%d): Insufficient virtual memory", 
-		     __LINE__);
-	       istat = ERR_NOMEM;
-	       goto done;
-	  }
-	  memcpy(tmp, uptr, len);
-	  tmp[len] = '\0';
-	  if (reslens)
-	       reslens[nres] = len;
-	  results[nres++] = tmp;
-
-	  if (dbglvl & DEBUG_HA7NET_RECV)
-	       detail2("ha7net_getstuff(%d): Received \"%.*s\"",
-		       __LINE__, len, (const char *)uptr);
-	  if ((nres + 1) >= maxresults)
-	       break;
-
-	  /*
-	   *  Now advance the pointer
-	   */
-	  uptr = uptr3 + 1;
-	  if (uptr < uend)
-	       ulen = uend - uptr;
-	  else
-	       ulen = 0;
-     } while (ulen);
+     if (!ctx->hresp.keep_alive)
+	  ha7net_hclose(ctx);
 
-     istat = ERR_OK;
-     goto done;
-
-bm_error:
-     istat = ERR_NO;
+     return(istat);
 
 done:
-     if (istat == ERR_OK)
-     {
-	  if (results && nres < maxresults)
-	  {
-	       results[nres] = NULL;
-	       if (reslens)
-		    reslens[nres] = 0;
-	  }
-	  if (nresults)
-	       *nresults = nres;
-     }
-     else
-     {
-	  if (nresults)
-	       *nresults = 0;
-	  if (results)
-	  {
-	       size_t j;
-
-	       for (j = 0; j < nres; j++)
-	       {
-		    if (results[j])
-		    {
-			 free(results[j]);
-			 results[j] = NULL;
-			 if (reslens)
-			      reslens[j] = 0;
-		    }
-	       }
-	       if (!nres && maxresults)
-	       {
-		    /* Doesn't happen when nres is 0 */
-		    results[0] = NULL;
-		    if (reslens)
-			 reslens[0] = 0;
-	       }
-	  }
-     }
-
      /*
       *  All done
       */
      return(istat);
+
+stale:
+     /*
+      *  The re-used connection appears to have gone stale.  Close it,
+      *  open a new one and try again.  We only do this once per request.
+      */
+     detail("ha7net_getstuff(%d): Re-used HTTP connection to %s:%u appears "
+	    "to have been closed by the bus master; re-connecting",
+	    __LINE__, ctx->host, ctx->port);
+     ha7net_hclose(ctx);
+     reused = 0;
+     goto reconnect;
 }
 
 
@@ -702,8 +784,8 @@ int
 ha7net_getlock(ha7net_t *ctx)
 {
      int istat;
-     size_t nresults, reslens[2];
-     char *results[2];
+     char lockid[MAX_LOCK_LEN + 1];
+     ha7net_vals_t vals;
 
      if (do_trace)
 	  trace("ha7net_getlock(%d): Called with ctx=%p", __LINE__, ctx);
@@ -721,9 +803,9 @@ ha7net_getlock(ha7net_t *ctx)
      /*
       *  Send the HTTP request for a lock and parse the response for a lock ID
       */
-     nresults = 0;
-     istat = ha7net_getstuff(ctx, results, reslens, &nresults, 2,
-			     "/1Wire/GetLock.html", &bm_info_getlock, NULL);
+     ha7net_vals_init(&vals, lockid, sizeof(lockid), NULL, NULL, 1);
+     istat = ha7net_getstuff(ctx, &vals, "/1Wire/GetLock.html",
+			     AC_MATCH_GETLOCK, 0, NULL);
      if (istat != ERR_OK)
      {
 	  detail("ha7net_getlock(%d): Error obtaining a lock on the 1-Wire "
@@ -731,7 +813,7 @@ ha7net_getlock(ha7net_t *ctx)
 		 __LINE__, istat, err_strerror(istat));
 	  goto done;
      }
-     else if (!nresults || !results[0])
+     else if (!vals.n || !vals.total)
      {
 	  debug("ha7net_getlock(%d): Error obtaining a lock on the 1-Wire "
 		"bus; although ha7net_getstuff() returned a success, no lock "
@@ -741,13 +823,10 @@ ha7net_getlock(ha7net_t *ctx)
      }
 
      /*
-      *  Save the lockid
+      *  Save the lockid.  ha7net_scan() has truncated it to fit lockid[]
       */
-     ctx->lockid_len = reslens[0];
-     if (ctx->lockid_len >= sizeof(ctx->lockid))
-	  ctx->lockid_len = sizeof(ctx->lockid) - 1;
-     memcpy(ctx->lockid, results[0], ctx->lockid_len);
-     ctx->lockid[ctx->lockid_len] = '\0';
+     ctx->lockid_len = strlen(lockid);
+     memcpy(ctx->lockid, lockid, ctx->lockid_len + 1);
 
      /*
       *  And return a success
@@ -755,12 +834,6 @@ ha7net_getlock(ha7net_t *ctx)
      istat = ERR_OK;
 
 done:
-     /*
-      *  Release the VM
-      */
-     if (nresults)
-	  ha7net_freestuff(results);
-
      /*
       *  Finished
       */
@@ -812,7 +885,7 @@ ha7net_releaselock(ha7net_t *ctx)
      /*
       *  Send the request
       */
-     istat = ha7net_getstuff(ctx, NULL, NULL, NULL, 0, url, NULL, NULL);
+     istat = ha7net_getstuff(ctx, NULL, url, 0, 0, NULL);
 
      /*
       *  Clear the lock info, regardless of whether or not the request worked
@@ -926,7 +999,7 @@ ha7net_powerdownbus(ha7net_t *ctx, int flags)
      /*
       *  Send the request
       */
-     istat = ha7net_getstuff(ctx, NULL, NULL, NULL, 0, url, NULL, NULL);
+     istat = ha7net_getstuff(ctx, NULL, url, 0, 0, NULL);
 
      /*
       *  Clear the lock?
@@ -1002,7 +1075,7 @@ ha7net_resetbus(ha7net_t *ctx, int flags)
      /*
       *  Send the request
       */
-     istat = ha7net_getstuff(ctx, NULL, NULL, NULL, 0, url, NULL, NULL);
+     istat = ha7net_getstuff(ctx, NULL, url, 0, 0, NULL);
 
      /*
       *  Clear the lock?
@@ -1032,8 +1105,8 @@ int
 ha7net_addressdevice(ha7net_t *ctx, device_t *dev, int flags)
 {
      int istat;
-     size_t nresults, reslens[2];
-     char *results[2];
+     char romid[OWIRE_ID_LEN + 1];
+     ha7net_vals_t vals;
      char url[64 + MAX_LOCK_LEN + 32 + 32 + 1];
 
      if (do_trace)
@@ -1110,9 +1183,9 @@ ha7net_addressdevice(ha7net_t *ctx, device_t *dev, int flags)
      /*
       *  Send the request
       */
-     nresults = 0;
-     istat = ha7net_getstuff(ctx, results, reslens, &nresults, 2, url,
-			     &bm_info_addressdevice, NULL);
+     ha7net_vals_init(&vals, romid, sizeof(romid), NULL, NULL, 1);
+     istat = ha7net_getstuff(ctx, &vals, url, AC_MATCH_ADDRESSDEVICE, 0,
+			     NULL);
      /*
       *  Clear the lock?
       */
@@ -1131,7 +1204,8 @@ ha7net_addressdevice(ha7net_t *ctx, device_t *dev, int flags)
      }
      else
      {
-	  if (!nresults || strcmp(results[0], dev->romid))
+	  if (!vals.n || vals.total != OWIRE_ID_LEN ||
+	      memcmp(romid, dev->romid, OWIRE_ID_LEN))
 	  {
 
 	       /*
@@ -1143,10 +1217,9 @@ ha7net_addressdevice(ha7net_t *ctx, device_t *dev, int flags)
 		     "that result did not indicate that the desired "
 		     "device was selected; instead it seems to say that "
 		     "\"%s\" was selected; most disconcerting",
-		     __LINE__, dev->romid, results[0]);
+		     __LINE__, dev->romid, romid);
 	       istat = ERR_NO;
 	  }
-	  ha7net_freestuff(results);
      }
 
      /*
@@ -1236,9 +1309,9 @@ ha7net_search(ha7net_t *ctx, device_t **devices, size_t *ndevices,
 	      unsigned char family_code, int cond_state, int flags)
 {
      device_t *devs;
-     int dispose, istat, len;
-     size_t i, ncount, nresults, reslens[1024];
-     char *results[1024];
+     int istat, len;
+     size_t i, ncount, offs[HA7NET_MAX_RESULTS], lens[HA7NET_MAX_RESULTS];
+     ha7net_vals_t vals;
      char url[64 + MAX_LOCK_LEN + 32 + 32 + 1];
 
      if (do_trace)
@@ -1264,9 +1337,10 @@ ha7net_search(ha7net_t *ctx, device_t **devices, size_t *ndevices,
 	  *ndevices = 0;
 
      /*
-      *  Flag indicating whether or not we have results to free
+      *  ha7net_scan() will malloc() a buffer for the ROM ids
       */
-     dispose = 0;
+     ha7net_vals_init(&vals, NULL, 0, offs, lens, HA7NET_MAX_RESULTS);
+     vals.alloc = 1;
 
      /*
       *  If we don't have a lock, then get one
@@ -1300,9 +1374,7 @@ ha7net_search(ha7net_t *ctx, device_t **devices, size_t *ndevices,
      /*
       *  Send the request
       */
-     nresults = 0;
-     istat = ha7net_getstuff(ctx, results, reslens, &nresults, 1024, url,
-			     &bm_info_search, NULL);
+     istat = ha7net_getstuff(ctx, &vals, url, AC_MATCH_SEARCH, 1, NULL);
 
      /*
       *  Clear the lock?
@@ -1320,12 +1392,11 @@ ha7net_search(ha7net_t *ctx, device_t **devices, size_t *ndevices,
 		 "%s", __LINE__, istat, err_strerror(istat));
 	  goto done;
      }
-     dispose = 1;
 
      /*
       *  Process the results of our ha7net_getstuff() call
       */
-     if (!nresults)
+     if (!vals.n)
      {
 	  debug("ha7net_search(%d): Search returned no devices", __LINE__);
 	  istat = ERR_OK;
@@ -1337,8 +1408,8 @@ ha7net_search(ha7net_t *ctx, device_t **devices, size_t *ndevices,
       *  (16 bytes when represented as hexadecimal)
       */
      ncount = 0;
-     for (i = 0; i < nresults; i++)
-	  if (reslens[i] == OWIRE_ID_LEN)
+     for (i = 0; i < vals.n; i++)
+	  if (lens[i] == OWIRE_ID_LEN)
 	       ncount++;
      if (!ncount)
      {
@@ -1365,13 +1436,15 @@ ha7net_search(ha7net_t *ctx, device_t **devices, size_t *ndevices,
      /*
       *  Copy the devices to the list
       */
-     for (i = 0; i < nresults; i++)
+     for (i = 0; i < vals.n; i++)
      {
-	  if (reslens[i] == OWIRE_ID_LEN)
+	  if (lens[i] == OWIRE_ID_LEN)
 	  {
-	       devs->fcode = (unsigned char)
-		    (0xff & strtoul(results[i] + reslens[i] - 2, NULL, 16));
-	       memcpy(devs->romid, results[i], OWIRE_ID_LEN);
+	       /*
+		*  The family code is the last byte of the ROM id
+		*/
+	       Hex2Byte(&devs->fcode, vals.buf + offs[i] + OWIRE_ID_LEN - 2, 2);
+	       memcpy(devs->romid, vals.buf + offs[i], OWIRE_ID_LEN);
 	       devs->romid[OWIRE_ID_LEN] = '\0';
 	       devs->driver = dev_driver_get(devs->fcode, NULL, 0);
 	       devs++;
@@ -1379,8 +1452,8 @@ ha7net_search(ha7net_t *ctx, device_t **devices, size_t *ndevices,
      }
 
 done:
-     if (dispose)
-	  ha7net_freestuff(results);
+     if (vals.buf)
+	  free(vals.buf);
 
      /*
       *  And return our results
@@ -1397,20 +1470,16 @@ ha7net_readpages_free(char *data)
 }
 
 
-int
-ha7net_readpages(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
-		 size_t start_page, size_t npages, int flags)
+/*
+ *  Read the pages, leaving the hex-encoded data in vals
+ */
+static int
+ha7net_readpages_vals(ha7net_t *ctx, device_t *dev, ha7net_vals_t *vals,
+		      size_t start_page, size_t npages, int flags)
 {
-     int dispose, istat;
-     size_t len, n, nresults, reslens[HA7NET_MAX_RESULTS];
-     char *results[HA7NET_MAX_RESULTS];
+     int istat;
      char url[64 + MAX_LOCK_LEN + 32 + 32 + 32 + 1];
 
-     if (do_trace)
-	  trace("ha7net_readpages(%d): Called with ctx=%p, dev=%p, data=%p, "
-		"dlen=%d, start_page=%u, npages=%u, flags=0x%x",
-		__LINE__, ctx, dev, data, dlen, start_page, npages, flags);
-
      /*
       *  Bozo checks
       */
@@ -1428,19 +1497,6 @@ ha7net_readpages(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
 	  return(ERR_BADARGS);
      }
 
-     /*
-      *  For the time being
-      */
-     if (data)
-	  *data = NULL;
-     if (dlen)
-	  *dlen = 0;
-
-     /*
-      *  Flag indicating whether or not we have results to free
-      */
-     dispose = 0;
-
      /*
       *  Lock's and device selection
       *  ReadPages.html will do a bus reset and device select when
@@ -1495,9 +1551,7 @@ ha7net_readpages(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
      /*
       *  Send the request
       */
-     nresults = 0;
-     istat = ha7net_getstuff(ctx, results, reslens, &nresults,
-			     HA7NET_MAX_RESULTS, url, &bm_info_readpages,
+     istat = ha7net_getstuff(ctx, vals, url, AC_MATCH_READPAGES, 1,
 			     dev ? &dev->lastcmd : NULL);
      /*
       *  Clear the lock?
@@ -1516,12 +1570,11 @@ ha7net_readpages(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
 		 __LINE__, istat, err_strerror(istat));
 	  goto done;
      }
-     dispose = 1;
 
      /*
       *  Return an error if no pages of data were returned
       */
-     if (!nresults || !results[0])
+     if (!vals->n)
      {
 	  debug("ha7net_readpages(%d): Although ha7net_getstuff() returned a "
 		"success code, no pages of data were returned; most odd",
@@ -1535,57 +1588,57 @@ ha7net_readpages(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
      if (dev)
 	  ctx->current_device = dev;
 
+     istat = ERR_OK;
+
+done:
      /*
-      *  Now prepare to return the results
+      *  All done
       */
-     len = 0;
-     for (n = 0; n < nresults; n++)
-	  if (results[n])
-	       len += reslens[n];
+     return(istat);
+}
 
-     if (data)
-     {
-	  char *ptr;
-	  ptr = (char *)malloc(len + 1);
-	  if (!ptr)
-	  {
-	       debug("ha7net_readpages(%d): Insufficient virtual memory",
-		     __LINE__);
-	       istat = ERR_NOMEM;
-	       goto done;
-	  }
-	  *data = ptr;
-	  for (n = 0; n < nresults; n++)
-	  {
-	       if (results[n])
-	       {
-		    memcpy(ptr, results[n], reslens[n]);
-		    ptr += reslens[n];
-		    free(results[n]);
-	       }
-	  }
-	  *ptr = '\0';
-	  /*
-	   *  We freed it already
-	   */
-	  dispose = 0;
-     }
-     if (dlen)
-	  *dlen = len;
 
-     istat = ERR_OK;
+int
+ha7net_readpages(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
+		 size_t start_page, size_t npages, int flags)
+{
+     int istat;
+     ha7net_vals_t vals;
+
+     if (do_trace)
+	  trace("ha7net_readpages(%d): Called with ctx=%p, dev=%p, data=%p, "
+		"dlen=%d, start_page=%u, npages=%u, flags=0x%x",
+		__LINE__, ctx, dev, data, dlen, start_page, npages, flags);
 
-done:
      /*
-      *  And return a result
+      *  For the time being
       */
-     if (dispose)
-	  ha7net_freestuff(results);
+     if (data)
+	  *data = NULL;
+     if (dlen)
+	  *dlen = 0;
 
      /*
-      *  All done
+      *  The pages are returned to the caller in a single malloc()ed
+      *  buffer which ha7net_scan() allocates and fills.  When the
+      *  caller doesn't want the data, we need only measure it.
       */
-     return(istat);
+     ha7net_vals_init(&vals, NULL, 0, NULL, NULL, HA7NET_MAX_RESULTS);
+     vals.alloc = data ? 1 : 0;
+     istat = ha7net_readpages_vals(ctx, dev, &vals, start_page, npages, flags);
+     if (istat != ERR_OK)
+     {
+	  if (vals.buf)
+	       free(vals.buf);
+	  return(istat);
+     }
+
+     if (data)
+	  *data = vals.buf;
+     if (dlen)
+	  *dlen = vals.total;
+
+     return(ERR_OK);
 }
 
 
@@ -1593,9 +1646,9 @@ int
 ha7net_readpages_ex(ha7net_t *ctx, device_t *dev, unsigned char *data,
 		    size_t minlen, size_t start_page, size_t npages, int flags)
 {
-     char *cdata;
-     size_t clen;
+     char *cdata, hbuf[2 * 4 * 32 + 1];
      int istat;
+     ha7net_vals_t vals;
 
      if (do_trace)
 	  trace("ha7net_readpages_ex(%d): Called with ctx=%p, dev=%p, "
@@ -1613,37 +1666,47 @@ ha7net_readpages_ex(ha7net_t *ctx, device_t *dev, unsigned char *data,
 	  return(ERR_BADARGS);
      }
 
-     cdata = NULL;
-     clen  = 0;
-     istat = ha7net_readpages(ctx, dev, &cdata, &clen, start_page, npages,
-			      flags);
-     if (istat != ERR_OK)
-     {
-	  if (cdata)
-	       ha7net_readpages_free(cdata);
-     }
-     else if (!cdata)
+     /*
+      *  Have ha7net_scan() put the hex-encoded data directly into a
+      *  stack buffer when it will fit.  Only the first 2 * minlen
+      *  hex digits are kept: that is all we will decode.
+      */
+     if ((2 * minlen + 1) <= sizeof(hbuf))
+	  cdata = hbuf;
+     else
      {
-	  debug("ha7net_readpages_ex(%d): Although ha7net_readpages() "
-		"returned a success, it returned no data; that should "
-		"never happen", __LINE__);
-	  return(ERR_NO);
+	  cdata = (char *)malloc(2 * minlen + 1);
+	  if (!cdata)
+	  {
+	       debug("ha7net_readpages_ex(%d): Insufficient virtual memory",
+		     __LINE__);
+	       return(ERR_NOMEM);
+	  }
      }
-     else if (clen < (2 * minlen))
+     ha7net_vals_init(&vals, cdata, 2 * minlen + 1, NULL, NULL,
+		      HA7NET_MAX_RESULTS);
+     istat = ha7net_readpages_vals(ctx, dev, &vals, start_page, npages,
+				   flags);
+     if (istat != ERR_OK)
+	  goto done;
+     else if (vals.total < (2 * minlen))
      {
 	  debug("ha7net_readpages_ex(%d): ha7net_readpages() did not "
 		"return the expected number of bytes; it was expected to "
 		"return 2 * %u bytes, but instead only returned %u",
-		__LINE__, minlen, clen);
-	  ha7net_writeblock_free(cdata);
-	  return(ERR_NO);
+		__LINE__, minlen, vals.total);
+	  istat = ERR_NO;
+	  goto done;
      }
 
-     Hex2Byte(data, cdata, clen);
+     Hex2Byte(data, cdata, 2 * minlen);
+     istat = ERR_OK;
 
-     ha7net_readpages_free(cdata);
+done:
+     if (cdata != hbuf)
+	  free(cdata);
 
-     return(ERR_OK);
+     return(istat);
 }
 
 
@@ -1655,19 +1718,67 @@ ha7net_writeblock_free(char *data)
 }
 
 
-int
-ha7net_writeblock(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
-		  const char *cmd, int flags)
+/*
+ *  Build the Request-URI for a WriteBlock.html request.  The URI is
+ *  written to buf when it fits; otherwise, it is written to a malloc()ed
+ *  buffer which the caller must free.  In either case, *url is set to
+ *  point to the URI.
+ */
+
+static int
+ha7net_writeblock_url(ha7net_t *ctx, device_t *dev, const char *cmd,
+		      int flags, char *buf, size_t buflen, char **url)
 {
-     int dispose, istat;
-     size_t len, nresults, reslens[2];
-     char *results[2], *url, urlbuf[128];
+     int istat;
+     size_t len;
 
-     if (do_trace)
-	  trace("ha7net_writeblock(%d): Called with ctx=%p, dev=%p, data=%p, "
-		"dlen=%d, cmd=\"%s\" (%p), flags=0x%x",
-		__LINE__, ctx, dev, data, dlen, cmd ? cmd : "(null)", cmd,
-		flags);
+     /*
+      *  Build the URL for the HTTP request:
+      *
+      *     GET /1Wire/WriteBlock.html?Address=<ROM-id>&LockID=<lock-id> \
+      *              &Data=<cmd>
+      */
+     *url = NULL;
+     len = ctx->lockid_len + strlen(cmd) + 64;
+     if (dev && !(flags & HA7NET_FLAGS_NOSELECT))
+	  /* &Address= */
+	  len += strlen(dev->romid) + 9;
+     if (len >= buflen)
+     {
+	  len++;
+	  buf = (char *)malloc(len);
+	  if (!buf)
+	  {
+	       debug("ha7net_writeblock_url(%d): Insufficient virtual memory",
+		     __LINE__);
+	       return(ERR_NOMEM);
+	  }
+     }
+     else
+	  len = buflen;
+     if (dev && !(flags & HA7NET_FLAGS_NOSELECT))
+	  istat = our_snprintf("ha7net_writeblock_url", __LINE__, buf, len,
+			       "/1Wire/WriteBlock.html?Address=%s&LockID=%.*s"
+			       "&Data=%s",
+			       dev->romid, ctx->lockid_len, ctx->lockid, cmd);
+     else
+	  istat = our_snprintf("ha7net_writeblock_url", __LINE__, buf, len,
+			       "/1Wire/WriteBlock.html?LockID=%.*s&Data=%s",
+			       ctx->lockid_len, ctx->lockid, cmd);
+     *url = buf;
+     return(istat);
+}
+
+
+/*
+ *  Write the block, leaving the hex-encoded data read back in vals
+ */
+static int
+ha7net_writeblock_vals(ha7net_t *ctx, device_t *dev, ha7net_vals_t *vals,
+		       const char *cmd, int flags)
+{
+     int istat;
+     char *url, urlbuf[128];
 
      /*
       *  Bozo check
@@ -1680,19 +1791,7 @@ ha7net_writeblock(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
 	  return(ERR_BADARGS);
      }
 
-     /*
-      *  For the time being
-      */
-     if (data)
-	  *data = NULL;
-     if (dlen)
-	  *dlen = 0;
-
-     /*
-      *  Flag indicating whether or not we have results to free
-      */
-     dispose = 0;
-     url     = NULL;
+     url = NULL;
 
      /*
       *  Obtain a lock on the 1-Wire bus if we don't have one already.
@@ -1711,50 +1810,18 @@ ha7net_writeblock(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
      }
 
      /*
-      *  Build the URL for the HTTP request:
-      *
-      *     GET /1Wire/WriteBlock.html?Address=<ROM-id>&LockID=<lock-id> \
-      *              &Data=<cmd>
+      *  Build the URL for the HTTP request
       */
-     len = ctx->lockid_len + strlen(cmd) + 64;
-     if (dev && !(flags & HA7NET_FLAGS_NOSELECT))
-	  /* &Address= */
-	  len += strlen(dev->romid) + 9;
-     if (len >= sizeof(urlbuf))
-     {
-	  len++;
-	  url = (char *)malloc(len);
-	  if (!url)
-	  {
-	       debug("ha7net_writeblock(%d): Insufficient virtual memory",
-		     __LINE__);
-	       istat = ERR_NOMEM;
-	       goto done;
-	  }
-     }
-     else
-     {
-	  url = urlbuf;
-	  len = sizeof(urlbuf);
-     }
-     if (dev && !(flags & HA7NET_FLAGS_NOSELECT))
-	  istat = our_snprintf("ha7net_writeblock", __LINE__, url, len,
-			       "/1Wire/WriteBlock.html?Address=%s&LockID=%.*s"
-			       "&Data=%s",
-			       dev->romid, ctx->lockid_len, ctx->lockid, cmd);
-     else
-	  istat = our_snprintf("ha7net_writeblock", __LINE__, url, len,
-			       "/1Wire/WriteBlock.html?LockID=%.*s&Data=%s",
-			       ctx->lockid_len, ctx->lockid, cmd);
+     istat = ha7net_writeblock_url(ctx, dev, cmd, flags, urlbuf,
+				   sizeof(urlbuf), &url);
      if (istat != ERR_OK)
-	  return(istat);
+	  goto done;
 
      /*
       *  Send the request
       */
-     nresults = 0;
-     istat = ha7net_getstuff(ctx, results, reslens, &nresults, 2, url,
-			     &bm_info_writeblock, dev ? &dev->lastcmd : NULL);
+     istat = ha7net_getstuff(ctx, vals, url, AC_MATCH_WRITEBLOCK, 0,
+			     dev ? &dev->lastcmd : NULL);
      if (url && url != urlbuf)
      {
 	  free(url);
@@ -1777,12 +1844,11 @@ ha7net_writeblock(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
 		 __LINE__, istat, err_strerror(istat));
 	  goto done;
      }
-     dispose = 1;
 
      /*
       *  Return an error if no data was returned
       */
-     if (!nresults || !results[0])
+     if (!vals->n)
      {
 	  debug("ha7net_writeblock(%d): Although ha7net_getstuff() returned a "
 		"success code, no pages of data were returned; most odd",
@@ -1797,30 +1863,163 @@ ha7net_writeblock(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
      if (dev)
 	  ctx->current_device = dev;
 
+     istat = ERR_OK;
+
+done:
+     if (url && url != urlbuf)
+	  free(url);
+
      /*
-      *  Return our results
+      *  All done
+      */
+     return(istat);
+}
+
+
+int
+ha7net_writeblock(ha7net_t *ctx, device_t *dev, char **data, size_t *dlen,
+		  const char *cmd, int flags)
+{
+     int istat;
+     ha7net_vals_t vals;
+
+     if (do_trace)
+	  trace("ha7net_writeblock(%d): Called with ctx=%p, dev=%p, data=%p, "
+		"dlen=%d, cmd=\"%s\" (%p), flags=0x%x",
+		__LINE__, ctx, dev, data, dlen, cmd ? cmd : "(null)", cmd,
+		flags);
+
+     /*
+      *  For the time being
       */
      if (data)
+	  *data = NULL;
+     if (dlen)
+	  *dlen = 0;
+
+     /*
+      *  Most callers ignore the data read back; for them we need not
+      *  copy it anywhere
+      */
+     ha7net_vals_init(&vals, NULL, 0, NULL, NULL, 1);
+     vals.alloc = data ? 1 : 0;
+     istat = ha7net_writeblock_vals(ctx, dev, &vals, cmd, flags);
+     if (istat != ERR_OK)
      {
-	  *data = results[0];
-	  results[0] = NULL;
-	  dispose = 0;
+	  if (vals.buf)
+	       free(vals.buf);
+	  return(istat);
      }
+
+     /*
+      *  Return our results
+      */
+     if (data)
+	  *data = vals.buf;
      if (dlen)
-	  *dlen = reslens[0];
+	  *dlen = vals.total;
 
-     istat = ERR_OK;
+     return(ERR_OK);
+}
 
-done:
-     if (url && url != urlbuf)
-	  free(url);
-     if (dispose)
-	  ha7net_freestuff(results);
+
+/*
+ *  Check the CRC8 or CRC16 values embedded in the minlen bytes of data
+ *  read back from the 1-Wire bus for the device dev, if known.  Returns
+ *  ERR_OK when the check passes or there are insufficient data to perform
+ *  it, and ERR_CRC when it fails.
+ */
+
+static int
+ha7net_crc_check(const device_t *dev, const unsigned char *data,
+		 size_t minlen, const ha7net_crc_t *crc_info)
+{
+     size_t crc_width, end_byte, i, k;
+     unsigned int computed, expected;
+
+     if (!crc_info || crc_info->algorithm == HA7NET_CRC_NONE)
+	  return(ERR_OK);
+
+     crc_width = (crc_info->algorithm == HA7NET_CRC_16) ? 2 : 1;
+     end_byte = crc_width + (crc_info->start_byte + crc_info->nbytes - 1);
+
+     if ((end_byte + 1) > minlen)
+     {
+	  debug("ha7net_crc_check(%d): Insufficient data to perform the "
+		"requested CRC check; read %u bytes but need %u",
+		__LINE__, minlen, 1 + end_byte);
+	  return(ERR_OK);
+     }
 
      /*
-      *  All done
+      *  The first run of data and its CRC, [i, i + k), followed by
+      *  repeat_every data bytes and a CRC as often as they fit
       */
-     return(istat);
+     i = crc_info->start_byte;
+     k = end_byte + 1 - crc_info->start_byte;
+     if (crc_info->algorithm == HA7NET_CRC_16)
+     {
+	  /*
+	   *  Compute the CRC16 over the data
+	   *  The CRC check passes if the resulting CRC is 0xB001
+	   */
+	  for (;;)
+	  {
+	       if (0xB001 != crc16_buf(0, data + i, k))
+		    goto crc_fail;
+	       i += k;
+	       k = crc_info->repeat_every + 2;
+	       if (crc_info->repeat_every <= 0 || (i + k) > minlen)
+		    break;
+	  }
+	  return(ERR_OK);
+     }
+     else if (crc_info->algorithm == HA7NET_CRC_8)
+     {
+	  /*
+	   *  Compute the CRC8 over the data *and* the CRC itself
+	   *  The CRC check passes if the resulting CRC is 0x00
+	   */
+	  for (;;)
+	  {
+	       if (0x00 != crc8_buf(0, data + i, k))
+		    goto crc_fail;
+	       i += k;
+	       k = crc_info->repeat_every + 1;
+	       if (crc_info->repeat_every <= 0 || (i + k) > minlen)
+		    break;
+	  }
+	  return(ERR_OK);
+     }
+     else
+     {
+	  debug("ha7net_crc_check(%d): Invalid value supplied for the "
+		"CRC algorithm; crc->algorithm=%d",
+		__LINE__, crc_info->algorithm);
+	  return(ERR_BADARGS);
+     }
+
+     /*
+      *  CRC test failed.  A CRC16 is sent inverted, low byte first.
+      */
+crc_fail:
+     if (crc_width == 2)
+     {
+	  expected = 0xffff & ~((unsigned int)data[i + k - 2] |
+				((unsigned int)data[i + k - 1] << 8));
+	  computed = (unsigned int)crc16_buf(0, data + i, k - 2);
+     }
+     else
+     {
+	  expected = data[i + k - 1];
+	  computed = crc8_buf(0, data + i, k - 1);
+     }
+     detail("ha7net_crc_check(%d): CRC check failed for the device %s; "
+	    "bytes %u through %u carry the CRC 0x%0*x but the data "
+	    "computes to 0x%0*x", __LINE__, dev ? dev->romid : "(unknown)",
+	    i, i + k - 1, (int)(2 * crc_width), expected,
+	    (int)(2 * crc_width), computed);
+     return(ERR_CRC);
 }
 
 
@@ -1830,9 +2029,9 @@ ha7net_writeblock_ex(ha7net_t *ctx, device_t *dev, unsigned char *data,
 		     int flags)
 {
      int attempts, istat;
-     char *cdata;
-     size_t clen, crc_width, end_byte;
+     char *cdata, hbuf[2 * HA7NET_WRITEBLOCK_MAX + 1];
      unsigned char pdata[HA7NET_WRITEBLOCK_MAX];
+     ha7net_vals_t vals;
 
      if (do_trace)
 	  trace("ha7net_writeblock_ex(%d): Called with ctx=%p, dev=%p, "
@@ -1851,161 +2050,425 @@ ha7net_writeblock_ex(ha7net_t *ctx, device_t *dev, unsigned char *data,
 	  return(ERR_BADARGS);
      }
 
+     /*
+      *  When the caller doesn't want the data, we still need it for
+      *  a CRC check
+      */
+     if (!data)
+     {
+	  if (!crc_info || crc_info->algorithm == HA7NET_CRC_NONE)
+	       return(ha7net_writeblock(ctx, dev, NULL, NULL, cmd, flags));
+	  data = pdata;
+	  if (!minlen)
+	       minlen = strlen(cmd) >> 1;
+	  if (minlen > HA7NET_WRITEBLOCK_MAX)
+	       minlen = HA7NET_WRITEBLOCK_MAX;
+     }
+
+     /*
+      *  Have ha7net_scan() put the hex-encoded data directly into a
+      *  stack buffer when it will fit.  Only the first 2 * minlen
+      *  hex digits are kept: that is all we will decode.
+      */
+     if ((2 * minlen + 1) <= sizeof(hbuf))
+	  cdata = hbuf;
+     else
+     {
+	  cdata = (char *)malloc(2 * minlen + 1);
+	  if (!cdata)
+	  {
+	       debug("ha7net_writeblock_ex(%d): Insufficient virtual memory",
+		     __LINE__);
+	       return(ERR_NOMEM);
+	  }
+     }
+
      attempts = (flags & HA7NET_FLAGS_NORESEND) ? 0xffffff : 1;
 loop:
-     cdata = NULL;
-     clen  = 0;
-     istat = ha7net_writeblock(ctx, dev, &cdata, &clen, cmd, flags);
+     ha7net_vals_init(&vals, cdata, 2 * minlen + 1, NULL, NULL, 1);
+     istat = ha7net_writeblock_vals(ctx, dev, &vals, cmd, flags);
      if (istat != ERR_OK)
-	  return(istat);
-     else if (!cdata)
-     {
-	  debug("ha7net_writeblock_ex(%d): Although ha7net_writeblock() "
-		"returned a success, it returned no data; that should "
-		"never happen", __LINE__);
-	  return(ERR_NO);
-     }
-     else if (clen < (2*minlen))
+	  goto done;
+     else if (vals.total < (2 * minlen))
      {
 	  debug("ha7net_writeblock_ex(%d): ha7net_writeblock() did not "
 		"return the expected number of bytes; it was expected to "
 		"return 2 * %u bytes, but instead only returned %u",
-		__LINE__, minlen, clen);
-	  ha7net_writeblock_free(cdata);
+		__LINE__, minlen, vals.total);
+	  istat = ERR_NO;
+	  goto done;
+     }
+
+     Hex2Byte(data, cdata, 2 * minlen);
+
+     istat = ha7net_crc_check(dev, data, minlen, crc_info);
+     if (istat != ERR_CRC)
+	  goto done;
+
+     /*
+      *  Try an additional write/read
+      */
+     if (++attempts <= 2)
+	  goto loop;
+
+     istat = ERR_CRC;
+
+done:
+     if (cdata != hbuf)
+	  free(cdata);
+
+     return(istat);
+}
+
+
+void
+ha7net_batch_init(ha7net_batch_t *batch)
+{
+     if (batch)
+	  memset(batch, 0, sizeof(ha7net_batch_t));
+}
+
+
+void
+ha7net_batch_free(ha7net_batch_t *batch)
+{
+     size_t i;
+
+     if (!batch)
+	  return;
+
+     for (i = 0; i < batch->nreq; i++)
+     {
+	  if (batch->url[i])
+	       free(batch->url[i]);
+	  if (batch->data[i])
+	       free(batch->data[i]);
+     }
+     memset(batch, 0, sizeof(ha7net_batch_t));
+}
+
+
+int
+ha7net_batch_writeblock(ha7net_t *ctx, ha7net_batch_t *batch, device_t *dev,
+			const char *cmd, int flags)
+{
+     int istat;
+     char *url;
+
+     if (do_trace)
+	  trace("ha7net_batch_writeblock(%d): Called with ctx=%p, batch=%p, "
+		"dev=%p, cmd=\"%s\" (%p), flags=0x%x",
+		__LINE__, ctx, batch, dev, cmd ? cmd : "(null)", cmd, flags);
+
+     /*
+      *  Bozo check
+      */
+     if (!ctx || !batch || !cmd)
+     {
+	  debug("ha7net_batch_writeblock(%d): Invalid call arguments "
+		"supplied; ctx=%p, batch=%p, cmd=%p; all of the preceding "
+		"must be non-zero", __LINE__, ctx, batch, cmd);
+	  return(ERR_BADARGS);
+     }
+     else if (batch->nreq >= HA7NET_BATCH_MAX)
+     {
+	  debug("ha7net_batch_writeblock(%d): The batch is full; at most "
+		"%d requests may be queued in a single batch",
+		__LINE__, HA7NET_BATCH_MAX);
 	  return(ERR_NO);
      }
 
-     if (!data)
+     /*
+      *  We need our lock ID to build the URL, so obtain the lock now
+      */
+     istat = ha7net_prelim(ctx, dev, flags | HA7NET_FLAGS_NOSELECT);
+     if (istat != ERR_OK)
      {
-	  if (!crc_info || crc_info->algorithm == HA7NET_CRC_NONE)
-	  {
-	       ha7net_writeblock_free(cdata);
-	       return(ERR_OK);
-	  }
-	  data = pdata;
-	  if (!minlen)
-	       minlen = strlen(cmd) >> 1;
-	  if (minlen > HA7NET_WRITEBLOCK_MAX)
-	       minlen = HA7NET_WRITEBLOCK_MAX;
+	  detail("ha7net_batch_writeblock(%d): Unable to obtain a bus lock "
+		 "from the 1-Wire bus master; ha7net_prelim() returned %d; %s", 
+		 __LINE__, istat, err_strerror(istat));
+	  return(istat);
+     }
+
+     /*
+      *  Passing no buffer has ha7net_writeblock_url() malloc() the URL
+      */
+     istat = ha7net_writeblock_url(ctx, dev, cmd, flags, NULL, 0, &url);
+     if (istat != ERR_OK)
+     {
+	  if (url)
+	       free(url);
+	  return(istat);
      }
-     Hex2Byte(data, cdata, 2 * minlen);
 
-     ha7net_writeblock_free(cdata);
+     batch->dev[batch->nreq]   = dev;
+     batch->url[batch->nreq]   = url;
+     batch->data[batch->nreq]  = NULL;
+     batch->dlen[batch->nreq]  = 0;
+     batch->istat[batch->nreq] = ERR_NO;
+     batch->nreq++;
 
-     if (!crc_info || crc_info->algorithm == HA7NET_CRC_NONE)
-	  return(ERR_OK);
+     return(ERR_OK);
+}
 
-     crc_width = (crc_info->algorithm == HA7NET_CRC_16) ? 2 : 1;
-     end_byte = crc_width + (crc_info->start_byte + crc_info->nbytes - 1);
 
-     if ((end_byte + 1) > minlen)
+int
+ha7net_batch_send(ha7net_t *ctx, ha7net_batch_t *batch, int flags)
+{
+     size_t i, next;
+     int istat, keep_alive;
+     ha7net_vals_t vals;
+
+     if (do_trace)
+	  trace("ha7net_batch_send(%d): Called with ctx=%p, batch=%p, "
+		"flags=0x%x", __LINE__, ctx, batch, flags);
+
+     /*
+      *  Bozo checks
+      */
+     if (!ctx || !batch)
      {
-	  debug("ha7net_writeblock_ex(%d): Insufficient data to perform the "
-		"requested CRC check; read %u bytes but need %u",
-		__LINE__, minlen, 1 + end_byte);
+	  debug("ha7net_batch_send(%d): Invalid call arguments supplied; "
+		"ctx=%p, batch=%p", __LINE__, ctx, batch);
+	  return(ERR_BADARGS);
+     }
+     else if (!ctx->host_len || !ctx->host[0] || !ctx->port)
+     {
+	  debug("ha7net_batch_send(%d): Invalid call arguments supplied; "
+		"ctx=%p has suspect data fields; ctx->host_len=%u, "
+		"ctx->host[0] = 0x%02x, ctx->port=%u",
+		__LINE__, ctx, ctx->host_len, ctx->host[0], ctx->port);
+	  return(ERR_BADARGS);
+     }
+     else if (!batch->nreq)
 	  return(ERR_OK);
+
+     /*
+      *  Discard the results of any previous send of this batch
+      */
+     for (i = 0; i < batch->nreq; i++)
+     {
+	  if (batch->data[i])
+	  {
+	       free(batch->data[i]);
+	       batch->data[i] = NULL;
+	  }
+	  batch->dlen[i]  = 0;
+	  batch->istat[i] = ERR_NO;
      }
 
-     if (crc_info->algorithm == HA7NET_CRC_16)
+     ha7net_hdispose(ctx);
+
+     /*
+      *  Unlike ha7net_getstuff(), no request is sent a second time once
+      *  any of it may have been written: each is a WriteBlock which the
+      *  device may already have carried out.  When a write fails, how
+      *  much of the batch reached the bus master is unknown and so the
+      *  requests not yet answered fail; the caller may start over.
+      */
+     next = 0;
+reconnect:
+     i = next;
+     if (!http_isopen(&ctx->hconn))
      {
-	  /*
-	   *  Compute the CRC16 over the data
-	   *  The CRC check passes if the resulting CRC is 0xB001
-	   */
-	  int crc;
-	  size_t i, j, k;
-
-	  crc = 0;
-	  for (i = crc_info->start_byte; i <= end_byte; i++)
-	       crc = crc16(crc, data[i]);
-	  if (crc != 0xB001)
-	       goto crc_fail;
-	  if (crc_info->repeat_every > 0)
+	  istat = http_open(&ctx->hconn, ctx->host, ctx->port, ctx->tmo);
+	  if (istat != ERR_OK)
 	  {
-	       k   = crc_info->repeat_every + 2;
-	       j   = 0;
-	       crc = 0;
-	       for (i = end_byte + 1; i < minlen; i++)
-	       {
-		    crc = crc16(crc, data[i]);
-		    if (++j == k)
-		    {
-			 if (crc != 0xB001)
-			      goto crc_fail;
-			 crc = 0;
-			 j   = 0;
-		    }
-	       }
+	       detail("ha7net_batch_send(%d): Unable to open a TCP connection "
+		      "to %s:%u; http_open() returned %d; %s",
+		      __LINE__, ctx->host, ctx->port, istat,
+		      err_strerror(istat));
+	       goto done;
 	  }
-	  return(ERR_OK);
      }
-     else if (crc_info->algorithm == HA7NET_CRC_8)
+
+     /*
+      *  Write all of the outstanding requests at once
+      */
+     if (dbglvl & DEBUG_HA7NET_XMIT)
+	  for (i = next; i < batch->nreq; i++)
+	       detail2("ha7net_batch_send(%d): GET %s", __LINE__, batch->url[i]);
+     i = next;
+     istat = http_send_requests(&ctx->hconn, "GET",
+				(const char **)(batch->url + next),
+				batch->nreq - next);
+     if (istat != ERR_OK)
+     {
+	  detail("ha7net_batch_send(%d): Error sending %u pipelined requests; "
+		 "http_send_requests() returned %d; %s",
+		 __LINE__, batch->nreq - next, istat, err_strerror(istat));
+	  ha7net_hclose(ctx);
+	  goto done;
+     }
+
+     /*
+      *  And now read the responses back in order
+      */
+     for (i = next; i < batch->nreq; i++)
      {
+	  ha7net_hdispose(ctx);
+
+	  istat = http_read_response(&ctx->hconn, &ctx->hresp);
+	  if (istat != ERR_OK)
+	  {
+	       /*
+		*  This request and those after it fail: whether the bus
+		*  master acted upon them is unknown
+		*/
+	       if (istat == ERR_EOM)
+		    istat = ERR_READ;
+	       detail("ha7net_batch_send(%d): Error reading the HTTP response "
+		      "to request %u of %u; http_read_response() returned %d; "
+		      "%s", __LINE__, i + 1, batch->nreq, istat,
+		      err_strerror(istat));
+	       ha7net_hclose(ctx);
+	       goto done;
+	  }
+	  ctx->hresp_dispose = 1;
+	  keep_alive = ctx->hresp.keep_alive;
+
+	  ha7net_vals_init(&vals, NULL, 0, NULL, NULL, 1);
+	  vals.alloc = 1;
+	  batch->istat[i] = ha7net_scan(&ctx->hresp, &vals,
+					AC_MATCH_WRITEBLOCK);
+	  if (batch->istat[i] == ERR_OK)
+	  {
+	       if (!vals.n || !vals.buf)
+	       {
+		    debug("ha7net_batch_send(%d): No data was returned in "
+			  "response to request %u of %u; most odd",
+			  __LINE__, i + 1, batch->nreq);
+		    batch->istat[i] = ERR_NO;
+		    if (vals.buf)
+			 free(vals.buf);
+	       }
+	       else
+	       {
+		    batch->data[i] = vals.buf;
+		    batch->dlen[i] = vals.total;
+		    if (batch->dev[i])
+			 ctx->current_device = batch->dev[i];
+	       }
+	  }
+
 	  /*
-	   *  Compute the CRC8 over the data *and* the CRC itself
-	   *  The CRC check passes if the resulting CRC is 0x00
+	   *  If the bus master is closing the connection, then it will
+	   *  not be acting upon any remaining requests: HTTP/1.1 forbids
+	   *  a server from processing requests which follow a response
+	   *  with "Connection: close".  Resume with them over a new
+	   *  connection.
 	   */
-	  unsigned char crc;
-	  size_t i, j, k;
-
-	  crc = 0;
-	  for (i = crc_info->start_byte; i <= end_byte; i++)
-	       crc = crc8(crc, data[i]);
-	  if (crc != 0x00)
-	       goto crc_fail;
-	  if (crc_info->repeat_every > 0)
+	  if (!keep_alive)
 	  {
-	       k   = crc_info->repeat_every + 1;
-	       j   = 0;
-	       crc = 0;
-	       for (i = end_byte + 1; i < minlen; i++)
+	       ha7net_hclose(ctx);
+	       if ((i + 1) < batch->nreq)
 	       {
-		    crc = crc8(crc, data[i]);
-		    if (++j == k)
-		    {
-			 if (crc != 0x00)
-			      goto crc_fail;
-			 crc = 0;
-			 j   = 0;
-		    }
+		    next = i + 1;
+		    goto reconnect;
 	       }
 	  }
-	  return(ERR_OK);
      }
-     else
+
+     /*
+      *  Report the first failure, if any
+      */
+     istat = ERR_OK;
+     for (i = 0; i < batch->nreq; i++)
      {
-	  debug("ha7net_writeblock_ex(%d): Invalid value supplied for the "
-		"CRC algorithm; crc->algorithm=%d",
-		__LINE__, crc_info->algorithm);
-	  return(ERR_BADARGS);
+	  if (batch->istat[i] != ERR_OK)
+	  {
+	       istat = batch->istat[i];
+	       break;
+	  }
      }
+     i = batch->nreq;
 
+done:
      /*
-      *  CRC test failed
+      *  Requests we did not get a response to share the failure
       */
-crc_fail:
-     detail("ha7net_writeblock_ex(%d): CRC check failed", __LINE__);
+     for (; i < batch->nreq; i++)
+	  batch->istat[i] = istat;
 
      /*
-      *  Try an additional write/read
+      *  Clear the lock?
       */
-     if (++attempts <= 2)
-	  goto loop;
+     if (flags & HA7NET_FLAGS_RELEASE)
+	  our_releaselock(ctx, "ha7net_batch_send", __LINE__);
 
-     return(ERR_CRC);
+     /*
+      *  All done
+      */
+     return(istat);
+}
+
+
+int
+ha7net_batch_result(ha7net_batch_t *batch, size_t index, unsigned char *data,
+		    size_t minlen, ha7net_crc_t *crc_info)
+{
+     const char *cdata;
+     unsigned char pdata[HA7NET_WRITEBLOCK_MAX];
+
+     if (do_trace)
+	  trace("ha7net_batch_result(%d): Called with batch=%p, index=%u, "
+		"data=%p, minlen=%u, crc=%p",
+		__LINE__, batch, index, data, minlen, crc_info);
+
+     if (!batch || index >= batch->nreq)
+     {
+	  debug("ha7net_batch_result(%d): Invalid call arguments supplied; "
+		"batch=%p, index=%u", __LINE__, batch, index);
+	  return(ERR_BADARGS);
+     }
+     else if (batch->istat[index] != ERR_OK)
+	  return(batch->istat[index]);
+
+     cdata = batch->data[index];
+     if (batch->dlen[index] < (2*minlen))
+     {
+	  debug("ha7net_batch_result(%d): ha7net_batch_send() did not "
+		"return the expected number of bytes; it was expected to "
+		"return 2 * %u bytes, but instead only returned %u",
+		__LINE__, minlen, batch->dlen[index]);
+	  return(ERR_NO);
+     }
+
+     if (!data)
+     {
+	  if (!crc_info || crc_info->algorithm == HA7NET_CRC_NONE)
+	       return(ERR_OK);
+	  data = pdata;
+	  if (!minlen)
+	       minlen = batch->dlen[index] >> 1;
+	  if (minlen > HA7NET_WRITEBLOCK_MAX)
+	       minlen = HA7NET_WRITEBLOCK_MAX;
+     }
+     Hex2Byte(data, cdata, 2 * minlen);
+
+     return(ha7net_crc_check(batch->dev[index], data, minlen, crc_info));
 }
 
 
 const char *
 ha7net_last_response(ha7net_t *ctx, size_t *len)
 {
-     if (!ctx || !ctx->hresp_dispose)
+     if (ctx && ctx->hresp_dispose)
      {
 	  if (len)
-	       *len = 0;
-	  return(NULL);
+	       *len = ctx->hresp.bdy_len;
+	  return(ctx->hresp.bdy);
+     }
+     else if (ctx && ctx->last_len)
+     {
+	  /*
+	   *  The connection has since been closed
+	   */
+	  if (len)
+	       *len = ctx->last_len;
+	  return(ctx->last);
      }
      if (len)
-	  *len = ctx->hresp.bdy_len;
-     return(ctx->hresp.bdy);
+	  *len = 0;
+     return(NULL);
 }
@@ -47,8 +47,9 @@ extern "C" {
 
 /*
  *  Maximum number of pages which can be read at once from a device.
+ *  Also the maximum number of devices ha7net_search() will return.
  *  This limit is a compile-time limit and owes itself to the size
- *  of the stack buffer which ha7net_readpages() declares for its call
+ *  of the stack arrays which ha7net_search() declares for its call
  *  to ha7net_getstuff().
  */
 #define HA7NET_MAX_RESULTS   1024
@@ -78,6 +79,11 @@ typedef struct ha7net_s {
      http_msg_t     hresp;
      int            hresp_dispose;
 
+     /* Copy of the last response's body once its connection is closed     */
+     char          *last;
+     size_t         last_len;
+     size_t         last_max;
+
      /* Lock info for our lock on the 1Wire bus                             */
      char           lockid[MAX_LOCK_LEN + 1];  /* ID for lock on the bus    */
      size_t         lockid_len;                /* Lock id length, bytes     */
@@ -85,6 +91,9 @@ typedef struct ha7net_s {
      /* Last device addressed since a bus reset */
      struct device_s *current_device;
 
+     /* Time of the last bus-wide (Skip ROM) Convert T; zero when none      */
+     struct timeval convert_t;
+
      /* We retain the following information in case we need to re-establish */
      /* our connection to the 1Wire bus master's HTTP server                */
      unsigned short port;                  /* TCP port for HTTP connection  */
@@ -117,6 +126,7 @@ typedef struct {
 #define HA7NET_FLAGS_RELEASE   0x08
 #define HA7NET_FLAGS_SELECT    0x10
 #define HA7NET_FLAGS_POWERDOWN 0x20
+#define HA7NET_FLAGS_KEEPALIVE 0x40
 
 int ha7net_lib_init(void);
 void ha7net_lib_done(void);
@@ -152,6 +162,39 @@ int ha7net_writeblock_ex(ha7net_t *ctx, device_t *dev, unsigned char *data,
   size_t minlen, const char *cmd, ha7net_crc_t *crc, int flags);
 void ha7net_writeblock_free(char *data);
 
+/*
+ *  ha7net_batch_t
+ *  A batch of WriteBlock.html requests which are queued with
+ *  ha7net_batch_writeblock() and then pipelined to the bus master with
+ *  ha7net_batch_send(): all of the requests are written to the TCP
+ *  connection at once and the responses then read back in order.  This
+ *  costs one network round trip rather than one per request.  Only
+ *  queue requests whose commands do not depend upon the results of
+ *  earlier requests in the same batch.  A request which may have reached
+ *  the bus master is never sent again: should a write fail or a response
+ *  be lost, the requests not yet answered fail and the caller may send
+ *  the batch anew.
+ */
+
+#define HA7NET_BATCH_MAX 8
+
+typedef struct {
+     size_t    nreq;                     /* Number of queued requests       */
+     device_t *dev[HA7NET_BATCH_MAX];    /* Device addressed or NULL        */
+     char     *url[HA7NET_BATCH_MAX];    /* Request-URI, malloc()ed         */
+     char     *data[HA7NET_BATCH_MAX];   /* Returned ResultData, malloc()ed */
+     size_t    dlen[HA7NET_BATCH_MAX];   /* Length of data[], bytes         */
+     int       istat[HA7NET_BATCH_MAX];  /* Per-request ERR_ status         */
+} ha7net_batch_t;
+
+void ha7net_batch_init(ha7net_batch_t *batch);
+void ha7net_batch_free(ha7net_batch_t *batch);
+int ha7net_batch_writeblock(ha7net_t *ctx, ha7net_batch_t *batch,
+  device_t *dev, const char *cmd, int flags);
+int ha7net_batch_send(ha7net_t *ctx, ha7net_batch_t *batch, int flags);
+int ha7net_batch_result(ha7net_batch_t *batch, size_t index,
+  unsigned char *data, size_t minlen, ha7net_crc_t *crc);
+
 const char *ha7net_last_response(ha7net_t *ctx, size_t *len);
 
 void ha7net_debug_set(debug_proc_t *proc, void *ctx, int flags);
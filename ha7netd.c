@@ -475,6 +475,14 @@ main(int argc, char **argv)
 	  tinfo->timeout      = ha7net_list->tmo;
 	  tinfo->max_fails    = ha7net_list->max_fails;
 	  tinfo->period       = ha7net_list->period;
+	  tinfo->history      = ha7net_list->history;
+	  tinfo->fsync        = ha7net_list->fsync;
+	  tinfo->binary       = ha7net_list->binary;
+	  tinfo->archive      = ha7net_list->archive;
+	  tinfo->snapshot     = ha7net_list->snapshot;
+	  memcpy(tinfo->rollup, ha7net_list->rollup, sizeof(tinfo->rollup));
+	  tinfo->bus_convert  = ha7net_list->bus_convert;
+	  tinfo->keepalive    = ha7net_list->keepalive;
 	  tinfo->cmd          = ha7net_list->cmd;
 	  tinfo->title        = ha7net_list->loc;
 	  tinfo->fname_path   = ha7net_list->dpath;
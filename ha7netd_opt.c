@@ -41,10 +41,16 @@
 #include "os.h"
 #include "ha7net.h"
 #include "ha7netd.h"
+#include "weather.h"
 
 #define PARSE_ALT 0
 #define PARSE_FLA 1
 #define PARSE_PER 2
+#define PARSE_HIS 3
+#define PARSE_SYN 4
+#define PARSE_SNP 5
+#define PARSE_R15 6
+#define PARSE_R60 7
 
 static opt_parse_proc_t parse_value;
 
@@ -52,10 +58,18 @@ static ha7netd_opt_t odummy;
 static opt_bulkload_t ha7netd_opts[] = {
      { OBULK_NUMP("altitude",     odummy.altitude,  0,
 		  OPT_DTYPE_INT,  parse_value,     (void *)PARSE_ALT) },
+     { OBULK_INT("archive",       odummy.archive,   0) },
      { OBULK_STR("averages",      odummy.avgs,      0) },
+     { OBULK_INT("binary",        odummy.binary,    0) },
+     { OBULK_INT("bus_convert",   odummy.bus_convert, 0) },
      { OBULK_STR("cmd",           odummy.cmd,       0) },
      { OBULK_STR("data",          odummy.dpath,     0) },
+     { OBULK_NUMP("fsync",        odummy.fsync,     0,
+		  OPT_DTYPE_INT,  parse_value,    (void *)PARSE_SYN) },
+     { OBULK_NUMP("history",      odummy.history,   0,
+		  OPT_DTYPE_INT,  parse_value,    (void *)PARSE_HIS) },
      { OBULK_STR("host",          odummy.host,      0) },
+     { OBULK_INT("keepalive",     odummy.keepalive, 0) },
      { OBULK_STR("latitude",      odummy.lat,       0) },
      { OBULK_STR("location",      odummy.loc,       0) },
      { OBULK_STR("longitude",     odummy.lon,       0) },
@@ -63,6 +77,12 @@ static opt_bulkload_t ha7netd_opts[] = {
      { OBULK_NUMP("period",       odummy.period,    0,
 		  OPT_DTYPE_INT,  parse_value,    (void *)PARSE_PER) },
      { OBULK_USHORT("port",       odummy.port,      0) },
+     { OBULK_NUMP("rollup_15m",   odummy.rollup[0], 0,
+		  OPT_DTYPE_INT,  parse_value,    (void *)PARSE_R15) },
+     { OBULK_NUMP("rollup_1h",    odummy.rollup[1], 0,
+		  OPT_DTYPE_INT,  parse_value,    (void *)PARSE_R60) },
+     { OBULK_NUMP("snapshot",     odummy.snapshot,  0,
+		  OPT_DTYPE_INT,  parse_value,    (void *)PARSE_SNP) },
      { OBULK_UINT("timeout",      odummy.tmo,       0) },
      { OBULK_TERM }
 };
@@ -92,14 +112,22 @@ static opt_bulkload_t ha7netd_gopts[] = {
 extern const char default_facility[];
 
 static const char     *default_avgs     = "10m 1h";
+static int             default_bus_cvt  = 1;
 static const char     *default_cmd      = "xml_to_html.sh %x";
 static int             default_debug    = 1;
 static const char     *default_dpath    = "data/";
 static int             default_fails    = 10;
+static int             default_fsync    = WEATHER_FSYNC_RECORD;
+static int             default_history  = 60 * 60 * 24; /* 24 hours */
 static const char     *default_host     = "192.168.0.250"; /* HA7Net default */
 static const char     *default_loc      = "A cornfield in Iowa";
 static int             default_period   = 60 * 2;    /* 2 minutes  */
 static unsigned short  default_port     = 80;
+static int             default_snapshot = 60 * 15;   /* 15 minutes */
+static int             default_rollup[NTIERS] = {
+     60 * 60 * 24 * 30,         /* 30 days of 15 minute bins */
+     60 * 60 * 24 * 90          /* 90 days of hourly bins    */
+};
 static unsigned int    default_tmo      = 60 * 1000; /* 60 seconds */
 static const char     *default_user     = "";
 static device_period_array_t default_periods = {10*60, 60*60, 0, 0};
@@ -127,7 +155,7 @@ static int
 parse_value(void *ctx, void *outbuf, size_t outbufsize, const char *inbuf,
 	    size_t inlen, const opt_option_t *opt, const opt_bulkload_t *item)
 {
-     int blank_seen, digit_seen, mode, sign, state, units_seen, val;
+     int blank_seen, dflt_per, digit_seen, mode, sign, state, units_seen, val;
      char c;
      size_t i, j;
      unsigned int uval;
@@ -142,9 +170,32 @@ parse_value(void *ctx, void *outbuf, size_t outbufsize, const char *inbuf,
       *  Parsing mode
       */
      mode = (int)ctx;
-     if (mode != PARSE_ALT && mode != PARSE_PER && mode != PARSE_FLA)
+     if (mode != PARSE_ALT && mode != PARSE_PER && mode != PARSE_FLA &&
+	 mode != PARSE_HIS && mode != PARSE_SYN && mode != PARSE_SNP &&
+	 mode != PARSE_R15 && mode != PARSE_R60)
 	  return(ERR_NO);
 
+     /*
+      *  A history length, snapshot interval, or rollup tier retention is
+      *  parsed just like a sampling period; only the default differs
+      */
+     dflt_per = default_period;
+     if (mode == PARSE_HIS)
+     {
+	  mode     = PARSE_PER;
+	  dflt_per = default_history;
+     }
+     else if (mode == PARSE_SNP)
+     {
+	  mode     = PARSE_PER;
+	  dflt_per = default_snapshot;
+     }
+     else if (mode == PARSE_R15 || mode == PARSE_R60)
+     {
+	  dflt_per = default_rollup[(mode == PARSE_R15) ? 0 : 1];
+	  mode     = PARSE_PER;
+     }
+
      /*
       *  Ignore leading LWSP
       */
@@ -157,6 +208,28 @@ parse_value(void *ctx, void *outbuf, size_t outbufsize, const char *inbuf,
 	  ++inbuf;
      }
 
+     /*
+      *  An fsync policy is either "record", "rotate", or else a period
+      *  during which at most one fsync is done
+      */
+     if (mode == PARSE_SYN)
+     {
+	  while (inlen && isspace(inbuf[inlen - 1]))
+	       --inlen;
+	  if (inlen == 6 && !strncasecmp(inbuf, "record", 6))
+	  {
+	       *(int *)outbuf = WEATHER_FSYNC_RECORD;
+	       return(ERR_OK);
+	  }
+	  else if (inlen == 6 && !strncasecmp(inbuf, "rotate", 6))
+	  {
+	       *(int *)outbuf = WEATHER_FSYNC_ROTATE;
+	       return(ERR_OK);
+	  }
+	  mode     = PARSE_PER;
+	  dflt_per = default_fsync;
+     }
+
      /*
       *  Deal with an empty line
       */
@@ -172,7 +245,7 @@ parse_value(void *ctx, void *outbuf, size_t outbufsize, const char *inbuf,
 	       break;
 
 	  case PARSE_PER :
-	       *(int *)outbuf = default_period;
+	       *(int *)outbuf = dflt_per;
 	       break;
 
 	  case PARSE_FLA :
@@ -364,7 +437,7 @@ parse_value(void *ctx, void *outbuf, size_t outbufsize, const char *inbuf,
 	       break;
 
 	  case PARSE_PER :
-	       val = default_period;
+	       val = dflt_per;
 	       break;
 
 	  default :
@@ -461,6 +534,11 @@ parse_flags:
 #undef PARSE_ALT
 #undef PARSE_FLA
 #undef PARSE_PER
+#undef PARSE_HIS
+#undef PARSE_SYN
+#undef PARSE_SNP
+#undef PARSE_R15
+#undef PARSE_R60
 
 
 /*
@@ -713,11 +791,16 @@ ha7netd_opt_defaults(ha7netd_opt_t *opts, ha7netd_gopt_t *gblopts)
      {
 	  memset(opts, 0, sizeof(ha7netd_opt_t));
 
-	  opts->altitude  = HA7NETD_NO_ALTITUDE;
-	  opts->max_fails = default_fails;
-	  opts->period    = default_period;
-	  opts->port      = default_port;
-	  opts->tmo       = default_tmo;
+	  opts->altitude    = HA7NETD_NO_ALTITUDE;
+	  opts->bus_convert = default_bus_cvt;
+	  opts->fsync       = default_fsync;
+	  opts->history     = default_history;
+	  opts->max_fails   = default_fails;
+	  opts->period      = default_period;
+	  opts->port        = default_port;
+	  opts->snapshot    = default_snapshot;
+	  memmove(opts->rollup, default_rollup, sizeof(opts->rollup));
+	  opts->tmo         = default_tmo;
 
 	  memmove(opts->periods, default_periods,
 		  sizeof(device_period_array_t));
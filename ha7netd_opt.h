@@ -70,9 +70,17 @@ typedef struct ha7netd_opt_s {
      struct ha7netd_opt_s *next;
      int                   altitude;     /* Altitude (meters)               */
      int                   period;       /* Interval between samples [secs] */
+     int                   history;      /* History kept in memory [secs]   */
+     int                   fsync;        /* Data file fsync policy          */
+     int                   binary;       /* Also keep binary data files     */
+     int                   archive;      /* Days of day files to keep       */
+     int                   snapshot;     /* State snapshot interval [secs]  */
+     int                   rollup[NTIERS]; /* Rollup tier retention [secs] */
      int                   max_fails;    /* Max. consecutive failures       */
      unsigned short        port;         /* HA7Net TCP port number          */
      unsigned int          tmo;          /* I/O timeout, milliseconds       */
+     int                   bus_convert;  /* Bus-wide DS18S20 conversions    */
+     int                   keepalive;    /* Keep HTTP connection open       */
      device_period_array_t periods;      /* Parsed averaging perionds       */
      char           avgs[MAX_OPT_LEN];   /* Averaging periods               */
      char           dpath[MAX_OPT_LEN];  /* Directory for data & XML files  */
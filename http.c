@@ -49,46 +49,40 @@
 #include "http_misc.h"
 
 /*
- *  Parsing states for handling an HTTP request
- *
- *  The value 0 is intentionally unused in an attempt to catch
- *  incorrectly initialized parsing states.
+ *  Message framing: how the end of the message-body is determined
+ */
+#define HTTP_BODY_NONE         0  /* No message-body                      */
+#define HTTP_BODY_LENGTH       1  /* Content-length: bytes of content     */
+#define HTTP_BODY_CHUNKED      2  /* Transfer-encoding: chunked           */
+#define HTTP_BODY_CLOSE        3  /* Content runs until the peer closes   */
+
+/*
+ *  Values for the Connection: header
+ */
+#define HTTP_CONN_DEFAULT      0
+#define HTTP_CONN_CLOSE        1
+#define HTTP_CONN_KEEPALIVE    2
+
+/*
+ *  Receive buffer sizing.  The buffer starts at HTTP_RBUF_SIZE bytes and
+ *  is grown as needed to hold a complete message, up to HTTP_MAX_MESSAGE
+ *  bytes.  We do not issue a recv() for fewer than HTTP_RBUF_MIN bytes.
  */
-#define HTTP_req               1
-#define HTTP_sta               2
-#define HTTP_fld_nam           3
-#define HTTP_fld_val           4
-#define HTTP_chunk_len         5
-#define HTTP_chunk_skip2eol    6
-#define HTTP_bdy_chunk         7
-#define HTTP_bdy_chunkeol      8
-#define HTTP_bdy_post          9
-#define HTTP_bdy_put          10
-#define HTTP_end              11
-#define HTTP_done             12
+#define HTTP_RBUF_SIZE      8192
+#define HTTP_RBUF_MIN        512
+#define HTTP_MAX_MESSAGE    (1024 * 1024)
 
 typedef struct {
 
   /* Parsing state */
-     int         state;                /* Parsing state                     */
-     /* Content length handling                                             */
+     int         request;              /* Parsing a request, not a response */
+     int         framing;              /* HTTP_BODY_                        */
+     size_t      clen;                 /* Content-length: value             */
+     int         clen_seen;            /* Content-length: header seen?      */
      int         chunked;              /* Transfer-encoding: chunked?       */
-     size_t      clen;                 /* Content-length: or chunk size     */
-     /* Header line processing                                              */
-     size_t      hdr_len;              /* Approx. header bytes read         */
-     size_t      hdr_fld_nam;          /* Offset to current hdr field name  */
-     size_t      hdr_fld_val;          /* Offset to current hdr field value */
-     /* Next three fields used to handle folding of header lines            */
-     size_t      hdr_len_last;         /* Previous hdr_len                  */
-     size_t      hdr_fld_nam_last;     /* Previous hdr_fld_nam              */
-     size_t      hdr_fld_val_last;     /* Previous hdr_fld_val              */
-
-  /* Read buffers */
-     e_string    req;                  /* Request- Status-Line buffer       */
-     e_string    header;               /* message-header                    */
-     e_string    content;              /* message-content                   */
-
-  /* Parsing results */
+     int         conn;                 /* Connection: header, HTTP_CONN_    */
+
+  /* Parsing results; offsets are relative to the start of the message    */
      size_t      ctype;                /* Content-type: field value, offset */
      size_t      ctype_len;            /* Content-type: field length        */
      int         ver_major;            /* Major version                     */
@@ -113,9 +107,12 @@ typedef struct {
  *  Forward declarations
  */
 static int parse_version(const char *str, int *major, int *minor);
-static int parse_request_line(http_parse_t *info, const e_string *req);
-static int parse_status_line(http_parse_t *info, const e_string *status);
-static int parse_line(http_parse_t *pinfo, const char *data, size_t dlen);
+static int parse_request_line(http_parse_t *info, const char *line,
+  size_t len);
+static int parse_status_line(http_parse_t *info, const char *line,
+  size_t len);
+static void parse_header(http_parse_t *info, const char *msg, size_t start,
+  size_t end);
 
 /*
  *  For fast isspace() handling
@@ -228,15 +225,15 @@ parse_version(const char *str, int *major, int *minor)
 
 
 static int
-parse_request_line(http_parse_t *info, const e_string *req)
+parse_request_line(http_parse_t *info, const char *line, size_t len)
 {
      size_t offset;
      const char *ptr;
 
-     if (!info || !req)
+     if (!info || !line)
      {
 	  debug("parse_request_line(%d): Invalid call arguments supplied; "
-		"info=%p, req=%p; both must be non-zero", __LINE__, info, req);
+		"info=%p, line=%p; both must be non-zero", __LINE__, info, line);
 	  return(-1);
      }
 
@@ -248,14 +245,15 @@ parse_request_line(http_parse_t *info, const e_string *req)
      info->method      = HTTP_UNKNOWN;
      info->req_uri     = 0;
      info->req_uri_len = 0;
+     offset            = 0;
 
      /*
       *  Request-Line = Method SP Request-URI SP HTTP-Version CRLF
       */
-     switch(info->req.data[0])
+     switch(line[0])
      {
      case 'O' :
-	  if (!estrncmp(req, "OPTIONS ", 8))
+	  if (!strncmp(line, "OPTIONS ", 8))
 	  {
 	       info->method = HTTP_OPTIONS;
 	       offset = 8;
@@ -263,7 +261,7 @@ parse_request_line(http_parse_t *info, const e_string *req)
 	  break;
 
      case 'G' :
-	  if (!estrncmp(req, "GET ", 4))
+	  if (!strncmp(line, "GET ", 4))
 	  {
 	       info->method = HTTP_GET;
 	       offset = 4;
@@ -271,7 +269,7 @@ parse_request_line(http_parse_t *info, const e_string *req)
 	  break;
 
      case 'H' :
-	  if (!estrncmp(req, "HEAD ", 5))
+	  if (!strncmp(line, "HEAD ", 5))
 	  {
 	       info->method = HTTP_HEAD;
 	       offset = 5;
@@ -279,12 +277,12 @@ parse_request_line(http_parse_t *info, const e_string *req)
 	  break;
 
      case 'P' :
-	  if (!estrncmp(req, "POST ", 5))
+	  if (!strncmp(line, "POST ", 5))
 	  {
 	       info->method = HTTP_POST;
 	       offset = 5;
 	  }
-	  else if (!estrncmp(req, "PUT ", 4))
+	  else if (!strncmp(line, "PUT ", 4))
 	  {
 	       info->method = HTTP_PUT;
 	       offset = 4;
@@ -292,7 +290,7 @@ parse_request_line(http_parse_t *info, const e_string *req)
 	  break;
 
      case 'D' :
-	  if (!estrncmp(req, "DELETE ", 7))
+	  if (!strncmp(line, "DELETE ", 7))
 	  {
 	       info->method = HTTP_DELETE;
 	       offset = 7;
@@ -300,7 +298,7 @@ parse_request_line(http_parse_t *info, const e_string *req)
 	  break;
 
      case 'T' :
-	  if (!estrncmp(req, "TRACE ", 6))
+	  if (!strncmp(line, "TRACE ", 6))
 	  {
 	       info->method = HTTP_TRACE;
 	       offset = 6;
@@ -308,7 +306,7 @@ parse_request_line(http_parse_t *info, const e_string *req)
 	  break;
 
      case 'C' :
-	  if (!estrncmp(req, "CONNECT ", 8))
+	  if (!strncmp(line, "CONNECT ", 8))
 	  {
 	       info->method = HTTP_CONNECT;
 	       offset = 8;
@@ -324,7 +322,7 @@ parse_request_line(http_parse_t *info, const e_string *req)
       */
      if (!offset)
      {
-	  ptr = req->data;
+	  ptr = line;
 	  while (*ptr && (*ptr == ' ' || *ptr == '\t'))
 	       ptr++;
 	  if (!ptr[0] || !ptr[1])
@@ -334,12 +332,12 @@ parse_request_line(http_parse_t *info, const e_string *req)
 	       goto bad_eol;
      }
      else
-	  ptr = req->data + offset;
+	  ptr = line + offset;
 
      /*
       *  Locate the offset to the Request-URI
       */
-     ptr = req->data + offset;
+     ptr = line + offset;
      while (*ptr && (*ptr == ' ' || *ptr == '\t'))
 	  ptr++;
      if (!ptr[0])
@@ -351,21 +349,21 @@ parse_request_line(http_parse_t *info, const e_string *req)
      /*
       *  Compute the offset
       */
-     info->req_uri = ptr - req->data;
+     info->req_uri = ptr - line;
 
      /*
       *  Move to the start of the LWSP between the Request-URI and HTTP-Version
       */
      while (*ptr && (*ptr != ' ' && *ptr != '\t'))
 	  ptr++;
-     info->req_uri_len = (ptr - req->data) - info->req_uri;
+     info->req_uri_len = (ptr - line) - info->req_uri;
 
      /*
       *  Now skip over the LWSP
       */
      while(*ptr && (*ptr == ' ' || *ptr == '\t'))
 	  ptr++;
-     if (!ptr[0] || !ptr[1])
+     if (!ptr[0])
 	  /*
 	   *  Premature EOL
 	   */
@@ -374,7 +372,7 @@ parse_request_line(http_parse_t *info, const e_string *req)
      /*
       *  Determine the HTTP version
       */
-     return(parse_version(ptr + 1,
+     return(parse_version(ptr,
 			  &info->ver_major,
 			  &info->ver_minor));
 
@@ -385,23 +383,23 @@ bad_eol:
      debug("parse_request_line(%d): Unable to parse the supplied HTTP "
 	   "Request-Line; premature end-of-line encountered; supplied "
 	   "Request-Line is \"%.*s\"",
-	   __LINE__, req->data ? req->len : 0, req->data ? req->data : "");
+	   __LINE__, (int)len, line);
      return(-1);
 }
 
 
 static int
-parse_status_line(http_parse_t *info, const e_string *status)
+parse_status_line(http_parse_t *info, const char *line, size_t len)
 {
      char c;
      int i;
      const char *ptr;
 
-     if (!info || !status)
+     if (!info || !line)
      {
 	  debug("parse_status_line(%d): Invalid call arguments supplied; "
-		"info=%p, status=%p; both must be non-zero",
-		__LINE__, info, status);
+		"info=%p, line=%p; both must be non-zero",
+		__LINE__, info, line);
 	  return(-1);
      }
 
@@ -417,7 +415,7 @@ parse_status_line(http_parse_t *info, const e_string *status)
      /*
       *  Parse the HTTP-Version field
       */
-     if (parse_version(status->data,
+     if (parse_version(line,
 		       &info->ver_major,
 		       &info->ver_minor))
      {
@@ -427,15 +425,14 @@ parse_status_line(http_parse_t *info, const e_string *status)
 	  debug("parse_status_line(%d): Unable to parse the supplied "
 		"Status-Line; cannot parse the HTTP-Version field; supplied "
 		"Request-Line is \"%.*s\"",
-		__LINE__, status->data ? status->len : 0,
-		status->data ? status->data : "");
+		__LINE__, (int)len, line);
 	  return(-1);
      }
 
      /*
       *  Look for the start of the status code
       */
-     ptr = status->data + 8;  /* HTTP/x.x is at least 8 bytes long */
+     ptr = line + 8;  /* HTTP/x.x is at least 8 bytes long */
      while (*ptr && (*ptr != ' ' && *ptr != '\t'))
 	  ptr++;
      if (!ptr[0] || !ptr[1])
@@ -477,7 +474,7 @@ parse_status_line(http_parse_t *info, const e_string *status)
       */
      while (*ptr && (*ptr == ' ' || *ptr == '\t'))
 	  ptr++;
-     info->reason     = ptr - status->data;
+     info->reason     = ptr - line;
      info->reason_len = strlen(ptr);
 
      /*
@@ -492,609 +489,229 @@ bad_eol:
      debug("parse_status_line(%d): Unable to parse the supplied HTTP "
 	   "Status-Line; premature end-of-line encountered; supplied "
 	   "Status-Line is \"%.*s\"",
-	   __LINE__, status->data ? status->len : 0,
-	   status->data ? status->data : "");
+	   __LINE__, (int)len, line);
      return(-1);
 }
 
 
-static int
-parse_line(http_parse_t *pinfo, const char *data, size_t dlen)
+/*
+ *  Parse the message-header fields found between offsets start and end
+ *  of the message msg, noting those which bear on the message framing
+ *  and connection handling.  Field names are matched without regard to
+ *  case.  Folded (continuation) lines are skipped: none of the fields
+ *  we look at are ever folded in practice.
+ */
+static void
+parse_header(http_parse_t *info, const char *msg, size_t start, size_t end)
 {
-     char c;
-     const char *data_end, *dptr;
-     int istat;
+     const char *colon, *eol, *fend, *fld, *val, *vend;
+     size_t nlen;
 
-     /*
-      *  Sanity check
-      */
-     if (!pinfo)
+     fld  = msg + start;
+     fend = msg + end;
+     for (; fld < fend; fld = eol + 1)
      {
-	  debug("parse_line(%d): Invalid call arguments supplied; pinfo=NULL",
-		__LINE__);
-	  return(ERR_BADARGS);
-     }
-
-     /*
-      *  Return now if there's no work to do
-      */
-     if (!data || !dlen)
-	  goto done;
-
-     /*
-      *  Saves doing a strlen(data) when we want to determine
-      *  how much of data is left.
-      */
-     data_end = data + dlen;
-
-     /*
-      *  Ensure enough storage for this data
-      */
-     if (ensure(&pinfo->req,     dlen,  2048) ||
-	 ensure(&pinfo->header,  dlen,  2048) ||
-	 ensure(&pinfo->content, dlen, 10240))
-	  goto no_mem;
-
-     /*
-      *  Now parse the data
-      */
-     while ((c = *data))
-     {
-	  switch (pinfo->state)
-	  {
-
-	  default :
-	       /*
-		*  Bogus value for pinfo->state
-		*/
-	       debug("parse_line(%d): Invalid parser state supplied; "
-		     "pinfo->state=%d", __LINE__, pinfo->state);
-	       return(ERR_BADARGS);
+	  eol = (const char *)memchr(fld, '\n', fend - fld);
+	  if (!eol)
+	       eol = fend;
 
 	  /*
-	   *  Extract the HTTP request or status from the first line
+	   *  Skip continuation lines and lines without a field name
 	   */
-	  case HTTP_req :
-	  case HTTP_sta :
-	       switch (c)
-	       {
-	       case ' '  :
-	       case '\t' :
-		    /*
-		     *  LWSP
-		     */
-		    if (!pinfo->req.len)
-			 /* Ignore leading LWSP */
-			 break;
-		    else if (ISSPACE(pinfo->req.data[pinfo->req.len-1]))
-			 /* Remove redundant LWSP */
-			 break;
-		    else
-			 ECHARCAT(pinfo->req, ' ');
-		    break;
-
-	       case '\r' :
-		    /*
-		     *  Toss the CR
-		     */
-		    break;
-
-	       case '\n' :
-		    /*
-		     *  End of the HTTP request
-		     */
-		    if (!pinfo->req.len)
-			 /* Hmmm.... Bogus */
-			 break;
-
-		    /*
-		     *  NUL terminate the string
-		     */
-		    ECHARCAT(pinfo->req, '\0');
-
-		    /*
-		     *  Parse the line
-		     */
-		    if (pinfo->state == HTTP_req)
-			 parse_request_line(pinfo, &pinfo->req);
-		    else
-			 parse_status_line(pinfo, &pinfo->req);
-
-		    /*
-		     *  And move on to the HTTP header
-		     */
-		    pinfo->hdr_len          = 0;
-		    pinfo->header.len       = 0;
-		    pinfo->hdr_fld_nam      = 0;
-		    pinfo->hdr_fld_val      = 0;
-		    pinfo->hdr_fld_nam_last = 0;
-		    pinfo->hdr_fld_val_last = 0;
-		    pinfo->state            = HTTP_fld_nam;
-		    break;
-
-	       default   :
-		    /*
-		     *  Consume everything up to the first LWSP or NUL
-		     */
-		    dptr = data;
-		    while ((c = *(++data)) && !ISSPACE(c))
-			 ;
-		    dlen = data - dptr;
-		    memmove(pinfo->req.data + pinfo->req.len, dptr, dlen);
-		    pinfo->req.len += dlen;
-		    goto end_while;
-	       }
-	       break;
-
-	  /*
-	   *  HTTP field name
-	   */
-	  case HTTP_fld_nam :
-	       switch (c)
-	       {
-	       case '\0' :
-		    break;
-
-	       case ' ' :
-	       case '\t' :
-		    /*
-		     *  Folding?
-		     */
-		    if (!pinfo->hdr_len)
-		    {
-			 /*
-			  *  Folded header line
-			  */
-			 if (pinfo->header.len >= 2 &&
-			     pinfo->header.data[pinfo->header.len-1] == '\n' &&
-			     pinfo->header.data[pinfo->header.len-2] == '\r')
-			 {
-			      /*
-			       *  Replace the previous CRLF pair with a SP
-			       */
-			      pinfo->header.data[pinfo->header.len-2] = ' ';
-			      pinfo->header.len--;
-			 }
-			 pinfo->hdr_fld_nam = pinfo->hdr_fld_nam_last;
-			 pinfo->hdr_fld_val = pinfo->hdr_fld_val_last;
-			 pinfo->hdr_len     = pinfo->hdr_len_last - 1;
-			 pinfo->state       = HTTP_fld_val;
-		    }
-		    else
-		    {
-			 /*
-			  *  Invalid characters for a field name:
-			  *  let us just silently eat them
-			  */
-		    }
-		    break;
-
-	       case '\r' :
-		    /*
-		     *  Invalid characters for a field name; eat them
-		     */
-		    break;
-
-	       case '\n' :
-		    if (pinfo->hdr_len)
-			 /*
-			  *  Invalid characters for a field name; not
-			  *  allow to CRLF within the field name either...
-			  */
-			 break;
-
-		    /*
-		     *  pinfo->hdr_len == 0 and thus this is an empty line.
-		     *  An empty line signifies the end of the header
-		     */
-
-		    /*
-		     *  Remove the trailing CRLF from the header
-		     */
-		    if (pinfo->header.len >= 2 &&
-			pinfo->header.data[pinfo->header.len-1] == '\n' &&
-			pinfo->header.data[pinfo->header.len-2] == '\r')
-			 pinfo->header.len -= 2;
-
-		    /*
-		     *  Trailing header after chunked body?
-		     */
-		    if (pinfo->chunked == 2)
-		    {
-			 /*
-			  *  We just saw the end of the trailing
-			  *  header after the last chunk
-			  */
-			 pinfo->state = HTTP_done;
-			 return(ERR_EOM);
-		    }
-
-		    /*
-		     *  Move on to reading the HTTP content/body
-		     */
-		    pinfo->content.len = 0;
-		    if (pinfo->chunked)
-		    {
-			 /*
-			  *  We're chunking.  Get ready to read the size
-			  *  of the first chunk of data.  We don't NUL
-			  *  terminate the header just yet.
-			  */
-			 pinfo->clen  = 0;
-			 pinfo->state = HTTP_chunk_len;
-		    }
-		    else if (!pinfo->clen)
-		    {
-			 /*
-			  *  We've been told zero length content
-			  */
-			 pinfo->state = HTTP_done;
-			 return(ERR_EOM);
-		    }
-		    else
-		    {
-			 if (pinfo->method == HTTP_GET)
-			      pinfo->state = HTTP_bdy_put;
-			 else if (pinfo->method == HTTP_POST)
-			      pinfo->state = HTTP_bdy_post;
-			 else if (pinfo->method == HTTP_PUT)
-			      pinfo->state = HTTP_bdy_put;
-			 else
-			      pinfo->state = HTTP_bdy_put;
-		    }
-		    break;
-
-	       case ':'  :
-		    ECHARCAT(pinfo->header, ':');
-		    pinfo->hdr_len++;
-		    pinfo->state       = HTTP_fld_val;
-		    pinfo->hdr_fld_val = pinfo->header.len;
-		    break;
-
-	       default   :
-		    dptr = data;
-		    do
-		    {
-			 ECHARCAT(pinfo->header, tolower(c));
-		    }
-		    while ((c = *(++data)) && !ISSPACE(c) && c != ':');
-		    pinfo->hdr_len += data - dptr;
-		    goto end_while;
-	       }
-	       break;
+	  if (*fld == ' ' || *fld == '\t')
+	       continue;
+	  colon = (const char *)memchr(fld, ':', eol - fld);
+	  if (!colon)
+	       continue;
+	  nlen = colon - fld;
 
 	  /*
-	   *  Handle an HTTP header field value (which may be folded)
+	   *  Trim LWSP from either end of the field value
 	   */
-	  case HTTP_fld_val :
-	       switch (c)
-	       {
-	       case '\0' :
-		    break;
-
-	       case '\n' :
+	  val  = colon + 1;
+	  vend = eol;
+	  while (val < vend && ISSPACE(*val))
+	       val++;
+	  while (vend > val && ISSPACE(vend[-1]))
+	       vend--;
+
+	  if (nlen == 17 && !strncasecmp(fld, "transfer-encoding", 17))
+	  {
+	       if ((vend - val) >= 7 && !strncasecmp(val, "chunked", 7))
+		    info->chunked = 1;
+	  }
+	  else if (nlen == 14 && !strncasecmp(fld, "content-length", 14))
+	  {
+	       /*
+		*  Content-length: nnn
+		*/
+	       info->clen = 0;
+	       while (val < vend && ISDIGIT(*val))
+		    info->clen = info->clen * 10 + (*val++ - '0');
+	       info->clen_seen = 1;
+	  }
+	  else if (nlen == 10 && !strncasecmp(fld, "connection", 10))
+	  {
+	       /*
+		*  Connection: close | keep-alive
+		*/
+	       if ((vend - val) >= 5 && !strncasecmp(val, "close", 5))
+		    info->conn = HTTP_CONN_CLOSE;
+	       else if ((vend - val) >= 10 &&
+			!strncasecmp(val, "keep-alive", 10))
+		    info->conn = HTTP_CONN_KEEPALIVE;
+	  }
+	  else if (nlen == 12 && !strncasecmp(fld, "content-type", 12))
+	  {
+	       /*
+		*  Content-type: a/b
+		*/
+	       info->ctype     = val - msg;
+	       info->ctype_len = 0;
+	       while (val < vend && !ISSPACE(*val) && *val != ';')
 	       {
-		    int ilen;
-		    
-		    /*
-		     *  End of this header line, start of the next
-		     */
-		    ECHARCAT(pinfo->header, '\n');
-
-		    /*
-		     *  Was this a header line of interest?
-		     */
-		    ilen = (pinfo->hdr_fld_val - pinfo->hdr_fld_nam) - 1;
-		    if (ilen == 17 &&
-			!memcmp("transfer-encoding",
-				pinfo->header.data + pinfo->hdr_fld_nam, 17))
-		    {
-			 dptr = pinfo->header.data + pinfo->hdr_fld_val;
-			 while (ISSPACE(*dptr))
-			      /*
-			       *  We know there's a terminating NUL
-			       *  and thus we won't walk off the end
-			       *  of the buffer
-			       */
-			      dptr++;
-			 if (7 < (pinfo->header.data +
-				  pinfo->header.len - dptr) &&
-			     (*dptr == 'c' || *dptr == 'C') &&
-			     !strncasecmp(dptr + 1, "hunked", 6))
-			 {
-			      pinfo->chunked = 1;
-			      pinfo->clen    = 0;
-			 }
-		    }
-		    else if (ilen == 14 &&
-			     !memcmp("content-length",
-				     pinfo->header.data + pinfo->hdr_fld_nam,
-				     14))
-		    {
-			 /*
-			  *  Content-length: nnn
-			  */
-			 pinfo->clen = strtoul(pinfo->header.data +
-					       pinfo->hdr_fld_val, NULL, 10);
-		    }
-		    else if (ilen == 12 &&
-			     !memcmp("content-type",
-				     pinfo->header.data + pinfo->hdr_fld_nam,
-				     12))
-		    {
-			 /*
-			  *  Content-type: a/b
-			  */
-			 int pos;
-
-			 /*
-			  *  We store an offset since the actual
-			  *  pointer value may change if/when we
-			  *  handle any secondary header after the
-			  *  end of chunked data.
-			  */
-			 pinfo->ctype = pinfo->hdr_fld_val;
-			 while (ISSPACE(pinfo->header.data[pinfo->ctype]))
-			      pinfo->ctype++;
-			 pos = pinfo->ctype;
-			 while(!ISSPACE(pinfo->header.data[pos]) &&
-			       pinfo->header.data[pos] != '\r' &&
-			       pinfo->header.data[pos] != '\n')
-			      pos++;
-			 pinfo->ctype_len = (size_t)(pos - pinfo->ctype);
-		    }
-		    pinfo->hdr_len_last     = pinfo->hdr_len + 1;
-		    pinfo->hdr_fld_nam_last = pinfo->hdr_fld_nam;
-		    pinfo->hdr_fld_val_last = pinfo->hdr_fld_val;
-
-		    pinfo->hdr_len          = 0;
-		    pinfo->hdr_fld_nam      = pinfo->header.len;
-		    pinfo->hdr_fld_val      = pinfo->header.len;
-		    pinfo->state            = HTTP_fld_nam;
+		    val++;
+		    info->ctype_len++;
 	       }
-	       break;
-
-	       default :
-		    dptr = data;
-		    while ((c = *(++data)) && c != '\n')
-			 ;
-		    dlen = data - dptr;
-		    memmove(pinfo->header.data + pinfo->header.len, dptr,
-			    dlen);
-		    pinfo->header.len += dlen;
-		    pinfo->hdr_len += dlen;
-		    goto end_while;
-	       }
-	       break;
-
-	  /*
-	   *  Read the chunk size for the next chunk of content
-	   */
-	  case HTTP_chunk_len :
-	       switch (c)
-	       {
-	       case '\r' :
-		    break;
-
-	       case '\n' :
-		    if (pinfo->clen)
-			 pinfo->state = HTTP_bdy_chunk;
-		    else
-		    {
-			 /*
-			  *  Chunk size of 0 indicates end of content
-			  *  Read remaining headers, if any
-			  */
-			 pinfo->chunked          = 2;
-			 pinfo->hdr_len          = 0;
-			 pinfo->hdr_fld_nam      = 0;
-			 pinfo->hdr_fld_val      = 0;
-			 pinfo->hdr_fld_nam_last = 0;
-			 pinfo->hdr_fld_val_last = 0;
-			 pinfo->state            = HTTP_fld_nam;
-		    }
-		    break;
-
-	       case '0' :
-	       case '1' :
-	       case '2' :
-	       case '3' :
-	       case '4' :
-	       case '5' :
-	       case '6' :
-	       case '7' :
-	       case '8' :
-	       case '9' :
-		    pinfo->clen = pinfo->clen * 16 + (c) - '0';
-		    break;
-
-	       case 'a' :
-	       case 'b' :
-	       case 'c' :
-	       case 'd' :
-	       case 'e' :
-	       case 'f' :
-		    pinfo->clen = pinfo->clen * 16 + 10 + (c) - 'a';
-		    break;
+	  }
+     }
+}
 
-	       case 'A' :
-	       case 'B' :
-	       case 'C' :
-	       case 'D' :
-	       case 'E' :
-	       case 'F' :
-		    pinfo->clen = pinfo->clen * 16 + 10 + (c) - 'A';
-		    break;
 
-	       default :
-		    pinfo->state = HTTP_chunk_skip2eol;
-		    break;
-	       }
-	       break;
-
-	  case HTTP_chunk_skip2eol :
-	       if (c != '\n')
-		    break;
-	       if (pinfo->clen)
-		    pinfo->state = HTTP_bdy_chunk;
-	       else
-	       {
-		    /*
-		     *  Chunk size of 0 indicates end of content
-		     *  Read remaining headers, if any
-		     */
-		    pinfo->chunked          = 2;
-		    pinfo->hdr_len          = 0;
-		    pinfo->hdr_fld_nam      = 0;
-		    pinfo->hdr_fld_val      = 0;
-		    pinfo->hdr_fld_nam_last = 0;
-		    pinfo->hdr_fld_val_last = 0;
-		    pinfo->state            = HTTP_fld_nam;
-	       }
-	       break;
+/*
+ *  Receive more data from the connection, appending it to the data
+ *  already in the connection's receive buffer.  Unparsed data is moved
+ *  to the start of the buffer or the buffer grown when there is too
+ *  little room left to be worth a recv() call.
+ *
+ *  Returns ERR_OK when data was received, ERR_EOM when the peer has
+ *  closed the connection, ERR_TOOLONG when a message will not fit within
+ *  HTTP_MAX_MESSAGE bytes, and ERR_READ or ERR_NOMEM otherwise.
+ */
+static int
+http_fill(http_conn_t *hconn)
+{
+     int again;
+     char *tmp;
+     size_t newmax;
+     ssize_t buflen;
 
-	  /*
-	   *  Actual content; number of expected bytes is info->clen;
-	   *  remove line breaks from the content
-	   */
-	  case HTTP_bdy_chunk :
-	       dlen = data_end - data;
-	       if (!dlen)
-		    break;
-	       if (dlen > pinfo->clen)
-		    dlen = pinfo->clen;
-	       if (ERR_OK != (istat = estrncat(&pinfo->content, data, dlen)))
-		    goto no_mem;
-	       data += dlen - 1;  /* We do data++ at end of loop */
-	       pinfo->clen -= dlen;
-	       if (pinfo->clen)
-		    break;
+     if ((hconn->rbuf_max - hconn->rbuf_len) < HTTP_RBUF_MIN)
+     {
+	  if (hconn->rbuf_pos >= HTTP_RBUF_MIN)
+	  {
 	       /*
-		*  Deal with trailing CRLF at end of the chunk
+		*  Slide the partial message down to the start of the buffer
 		*/
-	       pinfo->state = HTTP_bdy_chunkeol;
-	       break;
-
-	  /*
-	   *  Consume the trailing EOF after a chunk
-	   */
-	  case HTTP_bdy_chunkeol:
-	       if (c == '\n')
+	       hconn->rbuf_len -= hconn->rbuf_pos;
+	       if (hconn->rbuf_len)
+		    memmove(hconn->rbuf, hconn->rbuf + hconn->rbuf_pos,
+			    hconn->rbuf_len);
+	       hconn->rbuf_pos = 0;
+	  }
+	  else
+	  {
+	       if (hconn->rbuf_max >= HTTP_MAX_MESSAGE)
 	       {
-		    pinfo->clen  = 0;
-		    pinfo->state = HTTP_chunk_len;
+		    debug("http_fill(%d): HTTP message exceeds the maximum "
+			  "supported length of %u bytes",
+			  __LINE__, HTTP_MAX_MESSAGE);
+		    return(ERR_TOOLONG);
 	       }
-	       break;
-
-	  /*
-	   *  Actual content; number of expected bytes is info->clen;
-	   *  remove line breaks from the content
-	   */
-	  case HTTP_bdy_post :
-	       if (c == '\r' || c == '\n')
-		    break;
-	       ECHARCAT(pinfo->content, c);
-	       if (pinfo->content.len < pinfo->clen)
-		    break;
-/*
- *  Used to switch to HTTP_end and read until LF seen.  However, HTTP/1.1
- *  specification suggests that the type entity-body need not have a CRLF
- *  terminator pair.  In addition, the Coates were seeing a bizarre case
- *  where, left without adequate attention, Internet Exploder would omit the
- *  final CRLF pair in postings.  That is, if you left it idle for a few
- *  minutes and then POSTed, it would omit the CRLF.
- */
-	       pinfo->state = HTTP_done;
-	       break;
-
-	  /*
-	   *  Actual content; number of expected bytes is info->clen;
-	   *  preserve line breaks as \n
-	   */
-	  case HTTP_bdy_put :
-/*	       if (c == '\r')
- *		    break;
- */
-	       ECHARCAT(pinfo->content, c);
-	       if (pinfo->content.len < pinfo->clen)
-		    break;
-	       pinfo->state = HTTP_done; /* See comment in HTTP_bdy_post */
-	       break;
-
-	  /*
-	   *  Read the last CRLF pair and then we're done
-	   */
-	  case HTTP_end :
-	       if (c != '\n')
-		    break;
-	       pinfo->state = HTTP_done;
-	       return(ERR_EOM);
+	       newmax = 2 * hconn->rbuf_max;
+	       tmp = (char *)realloc(hconn->rbuf, newmax + 1);
+	       if (!tmp)
+	       {
+		    debug("http_fill(%d): Insufficient virtual memory",
+			  __LINE__);
+		    return(ERR_NOMEM);
+	       }
+	       hconn->rbuf     = tmp;
+	       hconn->rbuf_max = newmax;
+	  }
+     }
 
-	  /*
-	   *  We shouldn't see this, but oh well
-	   */
-	  case HTTP_done :
-	       return(ERR_EOM);
-          }
-	  data++;
-     end_while:
-	  ;
+     again = 0;
+read_again:
+     buflen = os_recv(hconn->sd, hconn->rbuf + hconn->rbuf_len,
+		      hconn->rbuf_max - hconn->rbuf_len, 0, hconn->recv_tmo);
+     if (dbglvl & DEBUG_RECV)
+     {
+	  int save_errno = SOCK_ERRNO;
+	  if (dbglvl & DEBUG_VERBOSE)
+	  {
+	       char tmpbuf[4096];
+	       tdebug("http_read(%d): Read %u bytes from socket %d \"%s\"",
+		      __LINE__, buflen, hconn->sd,
+		      pretty_print(hconn->rbuf + hconn->rbuf_len, buflen,
+				   tmpbuf, NULL, sizeof(tmpbuf)));
+	  }
+	  else
+	       tdebug("http_read(%d): Read %u bytes from socket %d",
+		      __LINE__, buflen, hconn->sd);
+	  SET_SOCK_ERRNO(save_errno);
      }
-done:
-     return(pinfo->state != HTTP_done ? ERR_OK : ERR_EOM);
+     if (buflen > 0)
+     {
+	  hconn->rbuf_len += (size_t)buflen;
+	  return(ERR_OK);
+     }
+     else if (buflen == 0)
+	  return(ERR_EOM);
+     else if (ISTEMPERR(SOCK_ERRNO) && ++again < 2)
+	  goto read_again;
 
-no_mem:
-     debug("parse_line(%d): Insufficient virtual memory", __LINE__);
-     return(istat);
+     if (dbglvl & (DEBUG_RECV | DEBUG_ERRS))
+     {
+	  int save_errno = SOCK_ERRNO;
+	  debug("http_read(%d): Error reading from socket %d; recv() call "
+		"failed; errno=%d; %s",
+		__LINE__, hconn->sd, save_errno, strerror(save_errno));
+	  SET_SOCK_ERRNO(save_errno);
+     }
+     return(ERR_READ);
 }
 
 
 void
 http_dispose(http_msg_t *hinfo)
 {
+     /*
+      *  The message fields point into the connection's receive buffer:
+      *  there is nothing to free
+      */
      if (hinfo)
-     {
-	  if (hinfo->req)
-	       free(hinfo->req);
-	  if (hinfo->sta)
-	       free(hinfo->sta);
-	  if (hinfo->hdr)
-	       free(hinfo->hdr);
-	  if (hinfo->bdy)
-	       free(hinfo->bdy);
-
-	  hinfo->req         = NULL;
-	  hinfo->req_len     = 0;
-	  hinfo->req_uri     = NULL;
-	  hinfo->req_uri_len = 0;
-
-	  hinfo->sta         = NULL;
-	  hinfo->sta_len     = 0;
-	  hinfo->reason      = NULL;
-	  hinfo->reason_len  = 0;
-
-	  hinfo->hdr         = NULL;
-	  hinfo->hdr_len     = 0;
-	  hinfo->ctype       = NULL;
-	  hinfo->ctype_len   = 0;
-
-	  hinfo->bdy         = NULL;
-	  hinfo->bdy_len     = 0;
-     }
+	  memset(hinfo, 0, sizeof(http_msg_t));
 }
 
 
 /*
- *  Read and parse a request from the HTTP client
+ *  Read and parse an HTTP request or response
+ *
+ *  Data is received into a buffer owned by the connection and the message
+ *  is parsed in place: the fields of hinfo point into that buffer and
+ *  remain valid until the next read from, or close of, the connection.
+ *  Chunked content is reassembled in place.  Any data following the end
+ *  of the message (e.g., a pipelined response) is left in the buffer for
+ *  the next call.
+ *
+ *  So that the Request-Line, Status-Line, header, and body may each be
+ *  NUL terminated, the byte following the body is saved and restored on
+ *  the next call when it belongs to the next message.
  */
+#define FILL \
+     if (ERR_OK != (istat = http_fill(hconn))) goto short_read; \
+     msg   = hconn->rbuf + hconn->rbuf_pos; \
+     avail = hconn->rbuf_len - hconn->rbuf_pos
+
 static int
-http_read(http_conn_t *hconn, http_msg_t *hinfo, int start_state)
+http_read(http_conn_t *hconn, http_msg_t *hinfo, int request)
 {
-#define BUFSIZE 8192
-     int again, istat, n;
-     char buffer[BUFSIZE+1];
-     ssize_t buflen;
-     fd_set efds, rfds;
+     char *msg;
+     const char *eol, *ptr;
+     int istat;
+     size_t avail, bdy, bdy_end, blank, end, hdr, hdr_end, line_end, scan;
+     size_t chunk, dst, src;
      http_parse_t pinfo;
 
      if (!hconn || !hinfo)
@@ -1112,153 +729,362 @@ http_read(http_conn_t *hconn, http_msg_t *hinfo, int start_state)
      }
 
      /*
-      *  Initialize our request reading & parsing state information
+      *  Allocate the connection's receive buffer if we haven't already.
+      *  Allow room for a NUL terminator.
+      */
+     if (!hconn->rbuf)
+     {
+	  hconn->rbuf = (char *)malloc(HTTP_RBUF_SIZE + 1);
+	  if (!hconn->rbuf)
+	  {
+	       debug("http_read(%d): Insufficient virtual memory", __LINE__);
+	       return(ERR_NOMEM);
+	  }
+	  hconn->rbuf_max   = HTTP_RBUF_SIZE;
+	  hconn->rbuf_pos   = 0;
+	  hconn->rbuf_len   = 0;
+	  hconn->rbuf_saved = 0;
+     }
+
+     /*
+      *  Put back the byte overwritten by the NUL terminating the
+      *  previous message's body
       */
-     istat = ERR_OK;
+     if (hconn->rbuf_saved)
+     {
+	  hconn->rbuf[hconn->rbuf_pos] = hconn->rbuf_save;
+	  hconn->rbuf_saved = 0;
+     }
+     else if (hconn->rbuf_pos >= hconn->rbuf_len)
+     {
+	  /*
+	   *  Nothing buffered: start over at the beginning of the buffer
+	   */
+	  hconn->rbuf_pos = 0;
+	  hconn->rbuf_len = 0;
+     }
+
      memset(hinfo,  0, sizeof(http_msg_t));
      memset(&pinfo, 0, sizeof(http_parse_t));
-     pinfo.state = start_state;
-     pinfo.clen  = 0x7fffffff;  /* Assume that we read until socket closes */
-     again = 0;
+     pinfo.request = request;
 
-read_loop:
      /*
-      *  Read data from the client
+      *  Read until we have the entire message-header: the Request- or
+      *  Status-Line and the header fields through the terminating empty
+      *  line.  Empty lines preceding the message are ignored.
       */
-     buflen = os_recv(hconn->sd, buffer, BUFSIZE, 0, hconn->recv_tmo);
-     if (dbglvl & DEBUG_RECV)
+     msg   = hconn->rbuf + hconn->rbuf_pos;
+     avail = hconn->rbuf_len - hconn->rbuf_pos;
+     scan  = 0;
+     for (;;)
      {
-	  int save_errno = SOCK_ERRNO;
-	  if (dbglvl & DEBUG_VERBOSE)
+	  while (avail && (*msg == '\r' || *msg == '\n'))
 	  {
-	       char tmpbuf[4096];
-	       tdebug("http_read(%d): Read %u bytes from socket %d \"%s\"",
-		      __LINE__, buflen, hconn->sd,
-		      pretty_print(buffer, buflen, tmpbuf, NULL,
-				   sizeof(tmpbuf)));
+	       hconn->rbuf_pos++;
+	       msg++;
+	       avail--;
 	  }
-	  else
-	       tdebug("http_read(%d): Read %u bytes from socket %d",
-		      __LINE__, buflen, hconn->sd);
-	  SET_SOCK_ERRNO(save_errno);
-     }
-     if (buflen > 0)
-     {
-	  again = 0;
-	  buffer[buflen] = '\0';
-	  istat = parse_line(&pinfo, buffer, buflen);
-	  if (istat == ERR_OK)
-	       goto read_loop;
-	  else if (istat != ERR_EOM)
+
+	  blank = 0;
+	  ptr   = msg + scan;
+	  while ((ptr = (const char *)memchr(ptr, '\n', msg + avail - ptr)))
 	  {
-	       debug("http_read(%d): Error parsing the received HTTP data; "
-		     "parse_line() returned %d", __LINE__, istat);
-	       goto done_bad;
+	       if ((ptr + 1) < (msg + avail) && ptr[1] == '\n')
+	       {
+		    blank   = ptr + 1 - msg;
+		    hdr_end = blank + 1;
+		    break;
+	       }
+	       else if ((ptr + 2) < (msg + avail) && ptr[1] == '\r' &&
+			ptr[2] == '\n')
+	       {
+		    blank   = ptr + 1 - msg;
+		    hdr_end = blank + 2;
+		    break;
+	       }
+	       ptr++;
 	  }
+	  if (blank)
+	       break;
+
+	  /*
+	   *  No need to rescan what we've already looked at
+	   */
+	  scan = (avail >= 2) ? avail - 2 : 0;
+	  FILL;
      }
-     else if ((buflen == 0 || ISTEMPERR(SOCK_ERRNO)) && ++again < 2)
-	  goto read_loop;
+
+     /*
+      *  Parse the Request- or Status-Line, NUL terminating it
+      */
+     eol = (const char *)memchr(msg, '\n', blank);
+     line_end = eol - msg;
+     hdr = line_end + 1;
+     if (line_end && msg[line_end - 1] == '\r')
+	  line_end--;
+     msg[line_end] = '\0';
+     if (request)
+	  parse_request_line(&pinfo, msg, line_end);
+     else
+	  parse_status_line(&pinfo, msg, line_end);
+
+     /*
+      *  Now the header fields
+      */
+     parse_header(&pinfo, msg, hdr, blank);
+
+     /*
+      *  Determine how the end of the message-body is marked
+      */
+     if (!request &&
+	 ((pinfo.sta_code >= 100 && pinfo.sta_code < 200) ||
+	  pinfo.sta_code == 204 || pinfo.sta_code == 304))
+	  /*
+	   *  Responses which never have content
+	   */
+	  pinfo.framing = HTTP_BODY_NONE;
+     else if (pinfo.chunked)
+	  pinfo.framing = HTTP_BODY_CHUNKED;
+     else if (pinfo.clen_seen)
+	  pinfo.framing = HTTP_BODY_LENGTH;
+     else if (request)
+	  /*
+	   *  A request lacking a Content-length: header has no body
+	   */
+	  pinfo.framing = HTTP_BODY_NONE;
      else
+	  /*
+	   *  A response with neither a Content-length: header nor
+	   *  chunking: the content runs until the server closes the
+	   *  connection
+	   */
+	  pinfo.framing = HTTP_BODY_CLOSE;
+
+     /*
+      *  And read the body
+      */
+     bdy = hdr_end;
+     switch(pinfo.framing)
      {
-	  if (dbglvl & (DEBUG_RECV | DEBUG_ERRS))
+     default :
+     case HTTP_BODY_NONE :
+	  bdy_end = end = hdr_end;
+	  break;
+
+     case HTTP_BODY_LENGTH :
+	  if (pinfo.clen > HTTP_MAX_MESSAGE)
 	  {
-	       int save_errno = SOCK_ERRNO;
-	       debug("http_read(%d): Error reading from socket %d; recv() "
-		     "call failed; errno=%d; %s",
-		     __LINE__, hconn->sd, save_errno, strerror(save_errno));
-	       SET_SOCK_ERRNO(save_errno);
+	       debug("http_read(%d): HTTP message exceeds the maximum "
+		     "supported length of %u bytes; Content-length: %u",
+		     __LINE__, HTTP_MAX_MESSAGE, pinfo.clen);
+	       istat = ERR_TOOLONG;
+	       goto done_bad;
 	  }
-	  istat = ERR_READ;
-	  goto done_bad;
+	  while (avail < (hdr_end + pinfo.clen))
+	  {
+	       FILL;
+	  }
+	  bdy_end = end = hdr_end + pinfo.clen;
+	  break;
+
+     case HTTP_BODY_CLOSE :
+	  for (;;)
+	  {
+	       istat = http_fill(hconn);
+	       if (istat == ERR_EOM)
+		    break;
+	       else if (istat != ERR_OK)
+		    goto done_bad;
+	  }
+	  msg   = hconn->rbuf + hconn->rbuf_pos;
+	  avail = hconn->rbuf_len - hconn->rbuf_pos;
+	  bdy_end = end = avail;
+	  break;
+
+     case HTTP_BODY_CHUNKED :
+	  /*
+	   *  Reassemble the chunks in place: dst is where the next chunk's
+	   *  data goes and src is where the next chunk-size line begins
+	   */
+	  dst = src = hdr_end;
+	  for (;;)
+	  {
+	       while (!(eol = (const char *)memchr(msg + src, '\n',
+						   avail - src)))
+	       {
+		    FILL;
+	       }
+	       chunk = 0;
+	       for (ptr = msg + src; ptr < eol; ptr++)
+	       {
+		    if (ISDIGIT(*ptr))
+			 chunk = chunk * 16 + (*ptr - '0');
+		    else if (*ptr >= 'a' && *ptr <= 'f')
+			 chunk = chunk * 16 + 10 + (*ptr - 'a');
+		    else if (*ptr >= 'A' && *ptr <= 'F')
+			 chunk = chunk * 16 + 10 + (*ptr - 'A');
+		    else
+			 /* chunk-extension or CRLF */
+			 break;
+	       }
+	       src = eol + 1 - msg;
+
+	       /*
+		*  Chunk size of 0 indicates end of content
+		*/
+	       if (!chunk)
+		    break;
+
+	       if (chunk > HTTP_MAX_MESSAGE)
+	       {
+		    debug("http_read(%d): HTTP message exceeds the maximum "
+			  "supported length of %u bytes; chunk size is %u",
+			  __LINE__, HTTP_MAX_MESSAGE, chunk);
+		    istat = ERR_TOOLONG;
+		    goto done_bad;
+	       }
+	       while (avail < (src + chunk))
+	       {
+		    FILL;
+	       }
+	       if (dst != src)
+		    memmove(msg + dst, msg + src, chunk);
+	       dst += chunk;
+	       src += chunk;
+
+	       /*
+		*  Consume the CRLF trailing the chunk's data
+		*/
+	       while (!(eol = (const char *)memchr(msg + src, '\n',
+						   avail - src)))
+	       {
+		    FILL;
+	       }
+	       src = eol + 1 - msg;
+	  }
+
+	  /*
+	   *  Skip any trailing header fields up through the empty line
+	   */
+	  for (;;)
+	  {
+	       while (!(eol = (const char *)memchr(msg + src, '\n',
+						   avail - src)))
+	       {
+		    FILL;
+	       }
+	       ptr = msg + src;
+	       src = eol + 1 - msg;
+	       if (ptr == eol || (ptr[0] == '\r' && (ptr + 1) == eol))
+		    break;
+	  }
+	  bdy_end = dst;
+	  end     = src;
+	  break;
      }
 
      /*
-      *  Now return the results
+      *  May the connection be used for another message?  HTTP/1.1
+      *  defaults to persistent connections; HTTP/1.0 does not.
       */
+     if (pinfo.framing == HTTP_BODY_CLOSE || pinfo.conn == HTTP_CONN_CLOSE)
+	  hinfo->keep_alive = 0;
+     else if (pinfo.conn == HTTP_CONN_KEEPALIVE)
+	  hinfo->keep_alive = 1;
+     else
+	  hinfo->keep_alive = (pinfo.ver_major > 1 ||
+			       (pinfo.ver_major == 1 && pinfo.ver_minor >= 1))
+	       ? 1 : 0;
 
      /*
-      *  NUL terminate the HTTP header & body
+      *  NUL terminate the header, less its trailing CRLF
       */
-     if (pinfo.header.data)
-     {
-	  if (ERR_OK != (istat = echarcat(&pinfo.header, '\0')))
-	       goto no_mem;
-     }
-     else
+     hdr_end = blank;
+     if (hdr_end > hdr && msg[hdr_end - 1] == '\n')
+	  hdr_end--;
+     if (hdr_end > hdr && msg[hdr_end - 1] == '\r')
+	  hdr_end--;
+     msg[hdr_end] = '\0';
+
+     /*
+      *  NUL terminate the body, saving the byte we overwrite if it
+      *  belongs to the next message
+      */
+     if (bdy_end < avail && bdy_end == end)
      {
-	  if (ERR_OK !=
-	      (istat = estrncat(&pinfo.header,
-				"content-type: text/html\r\n\0", 26)))
-	       goto no_mem;
-	  pinfo.ctype     = 14;
-	  pinfo.ctype_len =  9;
+	  hconn->rbuf_save  = msg[bdy_end];
+	  hconn->rbuf_saved = 1;
      }
-     if (ERR_OK != (istat = echarcat(&pinfo.content, '\0')))
-	  goto no_mem;
+     msg[bdy_end] = '\0';
 
      /*
-      *  And copy the data over from the parser state to the HTTP info
+      *  And now return the results
       */
      hinfo->ver_major = pinfo.ver_major;
      hinfo->ver_minor = pinfo.ver_minor;
-     if (start_state == HTTP_req)
+     if (request)
      {
-	  hinfo->req         = pinfo.req.data;
-	  hinfo->req_len     = pinfo.req.len;
+	  hinfo->req         = msg;
+	  hinfo->req_len     = line_end;
 	  hinfo->method      = pinfo.method;
-	  hinfo->req_uri     = pinfo.req.data + pinfo.req_uri;
+	  hinfo->req_uri     = msg + pinfo.req_uri;
 	  hinfo->req_uri_len = pinfo.req_uri_len;
-
-	  hinfo->sta         = NULL;
-	  hinfo->sta_len     = 0;
-	  hinfo->sta_code    = 0;
-	  hinfo->reason      = 0;
-	  hinfo->reason_len  = 0;
      }
      else
      {
-	  hinfo->req         = NULL;
-	  hinfo->req_len     = 0;
-	  hinfo->method      = 0;
-	  hinfo->req_uri     = NULL;
-	  hinfo->req_uri_len = 0;
-
-	  hinfo->sta         = pinfo.req.data;
-	  hinfo->sta_len     = pinfo.req.len;
+	  hinfo->sta         = msg;
+	  hinfo->sta_len     = line_end;
 	  hinfo->sta_code    = pinfo.sta_code;
-	  hinfo->reason      = pinfo.req.data + pinfo.reason;
+	  hinfo->reason      = msg + pinfo.reason;
 	  hinfo->reason_len  = pinfo.reason_len;
      }
-     pinfo.req.data = NULL;
 
-     if (pinfo.header.data)
+     hinfo->hdr     = msg + hdr;
+     hinfo->hdr_len = hdr_end - hdr;
+     if (pinfo.ctype_len)
      {
-	  hinfo->hdr       = pinfo.header.data;
-	  hinfo->hdr_len   = pinfo.header.len - 1;
-	  hinfo->ctype     = pinfo.header.data + pinfo.ctype;
+	  hinfo->ctype     = msg + pinfo.ctype;
 	  hinfo->ctype_len = pinfo.ctype_len;
-	  pinfo.header.data = NULL;
      }
      else
      {
+	  hinfo->ctype     = "text/html";
+	  hinfo->ctype_len = 9;
      }
 
-     hinfo->bdy       = pinfo.content.data;
-     hinfo->bdy_len   = pinfo.content.len - 1;
-     pinfo.content.data = NULL;
+     hinfo->bdy     = msg + bdy;
+     hinfo->bdy_len = bdy_end - bdy;
+
+     hconn->rbuf_pos += end;
 
      return(ERR_OK);
 
-no_mem:
-     debug("http_read(%d): Insufficient virtual memory", __LINE__);
+short_read:
+     /*
+      *  A close before any of the message arrived remains ERR_EOM so
+      *  that the caller may tell it apart from a close part way through
+      */
+     if (istat == ERR_EOM && avail)
+     {
+	  if (dbglvl & (DEBUG_RECV | DEBUG_ERRS))
+	       debug("http_read(%d): Connection on socket %d closed by the "
+		     "peer before a complete HTTP message was received",
+		     __LINE__, hconn->sd);
+	  istat = ERR_READ;
+     }
 
 done_bad:
-     edispose(&pinfo.req);
-     edispose(&pinfo.header);
-     edispose(&pinfo.content);
+     /*
+      *  We cannot find our way to the start of the next message
+      */
+     hconn->rbuf_pos = 0;
+     hconn->rbuf_len = 0;
+     memset(hinfo, 0, sizeof(http_msg_t));
      return(istat);
 }
 
+#undef FILL
+
 
 int
 http_close(http_conn_t *hconn)
@@ -1274,6 +1100,17 @@ http_close(http_conn_t *hconn)
      hconn->hlen    =  0;
      hconn->port    =  0;
 
+     /*
+      *  Any buffered data is meaningless once the connection is gone
+      */
+     if (hconn->rbuf)
+	  free(hconn->rbuf);
+     hconn->rbuf       = NULL;
+     hconn->rbuf_max   = 0;
+     hconn->rbuf_pos   = 0;
+     hconn->rbuf_len   = 0;
+     hconn->rbuf_saved = 0;
+
      if (sd != INVALID_SOCKET)
      {
 	  if (!os_sock_close(sd))
@@ -1502,17 +1339,103 @@ http_send_request(http_conn_t *hconn, const char *method, const char *uri)
 }
 
 
+int
+http_send_requests(http_conn_t *hconn, const char *method, const char **uris,
+		   size_t nuris)
+{
+     struct iovec iov[5 * HTTP_MAX_PIPELINE];
+     int iovcnt, istat;
+     size_t i, mlen;
+     static const char  str1[]   = "GET";
+     static size_t      str1_len =   3;
+     static const char  str2[]   = "/";
+     static size_t      str2_len =   1;
+     static const char  str3[]   = " HTTP/1.1\r\nHost: ";
+     static size_t      str3_len =  17;
+     static const char  str4[]   = " ";
+     static size_t      str4_len =   1;
+
+     /*
+      *  Sanity checks
+      */
+     if (!hconn || !uris || !nuris || nuris > HTTP_MAX_PIPELINE)
+     {
+	  debug("http_send_requests(%d): Invalid call arguments supplied; "
+		"hconn=%p, uris=%p, nuris=%u; nuris must be in the range "
+		"[1,%d]", __LINE__, hconn, uris, nuris, HTTP_MAX_PIPELINE);
+	  return(ERR_BADARGS);
+     }
+     else if (hconn->sd == INVALID_SOCKET)
+     {
+	  debug("http_send_requests(%d): HTTP connection is not currently "
+		"opened; first open or re-open the connection with "
+		"http_open()", __LINE__);
+	  return(ERR_NO);
+     }
+
+     if (!method || !*method)
+     {
+	  method = str1;
+	  mlen   = str1_len;
+     }
+     else
+	  mlen = strlen(method);
+
+     /*
+      *  Method SP Request-URI SP "HTTP/1.1" CRLF "Host:" SP host CRLF CRLF
+      *  for each request, one after the other
+      */
+     iovcnt = 0;
+     for (i = 0; i < nuris; i++)
+     {
+	  iov[iovcnt].iov_base = (char *)method;
+	  iov[iovcnt].iov_len  = mlen;
+	  iovcnt++;
+	  iov[iovcnt].iov_base = (char *)str4;
+	  iov[iovcnt].iov_len  = str4_len;
+	  iovcnt++;
+	  if (uris[i] && *uris[i])
+	  {
+	       iov[iovcnt].iov_base = (char *)uris[i];
+	       iov[iovcnt].iov_len  = strlen(uris[i]);
+	  }
+	  else
+	  {
+	       iov[iovcnt].iov_base = (char *)str2;
+	       iov[iovcnt].iov_len  = str2_len;
+	  }
+	  iovcnt++;
+	  iov[iovcnt].iov_base = (char *)str3;
+	  iov[iovcnt].iov_len  = str3_len;
+	  iovcnt++;
+	  iov[iovcnt].iov_base = (char *)hconn->host;
+	  iov[iovcnt].iov_len  = hconn->hlen;
+	  iovcnt++;
+     }
+
+     /*
+      *  Send the data
+      */
+     istat = os_writev(hconn->sd, iov, iovcnt);
+
+     /*
+      *  And return a result
+      */
+     return((istat > 0) ? ERR_OK : ERR_WRITE);
+}
+
+
 int
 http_read_request(http_conn_t *hconn, http_msg_t *hinfo)
 {
-     return(http_read(hconn, hinfo, HTTP_req));
+     return(http_read(hconn, hinfo, 1));
 }
 
 
 int
 http_read_response(http_conn_t *hconn, http_msg_t *hinfo)
 {
-     return(http_read(hconn, hinfo, HTTP_sta));
+     return(http_read(hconn, hinfo, 0));
 }
 
 
@@ -70,12 +70,22 @@ typedef struct {
      unsigned int   recv_tmo;  /* Read timeout in milliseconds               */
      char           host[128]; /* Destination host name                      */
      size_t         hlen;      /* Destination host name length               */
+     char          *rbuf;      /* Receive buffer; freed by http_close()      */
+     size_t         rbuf_max;  /* Size of rbuf, less room for a NUL          */
+     size_t         rbuf_pos;  /* Offset to unparsed data in rbuf            */
+     size_t         rbuf_len;  /* Bytes of received data in rbuf             */
+     char           rbuf_save; /* Byte at rbuf[rbuf_pos] replaced by a NUL   */
+     int            rbuf_saved;/* rbuf_save holds a byte to put back         */
 } http_conn_t;
 
 
 /*
  *  http_info_t
  *  Parsed information from an HTTP Request or Response as per HTTP/1.1
+ *
+ *  The pointers reference the receive buffer of the connection from
+ *  which the message was read and remain valid only until the next
+ *  message is read from, or the connection closed.
  */
 typedef struct {
 
@@ -102,6 +112,8 @@ typedef struct {
      char       *bdy;            /* HTTP message-body [NUL term]            */
      size_t      bdy_len;        /* Length of HTTP message-body (bytes)     */
 
+     int         keep_alive;     /* Connection may be used for another msg. */
+
 } http_msg_t;
 
 
@@ -194,9 +206,9 @@ int http_isopen(http_conn_t *hconn);
 
 
 /*
- *  Read and parse an HTTP Request from a remote HTTP client.
- *  Call http_dispose() to free up virtual memory associated with
- *  the http_msg_t structure "hmsg".
+ *  Read and parse an HTTP Request from a remote HTTP client.  The
+ *  request is parsed in place within the connection's receive buffer;
+ *  see http_msg_t above.
  */
 
 int http_read_request(http_conn_t *hconn, http_msg_t *hmsg);
@@ -227,19 +239,42 @@ int http_send_request(http_conn_t *hconn, const char *method,
   const char *uri);
 
 
+/*
+ *  Maximum number of requests which http_send_requests() will write
+ *  in a single call.
+ */
+#define HTTP_MAX_PIPELINE 16
+
+/*
+ *  Pipeline nuris HTTP requests over the connection hconn by writing
+ *  them all with a single os_writev() call.  Each request has the same
+ *  form as those sent with http_send_request(); method applies to all
+ *  of them.  The caller must then call http_read_response() once for
+ *  each request sent, reading the responses in the order in which the
+ *  requests appear in uris[].  At most HTTP_MAX_PIPELINE requests may
+ *  be sent per call.
+ */
+
+int http_send_requests(http_conn_t *hconn, const char *method,
+  const char **uris, size_t nuris);
+
+
 /*
  *  Read and parse an HTTP Response from an HTTP server.  Call this
- *  routine after sending a response with http_send_request().
- *  Call http_dispose() to free up virtual memory associated with
- *  the http_msg_t structure "hmsg".
+ *  routine after sending a response with http_send_request().  The
+ *  response is parsed in place within the connection's receive buffer;
+ *  see http_msg_t above.  Returns ERR_EOM when the server closed the
+ *  connection before sending any of the response and ERR_READ when it
+ *  did so part way through.
  */
 
 int http_read_response(http_conn_t *hconn, http_msg_t *hmsg);
 
 
 /*
- *  Dispose of virtual memory associated with an http_msg_t structure
- *  filled out by http_read_response() and http_read_request().
+ *  Clear an http_msg_t structure filled out by http_read_response() or
+ *  http_read_request().  The message data itself belongs to the
+ *  connection and is released by http_close().
  */
 
 void http_dispose(http_msg_t *hmsg);
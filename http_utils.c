@@ -347,118 +347,3 @@ pretty_print(const void *data, ssize_t len, char *workbuf, size_t *buflen,
      return((const char *)buf_start);
 }
 
-
-static int
-ensure(e_string *estr, size_t len, size_t incr)
-{
-     size_t newlen;
-     char *tmp;
-
-     if (!estr || (estr->len + len) < estr->maxlen)
-	  return(0);
-     newlen = incr * (int)((estr->len + len + 1 + incr - 1) / incr);
-     tmp = (char *)malloc(newlen);
-     if (!tmp)
-	  return(-1);
-     if (estr->data)
-     {
-	  if (estr->len)
-	       memmove(tmp, estr->data, estr->len);
-	  free(estr->data);
-     }
-     estr->data   = tmp;
-     estr->maxlen = newlen;
-     return(0);
-}
-
-
-static int
-echarcat(e_string *estr, char c)
-{
-     if (!estr->data)
-     {
-	  estr->maxlen = 0;
-	  estr->len    = 0;
-     }
-     if (estr->len >= estr->maxlen)
-     {
-	  char *tmp;
-	  size_t newlen;
-
-	  /*
-	   *  Grow in 2K increments
-	   */
-	  newlen = estr->maxlen + 2048;
-	  tmp = (char *)realloc(estr->data, newlen);
-	  if (!tmp)
-	  {
-	       debug("echarcat(%d): Insufficient virtual memory; call failed",
-		     __LINE__);
-	       return(ERR_NOMEM);
-	  }
-	  estr->data   = tmp;
-	  estr->maxlen = newlen;
-     }
-     if (estr->data)
-	  estr->data[estr->len++] = c;
-     return(ERR_OK);
-}
-
-
-static int
-estrncat(e_string *estr, const char *data, size_t len)
-{
-     if (!estr->data)
-     {
-	  estr->maxlen = 0;
-	  estr->len    = 0;
-     }
-
-     if ((estr->len + len) >= estr->maxlen)
-     {
-	  char *tmp;
-	  size_t newlen;
-
-	  /*
-	   *  Grow in multiples of 10K
-	   */
-	  newlen = (int)((estr->len + len + (10240 - 1)) / 10240) * 10240;
-	  tmp = (char *)realloc(estr->data, newlen);
-	  if (!tmp)
-	  {
-	       debug("estrncat(%d): Insufficient virtual memory; call failed",
-		     __LINE__);
-	       return(ERR_NOMEM);
-	  }
-	  estr->data   = tmp;
-	  estr->maxlen = newlen;
-     }
-     memmove(estr->data + estr->len, data, len);
-     estr->len += len;
-
-     return(ERR_OK);
-}
-
-
-static int
-estrncmp(const e_string *estr, const char *str, size_t len)
-{
-     int ires;
-
-     ires = -1;
-     if (!estr || !str || !len || estr->len < len ||
-	 (ires = memcmp(estr->data, str, len)))
-	  return(ires);
-     else
-	  return(0);
-}
-
-
-static void
-edispose(e_string *estr)
-{
-     if (estr->data != NULL)
-	  free(estr->data);
-     estr->len    = 0;
-     estr->maxlen = 0;
-}
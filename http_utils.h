@@ -39,23 +39,6 @@
 extern "C" {
 #endif
 
-/*
- *  Structure to store an extensible string
- */
-typedef struct {
-     size_t  len;
-     size_t  maxlen;
-     char   *data;
-} e_string;
-
-
-#define ECHARCAT(estr, c) (estr).data[(estr).len++] = c
-
-static int ensure(e_string *estr, size_t len, size_t incr);
-static int echarcat(e_string *estr, char c);
-static int estrncat(e_string *estr, const char *data, size_t len);
-static int estrncmp(const e_string *estr, const char *str, size_t len);
-static void edispose(e_string *estr);
 static const char *pretty_print(const void *data, ssize_t len, char *buf,
   size_t *buflen, size_t maxbuflen);
 
@@ -45,12 +45,24 @@
 #include "opt.h"
 #include "err.h"
 #include "os.h"
-#include "bm.h"
+#include "ac.h"
+
+/*
+ *  Strings from which to build an Aho-Corasick automaton
+ */
+#define AC_MAX_STRINGS 32
+
+typedef struct {
+     size_t      nstrings;
+     const char *name[AC_MAX_STRINGS];
+     const char *str[AC_MAX_STRINGS];
+} ac_strings_t;
 
 typedef struct {
-     FILE *fp;
-     int   make_header;
-     int   counter;
+     FILE         *fp;
+     int           make_header;
+     int           counter;
+     ac_strings_t *ac;
 } callback_t;
 
 
@@ -560,106 +572,6 @@ done:
 }
 
 
-static int
-build_skips(FILE *fp, const char *name, const char *str)
-{
-     bm_t binfo;
-     char c;
-     int j;
-
-     if (!fp || !name || !str)
-	  return(-1);
-
-     if (bm_skip_init(&binfo, str))
-     {
-	  fprintf(stderr, "Unable to build the Boyer-Moore skip table for "
-		  "the string \"%s\"\n",
-		  str ? str : "(null)");
-	  return(-1);
-     }
-
-     if (0 > fprintf(fp,
-		     "\n"
-		     "static const bm_t bm_info_%s = {\n"
-		     "  0, %d, {\"", name, binfo.sublen))
-	  return(-1);
-
-     while ((c = *str++))
-     {
-	  switch(c)
-	  {
-	  case '"' :
-	       if (EOF == fputc('\\', fp) ||
-		   EOF == fputc('"', fp))
-		    return(-1);
-	       break;
-
-	  case '\\' :
-	       if (EOF == fputc('\\', fp) ||
-		   EOF == fputc('\\', fp))
-		    return(-1);
-	       break;
-
-	  case '\f' :
-	       if (EOF == fputc('\\', fp) ||
-		   EOF == fputc('\\', fp) ||
-		   EOF == fputc('f', fp))
-		    return(-1);
-	       break;
-
-	  case '\n' :
-	       if (EOF == fputc('\\', fp) ||
-		   EOF == fputc('\\', fp) ||
-		   EOF == fputc('n', fp))
-		    return(-1);
-	       break;
-
-	  case '\r' :
-	       if (EOF == fputc('\\', fp) ||
-		   EOF == fputc('\\', fp) ||
-		   EOF == fputc('r', fp))
-		    return(-1);
-	       break;
-
-	  case '\t' :
-	       if (EOF == fputc('\\', fp) ||
-		   EOF == fputc('\\', fp) ||
-		   EOF == fputc('t', fp))
-		    return(-1);
-	       break;
-
-	  case '\v' :
-	       if (EOF == fputc('\\', fp) ||
-		   EOF == fputc('\\', fp) ||
-		   EOF == fputc('v', fp))
-		    return(-1);
-	       break;
-
-	  default :
-	       if (EOF == fputc(c, fp))
-		    return(-1);
-	       break;
-	  }
-     }
-     if (0 > fprintf(fp,
-		     "\"},\n"
-		     "  {"))
-	  return(-1);
-     for (j = 0; j < 256; j++)
-     {
-	  if (0 == (j % 16) && j != 0)
-	       if (0 > fprintf(fp, "\n   "))
-		    return(-1);
-	  if (0 > fprintf(fp, "%3d%s", binfo.skip[j], (j < 255) ? "," : ""))
-	       return(-1);
-     }
-     if (0 > fprintf(fp, "}\n};\n"))
-	 return(-1);
-
-     return(0);
-}
-
-
 static int
 walk_bm(void *our_ctx, void *optlib_ctx, const char *gname, 
 	size_t gnlen, const char *gval, size_t gvlen)
@@ -680,8 +592,21 @@ loop:
      else if (!name || !nlen || !str || !slen)
 	  goto loop;
 
-     if (build_skips(ctx->fp, name, str))
-	  return(ERR_NO);
+     /*
+      *  Remember the string for the Aho-Corasick automaton
+      */
+     if (ctx->ac)
+     {
+	  if (ctx->ac->nstrings >= AC_MAX_STRINGS)
+	  {
+	       fprintf(stderr, "Too many strings for the Aho-Corasick "
+		       "automaton; at most %d are allowed\n", AC_MAX_STRINGS);
+	       return(ERR_NO);
+	  }
+	  ctx->ac->name[ctx->ac->nstrings] = name;
+	  ctx->ac->str[ctx->ac->nstrings]  = str;
+	  ctx->ac->nstrings++;
+     }
 
      goto loop;
 
@@ -693,9 +618,173 @@ done:
 }
 
 
+/*
+ *  Build an Aho-Corasick automaton recognizing all of the strings in
+ *  ac and write it out as C source.  Each distinct string is assigned
+ *  a match number, AC_MATCH_<name>; strings which are identical share
+ *  the same number.  See ac.h for a description of the tables written.
+ */
+static int
+build_ac(FILE *fp, const ac_strings_t *ac)
+{
+     static int goto_tbl[AC_MAX_STATES][256], next[AC_MAX_STATES][256];
+     int c, fail[AC_MAX_STATES], match[AC_MAX_STATES], queue[AC_MAX_STATES];
+     int id[AC_MAX_STRINGS], head, i, j, nids, nstates, s, state, t, tail;
+     const unsigned char *ptr;
+     const char *name;
+     static const char *padding = "                                        ";
+
+     if (!fp || !ac || !ac->nstrings)
+	  return(-1);
+
+     /*
+      *  Assign match numbers, starting from 1
+      */
+     nids = 0;
+     for (i = 0; i < (int)ac->nstrings; i++)
+     {
+	  for (j = 0; j < i; j++)
+	       if (!strcmp(ac->str[i], ac->str[j]))
+		    break;
+	  id[i] = (j < i) ? id[j] : ++nids;
+     }
+
+     /*
+      *  Build the trie; -1 indicates no transition
+      */
+     memset(goto_tbl, 0xff, sizeof(goto_tbl));
+     memset(match, 0, sizeof(match));
+     nstates = 1;
+     for (i = 0; i < (int)ac->nstrings; i++)
+     {
+	  state = 0;
+	  for (ptr = (const unsigned char *)ac->str[i]; *ptr; ptr++)
+	  {
+	       if (goto_tbl[state][*ptr] < 0)
+	       {
+		    if (nstates >= AC_MAX_STATES)
+		    {
+			 fprintf(stderr, "The Aho-Corasick automaton requires "
+				 "more than %d states\n", AC_MAX_STATES);
+			 return(-1);
+		    }
+		    goto_tbl[state][*ptr] = nstates++;
+	       }
+	       state = goto_tbl[state][*ptr];
+	  }
+	  match[state] = id[i];
+     }
+
+     /*
+      *  Breadth first walk of the trie, computing the failure links
+      *  and folding them into the transition table as we go
+      */
+     head = tail = 0;
+     fail[0] = 0;
+     for (c = 0; c < 256; c++)
+     {
+	  t = goto_tbl[0][c];
+	  if (t > 0)
+	  {
+	       fail[t] = 0;
+	       queue[tail++] = t;
+	       next[0][c] = t;
+	  }
+	  else
+	       next[0][c] = 0;
+     }
+     while (head < tail)
+     {
+	  s = queue[head++];
+	  for (c = 0; c < 256; c++)
+	  {
+	       t = goto_tbl[s][c];
+	       if (t < 0)
+	       {
+		    next[s][c] = next[fail[s]][c];
+		    continue;
+	       }
+	       next[s][c] = t;
+	       fail[t]    = next[fail[s]][c];
+	       if (!match[t])
+		    match[t] = match[fail[t]];
+	       queue[tail++] = t;
+	  }
+     }
+
+     /*
+      *  Write out the match numbers
+      */
+     if (0 > fprintf(fp, "\n"))
+	  return(-1);
+     for (i = 0; i < (int)ac->nstrings; i++)
+     {
+	  name = ac->name[i];
+	  j = 14 - (int)strlen(name);
+	  if (j < 0)
+	       j = 0;
+	  if (0 > fprintf(fp, "#define AC_MATCH_"))
+	       return(-1);
+	  while (*name)
+	       if (EOF == fputc(toupper(*name++), fp))
+		    return(-1);
+	  if (0 > fprintf(fp, " %.*s%2d\n", j, padding, id[i]))
+	       return(-1);
+     }
+
+     /*
+      *  And the tables
+      */
+     if (0 > fprintf(fp,
+		     "\n"
+		     "static const unsigned char ac_next[%d][256] = {\n",
+		     nstates))
+	  return(-1);
+     for (s = 0; s < nstates; s++)
+     {
+	  if (0 > fprintf(fp, "  {"))
+	       return(-1);
+	  for (c = 0; c < 256; c++)
+	  {
+	       if (0 == (c % 16) && c != 0)
+		    if (0 > fprintf(fp, "\n   "))
+			 return(-1);
+	       if (0 > fprintf(fp, "%3d%s", next[s][c], (c < 255) ? "," : ""))
+		    return(-1);
+	  }
+	  if (0 > fprintf(fp, "}%s\n", (s < (nstates - 1)) ? "," : ""))
+	       return(-1);
+     }
+     if (0 > fprintf(fp,
+		     "};\n"
+		     "\n"
+		     "static const unsigned char ac_match[%d] = {\n"
+		     "  ", nstates))
+	  return(-1);
+     for (s = 0; s < nstates; s++)
+     {
+	  if (0 == (s % 16) && s != 0)
+	       if (0 > fprintf(fp, "\n  "))
+		    return(-1);
+	  if (0 > fprintf(fp, "%3d%s", match[s], (s < (nstates - 1)) ? "," : ""))
+	       return(-1);
+     }
+     if (0 > fprintf(fp,
+		     "\n"
+		     "};\n"
+		     "\n"
+		     "static const ac_t ac_info = { %d, ac_next, ac_match };\n",
+		     nstates))
+	 return(-1);
+
+     return(0);
+}
+
+
 int
 main(int argc, const char *argv[])
 {
+     ac_strings_t ac;
      callback_t ctx;
      int boyer_moore, dispose_opts, i, ires;
      const char *infile, *outfile;
@@ -704,6 +793,7 @@ main(int argc, const char *argv[])
 
      boyer_moore  = 0;
      ctx.fp       = NULL;
+     ctx.ac       = NULL;
      dispose_opts = 0;
      infile       = NULL;
      outfile      = NULL;
@@ -805,7 +895,7 @@ main(int argc, const char *argv[])
 			 "\n"
 			 "#define __BM_CONST_H__\n"
 			 "\n"
-			 "#include \"bm.h\"\n", __FILE__, infile);
+			 "#include \"ac.h\"\n", __FILE__, infile);
 	  else
 	       ires = fprintf(ctx.fp,
 			 "/*\n"
@@ -851,13 +941,24 @@ main(int argc, const char *argv[])
 
      if (boyer_moore)
      {
+	  ac.nstrings = 0;
+	  ctx.ac      = &ac;
 	  ires = opt_group_walk(&opts, "boyer-moore",
 				OPT_MATCH_EXACT | OPT_MATCH_NOGLOBAL,
 				walk_bm, (void *)&ctx);
-	  if (ires == ERR_OK)
-	       goto finish;
-	  else
+	  if (ires != ERR_OK)
 	       goto error;
+
+	  /*
+	   *  Now the Aho-Corasick automaton for all of the strings.
+	   *  This must be done before the options are disposed of.
+	   */
+	  if (build_ac(ctx.fp, &ac))
+	  {
+	       ires = ERR_NO;
+	       goto error;
+	  }
+	  goto finish;
      }
 
 
@@ -40,6 +40,9 @@
 #undef SYSLOG_NAMES
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <unistd.h>
 #include <limits.h>
 #include <strings.h>
@@ -113,6 +116,82 @@ os_fexists(const char *fname)
 }
 
 
+int
+os_mmap(const char *fname, const char **addr, size_t *len)
+{
+     int fd, save;
+     void *ptr;
+     struct stat sbuf;
+
+     if (!fname || !addr || !len)
+     {
+	  errno = EINVAL;
+	  return(-1);
+     }
+     *addr = NULL;
+     *len  = 0;
+
+     if (0 > (fd = open(fname, O_RDONLY)))
+	  return(-1);
+     if (fstat(fd, &sbuf))
+	  goto error;
+     if (sbuf.st_size > 0)
+     {
+	  ptr = mmap(NULL, (size_t)sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	  if (ptr == MAP_FAILED)
+	       goto error;
+#if defined(__linux__) || defined(__APPLE__)
+	  /*
+	   *  The callers read the file from start to end just the once
+	   */
+	  madvise(ptr, (size_t)sbuf.st_size, MADV_SEQUENTIAL);
+#endif
+	  *addr = (const char *)ptr;
+	  *len  = (size_t)sbuf.st_size;
+     }
+     close(fd);
+     return(0);
+
+error:
+     save = errno;
+     close(fd);
+     errno = save;
+     return(-1);
+}
+
+
+int
+os_dir_scan(const char *dir, int (*proc)(void *ctx, const char *name),
+	    void *ctx)
+{
+     DIR *dp;
+     struct dirent *ent;
+
+     if (!dir || !proc)
+     {
+	  errno = EINVAL;
+	  return(-1);
+     }
+
+     if (!(dp = opendir(dir)))
+	  return(-1);
+     while ((ent = readdir(dp)))
+	  if (proc(ctx, ent->d_name))
+	       break;
+     closedir(dp);
+
+     return(0);
+}
+
+
+void
+os_munmap(const char *addr, size_t len)
+{
+     if (addr && len)
+	  munmap((void *)addr, len);
+}
+
+
 const char *
 os_tzone(long *gmt_offset, const char **tzone, char *buf, size_t buflen)
 {
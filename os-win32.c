@@ -41,6 +41,8 @@
 #include <io.h>
 #include <string.h>
 #include <process.h>
+#include <fcntl.h>
+#include <errno.h>
 
 int
 os_sleep(unsigned int milliseconds)
@@ -73,6 +75,102 @@ os_fexists(const char *fname)
 }
 
 
+/*
+ *  No mapping here; the file is simply read into memory
+ */
+int
+os_mmap(const char *fname, const char **addr, size_t *len)
+{
+     int fd, nread;
+     char *buf;
+     struct _stat sbuf;
+
+     if (!fname || !addr || !len)
+     {
+	  errno = EINVAL;
+	  return(-1);
+     }
+     *addr = NULL;
+     *len  = 0;
+
+     if (0 > (fd = _open(fname, _O_RDONLY | _O_BINARY)))
+	  return(-1);
+     if (_fstat(fd, &sbuf))
+     {
+	  _close(fd);
+	  return(-1);
+     }
+     if (sbuf.st_size > 0)
+     {
+	  buf = (char *)malloc((size_t)sbuf.st_size);
+	  if (!buf)
+	  {
+	       _close(fd);
+	       errno = ENOMEM;
+	       return(-1);
+	  }
+	  nread = _read(fd, buf, (unsigned int)sbuf.st_size);
+	  if (nread < 0)
+	  {
+	       free(buf);
+	       _close(fd);
+	       return(-1);
+	  }
+	  *addr = buf;
+	  *len  = (size_t)nread;
+     }
+     _close(fd);
+     return(0);
+}
+
+
+void
+os_munmap(const char *addr, size_t len)
+{
+     if (addr)
+	  free((char *)addr);
+}
+
+
+int
+os_dir_scan(const char *dir, int (*proc)(void *ctx, const char *name),
+	    void *ctx)
+{
+     intptr_t h;
+     struct _finddata_t ent;
+     char *pat;
+     size_t len;
+
+     if (!dir || !proc)
+     {
+	  errno = EINVAL;
+	  return(-1);
+     }
+
+     len = strlen(dir);
+     if (!(pat = (char *)malloc(len + 3)))
+     {
+	  errno = ENOMEM;
+	  return(-1);
+     }
+     memcpy(pat, dir, len);
+     memcpy(pat + len, "\\*", 3);
+
+     h = _findfirst(pat, &ent);
+     free(pat);
+     if (h == -1)
+	  return((errno == ENOENT) ? 0 : -1);
+     do
+     {
+	  if (proc(ctx, ent.name))
+	       break;
+     } while (!_findnext(h, &ent));
+     _findclose(h);
+
+     return(0);
+}
+
+
 const char *
 os_tzone(long *gmt_offset, const char **tzone, char buf, size_t buflen)
 {
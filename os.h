@@ -82,6 +82,10 @@ extern "C" {
 #define O_TEXT 0
 #endif
 
+#if !defined(O_BINARY)
+#define O_BINARY 0
+#endif
+
 #if defined(__APPLE__)
 #define NOT_STREAMS_COMPATIBLE 1
 #endif
@@ -251,6 +255,43 @@ void os_pthread_thread_init(void);
 
 #endif
 
+/*
+ *  Memory ordering for data shared with lock-free readers (see
+ *  dev_snapshot()).  os_load_acquire() reads the unsigned int *p such
+ *  that no later load or store is performed ahead of it;
+ *  os_store_release() writes it only after all earlier loads and stores
+ *  have completed.  os_fence_acquire() keeps the loads before it from
+ *  being moved past the loads and stores following it;
+ *  os_fence_release() keeps the loads and stores before it from being
+ *  moved past the stores following it.  All four are compiler barriers
+ *  as well.
+ */
+#if defined(_WIN32)
+
+/* MSVC gives volatile accesses acquire and release semantics */
+#define os_load_acquire(p)    (*(volatile unsigned int *)(p))
+#define os_store_release(p,v) (*(volatile unsigned int *)(p) = (v))
+#define os_fence_acquire()    MemoryBarrier()
+#define os_fence_release()    MemoryBarrier()
+
+#elif defined(__ATOMIC_ACQUIRE)
+
+#define os_load_acquire(p)    __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define os_store_release(p,v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define os_fence_acquire()    __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define os_fence_release()    __atomic_thread_fence(__ATOMIC_RELEASE)
+
+#else
+
+#define os_load_acquire(p) \
+     (__sync_synchronize(), *(volatile unsigned int *)(p))
+#define os_store_release(p,v) \
+     (__sync_synchronize(), *(volatile unsigned int *)(p) = (v))
+#define os_fence_acquire()    __sync_synchronize()
+#define os_fence_release()    __sync_synchronize()
+
+#endif
+
 /*
  *  O/S dependent routines to handle shutdown signalling
  *  Uses pthread condition signalling on platforms with
@@ -325,6 +366,23 @@ os_pid_t os_spawn_nowait(const char *cmd, os_argv_t *argv, const char *new_env,
 
 int os_fexists(const char *fname);
 
+/*
+ *  Map the file fname read-only into memory, returning the address of its
+ *  contents in *addr and their length in *len.  A zero length file yields
+ *  a NULL address.  Returns 0 on success and -1 with errno set otherwise.
+ *  Release the contents with os_munmap().
+ */
+int os_mmap(const char *fname, const char **addr, size_t *len);
+void os_munmap(const char *addr, size_t len);
+
+/*
+ *  Call proc() with the name of each entry in the directory dir, stopping
+ *  early should proc() return non-zero.  Returns 0 on success and -1 with
+ *  errno set when the directory cannot be read.
+ */
+int os_dir_scan(const char *dir, int (*proc)(void *ctx, const char *name),
+  void *ctx);
+
 #if defined(__cplusplus)
 }
 #endif
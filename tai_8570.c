@@ -398,7 +398,8 @@ tai_8570_readp(ha7net_t *ctx, tai_8570_t *devx, unsigned char *hi_b,
 	       unsigned char *lo_b, const char *cmd, unsigned int sleep)
 {
      unsigned char data[44], *ptr1, *ptr2, umask, uval1, uval2;
-     int i, istat;
+     int attempts, i, istat;
+     ha7net_batch_t batch;
      /*
       *  To read a single bit, we send a sequence of 16 (!) bits:
       *
@@ -480,23 +481,32 @@ tai_8570_readp(ha7net_t *ctx, tai_8570_t *devx, unsigned char *hi_b,
       *          HA7Net WriteBlock request.  Thus there's no room for the
       *          three additional bytes to put the DS2406 reader into
       *          the correct mode. Soooo, we need to do two WriteBlocks().
+      *
+      *          Neither WriteBlock depends upon the results of the other
+      *          so we pipeline the two requests and pay for a single
+      *          HTTP round trip.  Should a CRC check fail, we send both
+      *          requests again.
       */
-     istat = ha7net_writeblock_ex(ctx, devx->rdev, data, 24, read_seq1, 
-				  &crc1, 0);
-     if (istat != ERR_OK)
-     {
-	  dev_debug("tai_8570_readp(%d): Unable to put the DS2406 reader into "
-		    "read mode; ha7net_writeblock() returned %d; %s",
-		    __LINE__, istat, err_strerror(istat));
-	  return(istat);
-     }
-
-     istat = ha7net_writeblock_ex(ctx, NULL, data + 24, 20, read_seq2,
-				  &crc2, HA7NET_FLAGS_NORESEND);
+     attempts = 0;
+resend:
+     ha7net_batch_init(&batch);
+     istat = ha7net_batch_writeblock(ctx, &batch, devx->rdev, read_seq1, 0);
+     if (istat == ERR_OK)
+	  istat = ha7net_batch_writeblock(ctx, &batch, NULL, read_seq2, 0);
+     if (istat == ERR_OK)
+	  istat = ha7net_batch_send(ctx, &batch, 0);
+     if (istat == ERR_OK)
+	  istat = ha7net_batch_result(&batch, 0, data, 24, &crc1);
+     if (istat == ERR_OK)
+	  istat = ha7net_batch_result(&batch, 1, data + 24, 20, &crc2);
+     ha7net_batch_free(&batch);
+     if (istat == ERR_CRC && ++attempts < 2)
+	  goto resend;
      if (istat != ERR_OK)
      {
 	  dev_debug("tai_8570_readp(%d): Unable to read data from the DS2406 "
-		    "reader; ha7net_writeblock_ex() returned %d; %s",
+		    "reader; ha7net_batch_send() or ha7net_batch_result() "
+		    "returned %d; %s",
 		    __LINE__, istat, err_strerror(istat));
 	  return(istat);
      }
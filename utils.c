@@ -31,14 +31,199 @@
  *  OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  *  SUCH DAMAGE.
  */
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
 #include <sys/types.h>
 #include <errno.h>
+#include "math.h"
 #include "utils.h"
 
+/*
+ *  Hex2Byte() is done 16 or 32 hex digits at a time when the CPU has
+ *  SSE2 or AVX2.  Which to use is decided at run time by hex2byte_init().
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HEX2BYTE_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void hex2byte_proc_t(unsigned char *dst, const unsigned char *src,
+  size_t nbytes);
+
+static const unsigned char hex2byte[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 0, 0, 0, 0, 0, 0,10,11,12,13,14,15, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0,10,11,12,13,14,15, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+/*
+ *  Convert 2 * nbytes hex digits to nbytes bytes, one byte at a time
+ */
+static void
+hex2byte_scalar(unsigned char *dst, const unsigned char *src, size_t nbytes)
+{
+     while (nbytes--)
+     {
+	  *dst++ = (unsigned char)(hex2byte[src[0]] * 16 + hex2byte[src[1]]);
+	  src += 2;
+     }
+}
+
+#if defined(HEX2BYTE_X86)
+
+/*
+ *  Like the hex2byte[] table, map each byte of c to the value of the hex
+ *  digit it represents or to 0 when it isn't a hex digit.  The compares
+ *  are signed, so bytes >= 0x80 fall outside both ranges.
+ */
+#define HEX2BYTE_NIBBLES(c, nib, w, cmpgt_, and_, or_, sub_, set1_)	\
+     {									\
+	  __m##w##i l_ = or_(c, set1_(0x20));				\
+	  __m##w##i d_ = and_(and_(cmpgt_(c, set1_('0' - 1)),		\
+				   cmpgt_(set1_('9' + 1), c)),		\
+			      sub_(c, set1_('0')));			\
+	  nib = or_(d_, and_(and_(cmpgt_(l_, set1_('a' - 1)),		\
+				  cmpgt_(set1_('f' + 1), l_)),		\
+			     sub_(l_, set1_('a' - 10))));		\
+     }
+
+/*
+ *  16 bytes at a time with SSE2
+ */
+__attribute__((target("sse2")))
+static void
+hex2byte_sse2(unsigned char *dst, const unsigned char *src, size_t nbytes)
+{
+     __m128i c0, c1, n0, n1, lo;
+
+     lo = _mm_set1_epi16(0x00ff);
+     for (; nbytes >= 16; nbytes -= 16, src += 32, dst += 16)
+     {
+	  c0 = _mm_loadu_si128((const __m128i *)src);
+	  c1 = _mm_loadu_si128((const __m128i *)(src + 16));
+	  HEX2BYTE_NIBBLES(c0, n0, 128, _mm_cmpgt_epi8, _mm_and_si128,
+			   _mm_or_si128, _mm_sub_epi8, _mm_set1_epi8);
+	  HEX2BYTE_NIBBLES(c1, n1, 128, _mm_cmpgt_epi8, _mm_and_si128,
+			   _mm_or_si128, _mm_sub_epi8, _mm_set1_epi8);
+
+	  /*
+	   *  Each 16 bit lane now holds the high nibble in its low byte
+	   *  and the low nibble in its high byte
+	   */
+	  n0 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n0, lo), 4),
+			    _mm_srli_epi16(n0, 8));
+	  n1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n1, lo), 4),
+			    _mm_srli_epi16(n1, 8));
+	  _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(n0, n1));
+     }
+     hex2byte_scalar(dst, src, nbytes);
+}
+
+/*
+ *  32 bytes at a time with AVX2
+ */
+__attribute__((target("avx2")))
+static void
+hex2byte_avx2(unsigned char *dst, const unsigned char *src, size_t nbytes)
+{
+     __m256i c0, c1, n0, n1, lo;
+
+     lo = _mm256_set1_epi16(0x00ff);
+     for (; nbytes >= 32; nbytes -= 32, src += 64, dst += 32)
+     {
+	  c0 = _mm256_loadu_si256((const __m256i *)src);
+	  c1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+	  HEX2BYTE_NIBBLES(c0, n0, 256, _mm256_cmpgt_epi8, _mm256_and_si256,
+			   _mm256_or_si256, _mm256_sub_epi8, _mm256_set1_epi8);
+	  HEX2BYTE_NIBBLES(c1, n1, 256, _mm256_cmpgt_epi8, _mm256_and_si256,
+			   _mm256_or_si256, _mm256_sub_epi8, _mm256_set1_epi8);
+	  n0 = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(n0, lo), 4),
+			       _mm256_srli_epi16(n0, 8));
+	  n1 = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(n1, lo), 4),
+			       _mm256_srli_epi16(n1, 8));
+
+	  /*
+	   *  The pack works within each 128 bit half; put the four
+	   *  8 byte results back in order
+	   */
+	  _mm256_storeu_si256((__m256i *)dst,
+			      _mm256_permute4x64_epi64(
+				   _mm256_packus_epi16(n0, n1), 0xd8));
+     }
+     hex2byte_sse2(dst, src, nbytes);
+}
+
+#endif /* defined(HEX2BYTE_X86) */
+
+static const struct {
+     const char      *name;
+     hex2byte_proc_t *proc;
+} hex2byte_impls[] = {
+     { "scalar", hex2byte_scalar },
+#if defined(HEX2BYTE_X86)
+     { "sse2",   hex2byte_sse2 },
+     { "avx2",   hex2byte_avx2 },
+#else
+     { "sse2",   NULL },
+     { "avx2",   NULL },
+#endif
+};
+
+static hex2byte_proc_t *hex2byte_proc = NULL;
+
+static int
+hex2byte_supported(int impl)
+{
+     if (impl < HEX2BYTE_SCALAR || impl > HEX2BYTE_AVX2 ||
+	 !hex2byte_impls[impl].proc)
+	  return(0);
+#if defined(HEX2BYTE_X86)
+     __builtin_cpu_init();
+     if (impl == HEX2BYTE_SSE2)
+	  return(__builtin_cpu_supports("sse2") ? 1 : 0);
+     else if (impl == HEX2BYTE_AVX2)
+	  return(__builtin_cpu_supports("avx2") ? 1 : 0);
+#endif
+     return(1);
+}
+
+
+int
+Hex2ByteSelect(int impl)
+{
+     if (impl == HEX2BYTE_AUTO)
+     {
+	  impl = HEX2BYTE_AVX2;
+	  while (impl > HEX2BYTE_SCALAR && !hex2byte_supported(impl))
+	       impl--;
+     }
+     else if (!hex2byte_supported(impl))
+	  return(-1);
+
+     hex2byte_proc = hex2byte_impls[impl].proc;
+     return(impl);
+}
+
+
+const char *
+Hex2ByteName(int impl)
+{
+     return((impl >= HEX2BYTE_SCALAR && impl <= HEX2BYTE_AVX2) ?
+	    hex2byte_impls[impl].name : "unknown");
+}
+
+
 /*
  *  void Hex2Byte(unsigned char *dst, const char *src, size_t srclen)
  *
@@ -48,43 +233,29 @@
 void
 Hex2Byte(unsigned char *dst, const char *src, size_t srclen)
 {
-     size_t i;
-     const unsigned char hex2byte[256] = {
-       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-       0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 0, 0, 0, 0, 0, 0,10,11,12,13,14,15, 0,
-       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-       0,10,11,12,13,14,15, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+     const unsigned char *usrc = (const unsigned char *)src;
 
      if (!dst || !src || !srclen)
 	  return;
 
+     /*
+      *  The first call picks the implementation to use.  Racing
+      *  threads will all pick the same one.
+      */
+     if (!hex2byte_proc)
+	  Hex2ByteSelect(HEX2BYTE_AUTO);
+
      /*
       *  Handle the first byte as a special case so that we can deal
       *  with an odd srclen.  When srclen is odd, we assume a leading '0'
       */
      if ((srclen % 2))
      {
-	  *dst++ = (unsigned char)hex2byte[src[0]];
-	  src++;
-	  i = 1;
+	  *dst++ = hex2byte[usrc[0]];
+	  usrc++;
      }
-     else
-	  i = 0;
 
-     srclen >>= 1;
-     for (; i < srclen; i++)
-     {
-	  *dst++ = (unsigned char)(hex2byte[src[0]] * 16 +
-				   hex2byte[src[1]]);
-	  src += 2;
-     }
+     (*hex2byte_proc)(dst, usrc, srclen >> 1);
 }
 
 /*
@@ -370,3 +541,136 @@ make_timestr(timestr buf, time_t t, int do_ampm)
      }
 }
 
+
+
+/*
+ *  void fmt_float_compile(fmt_float_t *ff, const char *fmt)
+ *
+ *  Parse a printf() format for a float, noting whether fmt_float() can
+ *  convert it without resorting to snprintf().  A NULL fmt means "%f".
+ */
+
+void
+fmt_float_compile(fmt_float_t *ff, const char *fmt)
+{
+     const char *ptr;
+     int i;
+
+     memset(ff, 0, sizeof(fmt_float_t));
+     ff->fmt = fmt ? fmt : "%f";
+
+     /*
+      *  %[-0][width][.prec]f and nothing else
+      */
+     ptr = ff->fmt;
+     if (*ptr++ != '%')
+	  return;
+     for (;; ptr++)
+     {
+	  if (*ptr == '-')
+	       ff->left = 1;
+	  else if (*ptr == '0')
+	       ff->zero = 1;
+	  else
+	       break;
+     }
+     while (isdigit(*ptr))
+     {
+	  ff->width = ff->width * 10 + (*ptr++ - '0');
+	  if (ff->width > FMT_FLOAT_MAXWIDTH)
+	       return;
+     }
+     ff->prec = 6;
+     if (*ptr == '.')
+     {
+	  ptr++;
+	  ff->prec = 0;
+	  while (isdigit(*ptr))
+	  {
+	       ff->prec = ff->prec * 10 + (*ptr++ - '0');
+	       if (ff->prec > FMT_FLOAT_MAXPREC)
+		    return;
+	  }
+     }
+     if (ptr[0] != 'f' || ptr[1] != '\0')
+	  return;
+
+     ff->scale = 1.0;
+     for (i = 0; i < ff->prec; i++)
+	  ff->scale *= 10.0;
+     ff->fast = 1;
+}
+
+
+/*
+ *  int fmt_float(char *buf, size_t buflen, const fmt_float_t *ff, float val)
+ *
+ *  Convert val as per the compiled format ff; see utils.h.
+ */
+
+int
+fmt_float(char *buf, size_t buflen, const fmt_float_t *ff, float val)
+{
+     char digits[FMT_FLOAT_LEN], *ptr;
+     double x, frac;
+     int i, len, ndigits, neg, pad;
+     unsigned long long u;
+
+     /*
+      *  The product of val and 10^prec needs at most 24 + 14 significant
+      *  bits and so is exact in a double.  Rounding it half to even then
+      *  gives precisely the digits which printf() would.  Values too large
+      *  for 64 bits once scaled, infinities, and NaNs go to snprintf().
+      */
+     if (!ff->fast || !(val > -1.0e12f && val < 1.0e12f))
+	  return(snprintf(buf, buflen, ff->fmt, val));
+
+     neg = signbit(val) ? 1 : 0;
+     x = (double)val * ff->scale;
+     if (neg)
+	  x = -x;
+     u = (unsigned long long)x;
+     frac = x - (double)u;
+     if (frac > 0.5 || (frac == 0.5 && (u & 1)))
+	  u++;
+
+     /*
+      *  Digits, least significant first, with at least one before the
+      *  decimal point
+      */
+     ndigits = 0;
+     do
+     {
+	  digits[ndigits++] = '0' + (char)(u % 10);
+	  u /= 10;
+     } while (u || ndigits <= ff->prec);
+
+     len = neg + (ndigits - ff->prec) + (ff->prec ? 1 + ff->prec : 0);
+     pad = (ff->width > len) ? ff->width - len : 0;
+     if ((size_t)(len + pad) >= buflen)
+	  return(snprintf(buf, buflen, ff->fmt, val));
+
+     ptr = buf;
+     if (!ff->left && !ff->zero)
+	  for (i = 0; i < pad; i++)
+	       *ptr++ = ' ';
+     if (neg)
+	  *ptr++ = '-';
+     if (!ff->left && ff->zero)
+	  for (i = 0; i < pad; i++)
+	       *ptr++ = '0';
+     while (ndigits > ff->prec)
+	  *ptr++ = digits[--ndigits];
+     if (ff->prec)
+     {
+	  *ptr++ = '.';
+	  while (ndigits)
+	       *ptr++ = digits[--ndigits];
+     }
+     if (ff->left)
+	  for (i = 0; i < pad; i++)
+	       *ptr++ = ' ';
+     *ptr = '\0';
+
+     return(len + pad);
+}
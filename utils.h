@@ -45,10 +45,25 @@ typedef char timestr[9];  /* HH:MM AM */
 #define EMPTY_TIMESTR {0, 0, 0, 0, 0, 0, 0, 0, 0}
 
 /*
- *  Convert hex-encoded bytes to raw binary bits
+ *  Convert hex-encoded bytes to raw binary bits.  Characters which
+ *  are not hex digits are treated as '0'.  dst may equal src.
  */
 void Hex2Byte(unsigned char *dst, const char *src, size_t len);
 
+/*
+ *  Hex2Byte() implementations.  By default, Hex2Byte() uses the fastest
+ *  one which the CPU supports.  Hex2ByteSelect() may be used to choose
+ *  another (e.g., for benchmarking); it returns the implementation
+ *  selected or -1 when the requested one is not supported.
+ */
+#define HEX2BYTE_AUTO   -1
+#define HEX2BYTE_SCALAR  0
+#define HEX2BYTE_SSE2    1
+#define HEX2BYTE_AVX2    2
+
+int Hex2ByteSelect(int impl);
+const char *Hex2ByteName(int impl);
+
 /*
  *  Convert an input string into a quoted string safe for inclusion
  *  in an XML document.
@@ -61,6 +76,36 @@ const char *xml_strquote(char const **dst, size_t *dlen, int *dispose,
  */
 void make_timestr(timestr buf, time_t t, int do_ampm);
 
+/*
+ *  A printf() format for a single float, compiled by fmt_float_compile().
+ *  Formats of the form %[-0][width][.prec]f with prec <= FMT_FLOAT_MAXPREC
+ *  are converted by fmt_float() with scaled integer arithmetic; any other
+ *  format is handed to snprintf().  Either way, the output is identical
+ *  to that of snprintf() with the original format.
+ */
+#define FMT_FLOAT_MAXPREC   6
+#define FMT_FLOAT_MAXWIDTH 32
+#define FMT_FLOAT_LEN      64  /* Ample buffer size for fmt_float()       */
+
+typedef struct {
+     const char *fmt;    /* The printf() format                          */
+     int         fast;   /* Non-zero when fmt is converted by fmt_float() */
+     int         left;   /* '-' flag: pad on the right                   */
+     int         zero;   /* '0' flag: pad with leading zeroes            */
+     int         width;  /* Minimum field width                          */
+     int         prec;   /* Digits after the decimal point               */
+     double      scale;  /* 10^prec                                      */
+} fmt_float_t;
+
+void fmt_float_compile(fmt_float_t *ff, const char *fmt);
+
+/*
+ *  Format val into buf as per ff.  Like snprintf(), the output is NUL
+ *  terminated and truncated to fit in buflen bytes; the length of the
+ *  untruncated output is returned or -1 on an error.
+ */
+int fmt_float(char *buf, size_t buflen, const fmt_float_t *ff, float val);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -50,6 +50,8 @@
 #include "debug.h"
 #include "os.h"
 #include "math.h"
+#include "bdat.h"
+#include "archive.h"
 #include "ha7net.h"
 #include "weather.h"
 #include "daily.h"
@@ -65,21 +67,122 @@ typedef struct {
      size_t    fld;
 } column_t;
 
+/*
+ *  Recording each sampling cycle -- appending to the data file, writing
+ *  the XML file, and running the command to transform it -- is left to a
+ *  writer thread so that a slow disk or a slow transform does not stretch
+ *  the sampling period.  Once a cycle's reads and pressure corrections
+ *  are done, weather_list_record() snapshots each device and queues the
+ *  snapshots along with the cycle's time stamp.  The writer thread then
+ *  records them from the snapshots alone.
+ *
+ *  The queue is a ring of WEATHER_QLEN cycles with a single producer, the
+ *  sampling thread, and a single consumer, the writer thread.  Only the
+ *  producer advances head and only the consumer advances tail, each with
+ *  a release store once it is through with the slot.  Both are free
+ *  running: the queue is empty when head == tail and full when head -
+ *  tail == WEATHER_QLEN.  The mutex and condition variable let an idle
+ *  writer sleep.  The mutex also guards claimed, the cycle after the one
+ *  which the writer is recording: when the writer falls so far behind
+ *  that the queue is full, the oldest cycle it has yet to claim is
+ *  dropped under the mutex to make room rather than stall the sampling.
+ */
+
+#define WEATHER_QLEN 16
+
+/*
+ *  The day's data file is held open by the writer from one cycle to the
+ *  next and only closed once a record for the following day arrives.
+ *  Each record is formatted into buf and then appended with a single
+ *  write() so that a reader never sees a partial line save for a short
+ *  write.  When to fsync is up to the fsync option: after every record,
+ *  at most once every so many seconds, or only when the file is closed.
+ */
+typedef struct {
+     int                 fd;        /* Open data file; -1 when none         */
+     char               *fname;     /* Name of the open data file           */
+     int                 sync;      /* WEATHER_FSYNC_x or seconds           */
+     int                 dirty;     /* Records written since the last fsync */
+     time_t              synced;    /* When last fsync'd                    */
+     char               *buf;       /* Record being formatted               */
+     size_t              buf_len;   /* Bytes of buf in use                  */
+     size_t              buf_max;   /* Size of buf                          */
+} weather_dfile_t;
+
+typedef struct {
+     time_t              tavg;      /* Time stamp of the cycle's record     */
+     dev_snapshot_t     *snap;      /* snap[n] is a snapshot of devices[n]  */
+} weather_cycle_t;
+
+/*
+ *  Images of the device state and rollup tiers files.  The sampling thread
+ *  fills one in between cycles, taking each device's mutex just long
+ *  enough to copy its statistics, and hands it to the writer thread to
+ *  put on disk.  An image still waiting when the next is handed over is
+ *  simply superseded.
+ */
+typedef struct {
+     weather_dfile_t     state;     /* Image of <fpath>.state; may be empty */
+     weather_dfile_t     tiers;     /* Image of <fpath>.tiers; may be empty */
+} weather_save_t;
+
+typedef struct {
+     unsigned int        head;      /* Next cycle to fill; producer's       */
+     unsigned int        tail;      /* Next cycle to record; consumer's     */
+     unsigned int        claimed;   /* Cycles the writer has taken up       */
+     int                 done;      /* No more cycles will be queued        */
+     int                 running;   /* Writer thread has been started       */
+     unsigned int        dropped;   /* Cycles dropped as the queue was full */
+     time_t              tlast;     /* Time stamp of the last cycle queued  */
+     int                 period;    /* Sampling period in seconds           */
+     size_t              ndevices;  /* Number of devices in devices[]       */
+     device_t           *devices;   /* The devices being sampled            */
+     weather_info_t     *winfo;     /* Output file names and command        */
+     weather_dfile_t     dfile;     /* The day's data file                  */
+     weather_dfile_t     bfile;     /* The day's binary data file, if any   */
+     int                 bfirst;    /* Start a new segment in bfile         */
+     weather_save_t     *sfill;     /* Image being filled; producer's       */
+     weather_save_t     *snext;     /* Image handed over; mutex protected   */
+     weather_save_t     *swrite;    /* Image being written; consumer's      */
+     int                 spending;  /* snext awaits writing                 */
+     weather_save_t      save[3];   /* What sfill, snext, and swrite use    */
+     pthread_t           thread;    /* The writer thread                    */
+     os_pthread_mutex_t  mutex;     /* Protects done and snext; with cond   */
+     os_pthread_cond_t   cond;      /* Signalled when head, snext, or done  */
+     weather_cycle_t     cycle[WEATHER_QLEN];
+} weather_queue_t;
+
 static void debug(const char *fmt, ...);
 static void detail(const char *fmt, ...);
 static void info(const char *fmt, ...);
 static void trace(const char *fmt, ...);
 static int weather_data_fname(char **fname, time_t t, size_t days_ago,
+  const char *fpath, const char *suffix);
+static int weather_data_read(device_t *devices, const dev_index_t *index,
+  size_t days_ago, const char *fpath, time_t after);
+static int weather_data_write(weather_dfile_t *df, device_t *devices,
+  const dev_snapshot_t *snaps, time_t tavg, int *first, const char *fpath);
+static int weather_data_close(weather_dfile_t *df);
+static int weather_bdat_read(device_t *devices, const dev_index_t *index,
+  size_t days_ago, const char *fpath, time_t after);
+static int weather_bdat_write(weather_dfile_t *df, device_t *devices,
+  const dev_snapshot_t *snaps, time_t tavg, int *first, const char *fpath);
+static int weather_xml_write(device_t *devices, const dev_snapshot_t *snaps,
+  int period, weather_info_t *winfo);
+static int weather_tiers_fname(char **fname, const char *fpath,
+  const char *suffix);
+static int weather_tiers_read(device_t *devices, const dev_index_t *index,
   const char *fpath);
-static int weather_data_read(device_t *devices, size_t days_ago,
-  const char *fpath);
-static int weather_data_write(device_t *devices, time_t tavg, int *first,
-  const char *fpath);
-static int weather_xml_write(device_t *devices, int period,
-  weather_info_t *winfo);
+static int weather_tiers_image(device_t *devices, weather_dfile_t *df,
+  time_t saved);
+static time_t weather_tiers_after(device_t *devices, time_t after);
+static int weather_state_read(device_t *devices, const dev_index_t *index,
+  const char *fpath, time_t *saved);
+static int weather_state_image(device_t *devices, weather_dfile_t *df,
+  time_t saved);
 
 static int weather_list_record(device_t *devices, ha7net_t *ha7net, int period,
-  weather_info_t *tinfo);
+  weather_info_t *tinfo, weather_queue_t *queue);
 static int weather_writedat(device_t *devices, time_t this_time,
   const char *fpath);
 
@@ -120,6 +223,7 @@ weather_debug_set(debug_proc_t *proc, void *ctx, int flags)
      xml_debug_set(proc, ctx, flags);
      ha7net_debug_set(proc, ctx, flags);
      daily_debug_set(proc, ctx, flags);
+     arch_debug_set(proc, ctx, flags);
 }
 
 
@@ -208,9 +312,10 @@ trace(const char *fmt, ...)
 #endif
 
 static int
-weather_data_fname(char **fname, time_t t, size_t days_ago, const char *fpath)
+weather_data_fname(char **fname, time_t t, size_t days_ago, const char *fpath,
+		   const char *suffix)
 {
-     size_t len;
+     size_t len, slen;
      char *ptr;
      struct tm this_tm;
      int val;
@@ -242,11 +347,12 @@ weather_data_fname(char **fname, time_t t, size_t days_ago, const char *fpath)
 	  return(ERR_OK);
 
      /*
-      *  Data file name will be: <ha7net-device-name>-yyyymmdd.dat
+      *  Data file name will be: <ha7net-device-name>-yyyymmdd<suffix>
+      *  where the suffix is ".dat" or ".bdat"
       */
 
      /*
-      *  Build the file path: "./" <ha7net-device-name> "-yyyymmdd.dat"
+      *  Build the file path: "./" <ha7net-device-name> "-yyyymmdd" <suffix>
       */
      if (!fpath)
      {
@@ -255,8 +361,9 @@ weather_data_fname(char **fname, time_t t, size_t days_ago, const char *fpath)
      }
      else
 	  len = strlen(fpath);
+     slen = suffix ? strlen(suffix) : 0;
 
-     *fname = (char *)malloc(2 + len + 13 + 1);
+     *fname = (char *)malloc(2 + len + 9 + slen + 1);
      if (!(*fname))
      {
 	  debug("weather_data_fname(%d): Insufficient virtual memory",
@@ -301,12 +408,11 @@ weather_data_fname(char **fname, time_t t, size_t days_ago, const char *fpath)
      ptr += 2;
 
      /*
-      *  Append ".dat"
+      *  Append the suffix
       */
-     *ptr++ = '.';
-     *ptr++ = 'd';
-     *ptr++ = 'a';
-     *ptr++ = 't';
+     if (slen)
+	  memcpy(ptr, suffix, slen);
+     ptr += slen;
 
      /*
       *  And, of course, a NUL terminator
@@ -320,961 +426,2686 @@ weather_data_fname(char **fname, time_t t, size_t days_ago, const char *fpath)
 }
 
 
+/*
+ *  State for loading a data file
+ */
+typedef struct {
+     device_t   *devices;   /* Devices to load the data into            */
+     const dev_index_t *index; /* ROM id index of devices              */
+     column_t   *columns;   /* columns[colnum] is the column's device   */
+     size_t      colmax;    /* Slots in columns[]                       */
+     device_t   *last_dev;  /* Device of the previous column described  */
+     int         last_fld;  /* and its field                            */
+     size_t      n;         /* Index of the latest record loaded        */
+     time_t      after;     /* When non-zero, replay only later records */
+     time_t      tiers_after; /* Older records are in every device's tiers */
+     int         tiers_only; /* Add the record to the rollup tiers only  */
+     float     (*vals)[NVALS]; /* Replayed record's values by device    */
+     char       *seen;      /* WEATHER_SEEN_x for each device           */
+} weather_load_t;
+
+/*
+ *  When replaying records after a restored device state, each record's
+ *  values are gathered by device and then added with dev_replay()
+ */
+#define WEATHER_SEEN_NONE    0
+#define WEATHER_SEEN_VALUE   1
+#define WEATHER_SEEN_MISSING 2
+
+
+/*
+ *  Set up to replay records
+ */
 static int
-weather_data_read(device_t *devices, size_t days_ago, const char *fpath)
+weather_load_replay(weather_load_t *ld)
 {
-     int advance_n, e, es, fd, fld, istat, last_fld, r, s, state;
-     char c, *fname, line[1024], romid[OWIRE_ID_LEN+1];
-     size_t colmax, colnum, n;
-     column_t *columns;
-     device_t *dev, *last_dev;
-     float fval;
-     ssize_t i, missing, nread, romid_len;
-     time_t tval;
-     static const int is_hexdigit[256] = {
-	  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-	  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,1,1,0,0,0,0,0,0,
-	  0,1,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-	  0,1,1,1,1,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-	  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-	  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-	  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-	  0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+     size_t ndevs;
+
+     ndevs = 0;
+     while (!dev_flag_test(&ld->devices[ndevs], DEV_FLAGS_END))
+	  ndevs++;
+     ld->vals = (float (*)[NVALS])calloc(ndevs + 1, sizeof(float[NVALS]));
+     ld->seen = (char *)calloc(ndevs + 1, 1);
+     if (!ld->vals || !ld->seen)
+     {
+	  debug("weather_load_replay(%d): Insufficient virtual memory",
+		__LINE__);
+	  return(ERR_NOMEM);
+     }
 
-     if (do_trace)
-	  trace("weather_data_read(%d): Called with devices=%p, days_ago=%u, "
-		"fpath=\"%s\" (%p)",
-		__LINE__, devices, days_ago, fpath ? fpath : "(null)", fpath);
+     return(ERR_OK);
+}
 
-     if (!devices)
+
+/*
+ *  Add the values gathered from the record for tval to each device
+ */
+static void
+weather_load_flush(weather_load_t *ld, time_t tval)
+{
+     device_t *dev;
+     size_t d;
+
+     for (dev = ld->devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
      {
-	  debug("weather_data_read(%d): Invalid call arguments; devices=NULL",
-		__LINE__, devices);
-	  return(ERR_BADARGS);
+	  d = dev - ld->devices;
+	  if (ld->seen[d] == WEATHER_SEEN_NONE)
+	       continue;
+	  dev_replay(dev, tval, ld->vals[d],
+		     ld->seen[d] == WEATHER_SEEN_MISSING);
+	  ld->seen[d] = WEATHER_SEEN_NONE;
      }
+}
 
-     /*
-      *  Initializations
-      */
-     colmax  = 0;
-     columns = NULL;
-     fname   = NULL;
-     fd      = -1;
+static const double weather_pow10[] = {
+     1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+     1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21,
+     1e22};
 
-     fname = NULL;
-     istat = weather_data_fname(&fname, (time_t)0, days_ago, fpath);
-     if (istat != ERR_OK)
+
+/*
+ *  Convert the value at *pptr as written by weather_data_write(),
+ *  advancing *pptr past it.  The mantissa's digits are gathered into an
+ *  integer which is then scaled by a power of ten.  For the 19 or fewer
+ *  significant digits and small exponents of any value we write, both
+ *  the integer and the power of ten are exact as doubles and so is the
+ *  correctly rounded result.  Returns ERR_OK or else ERR_SYNTAX when
+ *  there is no number at *pptr.
+ */
+static int
+weather_data_atof(const char **pptr, const char *end, float *val)
+{
+     const char *ptr;
+     unsigned long long mant;
+     int digits, e, e10, es, neg, seen;
+     double x;
+
+     ptr = *pptr;
+     neg = 0;
+     if (ptr < end && (*ptr == '-' || *ptr == '+'))
+	  neg = (*ptr++ == '-');
+
+     mant   = 0;
+     digits = 0;
+     e10    = 0;
+     seen   = 0;
+     for (; ptr < end && '0' <= *ptr && *ptr <= '9'; ptr++)
      {
-	  debug("weather_data_read(%d): Unable to generate a data file name; "
-		"weather_data_fname(%d) returned %d; %s",
-		__LINE__, istat, err_strerror(istat));
-	  goto done;
+	  seen = 1;
+	  if (digits < 19)
+	  {
+	       mant = mant * 10 + (unsigned long long)(*ptr - '0');
+	       if (mant)
+		    digits++;
+	  }
+	  else
+	       e10++;
      }
-     else if (!fname)
+     if (ptr < end && (*ptr == '.' || *ptr == ','))
      {
-	  debug("weather_data_read(%d): weather_data_fname() returned a "
-		"success but no file name pointer; coding error?",
-		__LINE__);
-	  istat = ERR_NO;
-	  goto done;
+	  for (ptr++; ptr < end && '0' <= *ptr && *ptr <= '9'; ptr++)
+	  {
+	       seen = 1;
+	       if (digits < 19)
+	       {
+		    mant = mant * 10 + (unsigned long long)(*ptr - '0');
+		    if (mant)
+			 digits++;
+		    e10--;
+	       }
+	  }
      }
+     if (!seen)
+	  return(ERR_SYNTAX);
 
-     /*
-      *  Now open the file in read mode
-      */
-     fd = open(fname, O_RDONLY | O_TEXT, 0);
-     if (fd < 0)
+     if (ptr < end && (*ptr == 'e' || *ptr == 'E' || *ptr == 'd' ||
+		       *ptr == 'D'))
      {
-	  if (!os_fexists(fname))
-	       /*
-		*  File does not exist
-		*/
-	       istat = ERR_EOM;
+	  ptr++;
+	  es = 1;
+	  if (ptr < end && (*ptr == '-' || *ptr == '+'))
+	       es = (*ptr++ == '-') ? -1 : 1;
+	  if (ptr == end || *ptr < '0' || '9' < *ptr)
+	       return(ERR_SYNTAX);
+	  for (e = 0; ptr < end && '0' <= *ptr && *ptr <= '9'; ptr++)
+	       if (e < 10000)
+		    e = e * 10 + (*ptr - '0');
+	  e10 += es * e;
+     }
+     *pptr = ptr;
+
+     x = (double)mant;
+     if (mant && e10)
+     {
+	  if (mant < (1ULL << 53) && -22 <= e10 && e10 <= 22)
+	       x = (e10 < 0) ? x / weather_pow10[-e10] : x * weather_pow10[e10];
 	  else
-	  {
-	       debug("weather_data_read(%d): Unable to open a data file; "
-		     "open(\"%s\", O_RDONLY, 0) call failed; errno=%d; %s",
-		     __LINE__, fname ? fname : "", errno, strerror(errno));
-	       istat = ERR_NO;
-	  }
-	  goto done;
+	       x = x * pow(10.0, (double)e10);
      }
+     *val = (float)(neg ? -x : x);
+
+     return(ERR_OK);
+}
 
-     /*
-      *  Parse the comment section of the data file.  It should look like
-      *
-      *  #<colnum>:<ROM id>:<fmt>:<units>:<comment>
-      *
-      *  For each column > 1, we need to know the ROM id of the device
-      *  to associate data for that column with.  The device may no longer
-      *  exist in which case we ignore data for that column.
-      */
 
 /*
- *  Parsing states
+ *  Associate column colnum of the records which follow with the next
+ *  field of the device with the given ROM id.  The device may no longer
+ *  exist in which case we ignore data for that column.
  */
-#define S_BOL      0
-#define S_COLNUM   1
-#define S_ROMID    2
-#define S_SKIP2EOL 3
-#define S_DONE     4
-#define S_SKIPLWSP 5
-#define S_VALUE    6
-
-     /*
-      *  Input buffer state
-      */
-     nread = 0;
-     i     = 0;
-
-     /*
-      *  Index of the next data point....  We set this once, way
-      *  before the loop which parses the data.  Reason being that
-      *  we may, part way through the data file encounter a new
-      *  set of comments describing new devices -- the result of
-      *  the data logger being restarted.  When we encounter such
-      *  a case, we come back to the comment parsing loop BUT we
-      *  want to preserve the data index.  Hence why we set it here
-      *  and not at the head of the data parsing loop.
-      */
-     n = NPAST;
+static int
+weather_data_assign(weather_load_t *ld, size_t colnum, const char *romid,
+		    size_t len)
+{
+     device_t *dev;
+     int fld;
+     size_t colmax;
+     column_t *tmp;
 
      /*
-      *  State information for parsing a comment section of the data file
+      *  Find the matching device in the device list.  The index ignores
+      *  case, so the ROM id needs no cannonicalization even should that
+      *  have changed across resets.
       */
-     state    = S_BOL;
-     last_dev = NULL;
-     last_fld = -1;
-
-read_loop_1:
-     while (i < nread && state != S_DONE)
+     dev = dev_index_find(ld->index, romid, len);
+     if (dev && !dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) &&
+	 dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
      {
-	  c = line[i++];
-	  switch (state)
+	  if (dev != ld->last_dev)
 	  {
-	  case S_BOL :
-	       if (c != '#')
-	       {
-		    --i;
-		    state = S_DONE;
-	       }
-	       else
+	       ld->last_dev = dev;
+	       ld->last_fld = -1;
+	  }
+	  for (fld = ld->last_fld + 1; fld < NVALS; fld++)
+	       if (dev->data.fld_used[fld] == DEV_FLD_USED)
+		    break;
+	  if (fld == NVALS)
+	  {
+	       debug("weather_data_assign(%d): Data file has too many "
+		     "columns of values for the device with ROM id %.*s",
+		     __LINE__, (int)len, romid);
+	       return(ERR_NO);
+	  }
+	  ld->last_fld = fld;
+	  if (colnum >= ld->colmax)
+	  {
+	       colmax = 200 * ((colnum + 200) / 200);
+	       tmp = (column_t *)realloc(ld->columns,
+					 colmax * sizeof(column_t));
+	       if (!tmp)
 	       {
-		    state  = S_COLNUM;
-		    colnum = 0;
+		    debug("weather_data_assign(%d): Insufficient virtual "
+			  "memory", __LINE__);
+		    return(ERR_NOMEM);
 	       }
-	       break;
-
-	  case S_COLNUM :
-	       switch (c)
-	       {
-	       case '0' :
-	       case '1' :
-	       case '2' :
-	       case '3' :
-	       case '4' :
-	       case '5' :
-	       case '6' :
-	       case '7' :
-	       case '8' :
-	       case '9' :
-		    colnum = colnum * 10 + (int)(c - '0');
-		    break;
+	       memset(tmp + ld->colmax, 0,
+		      (colmax - ld->colmax) * sizeof(column_t));
+	       ld->columns = tmp;
+	       ld->colmax  = colmax;
+	  }
+	  ld->columns[colnum].dev = dev;
+	  ld->columns[colnum].fld = (size_t)fld;
+     }
 
-	       case ':' :
-		    if (colnum > 0)
-		    {
-			 state = S_ROMID;
-			 romid_len = 0;
-		    }
-		    else
-			 state = S_SKIP2EOL;
-		    break;
+     return(ERR_OK);
+}
 
-	       default :
-		    state = S_SKIP2EOL;
-		    break;
-	       }
-	       break;
 
-	  case S_ROMID :
-	       if (romid_len < OWIRE_ID_LEN)
-	       {
-		    if (is_hexdigit[(unsigned char)c])
-			 romid[romid_len++] = c;
-		    else
-			 state = S_SKIP2EOL;
-	       }
-	       else if (romid_len == OWIRE_ID_LEN && c == ':')
-	       {
-		    /*
-		     *  We now have the column number AND ROM id
-		     */
-		    state = S_SKIP2EOL;
+/*
+ *  Parse a line from the comment section of a data file.  For each
+ *  column > 1, we need to know the ROM id of the device to associate
+ *  data for that column with.  Such lines look like
+ *
+ *  #<colnum>:<ROM id>:<fmt>:<units>:<type>:<comment>
+ *
+ *  and any other comment is ignored.
+ */
+static int
+weather_data_column(weather_load_t *ld, const char *ptr, const char *eol)
+{
+     size_t colnum;
 
-		    /*
-		     *  Cannonicalize the ROM id.  This in case the
-		     *  cannonicalization has changed across resets.
-		     */
-		    dev_romid_cannonical(romid, OWIRE_ID_LEN+1,
-					 romid, OWIRE_ID_LEN);
+     colnum = 0;
+     for (ptr++; ptr < eol && '0' <= *ptr && *ptr <= '9'; ptr++)
+	  colnum = colnum * 10 + (size_t)(*ptr - '0');
+     if (!colnum || ptr == eol || *ptr++ != ':' ||
+	 eol - ptr < OWIRE_ID_LEN + 1 || ptr[OWIRE_ID_LEN] != ':')
+	  return(ERR_OK);
 
-		    /*
-		     *  Find the matching device in the device list
-		     */
-		    dev = devices;
-		    while (!dev_flag_test(dev, DEV_FLAGS_END))
-		    {
-			 if (dev_flag_test(dev, DEV_FLAGS_IGNORE |
-					   DEV_FLAGS_ISSUB) ||
-			     !dev_flag_test(dev, DEV_FLAGS_INITIALIZED) ||
-			     memcmp(dev_romid(dev), romid, OWIRE_ID_LEN))
-			      goto skip_me;
-			 if (dev != last_dev)
-			 {
-			      last_dev = dev;
-			      last_fld = -1;
-			 }
-			 for (fld = last_fld + 1; fld < NVALS; fld++)
-			      if (dev->data.fld_used[fld] == DEV_FLD_USED)
-				   break;
-			 if (fld == NVALS)
-			 {
-			      debug("weather_data_read(%d): Data file has too "
-				    "many columns of values for the device "
-				    "with ROM id %.*s",
-				    __LINE__, OWIRE_ID_LEN, romid);
-			      istat = ERR_NO;
-			      goto done;
-			 }
-			 last_fld = fld;
-			 if (colnum >= colmax)
-			 {
-			      size_t colmax_new =
-				   200 * (int)((colnum + 199) / 200);
-			      column_t *tmp = (column_t *)
-				   realloc(columns,
-					   colmax_new * sizeof(column_t));
-			      if (!tmp)
-			      {
-				   debug("weather_data_read(%d): Insufficient "
-					 "virtual memory", __LINE__);
-				   istat = ERR_NOMEM;
-			      }
-			      memset((char *)tmp + colmax * sizeof(column_t),
-				     0,
-				     (colmax_new - colmax) * sizeof(column_t));
-			      columns = tmp;
-			      colmax  = colmax_new;
-			 }
-			 columns[colnum].dev = dev;
-			 columns[colnum].fld = fld;
+     return(weather_data_assign(ld, colnum, ptr, OWIRE_ID_LEN));
+}
 
-			 /*
-			  *  End the device search
-			  */
-			 break;
 
-		    skip_me:
-			 dev++;
-		    }
-	       }
-	       else
-		    state = S_SKIP2EOL;
-	       break;
+/*
+ *  Store a value from column colnum of the record for tval.  *advance
+ *  is set for the record's first value, which advances the index of
+ *  the latest record loaded.
+ */
+static void
+weather_data_store(weather_load_t *ld, size_t colnum, time_t tval,
+		   float fval, int missing, int *advance)
+{
+     device_t *dev;
+     size_t fld, n;
 
-	  case S_SKIP2EOL :
-	       if (c == '\n')
-		    state = S_BOL;
-	       break;
+     if (colnum >= ld->colmax || !(dev = ld->columns[colnum].dev))
+	  /*
+	   *  The data for this column corresponds to a device
+	   *  not turned up by the 1-Wire bus search
+	   */
+	  return;
+     fld = ld->columns[colnum].fld;
 
-	  default :
-	       debug("weather_data_read(%d): Coding error; while parsing the "
-		     "comment section of the file \"%s\", we found that the "
-		     "parsing state had the unknown value %d",
-		     __LINE__, fname ? fname : "(null)", state);
-	       istat = ERR_NO;
-	       goto done;
-	  }
+     if (ld->tiers_only)
+     {
+	  /*
+	   *  Covered by the restored device state but not by the rollup
+	   *  tiers saved with it
+	   */
+	  if (!missing)
+	       dev_rollup_add(dev, (int)fld, tval, fval);
+	  return;
      }
-
-     /*
-      *  while() loop over for the time being.  Is it over because
-      *  we've reached the end of the comments, or because we've
-      *  exhausted the input buffer and need to read more data?
-      */
-     if (state != S_DONE)
+     else if (ld->after)
      {
 	  /*
-	   *  Still processing comments and we've exhausted the input buffer.
-	   *  Read more file text to and resume comment processing.
+	   *  Replaying: gather the value for weather_load_flush()
 	   */
-	  if (0 < (nread = read(fd, line, sizeof(line))))
-	  {
-	       i = 0;
-	       goto read_loop_1;
-	  }
-	  if (nread == 0)
-	       /*
-		*  Premature eof but we can live with that
-		*/
-	       istat = ERR_OK;
+	  if (missing)
+	       ld->seen[dev - ld->devices] = WEATHER_SEEN_MISSING;
 	  else
 	  {
-	       /*
-		*  I/O error of some sort
-		*/
-	       debug("weather_data_read(%d): Encountered an I/O error "
-		     "while reading the data file \"%s\"; errno=%d; %s",
-		     __LINE__, fname ? fname : "(null)",
-		     errno, strerror(errno));
-	       istat = ERR_READ;
+	       ld->vals[dev - ld->devices][fld] = fval;
+	       if (ld->seen[dev - ld->devices] == WEATHER_SEEN_NONE)
+		    ld->seen[dev - ld->devices] = WEATHER_SEEN_VALUE;
 	  }
-	  goto done;
+	  return;
      }
 
      /*
-      *  If we're here, then we've reached the end of a comment section.
+      *  Now that we have an acceptable data value, go ahead and
+      *  advance our index into the list of values.  Note that the
+      *  initial value for n is -1 so that on the first advance we
+      *  set it to the index value 0.  All devices have the same
+      *  number of slots; see dev_history_size().
       */
+     if (*advance)
+     {
+	  *advance = 0;
+	  ld->n = (ld->n + 1 < dev->data.npast) ? ld->n + 1 : 0;
+     }
+     n = ld->n;
+     dev->data.n_current = n;
+
+     if (missing)
+     {
+	  /*
+	   *  Missing value
+	   */
+	  dev->data.time[n]     = DEV_MISSING_TVALUE;
+	  dev->data.val[fld][n] = 0.0;
+	  return;
+     }
+
+     dev->data.time[n]     = tval;
+     dev->data.val[fld][n] = fval;
+     dev_rollup_add(dev, (int)fld, tval, fval);
 
      /*
-      *  Did we find any columns of interest?
+      *  Handle extrema
       */
-     if (!columns)
+     if (dev->data.today.min[fld] > fval)
      {
-	  debug("weather_data_read(%d): The data file is not appropriately "
-		"formatted or does not contain any data", __LINE__);
-	  istat = ERR_OK;
-	  goto done;
+	  dev->data.today.min[fld]  = fval;
+	  dev->data.today.tmin[fld] = tval;
      }
+     if (dev->data.today.max[fld] < fval)
+     {
+	  dev->data.today.max[fld]  = fval;
+	  dev->data.today.tmax[fld] = tval;
+     }
+}
+
+
+/*
+ *  Load a record from a data file: a time stamp followed by a value or
+ *  DEV_MISSING_VALUE for each column.  Values for columns of devices
+ *  which no longer exist are skipped, as is the rest of the line after
+ *  anything unparsable.
+ */
+static void
+weather_data_record(weather_load_t *ld, const char *ptr, const char *eol)
+{
+     const char *tok;
+     float fval;
+     int advance_n, missing;
+     size_t colnum;
+     time_t tval;
 
      /*
-      *  Now parse the data within the file.
-      *  Note that we've already set n=NPAST and we do not want to reset it.
+      *  Time stamp
       */
-     colnum    = 0;
-     advance_n = 1;
-     state     = S_BOL;
+     tok  = ptr;
+     tval = (time_t)0;
+     for (; ptr < eol && '0' <= *ptr && *ptr <= '9'; ptr++)
+	  tval = tval * 10 + (time_t)(*ptr - '0');
+     if (tval == (time_t)0 || (ld->after && tval <= ld->tiers_after))
+	  return;
+     ld->tiers_only = (ld->after && tval <= ld->after);
 
-read_loop_2:
-     while (i < nread)
+     advance_n = 1;
+     colnum    = 1;
+     for (;;)
      {
-	  c = line[i++];
-	  switch (state)
-	  {
-	  case S_SKIP2EOL :
-	       if (c == '\n')
-		    state = S_BOL;
+	  /*
+	   *  Next column
+	   */
+	  if (ptr == eol || *ptr == '\r')
 	       break;
-	       
-	  case S_BOL :
-	       colnum    = 0;
-	       advance_n = 1;
-	       state     = S_SKIPLWSP;
+	  else if (*ptr != ' ' && *ptr != '\t')
 	       /*
-		*  Fall through to next case
+		*  Junk where a separator belongs
 		*/
+	       goto junk;
+	  while (ptr < eol && (*ptr == ' ' || *ptr == '\t'))
+	       ptr++;
+	  if (ptr == eol || *ptr == '\r')
+	       break;
+	  tok = ptr;
 
-	  case S_SKIPLWSP :
-	       if (c == ' ' || c == '\t' || c == '\r')
-		    break;
-	       else if (c == '\n')
-	       {
-		    colnum = 0;
-		    break;
-	       }
-	       else if (c == '#' && colnum == 0)
-	       {
-		    /*
-		     *  Comment...? at the start of the line...?
-		     *  The data recording was stopped and then
-		     *  restarted.  Dump columns, parse these
-		     *  new comments, and then continue reading
-		     *  data.
-		     */
-		    memset(columns, 0, colmax * sizeof(column_t));
-		    state    = S_COLNUM;
-		    last_dev = NULL;
-		    last_fld = -1;
-		    colnum   = 0;
-		    goto read_loop_1;
-	       }
+	  missing = (*ptr == DEV_MISSING_VALUE);
+	  if (missing)
+	  {
+	       ptr++;
+	       fval = 0.0;
+	  }
+	  else if (weather_data_atof(&ptr, eol, &fval) != ERR_OK)
+	       goto junk;
 
-	       /*
-		*  New column of data
-		*/
-	       if (colnum == 0)
-	       {
-		    advance_n = 1;
-		    colnum    = 1;
-		    tval      = (time_t)0;
-	       }
-	       else
-	       {
-		    colnum++;
-		    missing = 0;   /* Missing value    */
-		    fval    = 0.0; /* Value            */
-		    r       = 0;   /* 1/10, 1/100, ... */
-		    s       = 1;   /* Mantissa sign    */
-		    es      = 0;   /* Exponent sign    */
-	       }
+	  weather_data_store(ld, ++colnum, tval, fval, missing, &advance_n);
+     }
+     goto done;
 
-	       /*
-		*  Fall through to the next state
-		*/
-	       state = S_VALUE;
+junk:
+     while (ptr < eol && *ptr != ' ' && *ptr != '\t' && *ptr != '\r')
+	  ptr++;
+     detail("weather_data_record(%d): Unable to parse the value \"%.*s\" "
+	    "in column %u of the record for %ld; ignoring the rest of the "
+	    "record", __LINE__, (int)(ptr - tok), tok,
+	    (unsigned int)colnum + 1, (long)tval);
 
-	  case S_VALUE :
-	       if (colnum == 1)
-	       {
-		    if ('0' <= c && c <= '9')
-			 tval = tval * 10 + (time_t)(c - '0');
-		    else
-		    {
-			 if (c == ' ' || c == '\t')
-			      state = S_SKIPLWSP;
-			 else
-			      state = S_SKIP2EOL;
-		    }
-	       }
-	       else
-	       {
-		    switch(c)
-		    {
-		    case DEV_MISSING_VALUE :
-			 missing = 1;
-			 break;
-
-		    case '0' :
-		    case '1' :
-		    case '2' :
-		    case '3' :
-		    case '4' :
-		    case '5' :
-		    case '6' :
-		    case '7' :
-		    case '8' :
-		    case '9' :
-			 if (es)
-			      /*
-			       *  Mantissa
-			       */
-			      e = e * 10 + (int)(c - '0');
-			 else if (r == 0)
-			      fval = fval * 10.0 + (float)(c - '0');
-			 else
-			 {
-			      /*
-			       *  We've seen a decimal point already
-			       */
-			      fval += (float)(c - '0') / (float)r;
-			      r *= 10;
-			 }
-			 break;
+done:
+     if (ld->after && !ld->tiers_only)
+	  weather_load_flush(ld, tval);
+}
 
-		    case 'E' :
-		    case 'D' :
-			 e  = 0;  /* Exponent        */
-			 es = 1;  /* Exponent sign + */
-			 break;
 
-		    case '.' :
-		    case ',' :
-			 if (es)
-			 {
-			      /*
-			       *  Decimal points not allowed in the exponent
-			       */
-			      detail("weather_data_read(%d): Encountered a "
-				     "value expressed in scientific notation "
-				     "but with a decimal point in the "
-				     "exponent; file is \"%s\"",
-				     __LINE__, fname ? fname : "(null)");
-			      state = S_SKIP2EOL;
-			      break;
-			 }
-			 r = 10;
-			 break;
-
-		    case '-' :
-			 if (es)
-			      es = -1; /* Negative exponent */
-			 else
-			      s = -1;  /* Negative mantissa */
-			 break;
-
-		    case '+' :
-			 if (es)
-			      es = 1; /* Positive exponent */
-			 else
-			      s = 1;  /* Positive mantissa */
-			 break;
-
-		    case ' ' :
-		    case '\t' :
-			 state = S_SKIPLWSP;
-			 break;
-
-		    case '\r' :
-			 state = S_SKIP2EOL;
-			 break;
-
-		    case '\n' :
-			 state = S_BOL;
-			 break;
-
-		    default :
-			 state = S_SKIP2EOL;
-			 break;
-		    }
+/*
+ *  Load a day's data file.  The file is mapped into memory and taken a
+ *  line at a time: a run of comment lines describes the columns of the
+ *  records which follow.  Should the data logger have been restarted,
+ *  a new run of comments part way through the file describes the
+ *  columns anew.
+ */
+static int
+weather_data_read(device_t *devices, const dev_index_t *index,
+		  size_t days_ago, const char *fpath, time_t after)
+{
+     const char *base, *eol, *end, *ptr;
+     char *fname;
+     int comments, istat;
+     size_t len;
+     weather_load_t ld;
 
-		    if (state == S_VALUE)
-			 /*
-			  *  Still parsing the value
-			  */
-			 break;
-		    if (tval == (time_t)0 || colnum >= colmax)
-		    {
-			 /*
-			  *  Not good
-			  */
-			 if (state != S_BOL)
-			      state = S_SKIP2EOL;
-			 break;
-		    }
-		    else if (!(dev = columns[colnum].dev))
-		    {
-			 /*
-			  *  The data for this column corresponds to a
-			  *  device not turned up by the 1-Wire bus search
-			  */
-			 break;
-		    }
-		    else if ((fld = columns[colnum].fld) >= NVALS)
-		    {
-			 debug("weather_data_read(%d): Coding error; we've "
-			       "found that columns[%d].fld = %d which "
-			       "exceeds NVALS=%d",
-			       __LINE__, colnum, fld, NVALS);
-			 istat = ERR_NO;
-			 goto done;
-		    }
-
-		    /*
-		     *  Now that we have an acceptable data value, go ahead
-		     *  and advance our index into the list of values.
-		     *  Note that the initial value for n is NPAST so that
-		     *  on the first advance we set it to the index value 0.
-		     */
-		    if (advance_n)
-		    {
-			 advance_n = 0;
-			 n = (n < (NPAST - 1)) ? n + 1 : 0;
-		    }
-		    dev->data.n_current = n;
-
-		    if (missing)
-		    {
-			 /*
-			  *  Missing value
-			  */
-			 dev->data.time[n]     = DEV_MISSING_TVALUE;
-			 dev->data.val[fld][n] = 0.0;
-		    }
-		    else
-		    {
-			 /*
-			  *  Adjust the sign if necessary
-			  */
-			 if (es && e)
-			 {
-			      if (es < 0)
-				   e = -e;
-			      fval = fval * (float)pow(10.0, (double)e);
-			 }
-			 if (s == -1)
-			      fval = -fval;
-
-			 /*
-			  *  Store the value
-			  */
-			 dev->data.time[n]     = tval;
-			 dev->data.val[fld][n] = fval;
-
-			 /*
-			  *  Handle extrema
-			  */
-			 if (dev->data.today.min[fld] > fval)
-			 {
-			      dev->data.today.min[fld]  = fval;
-			      dev->data.today.tmin[fld] = tval;
-			 }
-			 if (dev->data.today.max[fld] < fval)
-			 {
-			      dev->data.today.max[fld]  = fval;
-			      dev->data.today.tmax[fld] = tval;
-			 }
-		    }
-		    missing = 0;
-	       }
-	       break;
+     if (do_trace)
+	  trace("weather_data_read(%d): Called with devices=%p, index=%p, "
+		"days_ago=%u, fpath=\"%s\" (%p), after=%ld", __LINE__, devices,
+		index, days_ago, fpath ? fpath : "(null)", fpath, (long)after);
 
-	  default :
-	       debug("weather_data_read(%d): Coding error; while parsing the "
-		     "comment section of a data file, we found that the "
-		     "parsing state had the unknown value %d",
-		     __LINE__, state);
-	       istat = ERR_NO;
-	       goto done;
-	  }
+     if (!devices || !index)
+     {
+	  debug("weather_data_read(%d): Invalid call arguments; devices=%p, "
+		"index=%p", __LINE__, devices, index);
+	  return(ERR_BADARGS);
      }
 
      /*
-      *  Refill the read buffer
+      *  Initializations
       */
-     if (0 < (nread = read(fd, line, sizeof(line))))
+     memset(&ld, 0, sizeof(weather_load_t));
+     ld.devices  = devices;
+     ld.index    = index;
+     ld.last_fld = -1;
+     ld.n        = (size_t)-1;
+     ld.after    = after;
+     base        = NULL;
+     len         = 0;
+
+     fname = NULL;
+     if (after && ERR_OK != (istat = weather_load_replay(&ld)))
+	  goto done;
+     if (after)
+	  ld.tiers_after = weather_tiers_after(devices, after);
+
+     istat = weather_data_fname(&fname, (time_t)0, days_ago, fpath, ".dat");
+     if (istat != ERR_OK)
      {
-	  i = 0;
-	  goto read_loop_2;
+	  debug("weather_data_read(%d): Unable to generate a data file name; "
+		"weather_data_fname(%d) returned %d; %s",
+		__LINE__, istat, err_strerror(istat));
+	  goto done;
+     }
+     else if (!fname)
+     {
+	  debug("weather_data_read(%d): weather_data_fname() returned a "
+		"success but no file name pointer; coding error?",
+		__LINE__);
+	  istat = ERR_NO;
+	  goto done;
      }
-
-#undef S_BOL
-#undef S_COLNUM
-#undef S_ROMID
-#undef S_SKIP2EOL
-#undef S_DONE
-#undef S_SKIPLWSP
-#undef S_VALUE
 
      /*
-      *  EOF achieved
+      *  Now map the file into memory
       */
-     if (nread >= 0)
-	  istat = ERR_OK;
-     else
+     if (os_mmap(fname, &base, &len))
      {
-	  debug("weather_data_read(%d): Encountered an I/O error while "
-		"reading the data file \"%s\"; errno=%d; %s",
-		__LINE__, fname ? fname : "(null)", errno, strerror(errno));
-	  istat = ERR_READ;
+	  if (!os_fexists(fname))
+	       /*
+		*  File does not exist
+		*/
+	       istat = ERR_EOM;
+	  else
+	  {
+	       debug("weather_data_read(%d): Unable to read a data file; "
+		     "os_mmap(\"%s\") call failed; errno=%d; %s",
+		     __LINE__, fname, errno, strerror(errno));
+	       istat = ERR_READ;
+	  }
+	  goto done;
+     }
+
+     comments = 0;
+     end = base + len;
+     for (ptr = base; ptr < end; ptr = eol + 1)
+     {
+	  if (!(eol = (const char *)memchr(ptr, '\n', (size_t)(end - ptr))))
+	       eol = end;
+	  while (ptr < eol && (*ptr == ' ' || *ptr == '\t'))
+	       ptr++;
+
+	  if (ptr < eol && *ptr == '#')
+	  {
+	       if (!comments)
+	       {
+		    /*
+		     *  Start of a new set of column descriptions
+		     */
+		    if (ld.columns)
+			 memset(ld.columns, 0, ld.colmax * sizeof(column_t));
+		    ld.last_dev = NULL;
+		    ld.last_fld = -1;
+		    comments    = 1;
+	       }
+	       istat = weather_data_column(&ld, ptr, eol);
+	       if (istat != ERR_OK)
+		    goto done;
+	       continue;
+	  }
+	  comments = 0;
+
+	  if (!ld.columns)
+	  {
+	       /*
+		*  Did not find any columns of interest
+		*/
+	       debug("weather_data_read(%d): The data file is not "
+		     "appropriately formatted or does not contain any data",
+		     __LINE__);
+	       break;
+	  }
+	  weather_data_record(&ld, ptr, eol);
      }
+     istat = ERR_OK;
 
 done:
      /*
       *  Release our resources
       */
-     if (fd >= 0)
-	  close(fd);
+     os_munmap(base, len);
      if (fname)
 	  free(fname);
-     if (columns)
-	  free(columns);
+     if (ld.columns)
+	  free(ld.columns);
+     if (ld.vals)
+	  free(ld.vals);
+     if (ld.seen)
+	  free(ld.seen);
 
      return(istat);
 }
 
 
+/*
+ *  Load a day's binary data file.  Each segment's column descriptions
+ *  are matched up with the devices and then its records are taken
+ *  directly from the mapped file.
+ */
 static int
-weather_data_write(device_t *devices, time_t tavg, int *first,
-		   const char *fpath)
+weather_bdat_read(device_t *devices, const dev_index_t *index,
+		  size_t days_ago, const char *fpath, time_t after)
 {
-     device_t *dev;
-     int fd, missing;
+     const char *base, *ptr, *rec;
      char *fname;
-     FILE *fp;
-     size_t i, istat, len, n;
-     struct stat sbuf;
+     int advance, istat;
+     size_t c, len, r;
+     bdat_seg_t seg;
+     time_t tval;
+     float fval;
+     weather_load_t ld;
 
      if (do_trace)
-	  trace("weather_data_write(%d): Called with devices=%p, tavg=%u, "
-		"first=%p; *first=%d, fpath=\"%s\" (%p)",
-		__LINE__, devices, tavg, first, first ? *first : 0,
-		fpath ? fpath : "(null)", fpath);
+	  trace("weather_bdat_read(%d): Called with devices=%p, index=%p, "
+		"days_ago=%u, fpath=\"%s\" (%p), after=%ld", __LINE__, devices,
+		index, days_ago, fpath ? fpath : "(null)", fpath, (long)after);
 
-     if (!devices)
+     if (!devices || !index)
      {
-	  debug("weather_data_write(%d): Invalid call arguments; devices=NULL",
-		__LINE__, devices);
+	  debug("weather_bdat_read(%d): Invalid call arguments; devices=%p, "
+		"index=%p", __LINE__, devices, index);
 	  return(ERR_BADARGS);
      }
 
+     /*
+      *  Initializations
+      */
+     memset(&ld, 0, sizeof(weather_load_t));
+     ld.devices  = devices;
+     ld.index    = index;
+     ld.last_fld = -1;
+     ld.n        = (size_t)-1;
+     ld.after    = after;
+     base        = NULL;
+     len         = 0;
+
      fname = NULL;
-     istat = weather_data_fname(&fname, tavg, 0, fpath);
+     if (after && ERR_OK != (istat = weather_load_replay(&ld)))
+	  goto done;
+     if (after)
+	  ld.tiers_after = weather_tiers_after(devices, after);
+
+     istat = weather_data_fname(&fname, (time_t)0, days_ago, fpath, ".bdat");
      if (istat != ERR_OK)
      {
-	  debug("weather_data_write(%d): Unable to generate a data file name; "
+	  debug("weather_bdat_read(%d): Unable to generate a data file name; "
 		"weather_data_fname(%d) returned %d; %s",
 		__LINE__, istat, err_strerror(istat));
-	  return(istat);
+	  goto done;
      }
      else if (!fname)
      {
-	  debug("weather_data_write(%d): weather_data_fname() returned a "
+	  debug("weather_bdat_read(%d): weather_data_fname() returned a "
 		"success but no file name pointer; coding error?",
 		__LINE__);
-	  return(ERR_NO);
-     }
-
-     /*
-      *  Now open the file in append mode
-      */
-     fd = open(fname, O_WRONLY | O_APPEND | O_CREAT | O_TEXT, 0644);
-     if (fd < 0)
-     {
-	  debug("weather_data_write(%d): Unable to open a data file; "
-		"open(\"%s\", O_APPEND | O_CREAT, 0644) call failed; "
-		"errno=%d; %s",
-		__LINE__, fname ? fname : "(null)", errno, strerror(errno));
-	  free(fname);
-	  return(ERR_NO);
+	  istat = ERR_NO;
+	  goto done;
      }
 
-     /*
-      *  Free up the file name
-      */
-     free(fname);
-     fname = NULL;
-
-     /*
-      *  Associate a stream with the file
-      */
-     fp = fdopen(fd, "a");
-     if (!fp)
+     if (os_mmap(fname, &base, &len))
      {
-	  debug("weather_data_write(%d): Unable to open the data file; "
-		"fdopen(%d, \"a+\") call failed; errno=%d; %s",
-		__LINE__, fd, errno, strerror(errno));
-	  return(ERR_NO);
+	  if (!os_fexists(fname))
+	       istat = ERR_EOM;
+	  else
+	  {
+	       debug("weather_bdat_read(%d): Unable to read a binary data "
+		     "file; os_mmap(\"%s\") call failed; errno=%d; %s",
+		     __LINE__, fname, errno, strerror(errno));
+	       istat = ERR_READ;
+	  }
+	  goto done;
      }
 
-     /*
-      *  If the file is new, then write a preamble into it
-      */
-     if ((first && *first) || (!fstat(fileno(fp), &sbuf) && sbuf.st_size == 0))
+     memset(&seg, 0, sizeof(bdat_seg_t));
+     while ((istat = bdat_seg_next(base, len, &seg)) == ERR_OK)
      {
-	  long tm_gmtoff;
-	  const char *tm_zone;
-	  char zbuf[64];
-
-	  if (first)
-	       *first = 0;
-
-	  os_tzone(&tm_gmtoff, &tm_zone, zbuf, sizeof(zbuf));
-	  fprintf(fp,
-"#ha7netd v%d.%d (compiled " __DATE__ " " __TIME__ ")\n"
-"#All time units are seconds since 00:00 1 Jan 1970 %c%02d%02d (%s)\n"
-"#<column>:<ROM id>:<format>:<units>:<type>:<description>\n"
-"#1::%%u:s:time_t:Seconds since 1 Jan 1970 00:00\n",
-		  WEATHER_VERSION_MAJOR, WEATHER_VERSION_MINOR,
-		  (tm_gmtoff >= 0) ? '+' : '-', abs(tm_gmtoff / 3600),
-		  abs(tm_gmtoff / 60) % 60, tm_zone);
+	  /*
+	   *  Describe the columns anew
+	   */
+	  if (ld.columns)
+	       memset(ld.columns, 0, ld.colmax * sizeof(column_t));
+	  ld.last_dev = NULL;
+	  ld.last_fld = -1;
+	  for (c = 0; c < seg.hdr->ncols; c++)
+	  {
+	       ptr = (const char *)memchr(seg.cols[c].romid, '\0',
+					  sizeof(seg.cols[c].romid));
+	       istat = weather_data_assign(&ld, c, seg.cols[c].romid,
+			   ptr ? (size_t)(ptr - seg.cols[c].romid) :
+			   sizeof(seg.cols[c].romid));
+	       if (istat != ERR_OK)
+		    goto done;
+	  }
+	  if (!ld.columns)
+	       /*
+		*  Did not find any columns of interest
+		*/
+	       continue;
 
-	  dev = devices;
-	  n = 1;
-	  while (!dev_flag_test(dev, DEV_FLAGS_END))
+	  for (r = 0; r < seg.nrecs; r++)
 	  {
-	       if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
-		   !dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
-		    goto skip_me1;
-	       for (i = 0; i < NVALS; i++)
+	       rec  = BDAT_REC(&seg, r);
+	       tval = BDAT_REC_TIME(rec);
+	       if (tval == (time_t)0 || (after && tval <= ld.tiers_after))
+		    continue;
+	       ld.tiers_only = (after && tval <= after);
+	       advance = 1;
+	       for (c = 0; c < seg.hdr->ncols; c++)
 	       {
-		    if (dev->data.fld_used[i] != DEV_FLD_USED)
-			 continue;
-		    n++;
-		    fprintf(fp, "#%zu:%s:%s:%s:%s:%s\n",
-			    n, dev_romid(dev),
-			    dev->data.fld_format[i] ?
-			      dev->data.fld_format[i] : "%f",
-			    dev_unitstr(dev->data.fld_units[i]),
-			    dev_dtypestr(dev->data.fld_dtype[i]),
-			    dev_dtypedescstr(dev->data.fld_dtype[i]));
+		    fval = BDAT_REC_VAL(rec, c);
+		    weather_data_store(&ld, c, tval, fval, BDAT_MISSING(fval),
+				       &advance);
 	       }
-	  skip_me1:
-	       dev++;
+	       if (after && !ld.tiers_only)
+		    weather_load_flush(&ld, tval);
 	  }
      }
+     if (istat == ERR_NO)
+	  debug("weather_bdat_read(%d): The file \"%s\" is not a binary data "
+		"file for this host; ignoring it", __LINE__, fname);
+     else
+	  istat = ERR_OK;
 
+done:
      /*
-      *  Time stamp
+      *  Release our resources
       */
-     if (0 > fprintf(fp, "%ld", tavg))
-	  goto write_error;
+     os_munmap(base, len);
+     if (fname)
+	  free(fname);
+     if (ld.columns)
+	  free(ld.columns);
+     if (ld.vals)
+	  free(ld.vals);
+     if (ld.seen)
+	  free(ld.seen);
 
-     dev = devices;
-     while (!dev_flag_test(dev, DEV_FLAGS_END))
-     {
-	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
-	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
-	       goto skip_me2;
-	  n = dev->data.n_current;
-	  for (i = 0; i < NVALS; i++)
-	  {
-	       if (dev->data.fld_used[i] != DEV_FLD_USED)
-		    continue;
+     return(istat);
+}
 
-	       if (EOF == fputc(' ', fp))
-		    goto write_error;
 
-	       if (dev->data.time[n] != DEV_MISSING_TVALUE)
-	       {
-		    if (dev->data.fld_format[i])
-		    {
-			 if (0 > fprintf(fp, dev->data.fld_format[i],
-					 dev->data.val[i][n]))
-			      goto write_error;
-		    }
-		    else
-			 if (0 > fprintf(fp, "%f", dev->data.val[i][n]))
-			      goto write_error;
-	       }
-	       else
-	       {
-		    if (EOF == fputc(DEV_MISSING_VALUE, fp))
-			 goto write_error;
-	       }
-	  }
-     skip_me2:
-	  dev++;
+/*
+ *  Load a day's data from its binary data file when binary data files
+ *  are kept and it is present, and otherwise from its text data file.
+ *  When after is non-zero, only the records later than it are loaded and
+ *  they are added to the devices' present state as dev_read() would.
+ */
+static int
+weather_day_read(device_t *devices, const dev_index_t *index,
+		 size_t days_ago, const weather_info_t *winfo, time_t after)
+{
+     int istat;
+
+     if (winfo->binary)
+     {
+	  istat = weather_bdat_read(devices, index, days_ago,
+				    winfo->fname_prefix, after);
+	  if (istat != ERR_EOM && istat != ERR_NO)
+	       return(istat);
      }
+     return(weather_data_read(devices, index, days_ago, winfo->fname_prefix,
+			      after));
+}
 
-     /*
-      *  And a record terminator
-      */
-     if (EOF == fputc('\n', fp))
-	  goto write_error;
 
-     /*
-      *  Flush the data
-      */
-     if (fsync(fileno(fp)))
-	 goto write_error;
+/*
+ *  Grow the data file's record buffer to hold at least len more bytes
+ */
+static int
+weather_data_grow(weather_dfile_t *df, size_t len)
+{
+     size_t max;
+     char *tmp;
 
-     /*
-      *  And finally, close the file
-      */
-     if (!fclose(fp))
+     if (len < df->buf_max - df->buf_len)
 	  return(ERR_OK);
 
-     /*
-      *  Error on close; fall through to write_error label
-      */
-     fp = NULL;
+     max = df->buf_max ? 2 * df->buf_max : 1024;
+     while (max <= df->buf_len + len)
+	  max *= 2;
+     tmp = (char *)realloc(df->buf, max);
+     if (!tmp)
+     {
+	  debug("weather_data_grow(%d): Insufficient virtual memory",
+		__LINE__);
+	  return(ERR_NOMEM);
+     }
+     df->buf     = tmp;
+     df->buf_max = max;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Append formatted text to the data file's record buffer, growing the
+ *  buffer as needed
+ */
+static int
+weather_data_printf(weather_dfile_t *df, const char *fmt, ...)
+{
+     va_list ap;
+     int istat, len;
+
+     for (;;)
+     {
+	  va_start(ap, fmt);
+	  len = vsnprintf(df->buf + df->buf_len, df->buf_max - df->buf_len,
+			  fmt, ap);
+	  va_end(ap);
+	  if (len < 0)
+	       return(ERR_NO);
+	  else if ((size_t)len < df->buf_max - df->buf_len)
+	       break;
+	  else if ((istat = weather_data_grow(df, (size_t)len)) != ERR_OK)
+	       return(istat);
+     }
+     df->buf_len += (size_t)len;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Append len bytes to the data file's record buffer
+ */
+static int
+weather_data_put(weather_dfile_t *df, const void *ptr, size_t len)
+{
+     int istat;
+
+     if ((istat = weather_data_grow(df, len)) != ERR_OK)
+	  return(istat);
+     memcpy(df->buf + df->buf_len, ptr, len);
+     df->buf_len += len;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Append a value to the data file's record buffer
+ */
+static int
+weather_data_value(weather_dfile_t *df, const fmt_float_t *ff, float val)
+{
+     int istat, len;
+
+     if ((istat = weather_data_grow(df, FMT_FLOAT_LEN)) != ERR_OK)
+	  return(istat);
+     for (;;)
+     {
+	  len = fmt_float(df->buf + df->buf_len, df->buf_max - df->buf_len,
+			  ff, val);
+	  if (len < 0)
+	       return(ERR_NO);
+	  else if ((size_t)len < df->buf_max - df->buf_len)
+	       break;
+	  else if ((istat = weather_data_grow(df, (size_t)len)) != ERR_OK)
+	       return(istat);
+     }
+     df->buf_len += (size_t)len;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Close the open data file, if any, first flushing it to disk if any
+ *  records remain unsynced
+ */
+static int
+weather_data_close(weather_dfile_t *df)
+{
+     int istat;
+
+     istat = ERR_OK;
+     if (df->fd >= 0)
+     {
+	  if (df->dirty && fsync(df->fd))
+	  {
+	       debug("weather_data_close(%d): Unable to flush the data file "
+		     "\"%s\" to disk; fsync(%d) call failed; errno=%d; %s",
+		     __LINE__, df->fname ? df->fname : "(null)", df->fd,
+		     errno, strerror(errno));
+	       istat = ERR_NO;
+	  }
+	  if (close(df->fd))
+	  {
+	       debug("weather_data_close(%d): Error closing the data file "
+		     "\"%s\"; close(%d) call failed; errno=%d; %s",
+		     __LINE__, df->fname ? df->fname : "(null)", df->fd,
+		     errno, strerror(errno));
+	       istat = ERR_NO;
+	  }
+	  df->fd    = -1;
+	  df->dirty = 0;
+     }
+     if (df->fname)
+     {
+	  free(df->fname);
+	  df->fname = NULL;
+     }
+
+     return(istat);
+}
+
+
+/*
+ *  Open the data file for the cycle at tavg, first closing out the
+ *  previous day's file should this cycle start a new day.  The file is
+ *  left as is when it is already open; otherwise *opened is set.
+ */
+static int
+weather_data_open(weather_dfile_t *df, time_t tavg, const char *fpath,
+		  const char *suffix, int flags, int *opened)
+{
+     char *fname;
+     int istat;
+
+     fname = NULL;
+     istat = weather_data_fname(&fname, tavg, 0, fpath, suffix);
+     if (istat != ERR_OK)
+     {
+	  debug("weather_data_open(%d): Unable to generate a data file name; "
+		"weather_data_fname(%d) returned %d; %s",
+		__LINE__, istat, err_strerror(istat));
+	  return(istat);
+     }
+     else if (!fname)
+     {
+	  debug("weather_data_open(%d): weather_data_fname() returned a "
+		"success but no file name pointer; coding error?",
+		__LINE__);
+	  return(ERR_NO);
+     }
+
+     /*
+      *  A new day means a new data file; close out the old one
+      */
+     if (df->fd >= 0 && strcmp(fname, df->fname))
+	  weather_data_close(df);
+
+     if (opened)
+	  *opened = 0;
+     if (df->fd >= 0)
+     {
+	  free(fname);
+	  return(ERR_OK);
+     }
+
+     /*
+      *  Now open the file in append mode
+      */
+     df->fd = open(fname, O_WRONLY | O_APPEND | O_CREAT | flags, 0644);
+     if (df->fd < 0)
+     {
+	  debug("weather_data_open(%d): Unable to open a data file; "
+		"open(\"%s\", O_APPEND | O_CREAT, 0644) call failed; "
+		"errno=%d; %s",
+		__LINE__, fname, errno, strerror(errno));
+	  free(fname);
+	  return(ERR_NO);
+     }
+     df->fname  = fname;
+     df->dirty  = 0;
+     df->synced = time(NULL);
+     if (opened)
+	  *opened = 1;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Append the record formatted in the data file's buffer with a single
+ *  write, only looping should the write come up short, and then flush
+ *  it to disk as per the fsync policy
+ */
+static int
+weather_data_append(weather_dfile_t *df)
+{
+     const char *ptr;
+     size_t len;
+     ssize_t nwritten;
+     time_t now;
+
+     ptr = df->buf;
+     len = df->buf_len;
+     while (len)
+     {
+	  nwritten = write(df->fd, ptr, len);
+	  if (nwritten < 0)
+	  {
+	       if (errno == EINTR)
+		    continue;
+	       goto write_error;
+	  }
+	  ptr += nwritten;
+	  len -= (size_t)nwritten;
+     }
+     df->dirty++;
+
+     /*
+      *  Flush the data as per the fsync policy
+      */
+     if (df->sync == WEATHER_FSYNC_RECORD ||
+	 (df->sync > 0 && ((now = time(NULL)) - df->synced >= df->sync ||
+			   now < df->synced)))
+     {
+	  if (fsync(df->fd))
+	       goto write_error;
+	  df->dirty  = 0;
+	  df->synced = time(NULL);
+     }
+
+     return(ERR_OK);
+
+write_error:
+     debug("weather_data_append(%d): A write error occurred whilst "
+	   "appending data to the data file \"%s\"; errno=%d; %s",
+	   __LINE__, df->fname, errno, strerror(errno));
+
+     /*
+      *  Start afresh with the next record
+      */
+     weather_data_close(df);
+     return(ERR_NO);
+}
+
+
+static int
+weather_data_write(weather_dfile_t *df, device_t *devices,
+		   const dev_snapshot_t *snaps, time_t tavg, int *first,
+		   const char *fpath)
+{
+     device_t *dev;
+     size_t i, istat, n;
+     const dev_snapshot_t *snap;
+     struct stat sbuf;
+
+     if (do_trace)
+	  trace("weather_data_write(%d): Called with df=%p, devices=%p, "
+		"snaps=%p, tavg=%u, first=%p; *first=%d, fpath=\"%s\" (%p)",
+		__LINE__, df, devices, snaps, tavg, first, first ? *first : 0,
+		fpath ? fpath : "(null)", fpath);
+
+     if (!df || !devices || !snaps)
+     {
+	  debug("weather_data_write(%d): Invalid call arguments; df=%p, "
+		"devices=%p, snaps=%p", __LINE__, df, devices, snaps);
+	  return(ERR_BADARGS);
+     }
+
+     istat = weather_data_open(df, tavg, fpath, ".dat", O_TEXT, NULL);
+     if (istat != ERR_OK)
+	  return(istat);
+
+     /*
+      *  If the file is new, then write a preamble into it
+      */
+     df->buf_len = 0;
+     if ((first && *first) || (!fstat(df->fd, &sbuf) && sbuf.st_size == 0))
+     {
+	  long tm_gmtoff;
+	  const char *tm_zone;
+	  char zbuf[64];
+
+	  if (first)
+	       *first = 0;
+
+	  os_tzone(&tm_gmtoff, &tm_zone, zbuf, sizeof(zbuf));
+	  if (weather_data_printf(df,
+"#ha7netd v%d.%d (compiled " __DATE__ " " __TIME__ ")\n"
+"#All time units are seconds since 00:00 1 Jan 1970 %c%02d%02d (%s)\n"
+"#<column>:<ROM id>:<format>:<units>:<type>:<description>\n"
+"#1::%%u:s:time_t:Seconds since 1 Jan 1970 00:00\n",
+		  WEATHER_VERSION_MAJOR, WEATHER_VERSION_MINOR,
+		  (tm_gmtoff >= 0) ? '+' : '-', abs(tm_gmtoff / 3600),
+		  abs(tm_gmtoff / 60) % 60, tm_zone))
+	       goto format_error;
+
+	  dev = devices;
+	  n = 1;
+	  while (!dev_flag_test(dev, DEV_FLAGS_END))
+	  {
+	       if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+		   !dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
+		    goto skip_me1;
+	       for (i = 0; i < NVALS; i++)
+	       {
+		    if (dev->data.fld_used[i] != DEV_FLD_USED)
+			 continue;
+		    n++;
+		    if (weather_data_printf(df, "#%u:%s:%s:%s:%s:%s\n",
+			    (unsigned int)n, dev_romid(dev),
+			    dev->data.fld_format[i] ?
+			      dev->data.fld_format[i] : "%f",
+			    dev_unitstr(dev->data.fld_units[i]),
+			    dev_dtypestr(dev->data.fld_dtype[i]),
+			    dev_dtypedescstr(dev->data.fld_dtype[i])))
+			 goto format_error;
+	       }
+	  skip_me1:
+	       dev++;
+	  }
+     }
+
+     /*
+      *  Time stamp
+      */
+     if (weather_data_printf(df, "%ld", tavg))
+	  goto format_error;
+
+     dev = devices;
+     while (!dev_flag_test(dev, DEV_FLAGS_END))
+     {
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
+	       goto skip_me2;
+	  snap = &snaps[dev - devices];
+	  for (i = 0; i < NVALS; i++)
+	  {
+	       if (dev->data.fld_used[i] != DEV_FLD_USED)
+		    continue;
+
+	       if (weather_data_printf(df, " "))
+		    goto format_error;
+
+	       if (snap->time[i] != DEV_MISSING_TVALUE)
+		    istat = weather_data_value(df, &dev->data.fld_fmt[i],
+					       snap->val[i]);
+	       else
+		    istat = weather_data_printf(df, "%c", DEV_MISSING_VALUE);
+	       if (istat != ERR_OK)
+		    goto format_error;
+	  }
+     skip_me2:
+	  dev++;
+     }
+
+     /*
+      *  And a record terminator
+      */
+     if (weather_data_printf(df, "\n"))
+	  goto format_error;
+
+     return(weather_data_append(df));
+
+format_error:
+     debug("weather_data_write(%d): Unable to format a record for the data "
+	   "file \"%s\"", __LINE__, df->fname);
+     return(ERR_NO);
+}
+
+
+/*
+ *  Append a cycle's record to the day's binary data file, first writing
+ *  a segment header describing the columns when the file is new or
+ *  *first is set.  A record whose write was cut short would misalign
+ *  all which follow it, so any partial record left at the end of the
+ *  file by a prior run is cut off when the file is opened.
+ */
+static int
+weather_bdat_write(weather_dfile_t *df, device_t *devices,
+		   const dev_snapshot_t *snaps, time_t tavg, int *first,
+		   const char *fpath)
+{
+     const char *base;
+     device_t *dev;
+     char *rec;
+     size_t i, len, n, ncols;
+     int istat, opened;
+     const dev_snapshot_t *snap;
+     struct stat sbuf;
+
+     if (do_trace)
+	  trace("weather_bdat_write(%d): Called with df=%p, devices=%p, "
+		"snaps=%p, tavg=%u, first=%p; *first=%d, fpath=\"%s\" (%p)",
+		__LINE__, df, devices, snaps, tavg, first, first ? *first : 0,
+		fpath ? fpath : "(null)", fpath);
+
+     if (!df || !devices || !snaps)
+     {
+	  debug("weather_bdat_write(%d): Invalid call arguments; df=%p, "
+		"devices=%p, snaps=%p", __LINE__, df, devices, snaps);
+	  return(ERR_BADARGS);
+     }
+
+     istat = weather_data_open(df, tavg, fpath, ".bdat", O_BINARY, &opened);
+     if (istat != ERR_OK)
+	  return(istat);
+
+     if (fstat(df->fd, &sbuf))
+	  sbuf.st_size = 0;
+     if (opened && sbuf.st_size > 0)
+     {
+	  if (os_mmap(df->fname, &base, &len))
+	  {
+	       debug("weather_bdat_write(%d): Unable to read the binary data "
+		     "file \"%s\"; os_mmap() call failed; errno=%d; %s",
+		     __LINE__, df->fname, errno, strerror(errno));
+	       goto close_error;
+	  }
+	  n = bdat_len(base, len);
+	  os_munmap(base, len);
+	  if (n == (size_t)-1)
+	  {
+	       debug("weather_bdat_write(%d): The file \"%s\" is not a binary "
+		     "data file for this host; not appending to it",
+		     __LINE__, df->fname);
+	       goto close_error;
+	  }
+	  else if (n < len)
+	  {
+	       if (ftruncate(df->fd, (off_t)n))
+	       {
+		    debug("weather_bdat_write(%d): Unable to remove a partial "
+			  "record from the end of the binary data file "
+			  "\"%s\"; ftruncate() call failed; errno=%d; %s",
+			  __LINE__, df->fname, errno, strerror(errno));
+		    goto close_error;
+	       }
+	       sbuf.st_size = (off_t)n;
+	  }
+     }
+
+     /*
+      *  Count the columns
+      */
+     ncols = 0;
+     for (dev = devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+     {
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
+	       continue;
+	  for (i = 0; i < NVALS; i++)
+	       if (dev->data.fld_used[i] == DEV_FLD_USED)
+		    ncols++;
+     }
+
+     df->buf_len = 0;
+     if (weather_data_grow(df, BDAT_HDR_LEN(ncols) + BDAT_REC_LEN(ncols)))
+	  return(ERR_NOMEM);
+
+     /*
+      *  If the file is new, then start it with a segment header
+      */
+     if ((first && *first) || sbuf.st_size == 0)
+     {
+	  long tm_gmtoff;
+	  const char *tm_zone;
+	  char zbuf[64];
+	  bdat_col_t *col;
+
+	  if (first)
+	       *first = 0;
+
+	  os_tzone(&tm_gmtoff, &tm_zone, zbuf, sizeof(zbuf));
+	  bdat_hdr_init((bdat_hdr_t *)df->buf, ncols, tm_gmtoff, tm_zone,
+			WEATHER_VERSION_MAJOR, WEATHER_VERSION_MINOR);
+	  col = (bdat_col_t *)(df->buf + sizeof(bdat_hdr_t));
+	  for (dev = devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+	  {
+	       if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+		   !dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
+		    continue;
+	       for (i = 0; i < NVALS; i++)
+	       {
+		    if (dev->data.fld_used[i] != DEV_FLD_USED)
+			 continue;
+		    bdat_col_init(col++, dev_romid(dev),
+				  dev->data.fld_format[i] ?
+				    dev->data.fld_format[i] : "%f",
+				  dev_unitstr(dev->data.fld_units[i]),
+				  dev_dtypestr(dev->data.fld_dtype[i]),
+				  dev_dtypedescstr(dev->data.fld_dtype[i]));
+	       }
+	  }
+	  df->buf_len = BDAT_HDR_LEN(ncols);
+     }
+
+     /*
+      *  And the record itself; missing values are left as NaNs
+      */
+     rec = df->buf + df->buf_len;
+     bdat_rec_init(rec, ncols, tavg, NULL);
+     n = 0;
+     for (dev = devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+     {
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
+	       continue;
+	  snap = &snaps[dev - devices];
+	  for (i = 0; i < NVALS; i++)
+	  {
+	       if (dev->data.fld_used[i] != DEV_FLD_USED)
+		    continue;
+	       if (snap->time[i] != DEV_MISSING_TVALUE)
+		    bdat_rec_set(rec, n, snap->val[i]);
+	       n++;
+	  }
+     }
+     df->buf_len += BDAT_REC_LEN(ncols);
+
+     return(weather_data_append(df));
+
+close_error:
+     weather_data_close(df);
+     return(ERR_NO);
+}
+
+
+/*
+ *  Returns 1 when none of the device's latest values are present
+ */
+static int
+weather_dev_missing(const device_t *dev, const dev_snapshot_t *snap)
+{
+     int i;
+
+     for (i = 0; i < NVALS; i++)
+	  if (dev->data.fld_used[i] && snap->time[i] != DEV_MISSING_TVALUE)
+	       return(0);
+     return(1);
+}
+
+
+static int
+weather_xml_write(device_t *devices, const dev_snapshot_t *snaps, int period,
+		  weather_info_t *winfo)
+{
+     xml_out_t ctx;
+     device_t *dev;
+     int istat;
+
+     if (do_trace)
+	  trace("weather_xml_write(%d): Called with devices=%p, snaps=%p, "
+		"period=%d, winfo=%p", __LINE__, devices, snaps, period, winfo);
+
+     /*
+      *  Test our inputs
+      */
+     if (!devices || !snaps || !winfo)
+     {
+	  debug("weather_xml_write(%d): Invalid call arguments supplied; "
+		"devices=%p, snaps=%p, winfo=%p",
+		__LINE__, devices, snaps, winfo);
+	  return(ERR_BADARGS);
+     }
+
+     /*
+      *  Open a temporary file
+      */
+     istat = xml_open(&ctx, &winfo->wsinfo, winfo->fname_prefix);
+     if (istat != ERR_OK)
+     {
+	  detail("weather_xml_write(%d): Unable to open a temporary output "
+		 "file; xml_open() returned %d; %s",
+		 __LINE__, istat, err_strerror(istat));
+	  return(istat);
+     }
+
+     /*
+      *  Write the data to the XML file
+      */
+     dev = devices;
+     while (!dev_flag_test(dev, DEV_FLAGS_END))
+     {
+	  /*
+	   *  Ignore devices which should not be probed
+	   */
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED) ||
+	      weather_dev_missing(dev, &snaps[dev - devices]))
+	       goto skip_me;
+
+	  /*
+	   *  Write the record
+	   */
+	  istat = xml_write(&ctx, dev, &snaps[dev - devices], period,
+			    winfo->title);
+	  if (istat != ERR_OK)
+	       detail("weather_xml_write(%d): Unable to record data for the "
+		      "device with id=\"%s\" (%s); xml_write() returned %d; "
+		      "%s", __LINE__, dev_romid(dev),
+		      dev_strfcode(dev_fcode(dev)), istat,
+		      err_strerror(istat));
+     skip_me:
+	  dev++;
+     }
+
+     /*
+      *  Finally produce a web page of the current data
+      */
+     istat = xml_tohtml(&ctx, winfo->cmd, NULL, 0);
+     if (istat != ERR_OK)
+	  detail("weather_xml_write(%d): Error generating HTML output; "
+		 "xml_tohtml() returned %d; %s",
+		 __LINE__, istat, err_strerror(istat));
+
+     /*
+      *  All done
+      */
+done:
+     return(istat);
+}
+
+/*
+ *  The rollup tiers are saved to the file <fpath>.tiers each time an hour's
+ *  bins close and at shutdown, stamped with the time of the last cycle
+ *  they include, and reloaded at startup.  The records of the data files
+ *  later than the stamp are then added to them as they are loaded or
+ *  replayed.  Each save is first copied to an image in memory by
+ *  weather_tiers_image() and then written out by weather_image_write().
+ *  The file is in the host's native byte order and is not intended for
+ *  exchange between hosts:
+ *
+ *    "HA7TIERS" sizeof(dev_rollup_t) saved
+ *    { romid[OWIRE_ID_LEN] fld k width nbins dev_rollup_t[nbins] } ...
+ *
+ *  with fld, k, width, nbins, and sizeof(dev_rollup_t) each an
+ *  unsigned int and saved a time_t.
+ */
+
+#define TIERS_MAGIC     "HA7TIERS"
+#define TIERS_MAGIC_LEN 8
+
+static int
+weather_tiers_fname(char **fname, const char *fpath, const char *suffix)
+{
+     size_t len1, len2;
+
+     len1 = fpath ? strlen(fpath) : 0;
+     len2 = strlen(suffix);
+     *fname = (char *)malloc(len1 + len2 + 1);
+     if (!(*fname))
+     {
+	  debug("weather_tiers_fname(%d): Insufficient virtual memory",
+		__LINE__);
+	  return(ERR_NOMEM);
+     }
+     if (len1)
+	  memcpy(*fname, fpath, len1);
+     memcpy(*fname + len1, suffix, len2 + 1);
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Write the image of a file to <fpath><suffix>.  It goes to a temporary
+ *  file which is pushed to disk and then renamed so that a crash at any
+ *  point leaves a complete file in place.
+ */
+static int
+weather_image_write(const weather_dfile_t *df, const char *fpath,
+		    const char *suffix)
+{
+     char *fname, *tname;
+     FILE *fp;
+     int istat;
+     size_t len;
+
+     fname = NULL;
+     tname = NULL;
+     fp    = NULL;
+     if (ERR_OK != (istat = weather_tiers_fname(&fname, fpath, suffix)))
+	  goto done;
+     len = strlen(fname);
+     if (!(tname = (char *)malloc(len + 5)))
+     {
+	  debug("weather_image_write(%d): Insufficient virtual memory",
+		__LINE__);
+	  istat = ERR_NOMEM;
+	  goto done;
+     }
+     memcpy(tname, fname, len);
+     memcpy(tname + len, ".tmp", 5);
+
+     fp = fopen(tname, "wb");
+     if (!fp)
+     {
+	  debug("weather_image_write(%d): Unable to open the file \"%s\"; "
+		"fopen() call failed; errno=%d; %s",
+		__LINE__, tname, errno, strerror(errno));
+	  istat = ERR_NO;
+	  goto done;
+     }
+     if ((df->buf_len && 1 != fwrite(df->buf, df->buf_len, 1, fp)) ||
+	 fflush(fp) || fsync(fileno(fp)))
+	  goto write_error;
+     istat = fclose(fp);
+     fp = NULL;
+     if (istat)
+	  goto write_error;
+
+     if (rename(tname, fname))
+     {
+	  debug("weather_image_write(%d): Unable to rename the file; "
+		"rename(\"%s\", \"%s\") call failed; errno=%d; %s",
+		__LINE__, tname, fname, errno, strerror(errno));
+	  istat = ERR_NO;
+	  goto done;
+     }
+     if (do_debug)
+	  debug("weather_image_write(%d): Saved \"%s\"", __LINE__, fname);
+     istat = ERR_OK;
+     goto done;
+
+write_error:
+     debug("weather_image_write(%d): Error writing to the file \"%s\"; "
+	   "errno=%d; %s", __LINE__, tname, errno, strerror(errno));
+     istat = ERR_WRITE;
+
+done:
+     if (fp)
+	  fclose(fp);
+     if (istat != ERR_OK && tname)
+	  remove(tname);
+     if (fname)
+	  free(fname);
+     if (tname)
+	  free(tname);
+
+     return(istat);
+}
+
+
+/*
+ *  Copy the rollup tiers into df as the contents of <fpath>.tiers, stamped
+ *  with the time saved
+ */
+static int
+weather_tiers_image(device_t *devices, weather_dfile_t *df, time_t saved)
+{
+     device_t *dev;
+     int istat;
+     unsigned int hdr[4];
+     size_t i, k;
+
+     if (do_trace)
+	  trace("weather_tiers_image(%d): Called with devices=%p, df=%p, "
+		"saved=%ld", __LINE__, devices, df, (long)saved);
+
+     if (!devices || !df)
+     {
+	  debug("weather_tiers_image(%d): Invalid call arguments; "
+		"devices=%p, df=%p", __LINE__, devices, df);
+	  return(ERR_BADARGS);
+     }
+
+     df->buf_len = 0;
+     hdr[0] = (unsigned int)sizeof(dev_rollup_t);
+     if (ERR_OK != (istat = weather_data_put(df, TIERS_MAGIC,
+					     TIERS_MAGIC_LEN)) ||
+	 ERR_OK != (istat = weather_data_put(df, hdr, sizeof(unsigned int))) ||
+	 ERR_OK != (istat = weather_data_put(df, &saved, sizeof(time_t))))
+	  return(istat);
+
+     for (dev = devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+     {
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
+	       continue;
+	  dev_lock(dev);
+	  for (i = 0; i < NVALS; i++)
+	  {
+	       for (k = 0; k < NTIERS; k++)
+	       {
+		    if (!dev->data.tier[k][i])
+			 continue;
+		    hdr[0] = (unsigned int)i;
+		    hdr[1] = (unsigned int)k;
+		    hdr[2] = (unsigned int)dev_tier_widths[k];
+		    hdr[3] = (unsigned int)dev->data.tier_nbins[k];
+		    if (ERR_OK != (istat = weather_data_put(df, dev_romid(dev),
+							    OWIRE_ID_LEN)) ||
+			ERR_OK != (istat = weather_data_put(df, hdr,
+						 4 * sizeof(unsigned int))) ||
+			ERR_OK != (istat = weather_data_put(df,
+						 dev->data.tier[k][i],
+						 (size_t)hdr[3] *
+						   sizeof(dev_rollup_t))))
+		    {
+			 dev_unlock(dev);
+			 return(istat);
+		    }
+	       }
+	  }
+	  dev_unlock(dev);
+     }
+
+     return(ERR_OK);
+}
+
+
+static int
+weather_tiers_read(device_t *devices, const dev_index_t *index,
+		   const char *fpath)
+{
+     device_t *dev;
+     dev_rollup_t *b, *saved, *tier;
+     char *fname, magic[TIERS_MAGIC_LEN], romid[OWIRE_ID_LEN];
+     FILE *fp;
+     int istat;
+     unsigned int hdr[4];
+     size_t j, nbins, nsaved;
+     time_t tsaved;
+
+     if (do_trace)
+	  trace("weather_tiers_read(%d): Called with devices=%p, index=%p, "
+		"fpath=\"%s\" (%p)",
+		__LINE__, devices, index, fpath ? fpath : "(null)", fpath);
+
+     if (!devices || !index)
+     {
+	  debug("weather_tiers_read(%d): Invalid call arguments; "
+		"devices=%p, index=%p", __LINE__, devices, index);
+	  return(ERR_BADARGS);
+     }
+
+     fname  = NULL;
+     fp     = NULL;
+     saved  = NULL;
+     nsaved = 0;
+     if (ERR_OK != (istat = weather_tiers_fname(&fname, fpath, ".tiers")))
+	  goto done;
+
+     fp = fopen(fname, "rb");
+     if (!fp)
+     {
+	  /*
+	   *  Nothing saved yet is not an error
+	   */
+	  if (errno != ENOENT)
+	       debug("weather_tiers_read(%d): Unable to open the file "
+		     "\"%s\"; fopen() call failed; errno=%d; %s",
+		     __LINE__, fname, errno, strerror(errno));
+	  istat = (errno == ENOENT) ? ERR_EOM : ERR_NO;
+	  goto done;
+     }
+
+     if (1 != fread(magic, TIERS_MAGIC_LEN, 1, fp) ||
+	 memcmp(magic, TIERS_MAGIC, TIERS_MAGIC_LEN) ||
+	 1 != fread(hdr, sizeof(unsigned int), 1, fp) ||
+	 hdr[0] != (unsigned int)sizeof(dev_rollup_t) ||
+	 1 != fread(&tsaved, sizeof(time_t), 1, fp))
+     {
+	  debug("weather_tiers_read(%d): The file \"%s\" is not a rollup "
+		"tier file for this host; ignoring it", __LINE__, fname);
+	  istat = ERR_NO;
+	  goto done;
+     }
+
+     while (1 == fread(romid, OWIRE_ID_LEN, 1, fp) &&
+	    4 == fread(hdr, sizeof(unsigned int), 4, fp))
+     {
+	  nbins = (size_t)hdr[3];
+
+	  /*
+	   *  Locate the device and confirm that its tier has the same
+	   *  bin width as the saved one
+	   */
+	  dev = dev_index_find(index, romid, OWIRE_ID_LEN);
+	  if (!dev || dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED) ||
+	      hdr[0] >= NVALS || hdr[1] >= NTIERS ||
+	      !dev->data.tier[hdr[1]][hdr[0]] ||
+	      hdr[2] != (unsigned int)dev_tier_widths[hdr[1]])
+	  {
+	       /*
+		*  Device no longer present or the tiers have changed
+		*/
+	       if (fseek(fp, (long)(nbins * sizeof(dev_rollup_t)), SEEK_CUR))
+		    break;
+	       continue;
+	  }
+
+	  /*
+	   *  Read the saved bins and then place each where it belongs in
+	   *  the tier as presently sized: the retention may have changed
+	   */
+	  if (nbins > nsaved)
+	  {
+	       b = (dev_rollup_t *)realloc(saved, nbins * sizeof(dev_rollup_t));
+	       if (!b)
+	       {
+		    debug("weather_tiers_read(%d): Insufficient virtual "
+			  "memory", __LINE__);
+		    break;
+	       }
+	       saved  = b;
+	       nsaved = nbins;
+	  }
+	  if (nbins != fread(saved, sizeof(dev_rollup_t), nbins, fp))
+	       break;
+
+	  dev_lock(dev);
+	  tier = dev->data.tier[hdr[1]][hdr[0]];
+	  for (j = 0; j < nbins; j++)
+	  {
+	       if (!saved[j].count)
+		    continue;
+	       b = &tier[saved[j].seq % dev->data.tier_nbins[hdr[1]]];
+	       if (!b->count || b->seq < saved[j].seq)
+		    *b = saved[j];
+	  }
+	  dev->data.tier_after = tsaved;
+	  dev_unlock(dev);
+     }
+
+     if (ferror(fp))
+     {
+	  debug("weather_tiers_read(%d): Error reading the file \"%s\"; "
+		"errno=%d; %s", __LINE__, fname, errno, strerror(errno));
+	  istat = ERR_READ;
+     }
+     else
+	  istat = ERR_OK;
+
+done:
+     if (fp)
+	  fclose(fp);
+     if (saved)
+	  free(saved);
+     if (fname)
+	  free(fname);
+
+     return(istat);
+}
+
+
+/*
+ *  The time up to which the records of the data files are in the rollup
+ *  tiers of every device which has tiers, but no later than after
+ */
+static time_t
+weather_tiers_after(device_t *devices, time_t after)
+{
+     device_t *dev;
+
+     for (dev = devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+     {
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED) || !dev->data.tiers)
+	       continue;
+	  if (dev->data.tier_after < after)
+	       after = dev->data.tier_after;
+     }
+
+     return(after);
+}
+
+#undef TIERS_MAGIC
+#undef TIERS_MAGIC_LEN
+
+
+/*
+ *  The statistics of each device -- its ring buffer, extrema, rolling
+ *  extrema, and running averages -- are saved periodically and at
+ *  shutdown to the file <fpath>.state, stamped with the time of the last
+ *  cycle they include.  At startup, provided that it was saved today, the
+ *  saved state is reloaded and only the records of today's data file
+ *  later than that are replayed rather than the day's data files in full.
+ *  As with the rollup tiers, the file is in the host's native byte order
+ *  and is not intended for exchange between hosts:
+ *
+ *    "HA7STATE" hdr[8] saved
+ *    { romid[OWIRE_ID_LEN] npast n_current n_previous mask fld_used[NVALS]
+ *      time[npast] { val[i][npast] } ...
+ *      last_time[NVALS] last_val[NVALS] today yesterday rolling[NROLL] avgs
+ *      { lo[i] hi[i] } ... } ...
+ *
+ *  where the val[i] and the deques lo[i] and hi[i] are present for each
+ *  bit i set in mask, a deque is stored as front[NROLL] back slot[npast],
+ *  and hdr[] records the version and the sizes of the stored types.
+ */
+
+#define STATE_MAGIC     "HA7STATE"
+#define STATE_MAGIC_LEN 8
+#define STATE_VERSION   1
+#define STATE_HDR_LEN   8
+
+static void
+weather_state_hdr(unsigned int *hdr)
+{
+     hdr[0] = STATE_VERSION;
+     hdr[1] = (unsigned int)sizeof(time_t);
+     hdr[2] = (unsigned int)sizeof(hi_lo_t);
+     hdr[3] = (unsigned int)sizeof(averages_t);
+     hdr[4] = (unsigned int)sizeof(unsigned long);
+     hdr[5] = NVALS;
+     hdr[6] = NPERS;
+     hdr[7] = NROLL;
+}
+
+
+/*
+ *  Length of a device's saved state, excluding its ROM id and header
+ */
+static size_t
+weather_state_len(size_t npast, unsigned int mask)
+{
+     size_t i, len, nvals;
+
+     nvals = 0;
+     for (i = 0; i < NVALS; i++)
+	  if (mask & (1U << i))
+	       nvals++;
+
+     len = NVALS * sizeof(int) +
+	  npast * sizeof(time_t) +
+	  nvals * npast * sizeof(float) +
+	  NVALS * (sizeof(time_t) + sizeof(float)) +
+	  (2 + NROLL) * sizeof(hi_lo_t) +
+	  sizeof(averages_t) +
+	  nvals * 2 * ((NROLL + 1) * sizeof(unsigned long) +
+		       npast * sizeof(unsigned int));
+
+     return(len);
+}
+
+
+static unsigned int
+weather_state_mask(const device_t *dev)
+{
+     size_t i;
+     unsigned int mask;
+
+     mask = 0;
+     for (i = 0; i < NVALS; i++)
+	  if (dev->data.val[i])
+	       mask |= 1U << i;
+
+     return(mask);
+}
+
+
+/*
+ *  Copy the state of each device into df as the contents of
+ *  <fpath>.state, stamped with the time saved
+ */
+static int
+weather_state_image(device_t *devices, weather_dfile_t *df, time_t saved)
+{
+     device_t *dev;
+     dev_deque_t *dq;
+     int istat;
+     unsigned int hdr[STATE_HDR_LEN];
+     size_t i, j, npast;
+
+     if (do_trace)
+	  trace("weather_state_image(%d): Called with devices=%p, df=%p, "
+		"saved=%ld", __LINE__, devices, df, (long)saved);
+
+     if (!devices || !df)
+     {
+	  debug("weather_state_image(%d): Invalid call arguments; "
+		"devices=%p, df=%p", __LINE__, devices, df);
+	  return(ERR_BADARGS);
+     }
+
+#define STATE_PUT(src, len) \
+     if (ERR_OK != (istat = weather_data_put(df, (src), (len)))) \
+	  goto done
+
+     df->buf_len = 0;
+     dev = NULL;
+     weather_state_hdr(hdr);
+     STATE_PUT(STATE_MAGIC, STATE_MAGIC_LEN);
+     STATE_PUT(hdr, STATE_HDR_LEN * sizeof(unsigned int));
+     STATE_PUT(&saved, sizeof(time_t));
+
+     for (dev = devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+     {
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED) ||
+	      !dev->data.time)
+	       continue;
+	  dev_lock(dev);
+	  npast  = dev->data.npast;
+	  hdr[0] = (unsigned int)npast;
+	  hdr[1] = (unsigned int)dev->data.n_current;
+	  hdr[2] = (unsigned int)dev->data.n_previous;
+	  hdr[3] = weather_state_mask(dev);
+	  STATE_PUT(dev_romid(dev), OWIRE_ID_LEN);
+	  STATE_PUT(hdr, 4 * sizeof(unsigned int));
+	  STATE_PUT(dev->data.fld_used, NVALS * sizeof(int));
+	  STATE_PUT(dev->data.time, npast * sizeof(time_t));
+	  for (i = 0; i < NVALS; i++)
+	       if (dev->data.val[i])
+	       {
+		    STATE_PUT(dev->data.val[i], npast * sizeof(float));
+	       }
+	  STATE_PUT(dev->data.last_time, NVALS * sizeof(time_t));
+	  STATE_PUT(dev->data.last_val, NVALS * sizeof(float));
+	  STATE_PUT(&dev->data.today, sizeof(hi_lo_t));
+	  STATE_PUT(&dev->data.yesterday, sizeof(hi_lo_t));
+	  STATE_PUT(dev->data.rolling, NROLL * sizeof(hi_lo_t));
+	  STATE_PUT(&dev->data.avgs, sizeof(averages_t));
+	  for (i = 0; i < NVALS; i++)
+	  {
+	       if (!dev->data.val[i])
+		    continue;
+	       for (j = 0; j < 2; j++)
+	       {
+		    dq = j ? &dev->data.roll.hi[i] : &dev->data.roll.lo[i];
+		    STATE_PUT(dq->front, NROLL * sizeof(unsigned long));
+		    STATE_PUT(&dq->back, sizeof(unsigned long));
+		    STATE_PUT(dq->slot, npast * sizeof(unsigned int));
+	       }
+	  }
+	  dev_unlock(dev);
+     }
+     dev = NULL;
+     istat = ERR_OK;
+
+done:
+     if (dev)
+	  dev_unlock(dev);
+
+#undef STATE_PUT
+
+     return(istat);
+}
+
+
+/*
+ *  Locate the device which the saved state at ptr belongs to and confirm
+ *  that it has the same layout and averaging periods as the device.  The
+ *  length of the saved state is returned in *rlen.  Returns ERR_OK, ERR_NO
+ *  when the saved state does not fit the device, or ERR_EOM when the file
+ *  ends part way through it.
+ */
+static int
+weather_state_dev(const char *ptr, const char *end, const dev_index_t *index,
+		  device_t **dev, size_t *rlen)
+{
+     averages_t avgs;
+     device_t *d;
+     const char *p;
+     int fld_used[NVALS];
+     unsigned int hdr[4];
+     unsigned long pos[NROLL + 1];
+     unsigned int slot;
+     size_t i, j, k, npast;
+
+     *dev = NULL;
+     if ((size_t)(end - ptr) < OWIRE_ID_LEN + sizeof(hdr))
+	  return(ERR_EOM);
+     memcpy(hdr, ptr + OWIRE_ID_LEN, sizeof(hdr));
+     npast = (size_t)hdr[0];
+     if (hdr[3] >> NVALS)
+	  return(ERR_NO);
+     *rlen = OWIRE_ID_LEN + sizeof(hdr) + weather_state_len(npast, hdr[3]);
+     if ((size_t)(end - ptr) < *rlen)
+	  return(ERR_EOM);
+
+     d = dev_index_find(index, ptr, OWIRE_ID_LEN);
+     if (!d || dev_flag_test(d, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	 !dev_flag_test(d, DEV_FLAGS_INITIALIZED) || !d->data.time ||
+	 npast != d->data.npast || !npast ||
+	 hdr[1] >= npast || hdr[2] >= npast ||
+	 hdr[3] != weather_state_mask(d))
+	  return(ERR_NO);
+
+     p = ptr + OWIRE_ID_LEN + sizeof(hdr);
+     memcpy(fld_used, p, sizeof(fld_used));
+     if (memcmp(fld_used, d->data.fld_used, sizeof(fld_used)))
+	  return(ERR_NO);
+
+     /*
+      *  The running averages must be over the same periods, and their
+      *  windows and the rolling extrema's deques must lie within the
+      *  ring buffer
+      */
+     p += sizeof(fld_used) + npast * sizeof(time_t);
+     for (i = 0; i < NVALS; i++)
+	  if (hdr[3] & (1U << i))
+	       p += npast * sizeof(float);
+     p += NVALS * (sizeof(time_t) + sizeof(float)) +
+	  (2 + NROLL) * sizeof(hi_lo_t);
+     memcpy(&avgs, p, sizeof(averages_t));
+     p += sizeof(averages_t);
+     if (memcmp(avgs.period, d->data.avgs.period, sizeof(avgs.period)))
+	  return(ERR_NO);
+     for (i = 0; i < NVALS; i++)
+     {
+	  if (!avgs.primed[i])
+	       continue;
+	  if (avgs.head[i] >= npast)
+	       return(ERR_NO);
+	  for (k = 0; k < NPERS; k++)
+	       if (avgs.tail[i][k] >= npast)
+		    return(ERR_NO);
+     }
+     for (i = 0; i < NVALS; i++)
+     {
+	  if (!(hdr[3] & (1U << i)))
+	       continue;
+	  for (j = 0; j < 2; j++)
+	  {
+	       memcpy(pos, p, sizeof(pos));
+	       p += sizeof(pos);
+	       for (k = 0; k < NROLL; k++)
+		    if (pos[NROLL] - pos[k] > npast ||
+			(k && pos[k] - pos[0] > pos[NROLL] - pos[0]))
+			 return(ERR_NO);
+	       for (k = 0; k < npast; k++, p += sizeof(unsigned int))
+	       {
+		    memcpy(&slot, p, sizeof(unsigned int));
+		    if (slot >= npast)
+			 return(ERR_NO);
+	       }
+	  }
+     }
+
+     *dev = d;
+     return(ERR_OK);
+}
+
+
+/*
+ *  Copy the saved state at ptr, which weather_state_dev() has vetted,
+ *  into the device
+ */
+static void
+weather_state_copy(device_t *dev, const char *ptr)
+{
+     dev_deque_t *dq;
+     unsigned int hdr[4];
+     size_t i, j, npast;
+
+#define STATE_TAKE(dst, len) memcpy((dst), ptr, (len)); ptr += (len)
+
+     ptr += OWIRE_ID_LEN;
+     STATE_TAKE(hdr, sizeof(hdr));
+     ptr += NVALS * sizeof(int);
+     npast = (size_t)hdr[0];
+
+     dev_lock(dev);
+     dev->data.n_current  = (size_t)hdr[1];
+     dev->data.n_previous = (size_t)hdr[2];
+     STATE_TAKE(dev->data.time, npast * sizeof(time_t));
+     for (i = 0; i < NVALS; i++)
+	  if (dev->data.val[i])
+	  {
+	       STATE_TAKE(dev->data.val[i], npast * sizeof(float));
+	  }
+     STATE_TAKE(dev->data.last_time, NVALS * sizeof(time_t));
+     STATE_TAKE(dev->data.last_val, NVALS * sizeof(float));
+     STATE_TAKE(&dev->data.today, sizeof(hi_lo_t));
+     STATE_TAKE(&dev->data.yesterday, sizeof(hi_lo_t));
+     STATE_TAKE(dev->data.rolling, NROLL * sizeof(hi_lo_t));
+     STATE_TAKE(&dev->data.avgs, sizeof(averages_t));
+     for (i = 0; i < NVALS; i++)
+     {
+	  if (!dev->data.val[i])
+	       continue;
+	  for (j = 0; j < 2; j++)
+	  {
+	       dq = j ? &dev->data.roll.hi[i] : &dev->data.roll.lo[i];
+	       STATE_TAKE(dq->front, NROLL * sizeof(unsigned long));
+	       STATE_TAKE(&dq->back, sizeof(unsigned long));
+	       STATE_TAKE(dq->slot, npast * sizeof(unsigned int));
+	  }
+     }
+     dev_unlock(dev);
+
+#undef STATE_TAKE
+}
+
+
+/*
+ *  Reload the device state saved by weather_state_image().  Nothing is
+ *  loaded unless the saved state is from today and covers every device
+ *  in use.  Returns ERR_OK when the state was loaded, along with the time
+ *  it was saved in *saved, ERR_EOM when there is no saved state, and
+ *  ERR_NO when it is stale or does not fit the present devices.
+ */
+static int
+weather_state_read(device_t *devices, const dev_index_t *index,
+		   const char *fpath, time_t *saved)
+{
+     const char *base, *end, *ptr;
+     device_t *dev, **owner;
+     char *fname;
+     int istat;
+     unsigned int hdr[STATE_HDR_LEN], hdr0[STATE_HDR_LEN];
+     size_t len, ndevs, nfound, rlen;
+     struct tm now_tm, saved_tm;
+     time_t now;
+
+     if (do_trace)
+	  trace("weather_state_read(%d): Called with devices=%p, index=%p, "
+		"fpath=\"%s\" (%p)",
+		__LINE__, devices, index, fpath ? fpath : "(null)", fpath);
+
+     if (!devices || !index || !saved)
+     {
+	  debug("weather_state_read(%d): Invalid call arguments; "
+		"devices=%p, index=%p, saved=%p",
+		__LINE__, devices, index, saved);
+	  return(ERR_BADARGS);
+     }
+
+     fname = NULL;
+     owner = NULL;
+     base  = NULL;
+     len   = 0;
+     if (ERR_OK != (istat = weather_tiers_fname(&fname, fpath, ".state")))
+	  goto done;
+
+     if (os_mmap(fname, &base, &len))
+     {
+	  /*
+	   *  Nothing saved yet is not an error
+	   */
+	  if (os_fexists(fname))
+	  {
+	       debug("weather_state_read(%d): Unable to read the file "
+		     "\"%s\"; os_mmap() call failed; errno=%d; %s",
+		     __LINE__, fname, errno, strerror(errno));
+	       istat = ERR_NO;
+	  }
+	  else
+	       istat = ERR_EOM;
+	  goto done;
+     }
+
+     weather_state_hdr(hdr0);
+     if (len < STATE_MAGIC_LEN + sizeof(hdr) + sizeof(time_t) ||
+	 memcmp(base, STATE_MAGIC, STATE_MAGIC_LEN) ||
+	 memcmp(base + STATE_MAGIC_LEN, hdr0, sizeof(hdr)))
+     {
+	  debug("weather_state_read(%d): The file \"%s\" is not a device "
+		"state file for this host and version; ignoring it",
+		__LINE__, fname);
+	  istat = ERR_NO;
+	  goto done;
+     }
+     ptr = base + STATE_MAGIC_LEN + sizeof(hdr);
+     end = base + len;
+     memcpy(saved, ptr, sizeof(time_t));
+     ptr += sizeof(time_t);
+
+     /*
+      *  The state must have been saved today: the records of today's
+      *  data file since then are replayed on top of it
+      */
+     now = time(NULL);
+     localtime_r(&now, &now_tm);
+     localtime_r(saved, &saved_tm);
+     if (*saved <= (time_t)0 || *saved > now ||
+	 saved_tm.tm_year != now_tm.tm_year ||
+	 saved_tm.tm_yday != now_tm.tm_yday)
+     {
+	  if (do_debug)
+	       debug("weather_state_read(%d): The device state in \"%s\" is "
+		     "stale; ignoring it", __LINE__, fname);
+	  istat = ERR_NO;
+	  goto done;
+     }
+
+     /*
+      *  Vet everything before copying anything so that the devices are
+      *  either wholly restored or left for the data files to rebuild
+      */
+     ndevs = 0;
+     for (dev = devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+	  ndevs++;
+     owner = (device_t **)calloc(ndevs + 1, sizeof(device_t *));
+     if (!owner)
+     {
+	  debug("weather_state_read(%d): Insufficient virtual memory",
+		__LINE__);
+	  istat = ERR_NOMEM;
+	  goto done;
+     }
+
+     nfound = 0;
+     for (; ptr < end; ptr += rlen)
+     {
+	  istat = weather_state_dev(ptr, end, index, &dev, &rlen);
+	  if (istat == ERR_EOM)
+	       break;
+	  else if (istat != ERR_OK || owner[dev - devices])
+	       continue;
+	  owner[dev - devices] = dev;
+	  nfound++;
+     }
+     if (ptr != end)
+     {
+	  debug("weather_state_read(%d): The file \"%s\" is truncated; "
+		"ignoring it", __LINE__, fname);
+	  istat = ERR_NO;
+	  goto done;
+     }
+
+     for (dev = devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+     {
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED) ||
+	      !dev->data.time || owner[dev - devices])
+	       continue;
+	  if (do_debug)
+	       debug("weather_state_read(%d): The file \"%s\" has no "
+		     "usable state for the device %s; ignoring it",
+		     __LINE__, fname, dev_romid(dev));
+	  istat = ERR_NO;
+	  goto done;
+     }
+
+     for (ptr = base + STATE_MAGIC_LEN + sizeof(hdr) + sizeof(time_t);
+	  ptr < end; ptr += rlen)
+     {
+	  if (ERR_OK == weather_state_dev(ptr, end, index, &dev, &rlen) &&
+	      owner[dev - devices])
+	  {
+	       weather_state_copy(dev, ptr);
+	       owner[dev - devices] = NULL;
+	  }
+     }
+
+     if (do_debug)
+	  debug("weather_state_read(%d): Restored the state of %u devices "
+		"from \"%s\"", __LINE__, nfound, fname);
+     istat = ERR_OK;
+
+done:
+     os_munmap(base, len);
+     if (owner)
+	  free(owner);
+     if (fname)
+	  free(fname);
+
+     return(istat);
+}
+
+#undef STATE_MAGIC
+#undef STATE_MAGIC_LEN
+#undef STATE_VERSION
+#undef STATE_HDR_LEN
+
+
+/*
+ *  Record a cycle: append it to the data file, and to the binary data
+ *  file when one is kept, and then, if there is a command to transform
+ *  it, write it to the XML file.  As the XML file merely shows current
+ *  conditions, it is skipped when a later cycle is already queued
+ *  (latest == 0) or a shutdown is underway.
+ */
+static int
+weather_cycle_write(weather_queue_t *queue, const weather_cycle_t *cycle,
+		    int latest)
+{
+     int istat, istat2;
+     weather_info_t *winfo = queue->winfo;
+
+     istat = weather_data_write(&queue->dfile, queue->devices, cycle->snap,
+				cycle->tavg, &winfo->first,
+				winfo->fname_prefix);
+     if (istat != ERR_OK)
+	  detail("weather_cycle_write(%d): Error writing data to the "
+		 "cumulative data file; weather_data_write() returned %d; %s",
+		 __LINE__, istat, err_strerror(istat));
+
+     if (winfo->binary)
+     {
+	  istat2 = weather_bdat_write(&queue->bfile, queue->devices,
+				      cycle->snap, cycle->tavg,
+				      &queue->bfirst, winfo->fname_prefix);
+	  if (istat2 != ERR_OK)
+	  {
+	       detail("weather_cycle_write(%d): Error writing data to the "
+		      "binary data file; weather_bdat_write() returned %d; "
+		      "%s", __LINE__, istat2, err_strerror(istat2));
+	       if (istat == ERR_OK)
+		    istat = istat2;
+	  }
+     }
+
+     if (winfo->cmd && winfo->cmd[0] && latest && !shutdown_flag)
+     {
+	  istat2 = weather_xml_write(queue->devices, cycle->snap,
+				     queue->period, winfo);
+	  if (istat2 != ERR_OK)
+	       detail("weather_cycle_write(%d): Error writing current data to "
+		      "an XML file and transforming to HTML; "
+		      "weather_xml_write() returned %d; %s",
+		      __LINE__, istat2, err_strerror(istat2));
+	  if (istat == ERR_OK)
+	       istat = istat2;
+     }
+
+     return(istat);
+}
+
+
+/*
+ *  Write the images of the device state and rollup tiers files
+ */
+static void
+weather_save_write(const weather_save_t *save, const weather_info_t *winfo)
+{
+     int istat;
+
+     if (save->tiers.buf_len)
+     {
+	  istat = weather_image_write(&save->tiers, winfo->fname_prefix,
+				      ".tiers");
+	  if (istat != ERR_OK)
+	       detail("weather_save_write(%d): Unable to save the rollup "
+		      "tiers; weather_image_write() returned %d; %s",
+		      __LINE__, istat, err_strerror(istat));
+     }
+     if (save->state.buf_len)
+     {
+	  istat = weather_image_write(&save->state, winfo->fname_prefix,
+				      ".state");
+	  if (istat != ERR_OK)
+	       detail("weather_save_write(%d): Unable to save the device "
+		      "state; weather_image_write() returned %d; %s",
+		      __LINE__, istat, err_strerror(istat));
+     }
+}
+
+
+/*
+ *  The writer thread: record each queued cycle in turn, and write each
+ *  image of the saved state handed over, until the queue is both empty
+ *  and done
+ */
+static void *
+weather_writer(void *ctx)
+{
+     weather_queue_t *queue = (weather_queue_t *)ctx;
+     weather_save_t *save;
+     unsigned int head, tail;
+
+     tail = queue->tail;
+     for (;;)
+     {
+	  /*
+	   *  Wait for the sampling thread should there be nothing to
+	   *  record, and then claim the next cycle so that it is not
+	   *  dropped from under us
+	   */
+	  os_pthread_mutex_lock(&queue->mutex);
+	  while (tail == os_load_acquire(&queue->head) && !queue->spending &&
+		 !queue->done)
+	       os_pthread_cond_wait(&queue->cond, &queue->mutex);
+	  head = os_load_acquire(&queue->head);
+	  if (tail == head)
+	  {
+	       /*
+		*  With the cycles recorded, write any saved state handed
+		*  over to us
+		*/
+	       if (queue->spending)
+	       {
+		    save = queue->swrite;
+		    queue->swrite   = queue->snext;
+		    queue->snext    = save;
+		    queue->spending = 0;
+		    os_pthread_mutex_unlock(&queue->mutex);
+		    weather_save_write(queue->swrite, queue->winfo);
+		    continue;
+	       }
+	       os_pthread_mutex_unlock(&queue->mutex);
+	       break;
+	  }
+	  queue->claimed = tail + 1;
+	  os_pthread_mutex_unlock(&queue->mutex);
+
+	  (void)weather_cycle_write(queue, &queue->cycle[tail % WEATHER_QLEN],
+				    head == tail + 1);
+	  os_store_release(&queue->tail, ++tail);
+     }
 
-write_error:
-     if (fp)
-	  fclose(fp);
-     debug("weather_data_write(%d): A write error occurred whilst appending "
-	   "data to the data file; fprintf() call failed; errno=%d; %s",
-	   __LINE__, errno, strerror(errno));
-     return(ERR_NO);
+     return(NULL);
 }
 
 
+/*
+ *  Allocate the queue's snapshots and start the writer thread.  Should
+ *  the thread fail to start, cycles are instead recorded as they are
+ *  queued.
+ */
 static int
-weather_xml_write(device_t *devices, int period, weather_info_t *winfo)
+weather_queue_init(weather_queue_t *queue, device_t *devices, int period,
+		   weather_info_t *winfo)
 {
-     xml_out_t ctx;
-     device_t *dev;
+     dev_snapshot_t *snaps;
      int istat;
+     size_t i;
+     pthread_attr_t t_stack;
+
+     memset(queue, 0, sizeof(weather_queue_t));
+     queue->dfile.fd   = -1;
+     queue->dfile.sync = winfo->fsync;
+     queue->bfile.fd   = -1;
+     queue->bfile.sync = winfo->fsync;
+     queue->bfirst     = 1;
+     queue->sfill      = &queue->save[0];
+     queue->snext      = &queue->save[1];
+     queue->swrite     = &queue->save[2];
+
+     queue->ndevices = 0;
+     while (!dev_flag_test(&devices[queue->ndevices], DEV_FLAGS_END))
+	  queue->ndevices++;
+
+     snaps = (dev_snapshot_t *)calloc(WEATHER_QLEN * queue->ndevices + 1,
+				      sizeof(dev_snapshot_t));
+     if (!snaps)
+     {
+	  debug("weather_queue_init(%d): Insufficient virtual memory",
+		__LINE__);
+	  return(ERR_NOMEM);
+     }
+     for (i = 0; i < WEATHER_QLEN; i++)
+	  queue->cycle[i].snap = snaps + i * queue->ndevices;
 
-     if (do_trace)
-	  trace("weather_xml_write(%d): Called with devices=%p, period=%d, "
-		"winfo=%p", __LINE__, devices, period, winfo);
+     queue->devices = devices;
+     queue->period  = period;
+     queue->winfo   = winfo;
+     os_pthread_mutex_init(&queue->mutex, NULL);
+     os_pthread_cond_init(&queue->cond, NULL);
 
      /*
-      *  Test our inputs
+      *  The writer needs the same stack as the sampling threads: it
+      *  calls the same output routines they once did
       */
-     if (!devices || !winfo)
+     pthread_attr_init(&t_stack);
+     pthread_attr_setstacksize(&t_stack, 1024 * 128);
+     istat = pthread_create(&queue->thread, &t_stack, weather_writer,
+			    (void *)queue);
+     pthread_attr_destroy(&t_stack);
+     if (istat)
+	  debug("weather_queue_init(%d): Unable to start the writer thread; "
+		"each cycle will be recorded before the next is sampled; "
+		"pthread_create() returned %d; %s",
+		__LINE__, istat, strerror(istat));
+     else
+	  queue->running = 1;
+
+     return(ERR_OK);
+}
+
+
+/*
+ *  Let the writer thread finish recording whatever remains queued and
+ *  then release the queue
+ */
+static void
+weather_queue_done(weather_queue_t *queue)
+{
+     size_t i;
+
+     if (!queue->cycle[0].snap)
+	  return;
+
+     if (queue->running)
      {
-	  debug("weather_xml_write(%d): Invalid call arguments supplied; "
-		"devices=%p, winfo=%p", __LINE__, devices, winfo);
-	  return(ERR_BADARGS);
+	  os_pthread_mutex_lock(&queue->mutex);
+	  queue->done = 1;
+	  os_pthread_cond_signal(&queue->cond);
+	  os_pthread_mutex_unlock(&queue->mutex);
+	  pthread_join(queue->thread, NULL);
+	  queue->running = 0;
      }
+     if (queue->dropped)
+	  detail("weather_queue_done(%d): %u sampling cycle%s not recorded "
+		 "owing to a backlog of output", __LINE__, queue->dropped,
+		 (queue->dropped != 1) ? "s were" : " was");
 
-     /*
-      *  Open a temporary file
-      */
-     istat = xml_open(&ctx, &winfo->wsinfo, winfo->fname_prefix);
-     if (istat != ERR_OK)
+     weather_data_close(&queue->dfile);
+     if (queue->dfile.buf)
      {
-	  detail("weather_xml_write(%d): Unable to open a temporary output "
-		 "file; xml_open() returned %d; %s",
-		 __LINE__, istat, err_strerror(istat));
-	  return(istat);
+	  free(queue->dfile.buf);
+	  queue->dfile.buf = NULL;
+     }
+     weather_data_close(&queue->bfile);
+     if (queue->bfile.buf)
+     {
+	  free(queue->bfile.buf);
+	  queue->bfile.buf = NULL;
+     }
+     for (i = 0; i < 3; i++)
+     {
+	  if (queue->save[i].state.buf)
+	       free(queue->save[i].state.buf);
+	  if (queue->save[i].tiers.buf)
+	       free(queue->save[i].tiers.buf);
+	  memset(&queue->save[i], 0, sizeof(weather_save_t));
      }
 
-     /*
-      *  Write the data to the XML file
-      */
-     dev = devices;
-     while (!dev_flag_test(dev, DEV_FLAGS_END))
+     os_pthread_cond_destroy(&queue->cond);
+     os_pthread_mutex_destroy(&queue->mutex);
+     free(queue->cycle[0].snap);
+     queue->cycle[0].snap = NULL;
+}
+
+
+/*
+ *  Snapshot the devices into the cycle
+ */
+static void
+weather_cycle_fill(weather_queue_t *queue, weather_cycle_t *cycle,
+		   time_t tavg)
+{
+     device_t *dev;
+
+     cycle->tavg = tavg;
+     for (dev = queue->devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+     {
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED))
+	       continue;
+	  dev_snapshot(dev, &cycle->snap[dev - queue->devices]);
+     }
+}
+
+
+/*
+ *  Snapshot the devices and queue the cycle for the writer thread.
+ *  Should the queue be full, the oldest cycle not yet taken up by the
+ *  writer is dropped to make room.  Errors recording the cycle are
+ *  reported by the writer and are not returned.
+ */
+static void
+weather_queue_put(weather_queue_t *queue, time_t tavg)
+{
+     weather_cycle_t cycle;
+     unsigned int head, i;
+
+     queue->tlast = tavg;
+     head = queue->head;
+     if (!queue->running)
      {
 	  /*
-	   *  Ignore devices which should not be probed
+	   *  No writer thread; record the cycle ourselves
 	   */
-	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB) ||
-	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED) ||
-	      dev->data.time[dev->data.n_current] == DEV_MISSING_TVALUE)
-	       goto skip_me;
+	  weather_cycle_fill(queue, &queue->cycle[head % WEATHER_QLEN], tavg);
+	  (void)weather_cycle_write(queue, &queue->cycle[head % WEATHER_QLEN],
+				    1);
+	  return;
+     }
 
+     if (head - os_load_acquire(&queue->tail) >= WEATHER_QLEN)
+     {
 	  /*
-	   *  Write the record
+	   *  Shift the cycles after the oldest unclaimed one down a slot
+	   *  and reuse its snapshots for this cycle, now the newest
 	   */
-	  istat = xml_write(&ctx, dev, period, winfo->title);
-	  if (istat != ERR_OK)
-	       detail("weather_xml_write(%d): Unable to record data for the "
-		      "device with id=\"%s\" (%s); xml_write() returned %d; "
-		      "%s", __LINE__, dev_romid(dev),
-		      dev_strfcode(dev_fcode(dev)), istat,
-		      err_strerror(istat));
-     skip_me:
-	  dev++;
+	  os_pthread_mutex_lock(&queue->mutex);
+	  i = queue->claimed;
+	  cycle = queue->cycle[i % WEATHER_QLEN];
+	  for (; i + 1 != head; i++)
+	       queue->cycle[i % WEATHER_QLEN] =
+		    queue->cycle[(i + 1) % WEATHER_QLEN];
+	  queue->cycle[(head - 1) % WEATHER_QLEN] = cycle;
+	  weather_cycle_fill(queue, &queue->cycle[(head - 1) % WEATHER_QLEN],
+			     tavg);
+	  os_pthread_mutex_unlock(&queue->mutex);
+
+	  if (!(queue->dropped++ % 10))
+	       detail("weather_queue_put(%d): Output has fallen %d cycles "
+		      "behind; dropping the oldest unrecorded cycle",
+		      __LINE__, WEATHER_QLEN);
+	  return;
      }
 
-     /*
-      *  Finally produce a web page of the current data
-      */
-     istat = xml_tohtml(&ctx, winfo->cmd, NULL, 0);
+     weather_cycle_fill(queue, &queue->cycle[head % WEATHER_QLEN], tavg);
+     os_store_release(&queue->head, head + 1);
+     os_pthread_mutex_lock(&queue->mutex);
+     os_pthread_cond_signal(&queue->cond);
+     os_pthread_mutex_unlock(&queue->mutex);
+}
+
+
+/*
+ *  Copy the device state when with_state is set, and the rollup tiers when
+ *  with_tiers is set, into an image and hand it to the writer thread to
+ *  save.  Only the copying is done on the sampling thread.  saved is the
+ *  time stamp of the last cycle which they include: at startup, the
+ *  records of the data files later than it are replayed.
+ */
+static void
+weather_queue_save(weather_queue_t *queue, time_t saved, int with_state,
+		   int with_tiers)
+{
+     weather_save_t *save;
+     int istat;
+
+     save = queue->sfill;
+     save->state.buf_len = 0;
+     save->tiers.buf_len = 0;
+     istat = ERR_OK;
+     if (with_tiers)
+	  istat = weather_tiers_image(queue->devices, &save->tiers, saved);
+     if (istat == ERR_OK && with_state)
+	  istat = weather_state_image(queue->devices, &save->state, saved);
      if (istat != ERR_OK)
-	  detail("weather_xml_write(%d): Error generating HTML output; "
-		 "xml_tohtml() returned %d; %s",
-		 __LINE__, istat, err_strerror(istat));
+     {
+	  detail("weather_queue_save(%d): Unable to copy the device state "
+		 "for saving; %d; %s", __LINE__, istat, err_strerror(istat));
+	  return;
+     }
 
-     /*
-      *  All done
-      */
-done:
-     return(istat);
+     if (!queue->running)
+     {
+	  /*
+	   *  No writer thread; save it ourselves
+	   */
+	  weather_save_write(save, queue->winfo);
+	  return;
+     }
+
+     os_pthread_mutex_lock(&queue->mutex);
+     queue->sfill    = queue->snext;
+     queue->snext    = save;
+     queue->spending = 1;
+     os_pthread_cond_signal(&queue->cond);
+     os_pthread_mutex_unlock(&queue->mutex);
 }
 
+
 static int
 weather_list_record(device_t *devices, ha7net_t *ha7net, int period,
-		    weather_info_t *winfo)
+		    weather_info_t *winfo, weather_queue_t *queue)
 {
      device_t *dev;
-     int flags, istat;
+     int flags, istat, rstat;
+     size_t nread;
      time_t t0, t1, tavg;
 
      if (do_trace)
 	  trace("weather_list_record(%d): Called with devices=%p, ha7net=%p, "
-		"period=%d, winfo=%p",
-		__LINE__, devices, ha7net, period, winfo);
+		"period=%d, winfo=%p, queue=%p",
+		__LINE__, devices, ha7net, period, winfo, queue);
 
      /*
       *  Sanity check
       */
-     if (!devices || !ha7net || !winfo)
+     if (!devices || !ha7net || !winfo || !queue)
      {
 	  debug("weather_list_record(%d): Bad call arguments supplied; "
-		"devices=%p, ha7net=%p, winfo=%p",
-		__LINE__, devices, ha7net, winfo);
+		"devices=%p, ha7net=%p, winfo=%p, queue=%p",
+		__LINE__, devices, ha7net, winfo, queue);
 	  return(ERR_BADARGS);
      }
 
      /*
-      *  Loop over the list of devices, gathering current readings
+      *  Have all of the DS18S20 thermometers convert at once.  Should
+      *  this fail, each DS18S20 will do its own conversion when read.
       */
      t0 = time(NULL);
+     if (winfo->bus_convert)
+	  (void)ds18s20_convert_all(ha7net, devices);
+
+     /*
+      *  Plan the cycle in two passes.  In the first pass, conversions
+      *  are started on every device whose driver supports split-phase
+      *  reads.  In the second pass, those conversions are collected
+      *  and all remaining devices are read in the usual fashion.  This
+      *  way the conversion times of the split-phase devices overlap
+      *  one another as well as the reads of the other devices.  A device
+      *  may start another it depends upon, as an EDS Analog Probe does
+      *  its DS18S20, and so the started flags are all cleared first.
+      */
+     for (dev = devices; !dev_flag_test(dev, DEV_FLAGS_END); dev++)
+	  dev_flag_clear(dev, DEV_FLAGS_STARTED);
+
+     /*
+      *  The cycle fails only when no device at all could be read
+      */
+     nread = 0;
+     rstat = ERR_OK;
+
+     dev = devices;
+     while (!dev_flag_test(dev, DEV_FLAGS_END))
+     {
+	  if (shutdown_flag)
+	  {
+	       memset(&ha7net->convert_t, 0, sizeof(struct timeval));
+	       ha7net_releaselock(ha7net);
+	       return(ERR_OK);
+	  }
+
+	  if (dev_flag_test(dev, DEV_FLAGS_IGNORE | DEV_FLAGS_ISSUB |
+			    DEV_FLAGS_STARTED) ||
+	      !dev_flag_test(dev, DEV_FLAGS_INITIALIZED) ||
+	      !dev_can_start(dev))
+	       goto skip_start;
+
+	  istat = dev_start(ha7net, dev, 0);
+	  if (istat != ERR_OK)
+	  {
+	       debug("weather_list_record(%d): Unable to start a conversion "
+		     "for the device with id=\"%s\" (%s); istat=%d; %s",
+		     __LINE__, dev_romid(dev), dev_strfcode(dev_fcode(dev)),
+		     istat, err_strerror(istat));
+	       if (rstat == ERR_OK)
+		    rstat = istat;
+	  }
+
+     skip_start:
+	  dev++;
+     }
+
+     /*
+      *  Loop over the list of devices, gathering current readings
+      */
      dev = devices;
      while (!dev_flag_test(dev, DEV_FLAGS_END))
      {
@@ -1284,6 +3115,7 @@ weather_list_record(device_t *devices, ha7net_t *ha7net, int period,
 	   */
 	  if (shutdown_flag)
 	  {
+	       memset(&ha7net->convert_t, 0, sizeof(struct timeval));
 	       ha7net_releaselock(ha7net);
 	       return(ERR_OK);
 	  }
@@ -1296,23 +3128,38 @@ weather_list_record(device_t *devices, ha7net_t *ha7net, int period,
 	       goto skip_me;
 
 	  /*
-	   *  Get the current measurements from this device
+	   *  Get the current measurements from this device.  A split-phase
+	   *  device whose conversion could not be started has already been
+	   *  recorded as a missing value.
 	   */
-	  istat = dev_read(ha7net, dev, 0);
+	  if (dev_flag_test(dev, DEV_FLAGS_STARTED))
+	       istat = dev_collect(ha7net, dev, 0);
+	  else if (!dev_can_start(dev))
+	       istat = dev_read(ha7net, dev, 0);
+	  else
+	       goto skip_me;
 	  if (istat != ERR_OK)
 	  {
 	       debug("weather_list_record(%d): Unable to read the device with "
 		     "id=\"%s\" (%s); istat=%d; %s",
 		      __LINE__, dev_romid(dev), dev_strfcode(dev_fcode(dev)),
 		     istat, err_strerror(istat));
+	       if (rstat == ERR_OK)
+		    rstat = istat;
 	       goto skip_me;
 	  }
+	  nread++;
 
      skip_me:
 	  dev++;
      }
      t1 = time(NULL);
 
+     /*
+      *  Any bus-wide conversion is only good for this cycle
+      */
+     memset(&ha7net->convert_t, 0, sizeof(struct timeval));
+
      /*
       *  Release any 1-Wire bus master lock
       */
@@ -1339,37 +3186,13 @@ weather_list_record(device_t *devices, ha7net_t *ha7net, int period,
      }
      
      /*
-      *  Now, write a single data record to the cumulative record
+      *  Now, hand the cycle off to be written to the cumulative record
+      *  and the XML file
       */
      tavg = t0 + (int)(difftime(t1, t0) / 2.0);
-     istat = weather_data_write(devices, tavg, &winfo->first,
-				winfo->fname_prefix);
-     if (istat != ERR_OK)
-	  detail("weather_list_record(%d): Error writing data to the "
-		 "cumulative data file; weather_data_write() returned %d; %s",
-		 __LINE__, istat, err_strerror(istat));
-
-     /*
-      *  Write the XML data
-      */
-     if (winfo->cmd && winfo->cmd[0])
-     {
-	  int istat2;
-
-	  istat2 = weather_xml_write(devices, period, winfo);
-	  if (istat != ERR_OK)
-	       detail("weather_list_record(%d): Error writing current data to "
-		      "an XML file and transforming to HTML; "
-		      "weather_xml_write() returned %d; %s",
-		      __LINE__, istat, err_strerror(istat));
-	  if (istat == ERR_OK)
-	       istat = istat2;
-     }
+     weather_queue_put(queue, tavg);
 
-     /*
-      *  All done
-      */
-     return(istat);
+     return(nread ? ERR_OK : rstat);
 }
 
 
@@ -1381,7 +3204,10 @@ weather_main(weather_info_t *winfo)
      size_t fails, ndevices, nlogical;
      const char *free_prefix;
      ha7net_t ha7net;
-     time_t t0;
+     dev_index_t index;
+     weather_queue_t queue;
+     struct tm tm_state, tm_tiers;
+     time_t saved, t0, tstate, ttiers;
 
      if (!winfo)
      {
@@ -1413,7 +3239,9 @@ weather_main(weather_info_t *winfo)
       */
      devices            = NULL;
      free_prefix        = NULL;
+     memset(&index, 0, sizeof(dev_index_t));
      ha7net_initialized = 0;
+     queue.cycle[0].snap = NULL;
  
      /*
       *  Initialize the ha7net library
@@ -1451,6 +3279,19 @@ try_connect:
      }
      ha7net_initialized = 1;
 
+     /*
+      *  Index the devices by ROM id for matching them up with the
+      *  configuration and the saved data files
+      */
+     istat = dev_index_build(&index, devices, ndevices);
+     if (istat != ERR_OK)
+     {
+	  debug("weather_main(%d): Unable to index the devices; "
+		"dev_index_build() returned %d; %s",
+		__LINE__, istat, err_strerror(istat));
+	  goto done;
+     }
+
      /*
       *  Initialize the devices
       */
@@ -1458,8 +3299,8 @@ try_connect:
      /*
       *  First, note which devices to ignore
       */
-     dev_info_hints(devices, ndevices, winfo->linfo);
-     dev_info_merge(devices, ndevices, 0, NULL, NULL, winfo->ilist);
+     dev_info_hints(devices, ndevices, winfo->linfo, &index);
+     dev_info_merge(devices, ndevices, 0, NULL, NULL, winfo->ilist, &index);
      istat = dev_list_init(&ha7net, devices);
      if (istat != ERR_OK)
      {
@@ -1494,7 +3335,7 @@ try_connect:
       *  from the configuration file
       */
      dev_info_merge(devices, ndevices, 0, winfo->avg_periods, winfo->linfo,
-		    NULL);
+		    NULL, &index);
 
      /*
       *  See if there are any barometers which can be adjusted to sea level.
@@ -1565,31 +3406,105 @@ try_connect:
      }
 
      /*
-      *  Load data from yesterday so that we can determine yesterday's extrema
+      *  Minimum period is 1 minute
+      */
+     period = winfo->period;
+     if (period < 60)
+	  period = 60;
+
+     /*
+      *  Size each device's measurement history from the sampling period
+      *  and the configured retention.  Must do this after the averaging
+      *  periods and pressure corrections are known, and before loading
+      *  any prior data.
       */
-     istat = weather_data_read(devices, 1, winfo->fname_prefix);
+     istat = dev_history_size(devices, period, winfo->history,
+			      winfo->rollup);
      if (istat != ERR_OK)
      {
-	  if (istat != ERR_EOM)
-	       debug("weather_main(%d): Unable to read yesterday's weather "
-		     "data; weather_data_read() returned %d; %s",
-		     __LINE__, istat, err_strerror(istat));
+	  debug("weather_main(%d): Unable to allocate the measurement "
+		"history; dev_history_size() returned %d; %s",
+		__LINE__, istat, err_strerror(istat));
+	  goto done;
      }
-     else
-	  /*
-	   *  Move the extrema to the slots for yesterday
-	   */
-	  dev_hi_lo_reset(devices);
 
      /*
-      *  Load today's data from a prior run
+      *  Load the rollup tiers saved by a prior run
       */
-     istat = weather_data_read(devices, 0, winfo->fname_prefix);
+     istat = weather_tiers_read(devices, &index, winfo->fname_prefix);
      if (istat != ERR_OK && istat != ERR_EOM)
-	  debug("weather_main(%d): Unable to read today's weather data; "
-		"weather_data_read() returned %d; %s",
+	  debug("weather_main(%d): Unable to load the rollup tiers; "
+		"weather_tiers_read() returned %d; %s",
 		__LINE__, istat, err_strerror(istat));
 
+     /*
+      *  Restore the device state saved by a prior run and bring it up to
+      *  date from today's data file.  Failing that, rebuild it from
+      *  yesterday's and today's data files.
+      */
+     istat = (winfo->snapshot > 0) ?
+	  weather_state_read(devices, &index, winfo->fname_prefix, &tstate) :
+	  ERR_EOM;
+     if (istat == ERR_OK)
+     {
+	  /*
+	   *  Rollup tiers saved before today also want the rest of
+	   *  yesterday's records
+	   */
+	  ttiers = weather_tiers_after(devices, tstate);
+	  localtime_r(&tstate, &tm_state);
+	  localtime_r(&ttiers, &tm_tiers);
+	  if (tm_tiers.tm_year != tm_state.tm_year ||
+	      tm_tiers.tm_yday != tm_state.tm_yday)
+	  {
+	       istat = weather_day_read(devices, &index, 1, winfo, tstate);
+	       if (istat != ERR_OK && istat != ERR_EOM)
+		    debug("weather_main(%d): Unable to read yesterday's "
+			  "weather data into the rollup tiers; "
+			  "weather_day_read() returned %d; %s",
+			  __LINE__, istat, err_strerror(istat));
+	  }
+	  istat = weather_day_read(devices, &index, 0, winfo, tstate);
+	  if (istat != ERR_OK && istat != ERR_EOM)
+	       debug("weather_main(%d): Unable to read today's weather data "
+		     "since the saved device state; weather_day_read() "
+		     "returned %d; %s", __LINE__, istat, err_strerror(istat));
+     }
+     else
+     {
+	  if (istat != ERR_EOM && istat != ERR_NO)
+	       debug("weather_main(%d): Unable to load the saved device "
+		     "state; weather_state_read() returned %d; %s",
+		     __LINE__, istat, err_strerror(istat));
+
+	  /*
+	   *  Load data from yesterday so that we can determine yesterday's
+	   *  extrema
+	   */
+	  istat = weather_day_read(devices, &index, 1, winfo, (time_t)0);
+	  if (istat != ERR_OK)
+	  {
+	       if (istat != ERR_EOM)
+		    debug("weather_main(%d): Unable to read yesterday's "
+			  "weather data; weather_day_read() returned %d; %s",
+			  __LINE__, istat, err_strerror(istat));
+	  }
+	  else
+	       /*
+		*  Move the extrema to the slots for yesterday
+		*/
+	       dev_hi_lo_reset(devices);
+
+	  /*
+	   *  Load today's data from a prior run
+	   */
+	  istat = weather_day_read(devices, &index, 0, winfo, (time_t)0);
+	  if (istat != ERR_OK && istat != ERR_EOM)
+	       debug("weather_main(%d): Unable to read today's weather data; "
+		     "weather_day_read() returned %d; %s",
+		     __LINE__, istat, err_strerror(istat));
+     }
+
      /*
       *  Let the nightly thread know about this block of devices
       */
@@ -1601,26 +3516,45 @@ try_connect:
 		__LINE__, istat, err_strerror(istat));
 
      /*
-      *  Minimum period is 1 minute
+      *  And have it archive the old day files
       */
-     period = winfo->period;
-     if (period < 60)
-	  period = 60;
+     if (winfo->archive > 0)
+     {
+	  istat = daily_add_archive(winfo->fname_prefix,
+				    (unsigned int)winfo->archive);
+	  if (istat != ERR_OK)
+	       debug("weather_main(%d): Unable to arrange for the nightly "
+		     "thread to archive old data files; daily_add_archive() "
+		     "returned %d; %s", __LINE__, istat, err_strerror(istat));
+     }
 
      /*
-      *  Now enter our endless loop of sampling & recording
+      *  Start the thread which records each cycle's data
       */
-
      winfo->first = 1;
-     fails = 0;
+     istat = weather_queue_init(&queue, devices, period, winfo);
+     if (istat != ERR_OK)
+     {
+	  debug("weather_main(%d): Unable to set up the output queue; "
+		"weather_queue_init() returned %d; %s",
+		__LINE__, istat, err_strerror(istat));
+	  goto done;
+     }
+
+     /*
+      *  Now enter our endless loop of sampling & recording
+      */
+     fails  = 0;
+     saved  = time(NULL);
+     ttiers = saved;
 
 loop:
      t0 = time(NULL);
-     istat = weather_list_record(devices, &ha7net, period, winfo);
+     istat = weather_list_record(devices, &ha7net, period, winfo, &queue);
      if (istat != ERR_OK)
      {
 	  if (!(fails % 5))
-	       debug("weather_main(%d): Error capturing and recording data; "
+	       debug("weather_main(%d): Error capturing data; "
 		     "%d consecutive failure%s so far; weather_list_record() "
 		     "returned %d; %s",
 		     __LINE__, (fails + 1), (fails != 0) ? "s" : "", istat,
@@ -1637,9 +3571,38 @@ loop:
 	  fails = 0;
 
      /*
-      *  Close the connection for now
+      *  Close the connection for now.  In keep-alive mode, the bus is
+      *  still powered down and our lock released, but the TCP connection
+      *  is left open for the next cycle.  Should the bus master close
+      *  it in the meantime, ha7net_getstuff() will transparently re-open
+      *  it.
       */
-     ha7net_close(&ha7net, HA7NET_FLAGS_POWERDOWN);
+     ha7net_close(&ha7net, HA7NET_FLAGS_POWERDOWN |
+		  (winfo->keepalive ? HA7NET_FLAGS_KEEPALIVE : 0));
+
+     /*
+      *  Periodically save the device state, and the rollup tiers each time
+      *  an hour's bins close, so that a restart after a crash need not
+      *  rebuild them.  The tiers are much the larger and, unlike the
+      *  state, are brought up to date from the data files however old
+      *  they are.
+      */
+     if (queue.tlast)
+     {
+	  int with_state, with_tiers;
+
+	  with_state = winfo->snapshot > 0 &&
+	       (difftime(time(NULL), saved) >= (double)winfo->snapshot ||
+		time(NULL) < saved);
+	  with_tiers = queue.tlast / dev_tier_widths[NTIERS - 1] !=
+	       ttiers / dev_tier_widths[NTIERS - 1];
+	  if (with_state)
+	       saved = time(NULL);
+	  if (with_tiers)
+	       ttiers = queue.tlast;
+	  if (with_state || with_tiers)
+	       weather_queue_save(&queue, queue.tlast, with_state, with_tiers);
+     }
 
      /*
       *  See how long to sleep
@@ -1665,6 +3628,15 @@ loop:
      goto loop;
 
 done:
+     /*
+      *  Save the rollup tiers and device state for the next run, and
+      *  then record whatever remains queued.  Should no cycle have been
+      *  queued, the files saved by the prior run still hold good.
+      */
+     if (queue.cycle[0].snap && queue.tlast)
+	  weather_queue_save(&queue, queue.tlast, winfo->snapshot > 0, 1);
+     weather_queue_done(&queue);
+
      if (free_prefix && winfo->fname_prefix)
      {
 	  free((char *)winfo->fname_prefix);
@@ -1675,6 +3647,7 @@ done:
 	  dev_list_done(&ha7net, devices);
 	  ha7net_search_free(devices);
      }
+     dev_index_free(&index);
 
      if (ha7net_initialized)
 	  ha7net_done(&ha7net, HA7NET_FLAGS_POWERDOWN);
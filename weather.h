@@ -61,13 +61,29 @@ typedef struct {
      char   latitude[WS_LEN];
 } weather_station_t;
 
+/*
+ *  weather_info_t fsync values: fsync the data file after every record
+ *  or only when it is closed at the end of the day.  A positive value
+ *  instead fsyncs at most once every that many seconds.
+ */
+#define WEATHER_FSYNC_RECORD   0
+#define WEATHER_FSYNC_ROTATE (-1)
+
 typedef struct {
      const char            *host;
      unsigned short         port;
      unsigned int           timeout;
      size_t                 max_fails;
      int                    have_pcor;
+     int                    bus_convert;
+     int                    keepalive;
      int                    period;
+     int                    history;
+     int                    fsync;
+     int                    binary;
+     int                    archive;
+     int                    snapshot;
+     int                    rollup[NTIERS];
      int                    first;
      device_period_array_t  avg_periods;
      const char            *cmd;
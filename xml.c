@@ -65,6 +65,15 @@ static const char preamble[] =
 
 static const char postamble[] = "</wstation>\n";
 
+/*
+ *  How far back to report each rollup tier: the last 6 hours of 15 minute
+ *  bins and the last 48 hours of 1 hour bins.  XML_ROLLUP_MAX bounds the
+ *  number of bins of any one tier.
+ */
+#define XML_ROLLUP_MAX 48
+
+static const time_t xml_rollup_spans[NTIERS] = {6*60*60, 48*60*60};
+
 static void xml_rm(xml_out_t *ctx);
 static int xml_mv(xml_out_t *ctx, const char *fname);
 
@@ -465,24 +474,45 @@ done:
 }
 
 
+/*
+ *  Write a value with its device's compiled format.  Returns the number
+ *  of bytes written or a negative value on an error, just as fprintf().
+ */
+static int
+xml_value(FILE *fp, const fmt_float_t *ff, float val)
+{
+     char buf[FMT_FLOAT_LEN];
+     int len;
+
+     len = fmt_float(buf, sizeof(buf), ff, val);
+     if (len < 0 || (size_t)len >= sizeof(buf))
+	  return(fprintf(fp, ff->fmt, val));
+
+     return((fwrite(buf, 1, (size_t)len, fp) == (size_t)len) ? len : -1);
+}
+
+
 int
-xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
+xml_write(xml_out_t *ctx, device_t *dev, const dev_snapshot_t *snap,
+	  int period, const char *title)
 {
      const char *desc, *desc_drv, *qdesc, *qdesc_drv, *qtitle;
      int dispose, dispose_drv, fld_rh, fld_temp, i, istat, j;
+     time_t now;
+     timestr tmin_str, tmax_str;
 
      if (do_trace)
 	  trace("xml_write(%d): Called with ctx=%p, dev=%p "
-		"(dev->romid=\"%s\"), period=%d, title=\"%s\" (%p)",
-		__LINE__, ctx, dev, dev ? dev_romid(dev) : "(null)",
+		"(dev->romid=\"%s\"), snap=%p, period=%d, title=\"%s\" (%p)",
+		__LINE__, ctx, dev, dev ? dev_romid(dev) : "(null)", snap,
 		period, title ? title : "(null)", title);
      /*
       *  Sanity checks
       */
-     if (!ctx || !dev)
+     if (!ctx || !dev || !snap)
      {
 	  debug("xml_write(%d): Invalid call arguments supplied; "
-		"ctx=%p, dev=%p", __LINE__, ctx, dev);
+		"ctx=%p, dev=%p, snap=%p", __LINE__, ctx, dev, snap);
 	  return(ERR_BADARGS);
      }
      else if (!ctx->fp)
@@ -625,16 +655,16 @@ xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
      /*
       *  Output <averages p="p1 p2 p3" p-units="s"/>
       */
-     if (dev->data.avgs.period[0] > 0)
+     if (snap->period[0] > 0)
      {
 	  int do_space = 0;
 	  int do_first = 1;
 
 	  for (j = NPERS - 1; j >= 0; j--)
 	  {
-	       if (dev->data.avgs.period[j] <= 0)
+	       if (snap->period[j] <= 0)
 		    continue;
-	       if (!dev->data.avgs.range_exists[j])
+	       if (!snap->range_exists[j])
 		    continue;
 	       if (do_first)
 	       {
@@ -649,7 +679,7 @@ xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
 			 goto write_error;
 		    do_space = 0;
 	       }
-	       if (0 > fprintf(ctx->fp, "%u", dev->data.avgs.period[j]))
+	       if (0 > fprintf(ctx->fp, "%u", snap->period[j]))
 		    goto write_error;
 	       do_space = 1;
 	  }
@@ -663,26 +693,27 @@ xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
       */
      fld_rh   = NVALS;
      fld_temp = NVALS;
+     now      = time(NULL);
 
      for (i = 0; i < NVALS; i++)
      {
-	  const char *fmt, *units;
+	  const fmt_float_t *ff;
+	  const char *units;
 
 	  if (!dev->data.fld_used[i])
 	       continue;
 
-	  fmt = dev->data.fld_format[i] ? dev->data.fld_format[i] : "%f";
+	  ff = &dev->data.fld_fmt[i];
 	  units = dev_unitstr(dev->data.fld_units[i]);
 
 	  /*
 	   *  Current value
 	   */
-	  if (dev->data.time[dev->data.n_current] != DEV_MISSING_TVALUE)
+	  if (snap->time[i] != DEV_MISSING_TVALUE)
 	  {
 	       if (0 > fprintf(ctx->fp, "    <value type=\"%s\" v=\"",
 			       dev_dtypestr(dev->data.fld_dtype[i])) ||
-		   0 > fprintf(ctx->fp, fmt,
-			       dev->data.val[i][dev->data.n_current]))
+		   0 > xml_value(ctx->fp, ff, snap->val[i]))
 		    goto write_error;
 	  }
 	  else
@@ -707,16 +738,16 @@ xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
 	  /*
 	   *  Running averages <averages v="a1 a2 a3" units="xx"/>
 	   */
-	  if (dev->data.avgs.period[0] > 0)
+	  if (snap->period[0] > 0)
 	  {
 	       int do_space = 0;
 	       int do_first = 1;
 
 	       for (j = NPERS - 1; j >= 0; j--)
 	       {
-		    if (dev->data.avgs.period[j] <= 0)
+		    if (snap->period[j] <= 0)
 			 continue;
-		    if (!dev->data.avgs.range_exists[j])
+		    if (!snap->range_exists[j])
 			 continue;
 		    if (do_first)
 		    {
@@ -731,7 +762,7 @@ xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
 			      goto write_error;
 			 do_space = 0;
 		    }
-		    if (0 > fprintf(ctx->fp, fmt, dev->data.avgs.avg[i][j]))
+		    if (0 > xml_value(ctx->fp, ff, snap->avg[i][j]))
 			 goto write_error;
 		    do_space = 1;
 	       }
@@ -743,24 +774,19 @@ xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
 	  /*
 	   *  Today's high and low
 	   */
-	  if (dev->data.today.min[i] <= dev->data.today.max[i])
+	  if (snap->today.min[i] <= snap->today.max[i])
 	  {
 	       /*
 		*  Today's extrema
 		*/
-	       if (!dev->data.today.tmin_str[i][0])
-		    make_timestr(dev->data.today.tmin_str[i],
-				 dev->data.today.tmin[i], 0);
-	       if (!dev->data.today.tmax_str[i][0])
-		    make_timestr(dev->data.today.tmax_str[i],
-				 dev->data.today.tmax[i], 0);
+	       make_timestr(tmin_str, snap->today.tmin[i], 0);
+	       make_timestr(tmax_str, snap->today.tmax[i], 0);
 	       if (0 > fprintf(ctx->fp, "      <extrema v=\"") ||
-		   0 > fprintf(ctx->fp, fmt, dev->data.today.min[i]) ||
+		   0 > xml_value(ctx->fp, ff, snap->today.min[i]) ||
 		   EOF == fputc(' ', ctx->fp) ||
-		   0 > fprintf(ctx->fp, fmt, dev->data.today.max[i]) ||
+		   0 > xml_value(ctx->fp, ff, snap->today.max[i]) ||
 		   0 > fprintf(ctx->fp, "\" time=\"%s %s\"",
-			       dev->data.today.tmin_str[i],
-			       dev->data.today.tmax_str[i]))
+			       tmin_str, tmax_str))
 		    goto write_error;
 	       if (units)
 	       {
@@ -772,28 +798,99 @@ xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
 			 goto write_error;
 	  }
 
+	  /*
+	   *  Rolling highs and lows, shortest period first:
+	   *  <rolling p="3600" p-units="s" v="lo hi" time="t1 t2" units="xx"/>
+	   */
+	  for (j = NROLL - 1; j >= 0; j--)
+	  {
+	       const hi_lo_t *r = &snap->rolling[j];
+
+	       if (r->min[i] > r->max[i])
+		    continue;
+	       make_timestr(tmin_str, r->tmin[i], 0);
+	       make_timestr(tmax_str, r->tmax[i], 0);
+	       if (0 > fprintf(ctx->fp, "      <rolling p=\"%d\" "
+			       "p-units=\"%s\" v=\"", dev_roll_periods[j],
+			       dev_unitstr(DEV_UNIT_S)) ||
+		   0 > xml_value(ctx->fp, ff, r->min[i]) ||
+		   EOF == fputc(' ', ctx->fp) ||
+		   0 > xml_value(ctx->fp, ff, r->max[i]) ||
+		   0 > fprintf(ctx->fp, "\" time=\"%s %s\"",
+			       tmin_str, tmax_str))
+		    goto write_error;
+	       if (units)
+	       {
+		    if (0 > fprintf(ctx->fp, " units=\"%s\"/>\n", units))
+			 goto write_error;
+	       }
+	       else
+		    if (0 > fprintf(ctx->fp, "/>\n"))
+			 goto write_error;
+	  }
+
+	  /*
+	   *  Rollup tiers, narrowest bins first:
+	   *  <rollup w="900" w-units="s" units="xx">
+	   *    <bin t="start" n="count" v="mean lo hi"/> ...
+	   *  </rollup>
+	   */
+	  for (j = 0; j < NTIERS; j++)
+	  {
+	       dev_rollup_t bins[XML_ROLLUP_MAX];
+	       size_t k, nbins;
+
+	       nbins = dev_rollup_get(dev, i, j, now - xml_rollup_spans[j],
+				      now + 1, bins, XML_ROLLUP_MAX);
+	       if (!nbins)
+		    continue;
+	       if (0 > fprintf(ctx->fp, "      <rollup w=\"%d\" "
+			       "w-units=\"%s\"", dev_tier_widths[j],
+			       dev_unitstr(DEV_UNIT_S)))
+		    goto write_error;
+	       if (units)
+	       {
+		    if (0 > fprintf(ctx->fp, " units=\"%s\">\n", units))
+			 goto write_error;
+	       }
+	       else
+		    if (0 > fprintf(ctx->fp, ">\n"))
+			 goto write_error;
+	       for (k = 0; k < nbins; k++)
+	       {
+		    if (0 > fprintf(ctx->fp, "        <bin t=\"%ld\" n=\"%u\" "
+				    "v=\"", (long)DEV_ROLLUP_START(j, &bins[k]),
+				    bins[k].count) ||
+			0 > xml_value(ctx->fp, ff,
+				      bins[k].sum / (float)bins[k].count) ||
+			EOF == fputc(' ', ctx->fp) ||
+			0 > xml_value(ctx->fp, ff, bins[k].min) ||
+			EOF == fputc(' ', ctx->fp) ||
+			0 > xml_value(ctx->fp, ff, bins[k].max) ||
+			0 > fprintf(ctx->fp, "\"/>\n"))
+			 goto write_error;
+	       }
+	       if (0 > fprintf(ctx->fp, "      </rollup>\n"))
+		    goto write_error;
+	  }
+
 	  /*
 	   *  Yesterday's high and low
 	   */
-	  if (dev->data.yesterday.min[i] <= dev->data.yesterday.max[i])
+	  if (snap->yesterday.min[i] <= snap->yesterday.max[i])
 	  {
 	       /*
 		*  Yesterday's extrema
 		*/
-	       if (!dev->data.yesterday.tmin_str[i][0])
-		    make_timestr(dev->data.yesterday.tmin_str[i],
-				 dev->data.yesterday.tmin[i], 0);
-	       if (!dev->data.yesterday.tmax_str[i][0])
-		    make_timestr(dev->data.yesterday.tmax_str[i],
-				 dev->data.yesterday.tmax[i], 0);
+	       make_timestr(tmin_str, snap->yesterday.tmin[i], 0);
+	       make_timestr(tmax_str, snap->yesterday.tmax[i], 0);
 	       if (0 > fprintf(ctx->fp, "      <yesterday>\n"
 			       "        <extrema v=\"") ||
-		   0 > fprintf(ctx->fp, fmt, dev->data.yesterday.min[i]) ||
+		   0 > xml_value(ctx->fp, ff, snap->yesterday.min[i]) ||
 		   EOF == fputc(' ', ctx->fp) ||
-		   0 > fprintf(ctx->fp, fmt, dev->data.yesterday.max[i]) ||
+		   0 > xml_value(ctx->fp, ff, snap->yesterday.max[i]) ||
 		   0 > fprintf(ctx->fp, "\" time=\"%s %s\"",
-			       dev->data.yesterday.tmin_str[i],
-			       dev->data.yesterday.tmax_str[i]))
+			       tmin_str, tmax_str))
 		    goto write_error;
 	       if (units)
 	       {
@@ -808,8 +905,10 @@ xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
 	  if (0 > fprintf(ctx->fp, "    </value>\n"))
 	       goto write_error;
 
-	  if (dev->data.fld_dtype[i] == DEV_DTYPE_RH &&
-	      convert_known(DEV_UNIT_RH, dev->data.fld_units[i]))
+	  if (snap->time[i] == DEV_MISSING_TVALUE)
+	       continue;
+	  else if (dev->data.fld_dtype[i] == DEV_DTYPE_RH &&
+		   convert_known(DEV_UNIT_RH, dev->data.fld_units[i]))
 	       fld_rh = i;
 	  else if (dev->data.fld_dtype[i] == DEV_DTYPE_TEMP &&
 		   convert_known(DEV_UNIT_C, dev->data.fld_units[i]))
@@ -824,10 +923,10 @@ xml_write(xml_out_t *ctx, device_t *dev, int period, const char *title)
 	  if (0 > fprintf(ctx->fp, "    <value type=\"%s\" v=\"%.f\" "
 			  "units=\"%s\"/>\n",
 	  dev_dtypestr(DEV_DTYPE_DEWP),
-	  dewpoint(convert_humidity(dev->data.val[fld_rh][dev->data.n_current],
+	  dewpoint(convert_humidity(snap->val[fld_rh],
 				    dev->data.fld_units[fld_rh],
 				    DEV_UNIT_RH),
-		   convert_temp(dev->data.val[fld_temp][dev->data.n_current],
+		   convert_temp(snap->val[fld_temp],
 				dev->data.fld_units[fld_temp],
 				DEV_UNIT_C)),
 	  dev_unitstr(DEV_UNIT_C)))
@@ -54,7 +54,8 @@ void xml_lib_done(void);
 
 int xml_open(xml_out_t *ctx, const weather_station_t *wsinfo,
   const char *tmpdir);
-int xml_write(xml_out_t *ctx, device_t *dev,int period, const char *title);
+int xml_write(xml_out_t *ctx, device_t *dev, const dev_snapshot_t *snap,
+  int period, const char *title);
 int xml_close(xml_out_t *ctx, int delete, const char *target_name);
 
 int xml_tohtml(xml_out_t *ctx, const char *cmd, const char *xml_fname,